@@ -0,0 +1,123 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2006-2015 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __MPSCQUEUE_H__
+#define __MPSCQUEUE_H__
+
+#include <atomic>
+#include <stddef.h>
+
+/**
+ * Bounded lock-free queue with multiple producers and a single consumer.
+ *
+ * Each cell carries a sequence number telling whether it is free for the
+ * producer of a given position or filled for the consumer (D. Vyukov's
+ * bounded queue). Producers claim a position with a compare-and-swap on the
+ * tail, the consumer owns the head.
+ *
+ * @tparam T
+ *              The type of the items, copied in and out.
+ */
+template <typename T>
+class MpscQueue
+{
+public:
+    /**
+     * Construct an empty queue.
+     *
+     * @param[in] capacity
+     *              The number of items the queue can hold, a power of two.
+     */
+    explicit MpscQueue(size_t capacity) :
+        cells(new Cell[capacity]),
+        mask(capacity - 1),
+        tail(0),
+        head(0)
+    {
+        for (size_t i = 0; i < capacity; i++) {
+            cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    ~MpscQueue()
+    {
+        delete[] cells;
+    }
+
+    /**
+     * Add an item, from any thread.
+     *
+     * @return false if the queue is full.
+     */
+    bool push(const T &item)
+    {
+        size_t position = tail.load(std::memory_order_relaxed);
+        Cell  *cell;
+        for (;;) {
+            cell = &cells[position & mask];
+            size_t   sequence   = cell->sequence.load(std::memory_order_acquire);
+            intptr_t difference = (intptr_t) sequence - (intptr_t) position;
+            if (difference == 0) {
+                if (tail.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (difference < 0) {
+                return false;
+            } else {
+                position = tail.load(std::memory_order_relaxed);
+            }
+        }
+
+        cell->item = item;
+        cell->sequence.store(position + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * Remove the oldest item, from the consumer thread only.
+     *
+     * @return false if the queue is empty.
+     */
+    bool pop(T &item)
+    {
+        Cell *cell = &cells[head & mask];
+        if (cell->sequence.load(std::memory_order_acquire) != head + 1) {
+            return false;
+        }
+
+        item = cell->item;
+        cell->sequence.store(head + mask + 1, std::memory_order_release);
+        head++;
+        return true;
+    }
+
+private:
+    MpscQueue(const MpscQueue &);
+    MpscQueue &operator=(const MpscQueue &);
+
+    struct Cell {
+        std::atomic<size_t> sequence;
+        T                   item;
+    };
+
+    Cell                            *cells;
+    const size_t                     mask;
+    /* Keep the producer and consumer positions on separate cache lines */
+    alignas(64) std::atomic<size_t>  tail;
+    alignas(64) size_t               head;
+};
+
+#endif  /* __MPSCQUEUE_H__ */
@@ -0,0 +1,209 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2006-2015 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __UPLINKFRAMER_H__
+#define __UPLINKFRAMER_H__
+
+#include <string.h>
+#include "../source/UplinkProtocol.h"
+
+/**
+ * Host side framing of the observer uplink: split a byte stream into frames
+ * on the delimiters and check them (UplinkFrameParser), or build frames and
+ * encode them (UplinkFrameWriter).
+ */
+
+/**
+ * Counters of an UplinkFrameParser.
+ */
+struct UplinkParserStats_t {
+    unsigned long frames;
+    unsigned long crcErrors;
+    unsigned long encodingErrors;
+    unsigned long lostFrames;
+};
+
+/**
+ * Split an uplink byte stream into frames. Handler must provide
+ *     void onFrame(uint8_t type, const uint8_t *records, size_t length, uint8_t count);
+ * which is called for each frame with a valid CRC.
+ */
+template <typename Handler>
+class UplinkFrameParser
+{
+public:
+    UplinkFrameParser(Handler &handlerIn) :
+        handler(handlerIn),
+        encodedLength(0),
+        overflow(false),
+        synchronized(false),
+        nextSequence(0)
+    {
+        memset(&stats, 0, sizeof(stats));
+    }
+
+    /**
+     * Feed bytes read from the stream.
+     */
+    void feed(const uint8_t *bytes, size_t length)
+    {
+        for (size_t i = 0; i < length; i++) {
+            if (bytes[i] != 0) {
+                if (encodedLength < sizeof(encoded)) {
+                    encoded[encodedLength++] = bytes[i];
+                } else {
+                    overflow = true;
+                }
+                continue;
+            }
+
+            /* Frames longer than the maximum are discarded up to the next
+             * delimiter */
+            if (overflow) {
+                stats.encodingErrors++;
+            } else if (encodedLength != 0) {
+                decodeFrame();
+            }
+            encodedLength = 0;
+            overflow      = false;
+        }
+    }
+
+    const UplinkParserStats_t &getStats(void) const
+    {
+        return stats;
+    }
+
+private:
+    void decodeFrame(void)
+    {
+        int frameLength = uplinkDecodeCOBS(encoded, encodedLength, frame);
+        if (frameLength < (int) (UPLINK_FRAME_HEADER_SIZE + UPLINK_FRAME_CRC_SIZE)) {
+            stats.encodingErrors++;
+            return;
+        }
+
+        uint16_t crc = frame[frameLength - 2] | (frame[frameLength - 1] << 8);
+        if (uplinkCRC16(0xFFFF, frame, frameLength - UPLINK_FRAME_CRC_SIZE) != crc) {
+            stats.crcErrors++;
+            return;
+        }
+
+        stats.frames++;
+        if (synchronized) {
+            stats.lostFrames += (uint8_t) (frame[1] - nextSequence);
+        }
+        synchronized = true;
+        nextSequence = frame[1] + 1;
+
+        handler.onFrame(frame[0], frame + UPLINK_FRAME_HEADER_SIZE,
+                        frameLength - UPLINK_FRAME_HEADER_SIZE - UPLINK_FRAME_CRC_SIZE, frame[2]);
+    }
+
+    Handler             &handler;
+    uint8_t              encoded[UPLINK_MAX_ENCODED_SIZE];
+    size_t               encodedLength;
+    bool                 overflow;
+    uint8_t              frame[UPLINK_MAX_ENCODED_SIZE];
+    bool                 synchronized;
+    uint8_t              nextSequence;
+    UplinkParserStats_t  stats;
+};
+
+/**
+ * Build uplink frames the way the observer firmware does, for simulators.
+ * Encoded frames are appended to an output buffer.
+ */
+class UplinkFrameWriter
+{
+public:
+    UplinkFrameWriter(void) : frameLength(0), sequence(0), outputLength(0)
+    {
+    }
+
+    /**
+     * Reserve space for a record, closing the current frame first if the
+     * record does not fit or is of another type.
+     */
+    uint8_t *reserveRecord(uint8_t type, size_t size)
+    {
+        if (frameLength != 0 &&
+            (frame[0] != type || frame[2] == 0xFF || frameLength + size + UPLINK_FRAME_CRC_SIZE > UPLINK_MAX_FRAME_SIZE)) {
+            closeFrame();
+        }
+        if (frameLength == 0) {
+            frame[0]    = type;
+            frame[2]    = 0;
+            frameLength = UPLINK_FRAME_HEADER_SIZE;
+        }
+
+        uint8_t *record = frame + frameLength;
+        frameLength    += size;
+        frame[2]++;
+        return record;
+    }
+
+    /**
+     * Encode the current frame into the output buffer.
+     */
+    void closeFrame(void)
+    {
+        if (frameLength == 0) {
+            return;
+        }
+        if (outputLength + UPLINK_MAX_ENCODED_SIZE > sizeof(output)) {
+            /* Dropped like on the observer, the sequence number shows it */
+            sequence++;
+            frameLength = 0;
+            return;
+        }
+
+        frame[1] = sequence++;
+        uint16_t crc = uplinkCRC16(0xFFFF, frame, frameLength);
+        frame[frameLength++] = crc;
+        frame[frameLength++] = crc >> 8;
+        outputLength += uplinkEncodeCOBS(frame, frameLength, output + outputLength);
+        frameLength   = 0;
+    }
+
+    const uint8_t *getOutput(void) const
+    {
+        return output;
+    }
+
+    size_t getOutputLength(void) const
+    {
+        return outputLength;
+    }
+
+    /**
+     * Remove the first bytes of the output buffer, once written.
+     */
+    void consumeOutput(size_t length)
+    {
+        memmove(output, output + length, outputLength - length);
+        outputLength -= length;
+    }
+
+private:
+    uint8_t frame[UPLINK_MAX_FRAME_SIZE];
+    size_t  frameLength;
+    uint8_t sequence;
+    uint8_t output[64 * UPLINK_MAX_ENCODED_SIZE];
+    size_t  outputLength;
+};
+
+#endif  /* __UPLINKFRAMER_H__ */
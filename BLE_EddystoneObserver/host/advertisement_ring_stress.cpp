@@ -0,0 +1,183 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2006-2015 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Stress test of AdvertisementRing. The main thread stands for the scan
+ * callback and pushes REPORT_RATE numbered reports per second into a ring of
+ * RING_SLOTS slots. A consumer thread stands for processAdvertisements: it
+ * takes batches of BATCH_SIZE reports and busy-waits for a given time per
+ * report, the time taken to parse and print it.
+ *
+ * Every report received must be intact and in order, and every report must
+ * either be received or counted as dropped. The longest push is printed.
+ *
+ * Build it with:
+ *     g++ -O2 -Istubs -I../source -o advertisement_ring_stress advertisement_ring_stress.cpp -lpthread
+ *
+ * Usage:
+ *     advertisement_ring_stress [work...]
+ * where each work is the time in us spent on a report; the default is
+ * 20 150 400. The exit status is the number of failed runs.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "AdvertisementRing.h"
+
+static const unsigned RING_SLOTS    = 32;
+static const unsigned BATCH_SIZE    = 8;
+static const unsigned REPORT_RATE   = 5000;
+static const unsigned DURATION_SECS = 4;
+static const unsigned REPORT_LENGTH = 31;
+
+static uint32_t nowMicros(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000u + now.tv_nsec / 1000;
+}
+
+extern "C" uint32_t us_ticker_read(void)
+{
+    return nowMicros();
+}
+
+struct Run_t {
+    AdvertisementRing<RING_SLOTS> ring;
+    unsigned                      workMicros;
+    volatile bool                 done;
+    unsigned long                 received;
+    unsigned long                 corrupted;
+    unsigned long                 reordered;
+};
+
+/**
+ * Payload of the report numbered @p sequence, at @p index.
+ */
+static uint8_t payloadByte(uint32_t sequence, unsigned index)
+{
+    return (uint8_t) (sequence * 7 + index);
+}
+
+static void *consume(void *arg)
+{
+    Run_t   *run      = static_cast<Run_t *>(arg);
+    uint32_t expected = 0;
+
+    while (!run->done || run->ring.front() != NULL) {
+        const AdvertisementReport_t *report;
+        unsigned                     batch = 0;
+        while (batch < BATCH_SIZE && (report = run->ring.front()) != NULL) {
+            uint32_t sequence;
+            memcpy(&sequence, report->advertisingData, sizeof(sequence));
+            bool intact = (report->advertisingDataLen == REPORT_LENGTH);
+            for (unsigned i = sizeof(sequence); intact && i < REPORT_LENGTH; i++) {
+                intact = (report->advertisingData[i] == payloadByte(sequence, i));
+            }
+            run->corrupted += intact ? 0 : 1;
+            /* Dropped reports leave gaps, but the sequence never goes back */
+            run->reordered += (sequence < expected) ? 1 : 0;
+            expected = sequence + 1;
+
+            run->ring.pop();
+            run->received++;
+            batch++;
+        }
+
+        uint32_t start = nowMicros();
+        while (nowMicros() - start < run->workMicros * batch) {
+            /* Parsing and printing */
+        }
+        if (batch == 0) {
+            usleep(100);
+        }
+    }
+    return NULL;
+}
+
+static bool runStress(unsigned workMicros)
+{
+    static Run_t run;
+    run.ring       = AdvertisementRing<RING_SLOTS>();
+    run.workMicros = workMicros;
+    run.done       = false;
+    run.received   = 0;
+    run.corrupted  = 0;
+    run.reordered  = 0;
+
+    pthread_t consumer;
+    if (pthread_create(&consumer, NULL, consume, &run) != 0) {
+        perror("pthread_create");
+        return false;
+    }
+
+    uint8_t                           data[REPORT_LENGTH];
+    Gap::AdvertisementCallbackParams_t params;
+    memset(&params, 0, sizeof(params));
+    params.rssi               = -60;
+    params.advertisingData    = data;
+    params.advertisingDataLen = REPORT_LENGTH;
+
+    const uint32_t reports = REPORT_RATE * DURATION_SECS;
+    uint32_t       maxPush = 0;
+    uint32_t       start   = nowMicros();
+    for (uint32_t sequence = 0; sequence < reports; sequence++) {
+        while (nowMicros() - start < sequence * (1000000 / REPORT_RATE)) {
+            /* Wait for the next report */
+        }
+        memcpy(data, &sequence, sizeof(sequence));
+        for (unsigned i = sizeof(sequence); i < REPORT_LENGTH; i++) {
+            data[i] = payloadByte(sequence, i);
+        }
+
+        struct timespec before, after;
+        clock_gettime(CLOCK_MONOTONIC, &before);
+        run.ring.push(&params);
+        clock_gettime(CLOCK_MONOTONIC, &after);
+        uint32_t pushNanos = (after.tv_sec - before.tv_sec) * 1000000000u + (after.tv_nsec - before.tv_nsec);
+        maxPush = (pushNanos > maxPush) ? pushNanos : maxPush;
+    }
+
+    run.done = true;
+    pthread_join(consumer, NULL);
+
+    uint32_t dropped = run.ring.getDropped();
+    bool     passed  = (run.corrupted == 0) && (run.reordered == 0) && (run.received + dropped == reports);
+    printf("%4u us/report: %lu of %lu received, %lu dropped, %lu corrupted, %lu out of order, longest push %lu ns%s\n",
+           workMicros, run.received, (unsigned long) reports, (unsigned long) dropped, run.corrupted, run.reordered,
+           (unsigned long) maxPush, passed ? "" : " FAIL");
+    return passed;
+}
+
+int main(int argc, char *argv[])
+{
+    static const unsigned defaultWork[] = {20, 150, 400};
+    int                   failures      = 0;
+
+    if (argc > 1) {
+        for (int i = 1; i < argc; i++) {
+            failures += runStress(atoi(argv[i])) ? 0 : 1;
+        }
+    } else {
+        for (unsigned i = 0; i < sizeof(defaultWork) / sizeof(defaultWork[0]); i++) {
+            failures += runStress(defaultWork[i]) ? 0 : 1;
+        }
+    }
+    return failures;
+}
@@ -0,0 +1,128 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2006-2015 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Benchmark of the Eddystone-UID lookup in a 31 byte advertising payload:
+ * the loop parseAdvertisement used before AdvertisingDataParser.h, which
+ * overlaid structs on the payload without checking their lengths, against
+ * adFindServiceData() and the frame length check that replaced it.
+ *
+ * Build it with the optimisation of the firmware, and with -O2 to compare:
+ *     g++ -Os -I../source -o advertising_data_benchmark advertising_data_benchmark.cpp
+ *
+ * The exit status is 1 if both lookups do not find the same byte.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "AdvertisingDataParser.h"
+
+static const unsigned RUNS   = 50000000;
+static const unsigned ROUNDS = 2;
+
+/* Flags, Eddystone UUID and UID frame */
+static const uint8_t advertisement[] = {
+    2, 0x01, 0x06,
+    3, 0x03, 0xAA, 0xFE,
+    23, 0x16, 0xAA, 0xFE, 0x00, 0xEE, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 0, 0
+};
+
+static const uint16_t EDDYSTONE_UUID     = 0xFEAA;
+static const uint8_t  FRAME_TYPE_UID     = 0x00;
+static const uint8_t  UID_FRAME_LENGTH   = 18;
+/* Byte read by both lookups: the fourth byte of the namespace */
+static const uint8_t  UID_NAMESPACE_BYTE = 2 + 3;
+
+static double nowNanos(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1e9 + now.tv_nsec;
+}
+
+/**
+ * The loop of parseAdvertisement before AdvertisingDataParser.h.
+ */
+__attribute__((noinline)) static int overlayLookup(const uint8_t *data, uint8_t length)
+{
+    struct AdvertisingData_t {
+        uint8_t length;
+        uint8_t dataType;
+        uint8_t data[1];
+    };
+    struct ServiceData_t {
+        uint8_t serviceUUID[2];
+        uint8_t frameType;
+        uint8_t txPower;
+        uint8_t payload[18];
+    };
+    static const uint8_t uuid[] = {EDDYSTONE_UUID & 0xFF, EDDYSTONE_UUID >> 8};
+
+    size_t index = 0;
+    while (index < length) {
+        const AdvertisingData_t *pAdvData = (const AdvertisingData_t *) &data[index];
+        if (pAdvData->dataType == AD_TYPE_SERVICE_DATA) {
+            const ServiceData_t *pServiceData = (const ServiceData_t *) pAdvData->data;
+            if (!memcmp(pServiceData->serviceUUID, uuid, sizeof(uuid)) && pServiceData->frameType == FRAME_TYPE_UID &&
+                pAdvData->length >= 21) {
+                return pServiceData->payload[UID_NAMESPACE_BYTE - 2];
+            }
+        }
+        index += pAdvData->length + 1;
+    }
+    return -1;
+}
+
+__attribute__((noinline)) static int iteratorLookup(const uint8_t *data, uint8_t length)
+{
+    const uint8_t *value;
+    uint8_t        valueLength;
+    if (!adFindServiceData(data, length, EDDYSTONE_UUID, value, valueLength) ||
+        valueLength < UID_FRAME_LENGTH || value[0] != FRAME_TYPE_UID) {
+        return -1;
+    }
+    return value[UID_NAMESPACE_BYTE];
+}
+
+static double timeLookup(int (*lookup)(const uint8_t *, uint8_t))
+{
+    volatile int sum   = 0;
+    double       start = nowNanos();
+    for (unsigned i = 0; i < RUNS; i++) {
+        sum += lookup(advertisement, sizeof(advertisement));
+        /* Keep the payload from being taken as constant */
+        __asm__ volatile("" : : "r"(advertisement) : "memory");
+    }
+    return (nowNanos() - start) / RUNS;
+}
+
+int main(void)
+{
+    int overlay  = overlayLookup(advertisement, sizeof(advertisement));
+    int iterator = iteratorLookup(advertisement, sizeof(advertisement));
+    if (overlay != iterator || overlay < 0) {
+        printf("the lookups found %d and %d\n", overlay, iterator);
+        return 1;
+    }
+
+    for (unsigned round = 0; round < ROUNDS; round++) {
+        double overlayNanos  = timeLookup(overlayLookup);
+        double iteratorNanos = timeLookup(iteratorLookup);
+        printf("overlay loop %.2f ns, iterator %.2f ns\n", overlayNanos, iteratorNanos);
+    }
+    return 0;
+}
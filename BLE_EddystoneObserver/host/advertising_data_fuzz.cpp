@@ -0,0 +1,169 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2006-2015 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Fuzzer of AdvertisingDataParser.h. Every input, up to the size of an
+ * advertising payload and its scan response, is copied into a buffer of
+ * exactly its size, so that the sanitizers catch any read past it. It is
+ * walked with AdStructureIterator and searched with every helper; the
+ * values returned must lie inside the input, and the structures walked must
+ * not add up to more than the input.
+ *
+ * The fuzz target is LLVMFuzzerTestOneInput. Build it for libFuzzer with:
+ *     clang++ -g -O1 -fsanitize=fuzzer,address,undefined -DLIBFUZZER -I../source -o advertising_data_fuzz advertising_data_fuzz.cpp
+ * Where libFuzzer is not available, the built-in driver mutates Eddystone,
+ * local name and manufacturer data payloads MUTATED_RUNS times, then tries
+ * every input of up to 3 bytes:
+ *     g++ -std=c++11 -g -O1 -fsanitize=address,undefined -I../source -o advertising_data_fuzz advertising_data_fuzz.cpp
+ *
+ * The exit status of the built-in driver is the number of failed checks.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <random>
+#include <vector>
+#include "AdvertisingDataParser.h"
+
+/**
+ * Largest input: an advertising payload and its scan response.
+ */
+static const size_t MAX_INPUT_SIZE = 2 * 31;
+
+static unsigned failures = 0;
+
+#define CHECK(condition, ...)                   \
+    do {                                        \
+        if (!(condition)) {                     \
+            failures++;                         \
+            if (failures <= 10) {               \
+                printf("FAIL: " __VA_ARGS__);   \
+                printf("\n");                   \
+            }                                   \
+        }                                       \
+    } while (0)
+
+static bool isInside(const uint8_t *value, uint8_t valueLength, const uint8_t *data, size_t size)
+{
+    return value >= data && value + valueLength <= data + size;
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *input, size_t size)
+{
+    if (size > MAX_INPUT_SIZE) {
+        size = MAX_INPUT_SIZE;
+    }
+    /* Exactly the size of the input, so that the sanitizers see overreads */
+    uint8_t *data = static_cast<uint8_t *>(malloc(size ? size : 1));
+    memcpy(data, input, size);
+
+    AdStructureIterator it(data, size);
+    size_t              walked = 0;
+    volatile unsigned   sum    = 0;
+    while (it.next()) {
+        CHECK(isInside(it.getValue(), it.getLength(), data, size), "AD structure of type 0x%02x overruns the input",
+              it.getType());
+        for (uint8_t i = 0; i < it.getLength(); i++) {
+            sum += it.getValue()[i];
+        }
+        walked += it.getLength() + 2;
+    }
+    CHECK(walked <= size, "%u bytes of AD structures in %u bytes", (unsigned) walked, (unsigned) size);
+
+    const uint8_t *value;
+    uint8_t        valueLength;
+    uint16_t       companyID;
+    bool           complete;
+    if (adFindServiceData(data, size, 0xFEAA, value, valueLength)) {
+        CHECK(isInside(value, valueLength, data, size), "service data overruns the input");
+    }
+    if (adFindLocalName(data, size, value, valueLength, complete)) {
+        CHECK(isInside(value, valueLength, data, size), "local name overruns the input");
+    }
+    if (adFindManufacturerData(data, size, companyID, value, valueLength)) {
+        CHECK(isInside(value, valueLength, data, size), "manufacturer data overruns the input");
+    }
+    sum += adHasServiceUUID(data, size, 0xFEAA) ? 1 : 0;
+
+    free(data);
+#ifdef LIBFUZZER
+    if (failures != 0) {
+        abort();
+    }
+#endif
+    return 0;
+}
+
+#ifndef LIBFUZZER
+
+/**
+ * Number of mutated payloads tried by the built-in driver.
+ */
+static const unsigned long MUTATED_RUNS = 20000000;
+
+int main(void)
+{
+    /* Flags, Eddystone UUID and UID frame, complete local name, manufacturer data */
+    static const uint8_t seed[] = {
+        2, 0x01, 0x06,
+        3, 0x03, 0xAA, 0xFE,
+        23, 0x16, 0xAA, 0xFE, 0x00, 0xEE, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 0, 0,
+        4, 0x09, 'L', 'E', 'D',
+        5, 0xFF, 0x59, 0x00, 1, 2
+    };
+    std::mt19937  rng(7);
+    unsigned long runs = 0;
+
+    for (unsigned long i = 0; i < MUTATED_RUNS; i++, runs++) {
+        std::vector<uint8_t> input(seed, seed + sizeof(seed));
+        unsigned             mutations = 1 + rng() % 6;
+        for (unsigned j = 0; j < mutations; j++) {
+            switch (rng() % 4) {
+                case 0:
+                    input[rng() % input.size()] = rng();
+                    break;
+                case 1:
+                    input.resize(rng() % (input.size() + 1));
+                    break;
+                case 2:
+                    input[rng() % input.size()] ^= 1 << (rng() % 8);
+                    break;
+                default:
+                    if (input.size() < MAX_INPUT_SIZE) {
+                        input.insert(input.begin() + rng() % input.size(), (uint8_t) rng());
+                    }
+                    break;
+            }
+            if (input.empty()) {
+                input.push_back(rng());
+            }
+        }
+        LLVMFuzzerTestOneInput(&input[0], input.size());
+    }
+
+    for (uint32_t bytes = 0; bytes < (1u << 24); bytes++) {
+        uint8_t input[3] = {(uint8_t) bytes, (uint8_t) (bytes >> 8), (uint8_t) (bytes >> 16)};
+        for (size_t size = 0; size <= sizeof(input); size++, runs++) {
+            LLVMFuzzerTestOneInput(input, size);
+        }
+    }
+
+    printf("%lu inputs, %u failures\n", runs, failures);
+    return failures;
+}
+
+#endif
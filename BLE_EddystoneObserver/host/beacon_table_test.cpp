@@ -0,0 +1,198 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2006-2015 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Host check and benchmark of BeaconTable with NUM_BEACONS distinct beacons,
+ * half of them keyed by address and half by Eddystone-UID, each heard
+ * REPORT_RATE times per second.
+ *
+ * The expiry cross-check runs the table against a reference map of the
+ * last time each beacon was heard, while every fifth beacon goes silent for
+ * SILENCE_MSEC. Each beacon must be new exactly when the reference does not
+ * hold it, and each expiry must come between the timeout and one tick after
+ * it; a beacon silent for longer than that must have expired.
+ *
+ * The benchmark then times the updates of the same beacons over ten minutes
+ * of simulated time, with the expiry ticks in between.
+ *
+ * Build it with:
+ *     g++ -O2 -Istubs -I../source -DBEACON_TABLE_SIZE=1024 -o beacon_table_test beacon_table_test.cpp ../source/BeaconTable.cpp
+ *
+ * The exit status is the number of failed checks.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <map>
+#include <string>
+#include "BeaconTable.h"
+
+static const unsigned NUM_BEACONS    = 500;
+static const unsigned REPORT_RATE    = 10;
+static const uint32_t TIMEOUT_MSEC   = 10000;
+static const uint32_t SILENCE_START  = 40000;
+static const uint32_t SILENCE_MSEC   = 30000;
+static const uint32_t CHECK_MSEC     = 120000;
+static const uint32_t BENCHMARK_MSEC = 600000;
+
+/**
+ * Time step of the simulation: every step, one beacon in
+ * 1000 / (REPORT_RATE * STEP_MSEC) is heard.
+ */
+static const uint32_t STEP_MSEC      = 10;
+static const unsigned STRIDE         = 1000 / (REPORT_RATE * STEP_MSEC);
+
+typedef std::map<std::string, uint32_t> Reference_t;
+
+static BeaconTable::Key_t keys[NUM_BEACONS];
+static Reference_t        reference;
+static uint32_t           now;
+static unsigned           failures     = 0;
+static unsigned           expiries     = 0;
+static uint32_t           minExpiryAge = 0xFFFFFFFF;
+static uint32_t           maxExpiryAge = 0;
+
+#define CHECK(condition, ...)                   \
+    do {                                        \
+        if (!(condition)) {                     \
+            failures++;                         \
+            if (failures <= 10) {               \
+                printf("FAIL: " __VA_ARGS__);   \
+                printf("\n");                   \
+            }                                   \
+        }                                       \
+    } while (0)
+
+static std::string referenceKey(const BeaconTable::Key_t &key)
+{
+    return std::string(reinterpret_cast<const char *>(&key), sizeof(key));
+}
+
+static void beaconExpired(const BeaconTable::Beacon_t &beacon)
+{
+    Reference_t::iterator entry = reference.find(referenceKey(beacon.key));
+    if (entry == reference.end()) {
+        CHECK(false, "unknown beacon expired at %lu ms", (unsigned long) now);
+        return;
+    }
+
+    uint32_t age = now - entry->second;
+    CHECK(age >= TIMEOUT_MSEC && age <= TIMEOUT_MSEC + BeaconTable::TICK_MSEC,
+          "beacon expired %lu ms after its last packet", (unsigned long) age);
+    CHECK(beacon.lastSeen == entry->second, "expired beacon was last seen at %lu ms, not %lu ms",
+          (unsigned long) beacon.lastSeen, (unsigned long) entry->second);
+    minExpiryAge = (age < minExpiryAge) ? age : minExpiryAge;
+    maxExpiryAge = (age > maxExpiryAge) ? age : maxExpiryAge;
+    expiries++;
+    reference.erase(entry);
+}
+
+static void makeKeys(void)
+{
+    srand(1);
+    for (unsigned i = 0; i < NUM_BEACONS; i++) {
+        uint8_t id[BeaconTable::ID_SIZE];
+        for (unsigned j = 0; j < sizeof(id); j++) {
+            id[j] = rand();
+        }
+        if (i % 2) {
+            BeaconTable::makeAddressKey(keys[i], id);
+        } else {
+            BeaconTable::makeUIDKey(keys[i], id);
+        }
+    }
+}
+
+static bool isSilent(unsigned beacon)
+{
+    return (beacon % 5 == 0) && (now >= SILENCE_START) && (now < SILENCE_START + SILENCE_MSEC);
+}
+
+static void checkExpiry(void)
+{
+    static BeaconTable table(TIMEOUT_MSEC, beaconExpired);
+    unsigned           returns = 0;
+
+    for (now = 0; now < CHECK_MSEC; now += STEP_MSEC) {
+        for (unsigned i = (now / STEP_MSEC) % STRIDE; i < NUM_BEACONS; i += STRIDE) {
+            if (isSilent(i)) {
+                continue;
+            }
+
+            std::string                 key    = referenceKey(keys[i]);
+            bool                        known  = reference.count(key) != 0;
+            BeaconTable::UpdateResult_t result = table.update(keys[i], -60 - (int) (i % 30), now);
+            CHECK(result != BeaconTable::TABLE_FULL, "table full at %lu ms", (unsigned long) now);
+            CHECK((result == BeaconTable::BEACON_NEW) == !known, "beacon %u %s at %lu ms", i,
+                  known ? "forgotten" : "not new", (unsigned long) now);
+            returns += (result == BeaconTable::BEACON_NEW && now > SILENCE_START) ? 1 : 0;
+            reference[key] = now;
+        }
+
+        if (now % BeaconTable::TICK_MSEC == 0) {
+            table.expire(now);
+            for (Reference_t::const_iterator entry = reference.begin(); entry != reference.end(); ++entry) {
+                CHECK(now - entry->second <= TIMEOUT_MSEC + BeaconTable::TICK_MSEC,
+                      "beacon not expired %lu ms after its last packet", (unsigned long) (now - entry->second));
+            }
+        }
+    }
+
+    CHECK(table.getNumBeacons() == reference.size(), "%u beacons in the table, %u expected",
+          table.getNumBeacons(), (unsigned) reference.size());
+    printf("%u beacons: %u expired %lu to %lu ms after their last packet, %u came back\n", NUM_BEACONS,
+           expiries, (unsigned long) minExpiryAge, (unsigned long) maxExpiryAge, returns);
+}
+
+static void benchmark(void)
+{
+    static BeaconTable table(TIMEOUT_MSEC, NULL);
+    unsigned long      updates    = 0;
+    volatile unsigned  newBeacons = 0;
+    struct timespec    start, end;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (now = 0; now < BENCHMARK_MSEC; now += STEP_MSEC) {
+        for (unsigned i = (now / STEP_MSEC) % STRIDE; i < NUM_BEACONS; i += STRIDE) {
+            newBeacons += (table.update(keys[i], -70, now) == BeaconTable::BEACON_NEW) ? 1 : 0;
+            updates++;
+        }
+        if (now % BeaconTable::TICK_MSEC == 0) {
+            table.expire(now);
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    double nanos = (end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec);
+    printf("%lu updates, %.1f ns per update, %u index slots, %u bytes\n", updates, nanos / updates,
+           BeaconTable::INDEX_SIZE, (unsigned) sizeof(table));
+}
+
+int main(void)
+{
+    if (BeaconTable::MAX_BEACONS < NUM_BEACONS) {
+        printf("BEACON_TABLE_SIZE must hold %u beacons\n", NUM_BEACONS);
+        return 1;
+    }
+
+    makeKeys();
+    checkExpiry();
+    benchmark();
+
+    printf("%u failures\n", failures);
+    return failures;
+}
@@ -0,0 +1,375 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2006-2015 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Replay of RSSI traces through the firmware CrossingDetector, to measure the
+ * error of the crossing times it reports.
+ *
+ * A trace holds passes of a tag in front of an observer. Each pass starts
+ * with a line "pass <time>", the time in ms the tag was closest to the
+ * observer, followed by one line "<time> <rssi>" per packet heard. Every
+ * pass is replayed into a fresh track: each packet is passed to addSample()
+ * and then to checkTimeout(), and a last checkTimeout() comes once the tag
+ * has gone. The first crossing of a pass is compared with its time, and so
+ * is the time of the strongest packet, the raw peak.
+ *
+ * The synthetic traces are generated with the model of uplink_simulator: a
+ * tag runs straight past the observer at a given speed and closest distance,
+ * advertising every interval plus up to 10 ms of advDelay, heard with a
+ * log-distance path loss, Gaussian noise and random packet loss. Without any
+ * option, the four cases quoted when CrossingDetector was added are replayed,
+ * 1000 passes each with the generator seeded with 42, and checked against
+ * the quoted figures (median / p95 error, raw peak in brackets):
+ *     5 m/s, 2 m,   3 dB noise, 100 ms:  66 / 191 ms (154 / 493)
+ *     8 m/s, 3 m,   4 dB noise, 100 ms:  84 / 244 ms (169 / 566)
+ *     3 m/s, 1.5 m, 4 dB noise, 50 ms:   69 / 233 ms (211 / 721)
+ *     5 m/s, 2 m,   6 dB noise, 100 ms: 135 / 579 ms (234 / 1041)
+ * One pass in 3000 was missed, and none was reported twice. The figures
+ * depend on the sequence of the standard generators, so a check allows them
+ * TOLERANCE above the quoted ones.
+ *
+ * Build it with:
+ *     g++ -std=c++11 -O2 -I../source -o crossing_replay crossing_replay.cpp ../source/CrossingDetector.cpp
+ *
+ * Usage:
+ *     crossing_replay [-v speed] [-d distance] [-s noise] [-r interval] [-n passes] [-w trace]
+ *     crossing_replay trace
+ * where -v is in m/s, -d in m, -s in dB and -r in ms. The first form
+ * replays one synthetic case, and writes its trace to a file with -w; the
+ * second replays a trace file, such as one recorded on an observer. The exit
+ * status is the number of failed checks.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <random>
+#include <vector>
+#include <algorithm>
+#include "CrossingDetector.h"
+
+/* Log-distance path loss model, as in uplink_simulator */
+static const double RSSI_AT_1M           = -59.0;
+static const double PATH_LOSS_EXPONENT   = 2.0;
+static const double PACKET_LOSS          = 0.15;
+static const double SENSITIVITY_DBM      = -100.0;
+static const double ADV_DELAY_MSEC       = 10.0;
+/* Window of a synthetic pass, and the spread of its crossing time */
+static const double PASS_MSEC            = 40000.0;
+static const double CROSSING_MSEC        = 20000.0;
+static const double CROSSING_SPREAD_MSEC = 1000.0;
+/* Minimum RSSI of a crossing, as in the observer firmware */
+static const int8_t CROSSING_MIN_PEAK_RSSI = -75;
+/* Margin allowed above the quoted figures */
+static const double TOLERANCE            = 0.1;
+
+struct Sample_t {
+    uint32_t time;
+    int8_t   rssi;
+};
+
+struct Pass_t {
+    double                crossingTime;
+    std::vector<Sample_t> samples;
+};
+
+struct Case_t {
+    double   speed;
+    double   distance;
+    double   noise;
+    unsigned interval;
+};
+
+struct Figures_t {
+    double   medianError;
+    double   p95Error;
+    double   medianPeakError;
+    double   p95PeakError;
+    unsigned missed;
+    unsigned duplicated;
+};
+
+static unsigned failures = 0;
+
+#define CHECK(condition, ...)                   \
+    do {                                        \
+        if (!(condition)) {                     \
+            failures++;                         \
+            if (failures <= 10) {               \
+                printf("FAIL: " __VA_ARGS__);   \
+                printf("\n");                   \
+            }                                   \
+        }                                       \
+    } while (0)
+
+static void generate(const Case_t &pass, unsigned numPasses, std::vector<Pass_t> &passes)
+{
+    std::mt19937                           rng(42);
+    std::normal_distribution<double>       noise(0, pass.noise);
+    std::uniform_real_distribution<double> uniform(0, 1);
+
+    passes.resize(numPasses);
+    for (unsigned i = 0; i < numPasses; i++) {
+        passes[i].crossingTime = CROSSING_MSEC + uniform(rng) * CROSSING_SPREAD_MSEC;
+        passes[i].samples.clear();
+        for (double t = uniform(rng) * pass.interval; t < PASS_MSEC;
+             t += pass.interval + uniform(rng) * ADV_DELAY_MSEC) {
+            if (uniform(rng) < PACKET_LOSS) {
+                continue;
+            }
+            double along    = pass.speed * (t - passes[i].crossingTime) / 1000;
+            double distance = sqrt(pass.distance * pass.distance + along * along);
+            double rssi     = RSSI_AT_1M - 10 * PATH_LOSS_EXPONENT * log10(distance) + noise(rng);
+            if (rssi < SENSITIVITY_DBM) {
+                continue;
+            }
+            Sample_t sample = {(uint32_t) t, (int8_t) lround(rssi)};
+            passes[i].samples.push_back(sample);
+        }
+    }
+}
+
+static bool writeTrace(const char *path, const std::vector<Pass_t> &passes)
+{
+    FILE *file = fopen(path, "w");
+    if (file == NULL) {
+        perror(path);
+        return false;
+    }
+    for (size_t i = 0; i < passes.size(); i++) {
+        fprintf(file, "pass %.0f\n", passes[i].crossingTime);
+        for (size_t j = 0; j < passes[i].samples.size(); j++) {
+            fprintf(file, "%lu %d\n", (unsigned long) passes[i].samples[j].time, passes[i].samples[j].rssi);
+        }
+    }
+    return fclose(file) == 0;
+}
+
+static bool readTrace(const char *path, std::vector<Pass_t> &passes)
+{
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        perror(path);
+        return false;
+    }
+
+    char     line[64];
+    unsigned lineNumber = 0;
+    while (fgets(line, sizeof(line), file) != NULL) {
+        double        crossingTime;
+        unsigned long time;
+        int           rssi;
+        lineNumber++;
+        if (sscanf(line, "pass %lf", &crossingTime) == 1) {
+            passes.push_back(Pass_t());
+            passes.back().crossingTime = crossingTime;
+        } else if (sscanf(line, "%lu %d", &time, &rssi) == 2 && !passes.empty() && rssi >= -128 && rssi <= 127) {
+            Sample_t sample = {(uint32_t) time, (int8_t) rssi};
+            passes.back().samples.push_back(sample);
+        } else if (line[0] != '\n' && line[0] != '#') {
+            fprintf(stderr, "%s:%u: not a pass or a sample\n", path, lineNumber);
+            fclose(file);
+            return false;
+        }
+    }
+    fclose(file);
+    return true;
+}
+
+/**
+ * Median and 95th percentile of the absolute errors.
+ */
+static void percentiles(std::vector<double> errors, double &median, double &p95)
+{
+    if (errors.empty()) {
+        median = p95 = 0;
+        return;
+    }
+    for (size_t i = 0; i < errors.size(); i++) {
+        errors[i] = fabs(errors[i]);
+    }
+    std::sort(errors.begin(), errors.end());
+    median = errors[errors.size() / 2];
+    p95    = errors[errors.size() * 95 / 100];
+}
+
+static Figures_t replay(const std::vector<Pass_t> &passes)
+{
+    CrossingDetector    detector(CROSSING_MIN_PEAK_RSSI);
+    std::vector<double> errors, peakErrors;
+    Figures_t           figures = {0, 0, 0, 0, 0, 0};
+
+    for (size_t i = 0; i < passes.size(); i++) {
+        const Pass_t                 &pass = passes[i];
+        CrossingDetector::Track_t    track;
+        CrossingDetector::Crossing_t crossing;
+        unsigned                     crossings = 0;
+        uint32_t                     peakTime  = 0;
+        int                          peakRSSI  = -128;
+
+        detector.reset(track);
+        for (size_t j = 0; j < pass.samples.size(); j++) {
+            const Sample_t &sample = pass.samples[j];
+            if (sample.rssi > peakRSSI) {
+                peakRSSI = sample.rssi;
+                peakTime = sample.time;
+            }
+            if (detector.addSample(track, sample.time, sample.rssi, crossing) && ++crossings == 1) {
+                errors.push_back((double) crossing.time - pass.crossingTime);
+                peakErrors.push_back((double) peakTime - pass.crossingTime);
+            }
+            if (detector.checkTimeout(track, sample.time, crossing) && ++crossings == 1) {
+                errors.push_back((double) crossing.time - pass.crossingTime);
+                peakErrors.push_back((double) peakTime - pass.crossingTime);
+            }
+        }
+
+        uint32_t gone = pass.samples.empty() ? 0 : pass.samples.back().time;
+        if (detector.checkTimeout(track, gone + 20000, crossing) && ++crossings == 1) {
+            errors.push_back((double) crossing.time - pass.crossingTime);
+            peakErrors.push_back((double) peakTime - pass.crossingTime);
+        }
+
+        figures.missed     += (crossings == 0) ? 1 : 0;
+        figures.duplicated += (crossings > 1) ? 1 : 0;
+    }
+
+    percentiles(errors, figures.medianError, figures.p95Error);
+    percentiles(peakErrors, figures.medianPeakError, figures.p95PeakError);
+    printf("%u passes, %u missed, %u reported twice: median / p95 error %.0f / %.0f ms (raw peak %.0f / %.0f)\n",
+           (unsigned) passes.size(), figures.missed, figures.duplicated, figures.medianError, figures.p95Error,
+           figures.medianPeakError, figures.p95PeakError);
+    return figures;
+}
+
+static void replayCase(const Case_t &pass, unsigned numPasses, const char *tracePath)
+{
+    std::vector<Pass_t> passes;
+    generate(pass, numPasses, passes);
+    if (tracePath != NULL) {
+        CHECK(writeTrace(tracePath, passes), "cannot write %s", tracePath);
+    }
+
+    printf("%.1f m/s, %.1f m, %.0f dB noise, %u ms: ", pass.speed, pass.distance, pass.noise, pass.interval);
+    Figures_t figures = replay(passes);
+    CHECK(figures.medianError < figures.medianPeakError && figures.p95Error < figures.p95PeakError,
+          "the fit is no better than the raw peak");
+}
+
+/**
+ * Replay the quoted cases and check their figures.
+ */
+static void checkQuotedCases(void)
+{
+    static const struct {
+        Case_t    pass;
+        Figures_t quoted;
+    } cases[] = {
+        {{5, 2,   3, 100}, { 66, 191, 154,  493, 0, 0}},
+        {{8, 3,   4, 100}, { 84, 244, 169,  566, 1, 0}},
+        {{3, 1.5, 4, 50},  { 69, 233, 211,  721, 0, 0}},
+        {{5, 2,   6, 100}, {135, 579, 234, 1041, 0, 0}}
+    };
+    static const unsigned NUM_PASSES = 1000;
+
+    unsigned missed = 0, duplicated = 0;
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        const Case_t    &pass   = cases[i].pass;
+        const Figures_t &quoted = cases[i].quoted;
+        std::vector<Pass_t> passes;
+        generate(pass, NUM_PASSES, passes);
+
+        printf("%.1f m/s, %.1f m, %.0f dB noise, %u ms: ", pass.speed, pass.distance, pass.noise, pass.interval);
+        Figures_t figures = replay(passes);
+        CHECK(figures.medianError <= quoted.medianError * (1 + TOLERANCE) &&
+              figures.p95Error <= quoted.p95Error * (1 + TOLERANCE),
+              "median / p95 error %.0f / %.0f ms, quoted %.0f / %.0f ms", figures.medianError, figures.p95Error,
+              quoted.medianError, quoted.p95Error);
+        CHECK(figures.medianError < figures.medianPeakError && figures.p95Error < figures.p95PeakError,
+              "the fit is no better than the raw peak");
+        missed     += figures.missed;
+        duplicated += figures.duplicated;
+    }
+
+    CHECK(missed <= 1, "%u passes missed, one quoted", missed);
+    CHECK(duplicated == 0, "%u passes reported twice", duplicated);
+}
+
+static int usage(const char *program)
+{
+    fprintf(stderr, "usage: %s [-v speed] [-d distance] [-s noise] [-r interval] [-n passes] [-w trace]\n"
+                    "       %s trace\n", program, program);
+    return 2;
+}
+
+int main(int argc, char *argv[])
+{
+    Case_t      pass      = {5, 2, 3, 100};
+    unsigned    numPasses = 1000;
+    const char *tracePath = NULL;
+    int         option;
+
+    if (argc == 1) {
+        checkQuotedCases();
+        printf("%u failures\n", failures);
+        return failures;
+    }
+
+    while ((option = getopt(argc, argv, "v:d:s:r:n:w:")) != -1) {
+        switch (option) {
+            case 'v':
+                pass.speed = atof(optarg);
+                break;
+            case 'd':
+                pass.distance = atof(optarg);
+                break;
+            case 's':
+                pass.noise = atof(optarg);
+                break;
+            case 'r':
+                pass.interval = atoi(optarg);
+                break;
+            case 'n':
+                numPasses = atoi(optarg);
+                break;
+            case 'w':
+                tracePath = optarg;
+                break;
+            default:
+                return usage(argv[0]);
+        }
+    }
+
+    if (optind + 1 == argc && optind == 1) {
+        std::vector<Pass_t> passes;
+        if (!readTrace(argv[optind], passes)) {
+            return 2;
+        }
+        printf("%s: ", argv[optind]);
+        replay(passes);
+        return 0;
+    }
+    if (optind != argc || pass.speed <= 0 || pass.distance <= 0 || pass.noise < 0 || pass.interval == 0 ||
+        numPasses == 0) {
+        return usage(argv[0]);
+    }
+
+    replayCase(pass, numPasses, tracePath);
+    printf("%u failures\n", failures);
+    return failures;
+}
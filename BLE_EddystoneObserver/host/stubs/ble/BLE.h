@@ -0,0 +1,48 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2006-2015 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * The part of the mbed BLE API used by the observer headers that the host
+ * tools build against.
+ */
+
+#ifndef __HOST_STUBS_BLE_H__
+#define __HOST_STUBS_BLE_H__
+
+#include <stdint.h>
+#include <string.h>
+
+namespace BLEProtocol {
+    typedef uint8_t AddressBytes_t[6];
+}
+
+struct GapAdvertisingData {
+    static const unsigned GAP_ADVERTISING_DATA_MAX_PAYLOAD = 31;
+};
+
+class Gap {
+public:
+    struct AdvertisementCallbackParams_t {
+        BLEProtocol::AddressBytes_t peerAddr;
+        int8_t                      rssi;
+        bool                        isScanResponse;
+        uint8_t                     type;
+        uint8_t                     advertisingDataLen;
+        const uint8_t              *advertisingData;
+    };
+};
+
+#endif  /* __HOST_STUBS_BLE_H__ */
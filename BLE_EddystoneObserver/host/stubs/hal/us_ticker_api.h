@@ -0,0 +1,28 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2006-2015 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * The microsecond ticker of mbed, provided by each host tool.
+ */
+
+#ifndef __HOST_STUBS_US_TICKER_API_H__
+#define __HOST_STUBS_US_TICKER_API_H__
+
+#include <stdint.h>
+
+extern "C" uint32_t us_ticker_read(void);
+
+#endif  /* __HOST_STUBS_US_TICKER_API_H__ */
@@ -0,0 +1,252 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2006-2015 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Reference host decoder of the Eddystone observer uplink. It reads the
+ * binary frames from a serial device, a pty or the standard input, and
+ * prints one line per record.
+ *
+ * Build it with:
+ *     g++ -O2 -o uplink_decoder uplink_decoder.cpp
+ *
+ * Usage:
+ *     uplink_decoder [-b baud] [-q] <device | ->
+ * -q only prints statistics, once per second.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <termios.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include "UplinkFramer.h"
+
+struct DecoderStats_t {
+    unsigned long reports;
+    unsigned long events;
+    unsigned long recordErrors;
+};
+
+static DecoderStats_t stats;
+static bool           quiet = false;
+
+static speed_t baudToSpeed(long baud)
+{
+    switch (baud) {
+        case 115200:  return B115200;
+        case 230400:  return B230400;
+        case 460800:  return B460800;
+        case 921600:  return B921600;
+        case 1000000: return B1000000;
+        case 2000000: return B2000000;
+        default:      return B0;
+    }
+}
+
+static int openInput(const char *path, long baud)
+{
+    if (strcmp(path, "-") == 0) {
+        return STDIN_FILENO;
+    }
+
+    int fd = open(path, O_RDONLY | O_NOCTTY);
+    if (fd < 0) {
+        fprintf(stderr, "%s: %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    /* Serial devices and ptys are switched to raw mode, other files are read
+     * as they are */
+    struct termios tio;
+    if (tcgetattr(fd, &tio) == 0) {
+        cfmakeraw(&tio);
+        tio.c_cc[VMIN]  = 1;
+        tio.c_cc[VTIME] = 0;
+        if (baudToSpeed(baud) != B0) {
+            cfsetispeed(&tio, baudToSpeed(baud));
+            cfsetospeed(&tio, baudToSpeed(baud));
+        } else {
+            fprintf(stderr, "unsupported baud rate %ld, keeping the device setting\n", baud);
+        }
+        tcsetattr(fd, TCSANOW, &tio);
+    }
+    return fd;
+}
+
+static void printAddress(const uint8_t *address)
+{
+    printf("%02x:%02x:%02x:%02x:%02x:%02x", address[5], address[4], address[3], address[2], address[1], address[0]);
+}
+
+static void decodeScanReports(const uint8_t *records, size_t length, uint8_t count)
+{
+    size_t offset = 0;
+    for (uint8_t i = 0; i < count; i++) {
+        if (offset + sizeof(UplinkScanReport_t) > length) {
+            stats.recordErrors++;
+            return;
+        }
+        const UplinkScanReport_t *report = (const UplinkScanReport_t *) (records + offset);
+        offset += sizeof(UplinkScanReport_t);
+        if (offset + report->dataLength > length) {
+            stats.recordErrors++;
+            return;
+        }
+        stats.reports++;
+
+        if (!quiet) {
+            printf("report %u ", uplinkGetUint32(report->time));
+            printAddress(report->peerAddr);
+            printf(" rssi %d type %u%s ", report->rssi, (report->flags >> 1) & 0x07, (report->flags & 0x01) ? " scan-response" : "");
+            for (uint8_t j = 0; j < report->dataLength; j++) {
+                printf("%02x", records[offset + j]);
+            }
+            printf("\n");
+        }
+        offset += report->dataLength;
+    }
+}
+
+static void decodeBeaconEvents(const uint8_t *records, size_t length, uint8_t count)
+{
+    static const char *EVENT_NAMES[] = {"?", "found", "lost", "crossing"};
+
+    if (count * sizeof(UplinkBeaconEvent_t) > length) {
+        stats.recordErrors++;
+        return;
+    }
+    for (uint8_t i = 0; i < count; i++) {
+        const UplinkBeaconEvent_t *event = (const UplinkBeaconEvent_t *) (records + i * sizeof(UplinkBeaconEvent_t));
+        stats.events++;
+
+        if (!quiet) {
+            printf("%s %u ", EVENT_NAMES[event->event <= UPLINK_BEACON_CROSSING ? event->event : 0], uplinkGetUint32(event->time));
+            if (event->keyType == 2) {
+                printf("uid ");
+                for (uint8_t j = 0; j < sizeof(event->id); j++) {
+                    printf("%02x", event->id[j]);
+                }
+            } else {
+                printf("addr ");
+                printAddress(event->id);
+            }
+            printf(" rssi %d count %u\n", event->rssi, uplinkGetUint32(event->count));
+        }
+    }
+}
+
+/**
+ * Frame handler of the UplinkFrameParser.
+ */
+struct FramePrinter {
+    void onFrame(uint8_t type, const uint8_t *records, size_t length, uint8_t count)
+    {
+        switch (type) {
+            case UPLINK_FRAME_SCAN_REPORTS:
+                decodeScanReports(records, length, count);
+                break;
+            case UPLINK_FRAME_BEACON_EVENTS:
+                decodeBeaconEvents(records, length, count);
+                break;
+            case UPLINK_FRAME_STATS:
+                if (length >= sizeof(UplinkStats_t) && !quiet) {
+                    const UplinkStats_t *record = (const UplinkStats_t *) records;
+                    printf("stats advertisements %u dropped-reports %u dropped-frames %u\n",
+                           uplinkGetUint32(record->advertisements), uplinkGetUint32(record->droppedReports),
+                           uplinkGetUint32(record->droppedFrames));
+                }
+                break;
+            default:
+                stats.recordErrors++;
+                break;
+        }
+    }
+};
+
+static double now(void)
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static void printStats(const UplinkParserStats_t &parserStats, double elapsed, unsigned long reports)
+{
+    fprintf(stderr, "%.0f reports/s, %lu frames, %lu reports, %lu events, %lu lost frames, %lu CRC errors, %lu encoding errors\n",
+            reports / elapsed, parserStats.frames, stats.reports, stats.events, parserStats.lostFrames, parserStats.crcErrors,
+            parserStats.encodingErrors + stats.recordErrors);
+}
+
+int main(int argc, char **argv)
+{
+    long baud = 1000000;
+    int  option;
+    while ((option = getopt(argc, argv, "b:q")) != -1) {
+        switch (option) {
+            case 'b':
+                baud = strtol(optarg, NULL, 10);
+                break;
+            case 'q':
+                quiet = true;
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-b baud] [-q] <device | ->\n", argv[0]);
+                return 1;
+        }
+    }
+    if (optind != argc - 1) {
+        fprintf(stderr, "usage: %s [-b baud] [-q] <device | ->\n", argv[0]);
+        return 1;
+    }
+
+    int fd = openInput(argv[optind], baud);
+    if (fd < 0) {
+        return 1;
+    }
+
+    FramePrinter                    printer;
+    UplinkFrameParser<FramePrinter> parser(printer);
+    uint8_t                         buffer[4096];
+    double                          start       = now();
+    double                          lastReport  = start;
+    unsigned long                   lastReports = 0;
+
+    for (;;) {
+        ssize_t length = read(fd, buffer, sizeof(buffer));
+        if (length < 0 && errno == EINTR) {
+            continue;
+        }
+        if (length <= 0) {
+            break;
+        }
+
+        parser.feed(buffer, length);
+
+        double current = now();
+        if (current - lastReport >= 1.0) {
+            printStats(parser.getStats(), current - lastReport, stats.reports - lastReports);
+            lastReport  = current;
+            lastReports = stats.reports;
+        }
+    }
+
+    fflush(stdout);
+    printStats(parser.getStats(), now() - start, stats.reports);
+    return 0;
+}
@@ -0,0 +1,663 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2006-2015 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Gateway aggregating the uplinks of several Eddystone observers into
+ * per-tag position and checkpoint crossing events.
+ *
+ * One reader thread per port decodes the frames and turns the records into
+ * sightings, with the observer time mapped to the host clock. The sightings
+ * are pushed into the lock-free queue of the shard owning the tag. Each
+ * shard thread keeps the state of its tags without locking, and fuses the
+ * sightings of all the observers: the position of a tag along the course is
+ * the RSSI-weighted centroid of the observers hearing it, and crossings
+ * reported by the observers are deduplicated into checkpoint events.
+ *
+ * Build it with:
+ *     g++ -std=c++17 -O2 -pthread -o uplink_gateway uplink_gateway.cpp
+ *
+ * Usage:
+ *     uplink_gateway [-b baud] [-s shards] [-d spacing] [-i interval] [-q] <port>...
+ * Observer i (in the order of the ports) is at i * spacing meters along the
+ * course. Statistics are printed on stderr every interval seconds, events on
+ * stdout unless -q is given.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <termios.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "../source/AdvertisingDataParser.h"
+#include "MpscQueue.h"
+#include "UplinkFramer.h"
+
+/* Sightings queued per shard */
+static const size_t   SHARD_QUEUE_SIZE         = 1 << 16;
+/* Maximum number of observers */
+static const size_t   MAX_OBSERVERS            = 32;
+/* An observer that has not heard a tag for this long is ignored for its
+ * position */
+static const int64_t  SIGHTING_TIMEOUT_MSEC    = 2000;
+/* Minimum interval between two position events of a tag */
+static const int64_t  POSITION_INTERVAL_MSEC   = 100;
+/* Crossings of a tag at the same checkpoint closer than this are the same */
+static const int64_t  CROSSING_DEDUP_MSEC      = 5000;
+/* Log-distance path loss model used to weigh the observers */
+static const double   RSSI_AT_1M               = -59.0;
+static const double   PATH_LOSS_EXPONENT       = 2.0;
+/* Weight of a new RSSI in the smoothed RSSI of a tag at an observer */
+static const float    RSSI_SMOOTHING_WEIGHT    = 0.25f;
+
+enum SightingKind_t {
+    SIGHTING_REPORT,
+    SIGHTING_FOUND,
+    SIGHTING_LOST,
+    SIGHTING_CROSSING
+};
+
+/**
+ * Tag identifier: an address, or an Eddystone-UID namespace and instance.
+ */
+struct TagKey_t {
+    uint8_t type;
+    uint8_t id[16];
+
+    bool operator==(const TagKey_t &other) const
+    {
+        return memcmp(this, &other, sizeof(TagKey_t)) == 0;
+    }
+};
+
+struct TagKeyHash {
+    size_t operator()(const TagKey_t &key) const
+    {
+        /* FNV-1a */
+        uint64_t hash = 14695981039346656037ULL;
+        const uint8_t *bytes = (const uint8_t *) &key;
+        for (size_t i = 0; i < sizeof(TagKey_t); i++) {
+            hash = (hash ^ bytes[i]) * 1099511628211ULL;
+        }
+        return hash;
+    }
+};
+
+/**
+ * A record of an observer about a tag, passed from a reader to a shard.
+ */
+struct Sighting_t {
+    TagKey_t key;
+    uint8_t  kind;
+    uint8_t  observer;
+    int8_t   rssi;
+    /* Observer time of the record mapped to the host clock, milliseconds */
+    int64_t  hostTime;
+    /* Host clock when the bytes of the record were read, nanoseconds */
+    int64_t  readTime;
+};
+
+static int64_t steadyNanoseconds(void)
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static bool              quiet = false;
+static std::mutex        outputMutex;
+static std::atomic<bool> readersDone(false);
+
+/**
+ * A shard of the tag table, owned by one thread.
+ */
+class Shard
+{
+public:
+    Shard(const std::vector<double> &observerPositionsIn) :
+        queue(SHARD_QUEUE_SIZE),
+        observerPositions(observerPositionsIn),
+        sightings(0),
+        events(0)
+    {
+    }
+
+    /**
+     * Add a sighting, from a reader thread. Waits while the queue is full.
+     *
+     * @return The number of times the queue was found full.
+     */
+    unsigned push(const Sighting_t &sighting)
+    {
+        unsigned waits = 0;
+        while (!queue.push(sighting)) {
+            waits++;
+            std::this_thread::yield();
+        }
+        return waits;
+    }
+
+    /**
+     * Process sightings until the readers are done and the queue is empty.
+     */
+    void run(void)
+    {
+        Sighting_t sighting;
+        unsigned   idle = 0;
+        for (;;) {
+            if (queue.pop(sighting)) {
+                process(sighting);
+                idle = 0;
+            } else if (readersDone.load(std::memory_order_acquire) && !queue.pop(sighting)) {
+                break;
+            } else if (++idle < 64) {
+                std::this_thread::yield();
+            } else {
+                std::this_thread::sleep_for(std::chrono::microseconds(50));
+            }
+        }
+    }
+
+    /**
+     * Move out the latency samples collected since the last call.
+     */
+    void takeLatencies(std::vector<int64_t> &pipeline, std::vector<int64_t> &endToEnd)
+    {
+        std::lock_guard<std::mutex> lock(latencyMutex);
+        pipeline.insert(pipeline.end(), pipelineLatencies.begin(), pipelineLatencies.end());
+        endToEnd.insert(endToEnd.end(), endToEndLatencies.begin(), endToEndLatencies.end());
+        pipelineLatencies.clear();
+        endToEndLatencies.clear();
+    }
+
+    std::atomic<unsigned long> *getSightings(void)
+    {
+        return &sightings;
+    }
+
+    std::atomic<unsigned long> *getEvents(void)
+    {
+        return &events;
+    }
+
+private:
+    struct ObserverState_t {
+        float   rssi;
+        int64_t lastSeen;
+        bool    valid;
+    };
+
+    struct TagState_t {
+        ObserverState_t observers[MAX_OBSERVERS];
+        int64_t         lastPosition;
+        int64_t         lastCrossing[MAX_OBSERVERS];
+    };
+
+    void process(const Sighting_t &sighting)
+    {
+        sightings.fetch_add(1, std::memory_order_relaxed);
+
+        std::unordered_map<TagKey_t, TagState_t, TagKeyHash>::iterator it = tags.find(sighting.key);
+        if (it == tags.end()) {
+            TagState_t state;
+            memset(&state, 0, sizeof(state));
+            state.lastPosition = INT64_MIN / 2;
+            for (size_t i = 0; i < MAX_OBSERVERS; i++) {
+                state.lastCrossing[i] = INT64_MIN / 2;
+            }
+            it = tags.insert(std::make_pair(sighting.key, state)).first;
+        }
+        TagState_t      &tag      = it->second;
+        ObserverState_t &observer = tag.observers[sighting.observer];
+
+        switch (sighting.kind) {
+            case SIGHTING_REPORT:
+                if (observer.valid && sighting.hostTime - observer.lastSeen < SIGHTING_TIMEOUT_MSEC) {
+                    observer.rssi += RSSI_SMOOTHING_WEIGHT * (sighting.rssi - observer.rssi);
+                } else {
+                    observer.rssi = sighting.rssi;
+                }
+                observer.lastSeen = sighting.hostTime;
+                observer.valid    = true;
+                if (sighting.hostTime - tag.lastPosition >= POSITION_INTERVAL_MSEC) {
+                    tag.lastPosition = sighting.hostTime;
+                    emitPosition(sighting, tag);
+                }
+                break;
+
+            case SIGHTING_LOST:
+                observer.valid = false;
+                break;
+
+            case SIGHTING_CROSSING:
+                if (sighting.hostTime - tag.lastCrossing[sighting.observer] >= CROSSING_DEDUP_MSEC) {
+                    tag.lastCrossing[sighting.observer] = sighting.hostTime;
+                    emitCrossing(sighting);
+                }
+                break;
+
+            default:
+                break;
+        }
+    }
+
+    void emitPosition(const Sighting_t &sighting, const TagState_t &tag)
+    {
+        double weights  = 0;
+        double position = 0;
+        for (size_t i = 0; i < observerPositions.size(); i++) {
+            const ObserverState_t &observer = tag.observers[i];
+            if (!observer.valid || sighting.hostTime - observer.lastSeen >= SIGHTING_TIMEOUT_MSEC) {
+                continue;
+            }
+            double distance = pow(10.0, (RSSI_AT_1M - observer.rssi) / (10.0 * PATH_LOSS_EXPONENT));
+            double weight   = 1.0 / (distance * distance);
+            weights  += weight;
+            position += weight * observerPositions[i];
+        }
+        if (weights == 0) {
+            return;
+        }
+        position /= weights;
+
+        int64_t now = steadyNanoseconds();
+        recordLatency(now - sighting.readTime, now / 1000000 - sighting.hostTime);
+        if (!quiet) {
+            std::lock_guard<std::mutex> lock(outputMutex);
+            printf("position ");
+            printKey(sighting.key);
+            printf(" %.1f m at %lld\n", position, (long long) sighting.hostTime);
+        }
+    }
+
+    void emitCrossing(const Sighting_t &sighting)
+    {
+        int64_t now = steadyNanoseconds();
+        recordLatency(now - sighting.readTime, -1);
+        if (!quiet) {
+            std::lock_guard<std::mutex> lock(outputMutex);
+            printf("crossing ");
+            printKey(sighting.key);
+            printf(" checkpoint %u at %lld, peak rssi %d\n", sighting.observer, (long long) sighting.hostTime, sighting.rssi);
+        }
+    }
+
+    void recordLatency(int64_t pipeline, int64_t endToEnd)
+    {
+        events.fetch_add(1, std::memory_order_relaxed);
+
+        std::lock_guard<std::mutex> lock(latencyMutex);
+        pipelineLatencies.push_back(pipeline);
+        if (endToEnd >= 0) {
+            endToEndLatencies.push_back(endToEnd);
+        }
+    }
+
+    static void printKey(const TagKey_t &key)
+    {
+        size_t length = (key.type == 2) ? sizeof(key.id) : 6;
+        for (size_t i = 0; i < length; i++) {
+            printf("%02x", key.id[i]);
+        }
+    }
+
+    MpscQueue<Sighting_t>                                 queue;
+    const std::vector<double>                            &observerPositions;
+    std::unordered_map<TagKey_t, TagState_t, TagKeyHash>  tags;
+    std::atomic<unsigned long>                            sightings;
+    std::atomic<unsigned long>                            events;
+    std::mutex                                            latencyMutex;
+    std::vector<int64_t>                                  pipelineLatencies;
+    std::vector<int64_t>                                  endToEndLatencies;
+};
+
+/**
+ * Reader of the uplink of one observer.
+ */
+class PortReader
+{
+public:
+    PortReader(uint8_t observerIn, int fdIn, std::vector<Shard *> &shardsIn) :
+        reports(0),
+        queueFullWaits(0),
+        lostFrames(0),
+        badFrames(0),
+        observer(observerIn),
+        fd(fdIn),
+        shards(shardsIn),
+        parser(*this),
+        synchronized(false),
+        lastObserverTime(0),
+        observerTimeHigh(0),
+        clockOffset(0),
+        readTime(0)
+    {
+    }
+
+    void run(void)
+    {
+        uint8_t buffer[4096];
+        for (;;) {
+            ssize_t length = read(fd, buffer, sizeof(buffer));
+            if (length < 0 && errno == EINTR) {
+                continue;
+            }
+            if (length <= 0) {
+                break;
+            }
+
+            readTime = steadyNanoseconds();
+            parser.feed(buffer, length);
+
+            const UplinkParserStats_t &stats = parser.getStats();
+            lostFrames.store(stats.lostFrames, std::memory_order_relaxed);
+            badFrames.store(stats.crcErrors + stats.encodingErrors, std::memory_order_relaxed);
+        }
+        close(fd);
+    }
+
+    /**
+     * Frame handler of the UplinkFrameParser.
+     */
+    void onFrame(uint8_t type, const uint8_t *records, size_t length, uint8_t count)
+    {
+        if (type == UPLINK_FRAME_SCAN_REPORTS) {
+            size_t offset = 0;
+            for (uint8_t i = 0; i < count && offset + sizeof(UplinkScanReport_t) <= length; i++) {
+                const UplinkScanReport_t *report = (const UplinkScanReport_t *) (records + offset);
+                offset += sizeof(UplinkScanReport_t);
+                if (offset + report->dataLength > length) {
+                    break;
+                }
+
+                Sighting_t sighting;
+                tagKeyFromReport(report, records + offset, sighting.key);
+                sighting.kind     = SIGHTING_REPORT;
+                sighting.rssi     = report->rssi;
+                sighting.hostTime = toHostTime(uplinkGetUint32(report->time));
+                dispatch(sighting);
+                offset += report->dataLength;
+                reports.fetch_add(1, std::memory_order_relaxed);
+            }
+        } else if (type == UPLINK_FRAME_BEACON_EVENTS && count * sizeof(UplinkBeaconEvent_t) <= length) {
+            for (uint8_t i = 0; i < count; i++) {
+                const UplinkBeaconEvent_t *event = (const UplinkBeaconEvent_t *) (records + i * sizeof(UplinkBeaconEvent_t));
+
+                Sighting_t sighting;
+                memset(&sighting.key, 0, sizeof(sighting.key));
+                sighting.key.type = event->keyType;
+                memcpy(sighting.key.id, event->id, (event->keyType == 2) ? sizeof(event->id) : 6);
+                sighting.kind     = (event->event == UPLINK_BEACON_FOUND) ? SIGHTING_FOUND :
+                                    (event->event == UPLINK_BEACON_LOST) ? SIGHTING_LOST : SIGHTING_CROSSING;
+                sighting.rssi     = event->rssi;
+                sighting.hostTime = toHostTime(uplinkGetUint32(event->time));
+                dispatch(sighting);
+            }
+        }
+    }
+
+    std::atomic<unsigned long> reports;
+    std::atomic<unsigned long> queueFullWaits;
+    std::atomic<unsigned long> lostFrames;
+    std::atomic<unsigned long> badFrames;
+
+private:
+    /**
+     * Identify a tag by its Eddystone-UID if the report carries one, or by
+     * its address.
+     */
+    static void tagKeyFromReport(const UplinkScanReport_t *report, const uint8_t *data, TagKey_t &key)
+    {
+        /* Frame type and TX power come before the namespace and instance */
+        static const uint8_t UID_OFFSET = 2;
+
+        const uint8_t *serviceData;
+        uint8_t        serviceDataLength;
+        memset(&key, 0, sizeof(key));
+        if (adFindServiceData(data, report->dataLength, 0xFEAA, serviceData, serviceDataLength) &&
+            serviceDataLength >= UID_OFFSET + sizeof(key.id) && serviceData[0] == 0x00) {
+            key.type = 2;
+            memcpy(key.id, serviceData + UID_OFFSET, sizeof(key.id));
+            return;
+        }
+        key.type = 1;
+        memcpy(key.id, report->peerAddr, sizeof(report->peerAddr));
+    }
+
+    /**
+     * Map an observer time to the host clock. The offset is the smallest
+     * difference seen between the reception time and the observer time, so
+     * it includes the smallest transmission latency.
+     */
+    int64_t toHostTime(uint32_t observerTime)
+    {
+        /* Extend the 32-bit observer time */
+        if (synchronized && observerTime < lastObserverTime && lastObserverTime - observerTime > 0x80000000UL) {
+            observerTimeHigh += 1LL << 32;
+        }
+        lastObserverTime = observerTime;
+        int64_t time     = observerTimeHigh + observerTime;
+
+        int64_t offset = readTime / 1000000 - time;
+        if (!synchronized || offset < clockOffset) {
+            clockOffset  = offset;
+            synchronized = true;
+        }
+        return time + clockOffset;
+    }
+
+    void dispatch(Sighting_t &sighting)
+    {
+        sighting.observer = observer;
+        sighting.readTime = readTime;
+        unsigned waits = shards[TagKeyHash()(sighting.key) % shards.size()]->push(sighting);
+        if (waits != 0) {
+            queueFullWaits.fetch_add(waits, std::memory_order_relaxed);
+        }
+    }
+
+    uint8_t                        observer;
+    int                            fd;
+    std::vector<Shard *>          &shards;
+    UplinkFrameParser<PortReader>  parser;
+    bool                           synchronized;
+    uint32_t                       lastObserverTime;
+    int64_t                        observerTimeHigh;
+    int64_t                        clockOffset;
+    int64_t                        readTime;
+};
+
+static speed_t baudToSpeed(long baud)
+{
+    switch (baud) {
+        case 115200:  return B115200;
+        case 230400:  return B230400;
+        case 460800:  return B460800;
+        case 921600:  return B921600;
+        case 1000000: return B1000000;
+        case 2000000: return B2000000;
+        default:      return B0;
+    }
+}
+
+static int openPort(const char *path, long baud)
+{
+    int fd = open(path, O_RDONLY | O_NOCTTY);
+    if (fd < 0) {
+        fprintf(stderr, "%s: %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    struct termios tio;
+    if (tcgetattr(fd, &tio) == 0) {
+        cfmakeraw(&tio);
+        tio.c_cc[VMIN]  = 1;
+        tio.c_cc[VTIME] = 0;
+        if (baudToSpeed(baud) != B0) {
+            cfsetispeed(&tio, baudToSpeed(baud));
+            cfsetospeed(&tio, baudToSpeed(baud));
+        }
+        tcsetattr(fd, TCSANOW, &tio);
+    }
+    return fd;
+}
+
+static int64_t percentile(std::vector<int64_t> &samples, double fraction)
+{
+    if (samples.empty()) {
+        return 0;
+    }
+    size_t index = std::min(samples.size() - 1, (size_t) (fraction * samples.size()));
+    std::nth_element(samples.begin(), samples.begin() + index, samples.end());
+    return samples[index];
+}
+
+static void printStats(std::vector<Shard *> &shards, std::vector<PortReader *> &readers, double elapsed,
+                       unsigned long &lastEvents, unsigned long &lastReports)
+{
+    std::vector<int64_t> pipeline, endToEnd;
+    unsigned long        events = 0, reports = 0, waits = 0, lost = 0, bad = 0;
+    for (size_t i = 0; i < shards.size(); i++) {
+        shards[i]->takeLatencies(pipeline, endToEnd);
+        events += shards[i]->getEvents()->load();
+    }
+    for (size_t i = 0; i < readers.size(); i++) {
+        reports += readers[i]->reports.load();
+        waits   += readers[i]->queueFullWaits.load();
+        lost    += readers[i]->lostFrames.load();
+        bad     += readers[i]->badFrames.load();
+    }
+
+    fprintf(stderr, "%.0f reports/s, %.0f events/s, pipeline latency p50 %lld us p99 %lld us p99.9 %lld us, "
+            "end-to-end p50 %lld ms p99 %lld ms, %lu lost frames, %lu bad frames, %lu queue full waits\n",
+            (reports - lastReports) / elapsed, (events - lastEvents) / elapsed,
+            (long long) percentile(pipeline, 0.5) / 1000, (long long) percentile(pipeline, 0.99) / 1000,
+            (long long) percentile(pipeline, 0.999) / 1000,
+            (long long) percentile(endToEnd, 0.5), (long long) percentile(endToEnd, 0.99), lost, bad, waits);
+    lastEvents  = events;
+    lastReports = reports;
+}
+
+int main(int argc, char **argv)
+{
+    long   baud      = 1000000;
+    size_t numShards = 4;
+    double spacing   = 50;
+    double interval  = 1;
+    int    option;
+    while ((option = getopt(argc, argv, "b:s:d:i:q")) != -1) {
+        switch (option) {
+            case 'b':
+                baud = strtol(optarg, NULL, 10);
+                break;
+            case 's':
+                numShards = std::max(1L, strtol(optarg, NULL, 10));
+                break;
+            case 'd':
+                spacing = atof(optarg);
+                break;
+            case 'i':
+                interval = atof(optarg);
+                break;
+            case 'q':
+                quiet = true;
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-b baud] [-s shards] [-d spacing] [-i interval] [-q] <port>...\n", argv[0]);
+                return 1;
+        }
+    }
+    size_t numPorts = argc - optind;
+    if (numPorts == 0 || numPorts > MAX_OBSERVERS) {
+        fprintf(stderr, "usage: %s [-b baud] [-s shards] [-d spacing] [-i interval] [-q] <port>...\n", argv[0]);
+        return 1;
+    }
+
+    std::vector<double> observerPositions;
+    for (size_t i = 0; i < numPorts; i++) {
+        observerPositions.push_back(i * spacing);
+    }
+
+    std::vector<Shard *>      shards;
+    std::vector<std::thread>  shardThreads;
+    for (size_t i = 0; i < numShards; i++) {
+        shards.push_back(new Shard(observerPositions));
+    }
+    for (size_t i = 0; i < numShards; i++) {
+        shardThreads.push_back(std::thread(&Shard::run, shards[i]));
+    }
+
+    std::vector<PortReader *> readers;
+    std::vector<std::thread>  readerThreads;
+    for (size_t i = 0; i < numPorts; i++) {
+        int fd = openPort(argv[optind + i], baud);
+        if (fd < 0) {
+            return 1;
+        }
+        readers.push_back(new PortReader(i, fd, shards));
+    }
+    for (size_t i = 0; i < numPorts; i++) {
+        readerThreads.push_back(std::thread(&PortReader::run, readers[i]));
+    }
+
+    /* Print statistics until every port is closed */
+    std::atomic<size_t> runningReaders(numPorts);
+    std::thread         waiter([&]() {
+        for (size_t i = 0; i < readerThreads.size(); i++) {
+            readerThreads[i].join();
+            runningReaders--;
+        }
+    });
+
+    unsigned long lastEvents  = 0;
+    unsigned long lastReports = 0;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::chrono::steady_clock::time_point last  = start;
+    while (runningReaders.load() != 0) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        double elapsed = std::chrono::duration<double>(now - last).count();
+        if (elapsed >= interval) {
+            printStats(shards, readers, elapsed, lastEvents, lastReports);
+            last = now;
+        }
+    }
+    waiter.join();
+
+    readersDone.store(true, std::memory_order_release);
+    for (size_t i = 0; i < shardThreads.size(); i++) {
+        shardThreads[i].join();
+    }
+
+    fflush(stdout);
+    unsigned long events = 0, reports = 0;
+    for (size_t i = 0; i < shards.size(); i++) {
+        events += shards[i]->getEvents()->load();
+    }
+    for (size_t i = 0; i < readers.size(); i++) {
+        reports += readers[i]->reports.load();
+    }
+    fprintf(stderr, "total: %lu reports, %lu events in %.1f s\n", reports, events,
+            std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+    return 0;
+}
@@ -0,0 +1,312 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2006-2015 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Simulator of a line of Eddystone observers watching tagged athletes run
+ * laps along a course, to exercise uplink_gateway without hardware.
+ *
+ * Each observer gets a pty, whose path is printed on the standard output.
+ * The tags advertise an Eddystone-UID frame every interval; the observers
+ * hear them with a log-distance path loss, Gaussian noise and random packet
+ * loss, and stream the scan reports and the crossings detected by the
+ * firmware CrossingDetector in uplink frames, in real time. Each observer
+ * clock has its own random offset.
+ *
+ * Build it with:
+ *     g++ -std=c++11 -O2 -I../source -o uplink_simulator uplink_simulator.cpp ../source/CrossingDetector.cpp -lutil
+ *
+ * Usage:
+ *     uplink_simulator [-n observers] [-a athletes] [-d spacing] [-r interval] [-t duration] [-w wait]
+ * For example:
+ *     ./uplink_simulator -n 12 > ports & sleep 0.2; ./uplink_gateway -q $(cat ports)
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <pty.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include <random>
+#include <vector>
+#include "CrossingDetector.h"
+#include "UplinkFramer.h"
+
+/* Simulation step, also the period frames are flushed at */
+static const int    STEP_MSEC            = 10;
+/* Log-distance path loss model */
+static const double RSSI_AT_1M           = -59.0;
+static const double PATH_LOSS_EXPONENT   = 2.0;
+static const double RSSI_NOISE_DB        = 3.0;
+static const double PACKET_LOSS          = 0.15;
+/* Weakest RSSI the observers receive */
+static const double SENSITIVITY_DBM      = -95.0;
+/* Course before the first observer and after the last one */
+static const double COURSE_MARGIN        = 40.0;
+/* Minimum RSSI of a crossing, as in the observer firmware */
+static const int8_t CROSSING_MIN_PEAK_RSSI = -75;
+
+struct Athlete_t {
+    double   position;
+    double   lateral;
+    double   speed;
+    double   nextAdvertisement;
+    uint8_t  address[6];
+    uint8_t  uid[16];
+};
+
+struct Observer_t {
+    int               master;
+    int               slave;
+    uint32_t          clockOffset;
+    UplinkFrameWriter writer;
+    unsigned long     reports;
+    unsigned long     crossings;
+};
+
+static double monotonicMilliseconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+/**
+ * Build the advertising payload of an Eddystone-UID tag.
+ */
+static uint8_t buildAdvertisement(const Athlete_t &athlete, uint8_t *data)
+{
+    uint8_t length = 0;
+    /* Flags */
+    data[length++] = 2;
+    data[length++] = 0x01;
+    data[length++] = 0x06;
+    /* Complete list of 16-bit UUIDs */
+    data[length++] = 3;
+    data[length++] = 0x03;
+    data[length++] = 0xAA;
+    data[length++] = 0xFE;
+    /* Service data: UID frame, TX power at 0 m, namespace, instance and RFU */
+    data[length++] = 23;
+    data[length++] = 0x16;
+    data[length++] = 0xAA;
+    data[length++] = 0xFE;
+    data[length++] = 0x00;
+    data[length++] = (uint8_t) -18;
+    memcpy(data + length, athlete.uid, sizeof(athlete.uid));
+    length += sizeof(athlete.uid);
+    data[length++] = 0;
+    data[length++] = 0;
+    return length;
+}
+
+static void addCrossing(Observer_t &observer, const Athlete_t &athlete, const CrossingDetector::Crossing_t &crossing)
+{
+    UplinkBeaconEvent_t *record =
+        (UplinkBeaconEvent_t *) observer.writer.reserveRecord(UPLINK_FRAME_BEACON_EVENTS, sizeof(UplinkBeaconEvent_t));
+
+    record->event   = UPLINK_BEACON_CROSSING;
+    record->keyType = 2;
+    memcpy(record->id, athlete.uid, sizeof(record->id));
+    uplinkPutUint32(record->time, crossing.time);
+    record->rssi    = crossing.peakRSSI;
+    uplinkPutUint32(record->count, 0);
+    observer.crossings++;
+}
+
+static bool writeOutput(Observer_t &observer)
+{
+    while (observer.writer.getOutputLength() != 0) {
+        ssize_t written = write(observer.master, observer.writer.getOutput(), observer.writer.getOutputLength());
+        if (written < 0 && errno == EINTR) {
+            continue;
+        }
+        if (written <= 0) {
+            return false;
+        }
+        observer.writer.consumeOutput(written);
+    }
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    int    numObservers = 12;
+    int    numAthletes  = 200;
+    double spacing      = 50;
+    double interval     = 100;
+    double duration     = 60;
+    double wait         = 1;
+    int    option;
+    while ((option = getopt(argc, argv, "n:a:d:r:t:w:")) != -1) {
+        switch (option) {
+            case 'n': numObservers = atoi(optarg); break;
+            case 'a': numAthletes  = atoi(optarg); break;
+            case 'd': spacing      = atof(optarg); break;
+            case 'r': interval     = atof(optarg); break;
+            case 't': duration     = atof(optarg); break;
+            case 'w': wait         = atof(optarg); break;
+            default:
+                fprintf(stderr, "usage: %s [-n observers] [-a athletes] [-d spacing] [-r interval] [-t duration] [-w wait]\n",
+                        argv[0]);
+                return 1;
+        }
+    }
+    if (numObservers <= 0 || numAthletes <= 0 || numAthletes > 0xFFFF || interval <= 0) {
+        fprintf(stderr, "invalid arguments\n");
+        return 1;
+    }
+
+    std::mt19937                           generator(1);
+    std::uniform_real_distribution<double> uniform(0, 1);
+    std::normal_distribution<double>       noise(0, RSSI_NOISE_DB);
+
+    /* Raw mode from the start, so that nothing is echoed back before the
+     * gateway opens the ports */
+    struct termios tio;
+    memset(&tio, 0, sizeof(tio));
+    cfmakeraw(&tio);
+    std::vector<Observer_t> observers(numObservers);
+    for (int i = 0; i < numObservers; i++) {
+        char path[64];
+        if (openpty(&observers[i].master, &observers[i].slave, path, &tio, NULL) != 0) {
+            fprintf(stderr, "openpty: %s\n", strerror(errno));
+            return 1;
+        }
+        observers[i].clockOffset = generator();
+        observers[i].reports     = 0;
+        observers[i].crossings   = 0;
+        printf("%s\n", path);
+    }
+    fflush(stdout);
+
+    double                 courseLength = (numObservers - 1) * spacing + 2 * COURSE_MARGIN;
+    std::vector<Athlete_t> athletes(numAthletes);
+    for (int j = 0; j < numAthletes; j++) {
+        Athlete_t &athlete = athletes[j];
+        athlete.position          = -COURSE_MARGIN + uniform(generator) * courseLength;
+        athlete.lateral           = 1 + 3 * uniform(generator);
+        athlete.speed             = 3 + 3 * uniform(generator);
+        athlete.nextAdvertisement = uniform(generator) * interval;
+        for (int k = 0; k < 6; k++) {
+            athlete.address[k] = (k < 2) ? (j >> (8 * k)) : 0xC0 + k;
+        }
+        memcpy(athlete.uid, "\x8b\x0c\xa7\x50\xe7\xa1\xe2\x7a\x2b\x4c", 10);
+        memset(athlete.uid + 10, 0, 4);
+        athlete.uid[14] = j >> 8;
+        athlete.uid[15] = j;
+    }
+
+    CrossingDetector                        detector(CROSSING_MIN_PEAK_RSSI);
+    std::vector<CrossingDetector::Track_t>  tracks(numObservers * numAthletes);
+    for (size_t i = 0; i < tracks.size(); i++) {
+        detector.reset(tracks[i]);
+    }
+
+    usleep(wait * 1e6);
+
+    double        start    = monotonicMilliseconds();
+    double        time     = 0;
+    unsigned long lateSteps = 0;
+    while (time < duration * 1000) {
+        double stepEnd = time + STEP_MSEC;
+
+        for (int j = 0; j < numAthletes; j++) {
+            Athlete_t &athlete = athletes[j];
+            for (; athlete.nextAdvertisement < stepEnd; athlete.nextAdvertisement += interval + 10 * uniform(generator)) {
+                double advertisementTime = start + athlete.nextAdvertisement;
+                double position          = athlete.position + athlete.speed * (athlete.nextAdvertisement - time) / 1000;
+
+                for (int i = 0; i < numObservers; i++) {
+                    double along = position - i * spacing;
+                    if (fabs(along) > 100 || uniform(generator) < PACKET_LOSS) {
+                        continue;
+                    }
+                    double distance = sqrt(along * along + athlete.lateral * athlete.lateral);
+                    double rssi     = RSSI_AT_1M - 10 * PATH_LOSS_EXPONENT * log10(distance) + noise(generator);
+                    if (rssi < SENSITIVITY_DBM) {
+                        continue;
+                    }
+
+                    Observer_t &observer     = observers[i];
+                    uint32_t    observerTime = (uint32_t) (int64_t) advertisementTime + observer.clockOffset;
+                    int8_t      sampleRSSI   = (int8_t) lround(rssi);
+
+                    uint8_t data[31];
+                    uint8_t dataLength = buildAdvertisement(athlete, data);
+                    uint8_t *record    = observer.writer.reserveRecord(UPLINK_FRAME_SCAN_REPORTS,
+                                                                       sizeof(UplinkScanReport_t) + dataLength);
+                    UplinkScanReport_t *report = (UplinkScanReport_t *) record;
+                    uplinkPutUint32(report->time, observerTime);
+                    memcpy(report->peerAddr, athlete.address, sizeof(report->peerAddr));
+                    report->rssi       = sampleRSSI;
+                    report->flags      = 0;
+                    report->dataLength = dataLength;
+                    memcpy(record + sizeof(UplinkScanReport_t), data, dataLength);
+                    observer.reports++;
+
+                    CrossingDetector::Crossing_t crossing;
+                    if (detector.addSample(tracks[i * numAthletes + j], observerTime, sampleRSSI, crossing)) {
+                        addCrossing(observer, athlete, crossing);
+                    }
+                }
+            }
+
+            athlete.position += athlete.speed * STEP_MSEC / 1000;
+            if (athlete.position > courseLength - COURSE_MARGIN) {
+                athlete.position -= courseLength;
+            }
+        }
+
+        for (int i = 0; i < numObservers; i++) {
+            Observer_t &observer = observers[i];
+            uint32_t    now      = (uint32_t) (int64_t) (start + stepEnd) + observer.clockOffset;
+            for (int j = 0; j < numAthletes; j++) {
+                CrossingDetector::Crossing_t crossing;
+                if (detector.checkTimeout(tracks[i * numAthletes + j], now, crossing)) {
+                    addCrossing(observer, athletes[j], crossing);
+                }
+            }
+            observer.writer.closeFrame();
+            if (!writeOutput(observer)) {
+                fprintf(stderr, "observer %d: %s\n", i, strerror(errno));
+                return 1;
+            }
+        }
+
+        /* Run in real time */
+        time = stepEnd;
+        double late = monotonicMilliseconds() - (start + time);
+        if (late < 0) {
+            usleep(-late * 1000);
+        } else if (late > STEP_MSEC) {
+            lateSteps++;
+        }
+    }
+
+    unsigned long reports = 0, crossings = 0;
+    for (int i = 0; i < numObservers; i++) {
+        reports   += observers[i].reports;
+        crossings += observers[i].crossings;
+        close(observers[i].master);
+        close(observers[i].slave);
+    }
+    fprintf(stderr, "%lu reports (%.0f/s), %lu crossings, %lu steps late\n", reports, reports / duration, crossings, lateSteps);
+    return 0;
+}
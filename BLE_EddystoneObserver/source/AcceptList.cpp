@@ -0,0 +1,137 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2006-2015 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "AcceptList.h"
+#include "AdvertisingDataParser.h"
+
+AcceptList::AcceptList(void) :
+    numAddresses(0),
+    numNamespaces(0),
+    numWhitelistedAddresses(0)
+{
+}
+
+bool AcceptList::addAddress(const BLEProtocol::AddressBytes_t address)
+{
+    if (findAddress(address) != numAddresses) {
+        return true;
+    } else if (numAddresses == MAX_ADDRESSES) {
+        return false;
+    }
+
+    memcpy(addresses[numAddresses++], address, sizeof(BLEProtocol::AddressBytes_t));
+    return true;
+}
+
+bool AcceptList::addNamespace(const uint8_t *namespaceID)
+{
+    if (numNamespaces == MAX_NAMESPACES) {
+        return false;
+    }
+
+    memcpy(namespaces[numNamespaces++], namespaceID, NAMESPACE_ID_SIZE);
+    return true;
+}
+
+bool AcceptList::isEmpty(void) const
+{
+    return (numAddresses == 0) && (numNamespaces == 0);
+}
+
+bool AcceptList::hasNamespaces(void) const
+{
+    return numNamespaces != 0;
+}
+
+bool AcceptList::accepts(const AdvertisementReport_t *report)
+{
+    if (isEmpty() || findAddress(report->peerAddr) != numAddresses) {
+        return true;
+    }
+
+    if (hasAcceptedNamespace(report)) {
+        /* Resolve the namespace to this address so that the beacon can be
+         * filtered by the controller from now on */
+        addAddress(report->peerAddr);
+        return true;
+    }
+    return false;
+}
+
+bool AcceptList::isWhitelistStale(void) const
+{
+    return numWhitelistedAddresses != numAddresses;
+}
+
+bool AcceptList::programWhitelist(Gap &gap)
+{
+    /* Don't retry before the list changes if the whitelist can't be used */
+    numWhitelistedAddresses = numAddresses;
+
+    if (numAddresses == 0 || numAddresses > gap.getMaxWhitelistSize()) {
+        return false;
+    }
+
+    /* The advertisement callback does not report the peer address type,
+     * beacons normally use a random static address */
+    BLEProtocol::Address_t whitelistAddresses[MAX_ADDRESSES];
+    for (uint8_t i = 0; i < numAddresses; i++) {
+        whitelistAddresses[i].type = BLEProtocol::AddressType::RANDOM_STATIC;
+        memcpy(whitelistAddresses[i].address, addresses[i], sizeof(BLEProtocol::AddressBytes_t));
+    }
+
+    Gap::Whitelist_t whitelist;
+    whitelist.addresses = whitelistAddresses;
+    whitelist.size      = numAddresses;
+    whitelist.capacity  = MAX_ADDRESSES;
+    if (gap.setWhitelist(whitelist) != BLE_ERROR_NONE) {
+        return false;
+    }
+    return true;
+}
+
+uint8_t AcceptList::findAddress(const BLEProtocol::AddressBytes_t address) const
+{
+    uint8_t i;
+    for (i = 0; i < numAddresses; i++) {
+        if (memcmp(addresses[i], address, sizeof(BLEProtocol::AddressBytes_t)) == 0) {
+            break;
+        }
+    }
+    return i;
+}
+
+bool AcceptList::hasAcceptedNamespace(const AdvertisementReport_t *report) const
+{
+    static const uint16_t EDDYSTONE_UUID      = 0xFEAA;
+    static const uint8_t  FRAME_TYPE_UID      = 0x00;
+    /* Frame type and ranging data come before the namespace */
+    static const uint8_t  NAMESPACE_ID_OFFSET = 2;
+
+    const uint8_t *serviceData;
+    uint8_t        serviceDataLength;
+    if (!adFindServiceData(report->advertisingData, report->advertisingDataLen, EDDYSTONE_UUID, serviceData, serviceDataLength) ||
+        serviceDataLength < NAMESPACE_ID_OFFSET + NAMESPACE_ID_SIZE || serviceData[0] != FRAME_TYPE_UID) {
+        return false;
+    }
+
+    for (uint8_t i = 0; i < numNamespaces; i++) {
+        if (memcmp(serviceData + NAMESPACE_ID_OFFSET, namespaces[i], NAMESPACE_ID_SIZE) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
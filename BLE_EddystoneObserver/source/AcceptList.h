@@ -0,0 +1,162 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2006-2015 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __ACCEPTLIST_H__
+#define __ACCEPTLIST_H__
+
+#include "ble/BLE.h"
+#include "AdvertisementRing.h"
+
+/**
+ * Class that holds the beacons the observer is interested in. Beacons are
+ * accepted by address, or by Eddystone-UID namespace: the address of a beacon
+ * advertising an accepted namespace is added to the list the first time it is
+ * heard.
+ *
+ * The addresses are programmed into the controller whitelist when the BLE
+ * stack supports it, so that the application is only woken up for accepted
+ * beacons. Otherwise advertisements are filtered in software.
+ */
+class AcceptList
+{
+public:
+    /**
+     * The maximum number of accepted addresses, including the ones resolved
+     * from namespaces.
+     */
+    static const uint8_t MAX_ADDRESSES     = 16;
+    /**
+     * The maximum number of accepted Eddystone-UID namespaces.
+     */
+    static const uint8_t MAX_NAMESPACES    = 4;
+    /**
+     * The size in bytes of an Eddystone-UID namespace ID.
+     */
+    static const uint8_t NAMESPACE_ID_SIZE = 10;
+
+    /**
+     * Construct an empty accept list, which accepts every advertisement.
+     */
+    AcceptList(void);
+
+    /**
+     * Accept the advertisements of a beacon.
+     *
+     * @param[in] address
+     *              The address of the beacon.
+     *
+     * @return true if the address is in the list, false if the list is full.
+     */
+    bool addAddress(const BLEProtocol::AddressBytes_t address);
+
+    /**
+     * Accept the advertisements of the beacons that advertise an
+     * Eddystone-UID namespace.
+     *
+     * @param[in] namespaceID
+     *              The NAMESPACE_ID_SIZE bytes of the namespace.
+     *
+     * @return true if the namespace is in the list, false if the list is
+     *         full.
+     */
+    bool addNamespace(const uint8_t *namespaceID);
+
+    /**
+     * Check whether the list is empty, in which case every advertisement is
+     * accepted.
+     *
+     * @return true if no address or namespace was added.
+     */
+    bool isEmpty(void) const;
+
+    /**
+     * Check whether some namespaces were added. The beacons using them can
+     * only be discovered while the controller does not filter
+     * advertisements.
+     *
+     * @return true if at least one namespace was added.
+     */
+    bool hasNamespaces(void) const;
+
+    /**
+     * Filter an advertisement report in software. An Eddystone-UID advertisement of
+     * an accepted namespace adds its sender to the accepted addresses.
+     *
+     * @param[in] report
+     *              The advertisement report received.
+     *
+     * @return true if the advertisement is accepted.
+     */
+    bool accepts(const AdvertisementReport_t *report);
+
+    /**
+     * Check whether addresses were added since programWhitelist() was last
+     * called.
+     *
+     * @return true if programWhitelist() should be called again.
+     */
+    bool isWhitelistStale(void) const;
+
+    /**
+     * Program the accepted addresses into the controller whitelist.
+     *
+     * @param[in] gap
+     *              The Gap instance of the BLE stack.
+     *
+     * @return true if the whitelist holds every accepted address and can be
+     *         used to filter scans, false if advertisements must be
+     *         filtered in software.
+     */
+    bool programWhitelist(Gap &gap);
+
+private:
+    /**
+     * Find an address in the list.
+     *
+     * @return The index of the address, or numAddresses if it is not in the
+     *         list.
+     */
+    uint8_t findAddress(const BLEProtocol::AddressBytes_t address) const;
+
+    /**
+     * Check whether an advertisement report carries an Eddystone-UID frame with an
+     * accepted namespace.
+     */
+    bool hasAcceptedNamespace(const AdvertisementReport_t *report) const;
+
+    /**
+     * The accepted addresses.
+     */
+    BLEProtocol::AddressBytes_t addresses[MAX_ADDRESSES];
+    /**
+     * The number of valid entries in addresses.
+     */
+    uint8_t                     numAddresses;
+    /**
+     * The accepted Eddystone-UID namespaces.
+     */
+    uint8_t                     namespaces[MAX_NAMESPACES][NAMESPACE_ID_SIZE];
+    /**
+     * The number of valid entries in namespaces.
+     */
+    uint8_t                     numNamespaces;
+    /**
+     * The number of addresses when programWhitelist() was last called.
+     */
+    uint8_t                     numWhitelistedAddresses;
+};
+
+#endif  /* __ACCEPTLIST_H__ */
@@ -0,0 +1,145 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2006-2015 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __ADVERTISEMENTRING_H__
+#define __ADVERTISEMENTRING_H__
+
+#include <string.h>
+#include "ble/BLE.h"
+#include "hal/us_ticker_api.h"
+
+/**
+ * A raw advertisement report, as copied out of the scan callback.
+ */
+struct AdvertisementReport_t {
+    /**
+     * The us_ticker time at which the report was received.
+     */
+    uint32_t                    timestamp;
+    BLEProtocol::AddressBytes_t peerAddr;
+    int8_t                      rssi;
+    uint8_t                     isScanResponse;
+    uint8_t                     type;
+    uint8_t                     advertisingDataLen;
+    uint8_t                     advertisingData[GapAdvertisingData::GAP_ADVERTISING_DATA_MAX_PAYLOAD];
+};
+
+/**
+ * Fixed-slot ring of advertisement reports with a single producer, the scan
+ * callback, and a single consumer, the job that parses the reports. The
+ * producer only writes head and the consumer only writes tail, so push() is
+ * safe to call from interrupt context without a critical section.
+ *
+ * Reports are dropped, and counted, when the ring is full.
+ *
+ * @tparam SLOTS
+ *              The number of reports the ring can hold, a power of two.
+ */
+template <unsigned SLOTS>
+class AdvertisementRing
+{
+public:
+    /**
+     * Construct an empty ring.
+     */
+    AdvertisementRing(void) : head(0), tail(0), dropped(0)
+    {
+    }
+
+    /**
+     * Copy a scan report into the ring.
+     *
+     * @param[in] params
+     *              The advertisement received.
+     *
+     * @return true if the report was queued, false if it was dropped.
+     */
+    bool push(const Gap::AdvertisementCallbackParams_t *params)
+    {
+        uint32_t index = head;
+        if (index - tail == SLOTS) {
+            dropped++;
+            return false;
+        }
+
+        AdvertisementReport_t &report = reports[index & (SLOTS - 1)];
+        report.timestamp              = us_ticker_read();
+        memcpy(report.peerAddr, params->peerAddr, sizeof(report.peerAddr));
+        report.rssi                   = params->rssi;
+        report.isScanResponse         = params->isScanResponse;
+        report.type                   = params->type;
+        report.advertisingDataLen     = (params->advertisingDataLen < sizeof(report.advertisingData)) ?
+                                        params->advertisingDataLen : sizeof(report.advertisingData);
+        memcpy(report.advertisingData, params->advertisingData, report.advertisingDataLen);
+
+        /* Publish the slot only once it is filled in */
+        head = index + 1;
+        return true;
+    }
+
+    /**
+     * Get the oldest report in the ring. It stays valid until pop() is
+     * called.
+     *
+     * @return The oldest report, or NULL if the ring is empty.
+     */
+    const AdvertisementReport_t *front(void) const
+    {
+        if (tail == head) {
+            return NULL;
+        }
+        return &reports[tail & (SLOTS - 1)];
+    }
+
+    /**
+     * Release the oldest report, returned by front().
+     */
+    void pop(void)
+    {
+        tail = tail + 1;
+    }
+
+    /**
+     * Get the number of reports dropped because the ring was full.
+     *
+     * @return The number of dropped reports since construction.
+     */
+    uint32_t getDropped(void) const
+    {
+        return dropped;
+    }
+
+private:
+    /**
+     * The report slots, indexed by the free-running head and tail counters
+     * modulo SLOTS.
+     */
+    AdvertisementReport_t reports[SLOTS];
+    /**
+     * The number of reports pushed, only written by the producer.
+     */
+    volatile uint32_t     head;
+    /**
+     * The number of reports popped, only written by the consumer.
+     */
+    volatile uint32_t     tail;
+    /**
+     * The number of reports dropped, only written by the producer.
+     */
+    volatile uint32_t     dropped;
+};
+
+#endif  /* __ADVERTISEMENTRING_H__ */
@@ -0,0 +1,298 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2006-2015 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __ADVERTISINGDATAPARSER_H__
+#define __ADVERTISINGDATAPARSER_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * AD types used by the helpers, with the values of
+ * GapAdvertisingData::DataType_t. This header does not depend on the BLE API
+ * so that it can also be used by host tools.
+ */
+static const uint8_t AD_TYPE_INCOMPLETE_LIST_16BIT_SERVICE_IDS = 0x02;
+static const uint8_t AD_TYPE_COMPLETE_LIST_16BIT_SERVICE_IDS   = 0x03;
+static const uint8_t AD_TYPE_SHORTENED_LOCAL_NAME              = 0x08;
+static const uint8_t AD_TYPE_COMPLETE_LOCAL_NAME               = 0x09;
+static const uint8_t AD_TYPE_SERVICE_DATA                      = 0x16;
+static const uint8_t AD_TYPE_MANUFACTURER_SPECIFIC_DATA        = 0xFF;
+
+/**
+ * Iterate over the AD structures of an advertising payload or scan
+ * response, without copying them.
+ *
+ * Each AD structure is a length byte, which counts the type and the value,
+ * a type byte and the value. A zero length ends the payload, the rest is
+ * padding. Iteration stops at the first structure that overruns the
+ * payload, and isMalformed() then returns true.
+ *
+ * Usage:
+ *     AdStructureIterator it(data, length);
+ *     while (it.next()) {
+ *         ... it.getType(), it.getValue(), it.getLength() ...
+ *     }
+ */
+class AdStructureIterator
+{
+public:
+    /**
+     * Construct an iterator placed before the first AD structure.
+     *
+     * @param[in] data
+     *              The advertising payload.
+     * @param[in] length
+     *              The length of the payload.
+     */
+    AdStructureIterator(const uint8_t *data, size_t length) :
+        data(data),
+        length(length),
+        offset(0),
+        type(0),
+        value(NULL),
+        valueLength(0),
+        malformed(false)
+    {
+    }
+
+    /**
+     * Move to the next AD structure.
+     *
+     * @return true if there is one, false at the end of the payload.
+     */
+    bool next(void)
+    {
+        if (offset >= length) {
+            return false;
+        }
+
+        uint8_t structureLength = data[offset];
+        if (structureLength == 0) {
+            offset = length;
+            return false;
+        }
+        if (structureLength > length - offset - 1) {
+            malformed = true;
+            offset    = length;
+            return false;
+        }
+
+        type        = data[offset + 1];
+        value       = data + offset + 2;
+        valueLength = structureLength - 1;
+        offset     += structureLength + 1;
+        return true;
+    }
+
+    /**
+     * Get the AD type of the current structure.
+     */
+    uint8_t getType(void) const
+    {
+        return type;
+    }
+
+    /**
+     * Get the value of the current structure, which points into the payload.
+     */
+    const uint8_t *getValue(void) const
+    {
+        return value;
+    }
+
+    /**
+     * Get the length of the value of the current structure.
+     */
+    uint8_t getLength(void) const
+    {
+        return valueLength;
+    }
+
+    /**
+     * Whether iteration stopped on a structure overrunning the payload.
+     */
+    bool isMalformed(void) const
+    {
+        return malformed;
+    }
+
+private:
+    const uint8_t *data;
+    size_t         length;
+    size_t         offset;
+    uint8_t        type;
+    const uint8_t *value;
+    uint8_t        valueLength;
+    bool           malformed;
+};
+
+/**
+ * Find the first AD structure of a type.
+ *
+ * @param[in] data
+ *              The advertising payload.
+ * @param[in] length
+ *              The length of the payload.
+ * @param[in] type
+ *              The AD type to look for.
+ * @param[out] value
+ *              The value of the structure found.
+ * @param[out] valueLength
+ *              The length of the value.
+ *
+ * @return true if a structure was found.
+ */
+inline bool adFind(const uint8_t *data, size_t length, uint8_t type, const uint8_t *&value, uint8_t &valueLength)
+{
+    AdStructureIterator it(data, length);
+    while (it.next()) {
+        if (it.getType() == type) {
+            value       = it.getValue();
+            valueLength = it.getLength();
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Find the service data of a 16-bit service UUID.
+ *
+ * @param[in] data
+ *              The advertising payload.
+ * @param[in] length
+ *              The length of the payload.
+ * @param[in] uuid
+ *              The 16-bit service UUID.
+ * @param[out] value
+ *              The service data following the UUID.
+ * @param[out] valueLength
+ *              The length of the service data.
+ *
+ * @return true if service data was found for the UUID.
+ */
+inline bool adFindServiceData(const uint8_t *data, size_t length, uint16_t uuid, const uint8_t *&value, uint8_t &valueLength)
+{
+    AdStructureIterator it(data, length);
+    while (it.next()) {
+        const uint8_t *structure = it.getValue();
+        if (it.getType() == AD_TYPE_SERVICE_DATA && it.getLength() >= 2 &&
+            (structure[0] | (structure[1] << 8)) == uuid) {
+            value       = structure + 2;
+            valueLength = it.getLength() - 2;
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Find the local name of a device, the complete one if there is one, else
+ * the shortened one.
+ *
+ * @param[in] data
+ *              The advertising payload.
+ * @param[in] length
+ *              The length of the payload.
+ * @param[out] name
+ *              The name, not NUL terminated.
+ * @param[out] nameLength
+ *              The length of the name.
+ * @param[out] complete
+ *              Whether the name is the complete one.
+ *
+ * @return true if a name was found.
+ */
+inline bool adFindLocalName(const uint8_t *data, size_t length, const uint8_t *&name, uint8_t &nameLength, bool &complete)
+{
+    bool                found = false;
+    AdStructureIterator it(data, length);
+    while (it.next()) {
+        if (it.getType() == AD_TYPE_COMPLETE_LOCAL_NAME ||
+            (it.getType() == AD_TYPE_SHORTENED_LOCAL_NAME && !found)) {
+            name       = it.getValue();
+            nameLength = it.getLength();
+            complete   = (it.getType() == AD_TYPE_COMPLETE_LOCAL_NAME);
+            found      = true;
+            if (complete) {
+                break;
+            }
+        }
+    }
+    return found;
+}
+
+/**
+ * Whether a 16-bit service UUID is in the complete or incomplete list of
+ * services of a payload.
+ *
+ * @param[in] data
+ *              The advertising payload.
+ * @param[in] length
+ *              The length of the payload.
+ * @param[in] uuid
+ *              The 16-bit service UUID.
+ *
+ * @return true if the service is listed.
+ */
+inline bool adHasServiceUUID(const uint8_t *data, size_t length, uint16_t uuid)
+{
+    AdStructureIterator it(data, length);
+    while (it.next()) {
+        if (it.getType() != AD_TYPE_INCOMPLETE_LIST_16BIT_SERVICE_IDS && it.getType() != AD_TYPE_COMPLETE_LIST_16BIT_SERVICE_IDS) {
+            continue;
+        }
+        for (uint8_t i = 0; i + 1 < it.getLength(); i += 2) {
+            if ((it.getValue()[i] | (it.getValue()[i + 1] << 8)) == uuid) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+/**
+ * Find the manufacturer specific data.
+ *
+ * @param[in] data
+ *              The advertising payload.
+ * @param[in] length
+ *              The length of the payload.
+ * @param[out] companyID
+ *              The company identifier.
+ * @param[out] value
+ *              The data following the company identifier.
+ * @param[out] valueLength
+ *              The length of the data.
+ *
+ * @return true if manufacturer specific data was found.
+ */
+inline bool adFindManufacturerData(const uint8_t *data, size_t length, uint16_t &companyID, const uint8_t *&value, uint8_t &valueLength)
+{
+    const uint8_t *structure;
+    uint8_t        structureLength;
+    if (!adFind(data, length, AD_TYPE_MANUFACTURER_SPECIFIC_DATA, structure, structureLength) || structureLength < 2) {
+        return false;
+    }
+
+    companyID   = structure[0] | (structure[1] << 8);
+    value       = structure + 2;
+    valueLength = structureLength - 2;
+    return true;
+}
+
+#endif  /* __ADVERTISINGDATAPARSER_H__ */
@@ -0,0 +1,208 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2006-2015 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "BeaconTable.h"
+
+BeaconTable::BeaconTable(uint32_t timeoutMsec, ExpiryCallback_t onExpiryIn) :
+    freeList(0),
+    numBeacons(0),
+    currentTick(0),
+    timeout(timeoutMsec),
+    onExpiry(onExpiryIn)
+{
+    if (timeout > (WHEEL_SLOTS - 1) * TICK_MSEC) {
+        timeout = (WHEEL_SLOTS - 1) * TICK_MSEC;
+    }
+
+    for (uint16_t i = 0; i < MAX_BEACONS; i++) {
+        pool[i].key.type = KEY_NONE;
+        pool[i].next     = (i + 1 < MAX_BEACONS) ? i + 1 : NIL;
+    }
+    for (uint16_t i = 0; i < INDEX_SIZE; i++) {
+        index[i] = NIL;
+    }
+    for (uint8_t i = 0; i < WHEEL_SLOTS; i++) {
+        wheel[i] = NIL;
+    }
+}
+
+void BeaconTable::makeAddressKey(Key_t &key, const BLEProtocol::AddressBytes_t address)
+{
+    memset(&key, 0, sizeof(key));
+    key.type = KEY_ADDRESS;
+    memcpy(key.id, address, sizeof(BLEProtocol::AddressBytes_t));
+}
+
+void BeaconTable::makeUIDKey(Key_t &key, const uint8_t *namespaceInstance)
+{
+    key.type = KEY_UID;
+    memcpy(key.id, namespaceInstance, ID_SIZE);
+}
+
+BeaconTable::UpdateResult_t BeaconTable::update(const Key_t &key, int8_t rssi, uint32_t now, uint16_t *entryOut)
+{
+    uint16_t hash = hashKey(key);
+    uint16_t slot = findSlot(key, hash);
+
+    if (index[slot] != NIL) {
+        if (entryOut != NULL) {
+            *entryOut = index[slot];
+        }
+        Beacon_t &beacon     = pool[index[slot]];
+        beacon.lastSeen      = now;
+        beacon.count++;
+        beacon.smoothedRSSI += ((rssi * 16) - beacon.smoothedRSSI) >> RSSI_SMOOTHING_SHIFT;
+        return BEACON_UPDATED;
+    }
+
+    if (freeList == NIL) {
+        return TABLE_FULL;
+    }
+
+    uint16_t entry      = freeList;
+    Beacon_t &beacon    = pool[entry];
+    freeList            = beacon.next;
+    beacon.key          = key;
+    beacon.hash         = hash;
+    beacon.firstSeen    = now;
+    beacon.lastSeen     = now;
+    beacon.count        = 1;
+    beacon.smoothedRSSI = rssi * 16;
+    index[slot]         = entry;
+    numBeacons++;
+
+    if (entryOut != NULL) {
+        *entryOut = entry;
+    }
+
+    if (numBeacons == 1) {
+        /* The wheel may have been left behind while the table was empty */
+        currentTick = now / TICK_MSEC;
+    }
+    scheduleExpiry(entry);
+    return BEACON_NEW;
+}
+
+void BeaconTable::expire(uint32_t now)
+{
+    uint32_t nowTick = now / TICK_MSEC;
+
+    if (numBeacons == 0) {
+        currentTick = nowTick;
+        return;
+    }
+
+    while (currentTick != nowTick) {
+        currentTick++;
+
+        /* Detach the bucket: the entries that are still alive are linked
+         * again into the bucket of their new expiry tick */
+        uint16_t entry = wheel[currentTick % WHEEL_SLOTS];
+        wheel[currentTick % WHEEL_SLOTS] = NIL;
+
+        while (entry != NIL) {
+            Beacon_t &beacon = pool[entry];
+            uint16_t next    = beacon.next;
+
+            if (beacon.lastSeen + timeout > currentTick * TICK_MSEC) {
+                scheduleExpiry(entry);
+            } else {
+                if (onExpiry != NULL) {
+                    onExpiry(beacon);
+                }
+                removeSlot(findSlot(beacon.key, beacon.hash));
+                beacon.key.type = KEY_NONE;
+                beacon.next     = freeList;
+                freeList        = entry;
+                numBeacons--;
+            }
+            entry = next;
+        }
+    }
+}
+
+const BeaconTable::Beacon_t *BeaconTable::getBeacon(uint16_t entry) const
+{
+    if (entry >= MAX_BEACONS || pool[entry].key.type == KEY_NONE) {
+        return NULL;
+    }
+    return &pool[entry];
+}
+
+uint16_t BeaconTable::getNumBeacons(void) const
+{
+    return numBeacons;
+}
+
+int8_t BeaconTable::getRSSI(const Beacon_t &beacon)
+{
+    return (beacon.smoothedRSSI + 8) >> 4;
+}
+
+uint16_t BeaconTable::hashKey(const Key_t &key)
+{
+    uint32_t hash = 2166136261UL;
+    hash = (hash ^ key.type) * 16777619UL;
+    for (uint8_t i = 0; i < ID_SIZE; i++) {
+        hash = (hash ^ key.id[i]) * 16777619UL;
+    }
+    return (uint16_t) (hash ^ (hash >> 16));
+}
+
+uint16_t BeaconTable::findSlot(const Key_t &key, uint16_t hash) const
+{
+    /* The index is never full, so the probe ends on a free slot */
+    uint16_t slot = hash & (INDEX_SIZE - 1);
+    while (index[slot] != NIL) {
+        const Beacon_t &beacon = pool[index[slot]];
+        if (beacon.hash == hash && memcmp(&beacon.key, &key, sizeof(Key_t)) == 0) {
+            break;
+        }
+        slot = (slot + 1) & (INDEX_SIZE - 1);
+    }
+    return slot;
+}
+
+void BeaconTable::removeSlot(uint16_t slot)
+{
+    uint16_t next = slot;
+    for (;;) {
+        next = (next + 1) & (INDEX_SIZE - 1);
+        if (index[next] == NIL) {
+            break;
+        }
+
+        /* An entry can fill the hole if its home slot is not between the
+         * hole and its current slot (cyclically) */
+        uint16_t home = pool[index[next]].hash & (INDEX_SIZE - 1);
+        if (((next - home) & (INDEX_SIZE - 1)) >= ((next - slot) & (INDEX_SIZE - 1))) {
+            index[slot] = index[next];
+            slot        = next;
+        }
+    }
+    index[slot] = NIL;
+}
+
+void BeaconTable::scheduleExpiry(uint16_t entry)
+{
+    uint32_t tick = (pool[entry].lastSeen + timeout + TICK_MSEC - 1) / TICK_MSEC;
+    if (tick <= currentTick) {
+        tick = currentTick + 1;
+    }
+
+    pool[entry].next          = wheel[tick % WHEEL_SLOTS];
+    wheel[tick % WHEEL_SLOTS] = entry;
+}
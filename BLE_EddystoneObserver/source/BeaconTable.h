@@ -0,0 +1,260 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2006-2015 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __BEACONTABLE_H__
+#define __BEACONTABLE_H__
+
+#include "ble/BLE.h"
+
+/**
+ * Number of slots of the hash index of the beacon table, a power of two. At
+ * most three quarters of them are used, to keep the probe sequences short.
+ */
+#ifndef BEACON_TABLE_SIZE
+#define BEACON_TABLE_SIZE 64
+#endif
+
+/**
+ * Table of the beacons seen by the observer, with their last-seen time,
+ * packet count and smoothed RSSI. Beacons are identified by their address,
+ * or by their namespace and instance for Eddystone-UID frames.
+ *
+ * The beacons are held in a fixed pool indexed by an open-addressing hash
+ * table, so memory is bounded and updates take O(1) on average. Beacons that
+ * are not heard for the timeout are expired by a timer wheel.
+ */
+class BeaconTable
+{
+public:
+    /**
+     * Size in bytes of a beacon identifier: an address, or an Eddystone-UID
+     * namespace and instance.
+     */
+    static const uint8_t  ID_SIZE              = 16;
+    /**
+     * Number of slots of the hash index.
+     */
+    static const uint16_t INDEX_SIZE           = BEACON_TABLE_SIZE;
+    /**
+     * The maximum number of beacons in the table.
+     */
+    static const uint16_t MAX_BEACONS          = (BEACON_TABLE_SIZE * 3) / 4;
+    /**
+     * Number of buckets of the timer wheel. The timeout must be shorter than
+     * WHEEL_SLOTS ticks.
+     */
+    static const uint8_t  WHEEL_SLOTS          = 32;
+    /**
+     * Duration of a tick of the timer wheel in milliseconds.
+     */
+    static const uint32_t TICK_MSEC            = 1000;
+    /**
+     * Weight of a new RSSI sample in the smoothed RSSI, 1 / 2^shift.
+     */
+    static const uint8_t  RSSI_SMOOTHING_SHIFT = 3;
+
+    /**
+     * Kind of beacon identifier.
+     */
+    enum KeyType_t {
+        KEY_NONE = 0,
+        KEY_ADDRESS,
+        KEY_UID
+    };
+
+    /**
+     * Beacon identifier.
+     */
+    struct Key_t {
+        uint8_t type;
+        uint8_t id[ID_SIZE];
+    };
+
+    /**
+     * Entry of the table.
+     */
+    struct Beacon_t {
+        Key_t    key;
+        /**
+         * Time of the first and the last packet, in milliseconds.
+         */
+        uint32_t firstSeen;
+        uint32_t lastSeen;
+        /**
+         * Number of packets received.
+         */
+        uint32_t count;
+        /**
+         * Smoothed RSSI in 1/16 dBm, use getRSSI() to read it.
+         */
+        int16_t  smoothedRSSI;
+        /**
+         * Hash of the key.
+         */
+        uint16_t hash;
+        /**
+         * Next entry in the same timer wheel bucket or in the free list.
+         */
+        uint16_t next;
+    };
+
+    /**
+     * Result of an update of the table.
+     */
+    enum UpdateResult_t {
+        BEACON_NEW,
+        BEACON_UPDATED,
+        TABLE_FULL
+    };
+
+    /**
+     * Callback called for each beacon that expires, before it is removed.
+     */
+    typedef void (*ExpiryCallback_t)(const Beacon_t &beacon);
+
+    /**
+     * Construct an empty beacon table.
+     *
+     * @param[in] timeoutMsec
+     *              The time in milliseconds after which a beacon that is not
+     *              heard expires. Limited to WHEEL_SLOTS - 1 ticks.
+     * @param[in] onExpiry
+     *              Callback called for each beacon that expires, or NULL.
+     */
+    BeaconTable(uint32_t timeoutMsec, ExpiryCallback_t onExpiry);
+
+    /**
+     * Build the key of a beacon identified by its address.
+     */
+    static void makeAddressKey(Key_t &key, const BLEProtocol::AddressBytes_t address);
+
+    /**
+     * Build the key of a beacon identified by its Eddystone-UID namespace and
+     * instance, ID_SIZE bytes.
+     */
+    static void makeUIDKey(Key_t &key, const uint8_t *namespaceInstance);
+
+    /**
+     * Record a packet from a beacon.
+     *
+     * @param[in] key
+     *              The beacon identifier.
+     * @param[in] rssi
+     *              The RSSI of the packet.
+     * @param[in] now
+     *              The current time in milliseconds.
+     * @param[out] entry
+     *              If not NULL, the index of the beacon in the pool.
+     *
+     * @return BEACON_NEW if the beacon was added to the table, BEACON_UPDATED
+     *         if it was already in it, or TABLE_FULL if it could not be added.
+     */
+    UpdateResult_t update(const Key_t &key, int8_t rssi, uint32_t now, uint16_t *entry = NULL);
+
+    /**
+     * Advance the timer wheel and remove the beacons that were not heard for
+     * the timeout. Should be called every TICK_MSEC.
+     *
+     * @param[in] now
+     *              The current time in milliseconds.
+     */
+    void expire(uint32_t now);
+
+    /**
+     * Get a beacon of the pool, to iterate over the table.
+     *
+     * @param[in] index
+     *              The index in the pool, below MAX_BEACONS.
+     *
+     * @return The beacon, or NULL if the entry is free.
+     */
+    const Beacon_t *getBeacon(uint16_t index) const;
+
+    /**
+     * Get the number of beacons in the table.
+     */
+    uint16_t getNumBeacons(void) const;
+
+    /**
+     * Get the smoothed RSSI of a beacon in dBm.
+     */
+    static int8_t getRSSI(const Beacon_t &beacon);
+
+private:
+    /**
+     * Marker of the end of a list and of a free index slot.
+     */
+    static const uint16_t NIL = 0xFFFF;
+
+    /**
+     * Compute the hash of a key (FNV-1a, folded to 16 bits).
+     */
+    static uint16_t hashKey(const Key_t &key);
+
+    /**
+     * Find the index slot of a key.
+     *
+     * @return The slot holding the key, or the free slot where it would be
+     *         inserted.
+     */
+    uint16_t findSlot(const Key_t &key, uint16_t hash) const;
+
+    /**
+     * Remove an index slot, moving back the following entries of the probe
+     * sequence so that no tombstone is needed.
+     */
+    void removeSlot(uint16_t slot);
+
+    /**
+     * Link a pool entry into the timer wheel bucket of its expiry tick.
+     */
+    void scheduleExpiry(uint16_t entry);
+
+    /**
+     * The beacons.
+     */
+    Beacon_t         pool[MAX_BEACONS];
+    /**
+     * Open-addressing hash index of pool entries, with linear probing.
+     */
+    uint16_t         index[INDEX_SIZE];
+    /**
+     * Timer wheel buckets, lists of pool entries by expiry tick.
+     */
+    uint16_t         wheel[WHEEL_SLOTS];
+    /**
+     * List of the free pool entries.
+     */
+    uint16_t         freeList;
+    /**
+     * Number of beacons in the table.
+     */
+    uint16_t         numBeacons;
+    /**
+     * The last tick processed by expire().
+     */
+    uint32_t         currentTick;
+    /**
+     * The timeout in milliseconds.
+     */
+    uint32_t         timeout;
+    /**
+     * Callback for expired beacons.
+     */
+    ExpiryCallback_t onExpiry;
+};
+
+#endif  /* __BEACONTABLE_H__ */
@@ -0,0 +1,170 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2006-2015 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "CrossingDetector.h"
+
+const float CrossingDetector::SMOOTHING_WEIGHT = 0.25f;
+
+CrossingDetector::CrossingDetector(int8_t minPeakRSSIIn) :
+    minPeakRSSI(minPeakRSSIIn)
+{
+}
+
+void CrossingDetector::reset(Track_t &track) const
+{
+    track.numSamples = 0;
+    track.nextSample = 0;
+    track.armed      = true;
+    track.peakValid  = false;
+    track.peakPassed = false;
+}
+
+bool CrossingDetector::addSample(Track_t &track, uint32_t time, int8_t rssi, Crossing_t &crossing) const
+{
+    track.samples[track.nextSample].time = time;
+    track.samples[track.nextSample].rssi = rssi;
+    track.nextSample                     = (track.nextSample + 1) % MAX_SAMPLES;
+    if (track.numSamples < MAX_SAMPLES) {
+        track.numSamples++;
+    }
+
+    if (track.numSamples == 1) {
+        track.smoothedRSSI = rssi;
+    } else {
+        track.smoothedRSSI += SMOOTHING_WEIGHT * (rssi - track.smoothedRSSI);
+    }
+    track.lastTime = time;
+
+    if (!track.armed) {
+        /* Wait for the tag to move away before detecting it again */
+        if (track.smoothedRSSI < minPeakRSSI - REARM_HYSTERESIS_DB && time - track.peakTime >= MIN_CROSSING_INTERVAL_MSEC) {
+            track.armed = true;
+        }
+        return false;
+    }
+
+    if (!track.peakPassed) {
+        if (track.smoothedRSSI >= minPeakRSSI && (!track.peakValid || track.smoothedRSSI > track.peakRSSI)) {
+            track.peakValid = true;
+            track.peakRSSI  = track.smoothedRSSI;
+            track.peakTime  = time;
+            return false;
+        }
+        if (track.peakValid && track.smoothedRSSI <= track.peakRSSI - PEAK_DROP_DB) {
+            track.peakPassed = true;
+        }
+    }
+
+    /* Collect the samples of the second half of the fit window before
+     * ending the crossing */
+    if (track.peakPassed && time - track.peakTime >= FIT_HALF_WINDOW_MSEC) {
+        endCrossing(track, crossing);
+        return true;
+    }
+    return false;
+}
+
+bool CrossingDetector::checkTimeout(Track_t &track, uint32_t now, Crossing_t &crossing) const
+{
+    if (track.numSamples == 0 || now - track.lastTime < LOSS_TIMEOUT_MSEC) {
+        return false;
+    }
+
+    bool crossed = false;
+    if (track.armed && track.peakValid) {
+        endCrossing(track, crossing);
+        crossed = true;
+    }
+    reset(track);
+    return crossed;
+}
+
+void CrossingDetector::endCrossing(Track_t &track, Crossing_t &crossing) const
+{
+    crossing.peakRSSI   = (int8_t) track.peakRSSI;
+    /* The smoothed peak lags, so fit again around the first estimate */
+    uint32_t estimate;
+    crossing.fitSamples = fitPeak(track, track.peakTime, estimate);
+    if (crossing.fitSamples == 0) {
+        crossing.time = track.peakTime;
+    } else if ((crossing.fitSamples = fitPeak(track, estimate, crossing.time)) == 0) {
+        crossing.time = estimate;
+    }
+
+    track.armed      = false;
+    track.peakValid  = false;
+    track.peakPassed = false;
+}
+
+uint8_t CrossingDetector::fitPeak(const Track_t &track, uint32_t center, uint32_t &time) const
+{
+    static const uint8_t MIN_FIT_SAMPLES = 5;
+
+    /* Keep the window symmetric around the center when the tag was lost
+     * before the end of the window */
+    int32_t halfWindow = (int32_t) (track.lastTime - center);
+    if (halfWindow > (int32_t) FIT_HALF_WINDOW_MSEC) {
+        halfWindow = FIT_HALF_WINDOW_MSEC;
+    }
+
+    /* Least squares fit of rssi = a.x^2 + b.x + c, with x the time from the
+     * center in seconds to keep the sums well conditioned */
+    float   s[5] = {0, 0, 0, 0, 0};
+    float   sy   = 0, sxy = 0, sx2y = 0;
+    uint8_t n    = 0;
+    for (uint8_t i = 0; i < track.numSamples; i++) {
+        const Sample_t &sample = track.samples[i];
+        int32_t offset = (int32_t) (sample.time - center);
+        if (offset < -halfWindow || offset > halfWindow) {
+            continue;
+        }
+
+        float x  = offset / 1000.0f;
+        float x2 = x * x;
+        s[0] += 1;
+        s[1] += x;
+        s[2] += x2;
+        s[3] += x2 * x;
+        s[4] += x2 * x2;
+        sy   += sample.rssi;
+        sxy  += x * sample.rssi;
+        sx2y += x2 * sample.rssi;
+        n++;
+    }
+    if (n < MIN_FIT_SAMPLES) {
+        return 0;
+    }
+
+    /* Solve the normal equations with Cramer's rule */
+    float det = s[4] * (s[2] * s[0] - s[1] * s[1]) - s[3] * (s[3] * s[0] - s[1] * s[2]) + s[2] * (s[3] * s[1] - s[2] * s[2]);
+    if (det == 0) {
+        return 0;
+    }
+    float a = (sx2y * (s[2] * s[0] - s[1] * s[1]) - s[3] * (sxy * s[0] - s[1] * sy) + s[2] * (sxy * s[1] - s[2] * sy)) / det;
+    float b = (s[4] * (sxy * s[0] - sy * s[1]) - sx2y * (s[3] * s[0] - s[1] * s[2]) + s[2] * (s[3] * sy - sxy * s[2])) / det;
+    if (a >= 0) {
+        /* Not a peak */
+        return 0;
+    }
+
+    float vertex = -b / (2 * a);
+    if (vertex < -halfWindow / 1000.0f || vertex > halfWindow / 1000.0f) {
+        return 0;
+    }
+
+    time = center + (int32_t) (vertex * 1000.0f);
+    return n;
+}
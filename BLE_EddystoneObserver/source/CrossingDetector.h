@@ -0,0 +1,197 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2006-2015 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __CROSSINGDETECTOR_H__
+#define __CROSSINGDETECTOR_H__
+
+#include <stdint.h>
+
+/**
+ * Detect when a tag passes by the observer, from the RSSI of its packets.
+ *
+ * The RSSI of a passing tag rises to a peak at the closest approach and then
+ * falls. The detector smooths the RSSI to find the peak, and declares a
+ * crossing once the smoothed RSSI dropped PEAK_DROP_DB below it and the
+ * samples up to FIT_HALF_WINDOW_MSEC after the peak are collected, or once
+ * the tag is not heard anymore. The time of closest approach is then
+ * estimated by fitting a parabola to the raw RSSI samples around the peak,
+ * which resolves it more finely than the packet interval and removes the lag
+ * of the smoothing.
+ *
+ * The state of each tag is held in a fixed-size Track_t owned by the caller.
+ */
+class CrossingDetector
+{
+public:
+    /**
+     * Number of raw samples kept per tag for the fit.
+     */
+    static const uint8_t  MAX_SAMPLES                = 48;
+    /**
+     * Drop of the smoothed RSSI below its peak, in dB, after which the tag
+     * is known to move away.
+     */
+    static const uint8_t  PEAK_DROP_DB               = 6;
+    /**
+     * Drop below the minimum peak RSSI, in dB, after which a tag that
+     * crossed can cross again.
+     */
+    static const uint8_t  REARM_HYSTERESIS_DB        = 3;
+    /**
+     * Minimum time between two crossings of a tag, in milliseconds.
+     */
+    static const uint32_t MIN_CROSSING_INTERVAL_MSEC = 5000;
+    /**
+     * Half width of the window of samples around the peak used for the fit,
+     * in milliseconds.
+     */
+    static const uint32_t FIT_HALF_WINDOW_MSEC       = 1500;
+    /**
+     * Time without packets after which a tag that reached its peak is
+     * considered to have crossed, in milliseconds.
+     */
+    static const uint32_t LOSS_TIMEOUT_MSEC          = 2000;
+
+    /**
+     * A raw RSSI sample.
+     */
+    struct Sample_t {
+        uint32_t time;
+        int8_t   rssi;
+    };
+
+    /**
+     * Per-tag detector state.
+     */
+    struct Track_t {
+        /**
+         * Ring of the last raw samples.
+         */
+        Sample_t samples[MAX_SAMPLES];
+        uint8_t  numSamples;
+        uint8_t  nextSample;
+        /**
+         * Whether a crossing can be detected, false from a crossing until
+         * the tag moves away.
+         */
+        bool     armed;
+        /**
+         * Whether the smoothed RSSI reached the minimum peak RSSI.
+         */
+        bool     peakValid;
+        /**
+         * Whether the smoothed RSSI dropped PEAK_DROP_DB below the peak.
+         */
+        bool     peakPassed;
+        float    smoothedRSSI;
+        float    peakRSSI;
+        uint32_t peakTime;
+        uint32_t lastTime;
+    };
+
+    /**
+     * A detected crossing.
+     */
+    struct Crossing_t {
+        /**
+         * Estimated time of closest approach, in milliseconds.
+         */
+        uint32_t time;
+        /**
+         * Peak of the smoothed RSSI.
+         */
+        int8_t   peakRSSI;
+        /**
+         * Number of samples used by the fit, 0 if the time of the peak sample
+         * was used instead.
+         */
+        uint8_t  fitSamples;
+    };
+
+    /**
+     * Construct a crossing detector.
+     *
+     * @param[in] minPeakRSSI
+     *              The RSSI the smoothed RSSI of a tag must reach to be
+     *              considered passing by, in dBm.
+     */
+    CrossingDetector(int8_t minPeakRSSI);
+
+    /**
+     * Reset the state of a tag, when it is first seen.
+     */
+    void reset(Track_t &track) const;
+
+    /**
+     * Add a packet of a tag.
+     *
+     * @param[in,out] track
+     *              The state of the tag.
+     * @param[in] time
+     *              The reception time of the packet in milliseconds.
+     * @param[in] rssi
+     *              The RSSI of the packet.
+     * @param[out] crossing
+     *              The crossing, if one is detected.
+     *
+     * @return true if the tag crossed.
+     */
+    bool addSample(Track_t &track, uint32_t time, int8_t rssi, Crossing_t &crossing) const;
+
+    /**
+     * Check whether a tag that reached its peak is not heard anymore, which
+     * also ends a crossing. Should be called periodically.
+     *
+     * @param[in,out] track
+     *              The state of the tag.
+     * @param[in] now
+     *              The current time in milliseconds.
+     * @param[out] crossing
+     *              The crossing, if one is detected.
+     *
+     * @return true if the tag crossed.
+     */
+    bool checkTimeout(Track_t &track, uint32_t now, Crossing_t &crossing) const;
+
+private:
+    /**
+     * Weight of a new RSSI sample in the smoothed RSSI.
+     */
+    static const float SMOOTHING_WEIGHT;
+
+    /**
+     * Fill in a crossing at the peak of a track and disarm it.
+     */
+    void endCrossing(Track_t &track, Crossing_t &crossing) const;
+
+    /**
+     * Fit a parabola to the samples of a track in the window around a time.
+     *
+     * @param[in] track
+     *              The state of the tag.
+     * @param[in] center
+     *              The center of the window.
+     * @param[out] time
+     *              The time of the vertex of the parabola.
+     *
+     * @return The number of samples used, or 0 if the fit failed.
+     */
+    uint8_t fitPeak(const Track_t &track, uint32_t center, uint32_t &time) const;
+
+    int8_t minPeakRSSI;
+};
+
+#endif  /* __CROSSINGDETECTOR_H__ */
@@ -0,0 +1 @@
+../../BLE_EddystoneService/source/EddystoneURLCodec.h
\ No newline at end of file
@@ -0,0 +1,144 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2006-2015 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "ReportUplink.h"
+
+ReportUplink::ReportUplink(PinName tx, PinName rx, int baud) :
+    serial(tx, rx, baud),
+    frameLength(0),
+    sequence(0),
+    txHead(0),
+    txTail(0),
+    transmitting(false),
+    droppedFrames(0)
+{
+}
+
+void ReportUplink::addScanReport(const AdvertisementReport_t &report, uint32_t time)
+{
+    uint8_t *record = reserveRecord(UPLINK_FRAME_SCAN_REPORTS, sizeof(UplinkScanReport_t) + report.advertisingDataLen);
+
+    UplinkScanReport_t *header = (UplinkScanReport_t *) record;
+    uplinkPutUint32(header->time, time);
+    memcpy(header->peerAddr, report.peerAddr, sizeof(header->peerAddr));
+    header->rssi       = report.rssi;
+    header->flags      = (report.isScanResponse ? 0x01 : 0x00) | ((report.type & 0x07) << 1);
+    header->dataLength = report.advertisingDataLen;
+    memcpy(record + sizeof(UplinkScanReport_t), report.advertisingData, report.advertisingDataLen);
+}
+
+void ReportUplink::addBeaconEvent(UplinkBeaconEventType_t event, const BeaconTable::Beacon_t &beacon, uint32_t time, int8_t rssi)
+{
+    UplinkBeaconEvent_t *record = (UplinkBeaconEvent_t *) reserveRecord(UPLINK_FRAME_BEACON_EVENTS, sizeof(UplinkBeaconEvent_t));
+
+    record->event   = event;
+    record->keyType = beacon.key.type;
+    memcpy(record->id, beacon.key.id, sizeof(record->id));
+    uplinkPutUint32(record->time, time);
+    record->rssi    = rssi;
+    uplinkPutUint32(record->count, beacon.count);
+}
+
+void ReportUplink::sendStats(uint32_t advertisements, uint32_t droppedReports)
+{
+    UplinkStats_t *record = (UplinkStats_t *) reserveRecord(UPLINK_FRAME_STATS, sizeof(UplinkStats_t));
+
+    uplinkPutUint32(record->advertisements, advertisements);
+    uplinkPutUint32(record->droppedReports, droppedReports);
+    uplinkPutUint32(record->droppedFrames, droppedFrames);
+    flush();
+}
+
+void ReportUplink::flush(void)
+{
+    if (frameLength == 0) {
+        return;
+    }
+
+    /* The sequence number also counts the dropped frames, so that the host
+     * sees them as lost */
+    frame[1] = sequence++;
+    if ((uint8_t) (txTail - txHead) == TX_BUFFERS) {
+        droppedFrames++;
+        frameLength = 0;
+        return;
+    }
+
+    uint16_t crc = uplinkCRC16(0xFFFF, frame, frameLength);
+    frame[frameLength++] = crc;
+    frame[frameLength++] = crc >> 8;
+
+    uint8_t buffer    = txTail % TX_BUFFERS;
+    txLengths[buffer] = uplinkEncodeCOBS(frame, frameLength, txBuffers[buffer]);
+    txTail            = txTail + 1;
+    frameLength       = 0;
+
+    startTransmit();
+}
+
+uint32_t ReportUplink::getDroppedFrames(void) const
+{
+    return droppedFrames;
+}
+
+uint8_t *ReportUplink::reserveRecord(UplinkFrameType_t type, size_t size)
+{
+    if (frameLength != 0 &&
+        (frame[0] != type || frame[2] == 0xFF || frameLength + size + UPLINK_FRAME_CRC_SIZE > UPLINK_MAX_FRAME_SIZE)) {
+        flush();
+    }
+
+    if (frameLength == 0) {
+        frame[0]    = type;
+        frame[2]    = 0;
+        frameLength = UPLINK_FRAME_HEADER_SIZE;
+    }
+
+    uint8_t *record = frame + frameLength;
+    frameLength    += size;
+    frame[2]++;
+    return record;
+}
+
+void ReportUplink::startTransmit(void)
+{
+    core_util_critical_section_enter();
+    if (transmitting || txHead == txTail) {
+        core_util_critical_section_exit();
+        return;
+    }
+    transmitting = true;
+    core_util_critical_section_exit();
+
+    uint8_t buffer = txHead % TX_BUFFERS;
+#if DEVICE_SERIAL_ASYNCH
+    serial.write(txBuffers[buffer], txLengths[buffer], event_callback_t(this, &ReportUplink::transmitComplete));
+#else
+    /* Without asynchronous writes, the frames are sent from the event queue
+     * thread */
+    for (uint16_t i = 0; i < txLengths[buffer]; i++) {
+        serial.putc(txBuffers[buffer][i]);
+    }
+    transmitComplete(0);
+#endif
+}
+
+void ReportUplink::transmitComplete(int events)
+{
+    txHead       = txHead + 1;
+    transmitting = false;
+    startTransmit();
+}
@@ -0,0 +1,145 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2006-2015 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __REPORTUPLINK_H__
+#define __REPORTUPLINK_H__
+
+#include "mbed.h"
+#include "AdvertisementRing.h"
+#include "BeaconTable.h"
+#include "UplinkProtocol.h"
+
+/**
+ * Stream scan reports and beacon table events to a host gateway over a UART,
+ * in the binary frames described in UplinkProtocol.h.
+ *
+ * Records are batched into a frame until it is full, its type changes or
+ * flush() is called. Encoded frames are queued in TX_BUFFERS buffers and
+ * sent with asynchronous (DMA) UART writes where the target supports them,
+ * so the event queue is not blocked by the transmission. Frames are dropped,
+ * and counted, when all the buffers are waiting to be sent.
+ */
+class ReportUplink
+{
+public:
+    /**
+     * Number of encoded frames that can wait for the UART.
+     */
+    static const uint8_t TX_BUFFERS = 4;
+
+    /**
+     * Construct an uplink.
+     *
+     * @param[in] tx
+     *              The UART TX pin.
+     * @param[in] rx
+     *              The UART RX pin.
+     * @param[in] baud
+     *              The UART baud rate.
+     */
+    ReportUplink(PinName tx, PinName rx, int baud);
+
+    /**
+     * Add a scan report to the current frame.
+     *
+     * @param[in] report
+     *              The scan report.
+     * @param[in] time
+     *              The reception time of the report in milliseconds.
+     */
+    void addScanReport(const AdvertisementReport_t &report, uint32_t time);
+
+    /**
+     * Add a beacon table event to the current frame.
+     *
+     * @param[in] event
+     *              The type of event.
+     * @param[in] beacon
+     *              The beacon the event is about.
+     * @param[in] time
+     *              The time of the event in milliseconds.
+     * @param[in] rssi
+     *              The smoothed RSSI of the beacon, or the peak RSSI of a
+     *              crossing.
+     */
+    void addBeaconEvent(UplinkBeaconEventType_t event, const BeaconTable::Beacon_t &beacon, uint32_t time, int8_t rssi);
+
+    /**
+     * Send a statistics frame.
+     *
+     * @param[in] advertisements
+     *              The number of advertisement callbacks.
+     * @param[in] droppedReports
+     *              The number of reports dropped by the report ring.
+     */
+    void sendStats(uint32_t advertisements, uint32_t droppedReports);
+
+    /**
+     * Queue the current frame for transmission. Should be called
+     * periodically to bound the latency of the records.
+     */
+    void flush(void);
+
+    /**
+     * Get the number of frames dropped because the UART was busy.
+     */
+    uint32_t getDroppedFrames(void) const;
+
+private:
+    /**
+     * Reserve space for a record in the current frame, flushing it first if
+     * the record does not fit or is of another type.
+     *
+     * @return Pointer to where the record must be written.
+     */
+    uint8_t *reserveRecord(UplinkFrameType_t type, size_t size);
+
+    /**
+     * Start sending the oldest queued frame if the UART is idle.
+     */
+    void startTransmit(void);
+
+    /**
+     * Called from interrupt context when a frame was sent.
+     */
+    void transmitComplete(int events);
+
+    RawSerial        serial;
+    /**
+     * The frame being filled, not encoded.
+     */
+    uint8_t          frame[UPLINK_MAX_FRAME_SIZE];
+    size_t           frameLength;
+    uint8_t          sequence;
+    /**
+     * Encoded frames, indexed by the free-running txHead and txTail counters
+     * modulo TX_BUFFERS.
+     */
+    uint8_t          txBuffers[TX_BUFFERS][UPLINK_MAX_ENCODED_SIZE];
+    uint16_t         txLengths[TX_BUFFERS];
+    /**
+     * The number of frames sent, only written when a transmission ends.
+     */
+    volatile uint8_t txHead;
+    /**
+     * The number of frames queued, only written by flush().
+     */
+    volatile uint8_t txTail;
+    volatile bool    transmitting;
+    uint32_t         droppedFrames;
+};
+
+#endif  /* __REPORTUPLINK_H__ */
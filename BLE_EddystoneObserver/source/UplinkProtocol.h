@@ -0,0 +1,216 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2006-2015 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __UPLINKPROTOCOL_H__
+#define __UPLINKPROTOCOL_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * Binary protocol of the observer uplink, shared by the firmware and the host
+ * decoder. It has no dependency on mbed.
+ *
+ * A frame is:
+ *     type (1 byte) | sequence (1 byte) | record count (1 byte) | records |
+ *     CRC16 (2 bytes, little endian)
+ * The CRC16 (CCITT, initial value 0xFFFF) covers everything before it. The
+ * frame is COBS encoded and followed by a 0x00 delimiter, so a receiver can
+ * resynchronize on the next delimiter after an error. Multi-byte fields are
+ * little endian. The sequence number lets the receiver count lost frames.
+ */
+
+/**
+ * Frame types.
+ */
+enum UplinkFrameType_t {
+    /**
+     * Records are UplinkScanReport_t headers, each followed by its
+     * advertising data.
+     */
+    UPLINK_FRAME_SCAN_REPORTS  = 0x01,
+    /**
+     * Records are UplinkBeaconEvent_t.
+     */
+    UPLINK_FRAME_BEACON_EVENTS = 0x02,
+    /**
+     * A single UplinkStats_t record.
+     */
+    UPLINK_FRAME_STATS         = 0x03
+};
+
+/**
+ * Events of the beacon table.
+ */
+enum UplinkBeaconEventType_t {
+    UPLINK_BEACON_FOUND    = 0x01,
+    UPLINK_BEACON_LOST     = 0x02,
+    UPLINK_BEACON_CROSSING = 0x03
+};
+
+/**
+ * Size of the frame header: type, sequence and record count.
+ */
+static const size_t UPLINK_FRAME_HEADER_SIZE = 3;
+/**
+ * Size of the CRC16 trailer.
+ */
+static const size_t UPLINK_FRAME_CRC_SIZE    = 2;
+/**
+ * Maximum size of a frame before encoding, header and CRC included.
+ */
+static const size_t UPLINK_MAX_FRAME_SIZE    = 254;
+/**
+ * Maximum size of an encoded frame, delimiter included. COBS adds one byte
+ * per 254 bytes of input.
+ */
+static const size_t UPLINK_MAX_ENCODED_SIZE  = UPLINK_MAX_FRAME_SIZE + (UPLINK_MAX_FRAME_SIZE / 254) + 2;
+
+/**
+ * Header of a scan report record, followed by dataLength bytes of
+ * advertising data.
+ */
+struct UplinkScanReport_t {
+    uint8_t time[4];          /* Reception time in milliseconds */
+    uint8_t peerAddr[6];
+    int8_t  rssi;
+    uint8_t flags;            /* Bit 0: scan response, bits 1-3: advertising type */
+    uint8_t dataLength;
+};
+
+/**
+ * Beacon event record.
+ */
+struct UplinkBeaconEvent_t {
+    uint8_t event;            /* UplinkBeaconEventType_t */
+    uint8_t keyType;          /* Address or Eddystone-UID */
+    uint8_t id[16];           /* Address, or namespace and instance */
+    uint8_t time[4];          /* Event time in milliseconds */
+    int8_t  rssi;             /* Smoothed RSSI, or peak RSSI of a crossing */
+    uint8_t count[4];         /* Packets received */
+};
+
+/**
+ * Statistics record.
+ */
+struct UplinkStats_t {
+    uint8_t advertisements[4]; /* Advertisement callbacks */
+    uint8_t droppedReports[4]; /* Reports dropped by the report ring */
+    uint8_t droppedFrames[4];  /* Frames dropped because the UART was busy */
+};
+
+static inline void uplinkPutUint32(uint8_t *bytes, uint32_t value)
+{
+    bytes[0] = value;
+    bytes[1] = value >> 8;
+    bytes[2] = value >> 16;
+    bytes[3] = value >> 24;
+}
+
+static inline uint32_t uplinkGetUint32(const uint8_t *bytes)
+{
+    return bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) | ((uint32_t) bytes[3] << 24);
+}
+
+/**
+ * Update a CRC16-CCITT with some bytes.
+ *
+ * @param[in] crc
+ *              The CRC of the previous bytes, 0xFFFF to start.
+ */
+static inline uint16_t uplinkCRC16(uint16_t crc, const uint8_t *data, size_t length)
+{
+    /* Nibble-wide table, a compromise between the bitwise and the
+     * byte-wide implementations */
+    static const uint16_t CRC16_TABLE[16] = {
+        0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50a5, 0x60c6, 0x70e7,
+        0x8108, 0x9129, 0xa14a, 0xb16b, 0xc18c, 0xd1ad, 0xe1ce, 0xf1ef
+    };
+
+    for (size_t i = 0; i < length; i++) {
+        crc = (crc << 4) ^ CRC16_TABLE[(crc >> 12) ^ (data[i] >> 4)];
+        crc = (crc << 4) ^ CRC16_TABLE[(crc >> 12) ^ (data[i] & 0x0F)];
+    }
+    return crc;
+}
+
+/**
+ * COBS encode a buffer and append the 0x00 delimiter.
+ *
+ * @param[in] data
+ *              The bytes to encode.
+ * @param[in] length
+ *              The number of bytes, at most UPLINK_MAX_FRAME_SIZE.
+ * @param[out] encoded
+ *              Buffer of at least UPLINK_MAX_ENCODED_SIZE bytes.
+ *
+ * @return The encoded length, delimiter included.
+ */
+static inline size_t uplinkEncodeCOBS(const uint8_t *data, size_t length, uint8_t *encoded)
+{
+    size_t  codeIndex = 0;
+    size_t  out       = 1;
+    uint8_t code      = 1;
+
+    for (size_t i = 0; i < length; i++) {
+        if (data[i] != 0) {
+            encoded[out++] = data[i];
+            code++;
+        }
+        if (data[i] == 0 || code == 0xFF) {
+            encoded[codeIndex] = code;
+            codeIndex          = out++;
+            code               = 1;
+        }
+    }
+    encoded[codeIndex] = code;
+    encoded[out++]     = 0;
+    return out;
+}
+
+/**
+ * Decode a COBS encoded frame, without its delimiter.
+ *
+ * @param[in] encoded
+ *              The encoded bytes.
+ * @param[in] length
+ *              The number of encoded bytes.
+ * @param[out] data
+ *              Buffer of at least @p length bytes.
+ *
+ * @return The decoded length, or -1 if the encoding is invalid.
+ */
+static inline int uplinkDecodeCOBS(const uint8_t *encoded, size_t length, uint8_t *data)
+{
+    size_t in  = 0;
+    size_t out = 0;
+
+    while (in < length) {
+        uint8_t code = encoded[in++];
+        if (code == 0 || in + code - 1 > length) {
+            return -1;
+        }
+        for (uint8_t i = 1; i < code; i++) {
+            data[out++] = encoded[in++];
+        }
+        if (code != 0xFF && in < length) {
+            data[out++] = 0;
+        }
+    }
+    return (int) out;
+}
+
+#endif  /* __UPLINKPROTOCOL_H__ */
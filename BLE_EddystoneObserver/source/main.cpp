@@ -17,11 +17,82 @@
 #include <events/mbed_events.h>
 #include "mbed.h"
 #include "ble/BLE.h"
+#include "EddystoneURLCodec.h"
+#include "AcceptList.h"
+#include "AdvertisementRing.h"
+#include "AdvertisingDataParser.h"
+#include "BeaconTable.h"
+#include "CrossingDetector.h"
+#if MBED_CONF_APP_UPLINK_ENABLED
+#include "ReportUplink.h"
+#endif
+
+/* The uplink takes over the console UART: nRF5x targets have a single UART,
+ * and D1/D0 are the stdio UART on Nucleo boards. Text printed there would be
+ * interleaved with the frames and break their CRC, so the console output is
+ * compiled out when the uplink is enabled. The arguments are still parsed, for
+ * the variables only printed not to be reported unused. */
+#if MBED_CONF_APP_UPLINK_ENABLED
+#define CONSOLE_PRINTF(...) do { if (0) { printf(__VA_ARGS__); } } while (0)
+#else
+#define CONSOLE_PRINTF(...) printf(__VA_ARGS__)
+#endif
 
 static const int URI_MAX_LENGTH = 18;             // Maximum size of service data in ADV packets
 
+/* Interval at which the number of advertisement callbacks is reported */
+static const int WAKEUP_REPORT_PERIOD_SECONDS = 10;
+
+/* Number of advertisement reports buffered between the scan callback and the
+ * job parsing them, and the number parsed before yielding to BLE events */
+static const unsigned ADVERTISEMENT_RING_SLOTS   = 32;
+static const unsigned ADVERTISEMENT_BATCH_SIZE   = 8;
+
+/* Beacons not heard for the timeout are reported lost, and the beacons in
+ * the table are summarized every summary period */
+static const int BEACON_TIMEOUT_SECONDS        = 10;
+static const int BEACON_SUMMARY_PERIOD_SECONDS = 30;
+
+/* RSSI a tag must reach to be considered passing by the observer */
+static const int8_t CROSSING_MIN_PEAK_RSSI     = -75;
+
+/* While namespaces are accepted, the controller filter is lifted for a
+ * discovery window every discovery period so that new beacons using them
+ * can be resolved to addresses */
+static const int DISCOVERY_PERIOD_SECONDS     = 60;
+static const int DISCOVERY_WINDOW_SECONDS     = 5;
+
+/* Eddystone-UID namespace of the beacons to observe, the default of the
+ * BLE_EddystoneService example */
+static const uint8_t acceptedNamespaceID[AcceptList::NAMESPACE_ID_SIZE] = {0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77, 0x88, 0x99};
+
 static EventQueue eventQueue(/* event count */ 16 * EVENTS_EVENT_SIZE);
 
+static AcceptList acceptList;
+static bool       whitelistProgrammed   = false;
+static bool       controllerFiltering   = false;
+static bool       discoveryWindow       = false;
+static bool       filterUpdateScheduled = false;
+static uint32_t   advertisementCount    = 0;
+
+static AdvertisementRing<ADVERTISEMENT_RING_SLOTS> advertisementRing;
+static volatile bool                               processingScheduled = false;
+
+void beaconExpiredCallback(const BeaconTable::Beacon_t &beacon);
+
+static Timer       uptime;
+static BeaconTable beaconTable(BEACON_TIMEOUT_SECONDS * 1000, beaconExpiredCallback);
+
+static CrossingDetector          crossingDetector(CROSSING_MIN_PEAK_RSSI);
+static CrossingDetector::Track_t crossingTracks[BeaconTable::MAX_BEACONS];
+
+#if MBED_CONF_APP_UPLINK_ENABLED
+/* Maximum time a record waits in the uplink before its frame is sent */
+static const int UPLINK_FLUSH_PERIOD_MSEC = 20;
+
+static ReportUplink uplink(MBED_CONF_APP_UPLINK_TX, MBED_CONF_APP_UPLINK_RX, MBED_CONF_APP_UPLINK_BAUD);
+#endif
+
 DigitalOut led1(LED1, 1);
 
 void periodicCallback(void)
@@ -31,93 +102,263 @@ void periodicCallback(void)
 
 void decodeURI(const uint8_t* uriData, const size_t uriLen)
 {
-    const char *prefixes[] = {
-        "http://www.",
-        "https://www.",
-        "http://",
-        "https://",
-        "urn:uuid:"
-    };
-    const size_t NUM_PREFIXES = sizeof(prefixes) / sizeof(char *);
-    const char *suffixes[] = {
-        ".com/",
-        ".org/",
-        ".edu/",
-        ".net/",
-        ".info/",
-        ".biz/",
-        ".gov/",
-        ".com",
-        ".org",
-        ".edu",
-        ".net",
-        ".info",
-        ".biz",
-        ".gov"
-    };
-    const size_t NUM_SUFFIXES = sizeof(suffixes) / sizeof(char *);
-
-    size_t index = 0;
-
-    /* First byte is the URL Scheme. */
-    if (uriData[index] < NUM_PREFIXES) {
-        printf("%s", prefixes[uriData[index]]);
-        index++;
+    char url[EDDYSTONE_URL_DECODED_SIZE(URI_MAX_LENGTH)];
+
+    if (decodeEddystoneURL(uriData, uriLen, url, sizeof(url)) < 0) {
+        CONSOLE_PRINTF("URL Scheme was not encoded!");
+        return;
+    }
+
+    CONSOLE_PRINTF("%s\n\r", url);
+}
+
+void printBeaconID(const BeaconTable::Key_t &key)
+{
+    if (key.type == BeaconTable::KEY_UID) {
+        CONSOLE_PRINTF("UID ");
+        for (uint8_t i = 0; i < BeaconTable::ID_SIZE; i++) {
+            CONSOLE_PRINTF("%02x", key.id[i]);
+        }
     } else {
-        printf("URL Scheme was not encoded!");
+        CONSOLE_PRINTF("addr %02x:%02x:%02x:%02x:%02x:%02x",
+               key.id[5], key.id[4], key.id[3], key.id[2], key.id[1], key.id[0]);
+    }
+}
+
+void beaconExpiredCallback(const BeaconTable::Beacon_t &beacon)
+{
+    CONSOLE_PRINTF("lost ");
+    printBeaconID(beacon.key);
+    CONSOLE_PRINTF(" after %lu packets\r\n", (unsigned long) beacon.count);
+#if MBED_CONF_APP_UPLINK_ENABLED
+    uplink.addBeaconEvent(UPLINK_BEACON_LOST, beacon, uptime.read_ms(), BeaconTable::getRSSI(beacon));
+#endif
+}
+
+void reportCrossing(const BeaconTable::Beacon_t &beacon, const CrossingDetector::Crossing_t &crossing)
+{
+    CONSOLE_PRINTF("crossing ");
+    printBeaconID(beacon.key);
+    CONSOLE_PRINTF(" at %lu ms, peak rssi %d (%u samples fitted)\r\n",
+           (unsigned long) crossing.time, crossing.peakRSSI, crossing.fitSamples);
+#if MBED_CONF_APP_UPLINK_ENABLED
+    uplink.addBeaconEvent(UPLINK_BEACON_CROSSING, beacon, crossing.time, crossing.peakRSSI);
+#endif
+}
+
+/*
+ * Record a packet of a beacon in the beacon table and feed its RSSI to the
+ * crossing detector.
+ *
+ * @return true if the beacon is new.
+ */
+bool updateBeacon(const BeaconTable::Key_t &key, int8_t rssi, uint32_t receivedAt)
+{
+    uint16_t                    entry;
+    BeaconTable::UpdateResult_t result = beaconTable.update(key, rssi, receivedAt, &entry);
+    if (result == BeaconTable::TABLE_FULL) {
+        return false;
+    }
+
+    if (result == BeaconTable::BEACON_NEW) {
+        crossingDetector.reset(crossingTracks[entry]);
+#if MBED_CONF_APP_UPLINK_ENABLED
+        uplink.addBeaconEvent(UPLINK_BEACON_FOUND, *beaconTable.getBeacon(entry), receivedAt, rssi);
+#endif
+    }
+    CrossingDetector::Crossing_t crossing;
+    if (crossingDetector.addSample(crossingTracks[entry], receivedAt, rssi, crossing)) {
+        reportCrossing(*beaconTable.getBeacon(entry), crossing);
+    }
+    return result == BeaconTable::BEACON_NEW;
+}
+
+void expireBeacons(void)
+{
+    uint32_t now = uptime.read_ms();
+
+    /* Tags that are lost after their peak end their crossing */
+    for (uint16_t i = 0; i < BeaconTable::MAX_BEACONS; i++) {
+        const BeaconTable::Beacon_t *beacon = beaconTable.getBeacon(i);
+        CrossingDetector::Crossing_t crossing;
+        if (beacon != NULL && crossingDetector.checkTimeout(crossingTracks[i], now, crossing)) {
+            reportCrossing(*beacon, crossing);
+        }
+    }
+
+    beaconTable.expire(now);
+}
+
+void printBeaconSummary(void)
+{
+    uint32_t now = uptime.read_ms();
+
+    CONSOLE_PRINTF("%u beacons\r\n", beaconTable.getNumBeacons());
+    for (uint16_t i = 0; i < BeaconTable::MAX_BEACONS; i++) {
+        const BeaconTable::Beacon_t *beacon = beaconTable.getBeacon(i);
+        if (beacon == NULL) {
+            continue;
+        }
+        CONSOLE_PRINTF("  ");
+        printBeaconID(beacon->key);
+        CONSOLE_PRINTF(" rssi %d, %lu packets, last seen %lu ms ago\r\n", BeaconTable::getRSSI(*beacon),
+               (unsigned long) beacon->count, (unsigned long) (now - beacon->lastSeen));
+    }
+}
+
+void updateScanFilter(void);
+
+/*
+ * Filter an advertisement report and record it in the beacon table. Only new
+ * beacons are printed: the URL of Eddystone-URL frames, and the namespace and
+ * instance of Eddystone-UID frames.
+ */
+void parseAdvertisement(const AdvertisementReport_t *report)
+{
+    if (!controllerFiltering && !acceptList.accepts(report)) {
+        return;
+    }
+    if (acceptList.isWhitelistStale() && !filterUpdateScheduled) {
+        /* A namespace was resolved to a new address */
+        filterUpdateScheduled = true;
+        if (eventQueue.call(updateScanFilter) == 0) {
+            filterUpdateScheduled = false;
+        }
+    }
+
+    /* Time of reception of the packet, on the uptime timer */
+    uint32_t receivedAt = uptime.read_ms() - (us_ticker_read() - report->timestamp) / 1000;
+#if MBED_CONF_APP_UPLINK_ENABLED
+    uplink.addScanReport(*report, receivedAt);
+#endif
+
+    static const uint16_t EDDYSTONE_UUID = 0xFEAA;
+    static const uint8_t  FRAME_TYPE_URL = 0x10;
+    static const uint8_t  FRAME_TYPE_UID = 0x00;
+    /* Frame type and TX power come before the URL or the UID */
+    static const uint8_t  FRAME_HEADER_SIZE = 2;
+
+    const uint8_t *serviceData;
+    uint8_t        serviceDataLength;
+    if (!adFindServiceData(report->advertisingData, report->advertisingDataLen, EDDYSTONE_UUID, serviceData, serviceDataLength) ||
+        serviceDataLength < FRAME_HEADER_SIZE) {
         return;
     }
 
-    /* From second byte onwards we can have a character or a suffix */
-    while(index < uriLen) {
-        if (uriData[index] < NUM_SUFFIXES) {
-            printf("%s", suffixes[uriData[index]]);
-        } else {
-            printf("%c", uriData[index]);
+    if (serviceData[0] == FRAME_TYPE_URL) {
+        BeaconTable::Key_t key;
+        BeaconTable::makeAddressKey(key, report->peerAddr);
+        if (updateBeacon(key, report->rssi, receivedAt)) {
+            decodeURI(serviceData + FRAME_HEADER_SIZE, serviceDataLength - FRAME_HEADER_SIZE);
+        }
+    } else if (serviceData[0] == FRAME_TYPE_UID && serviceDataLength >= FRAME_HEADER_SIZE + BeaconTable::ID_SIZE) {
+        BeaconTable::Key_t key;
+        BeaconTable::makeUIDKey(key, serviceData + FRAME_HEADER_SIZE);
+        if (updateBeacon(key, report->rssi, receivedAt)) {
+            printBeaconID(key);
+            CONSOLE_PRINTF("\r\n");
         }
-        index++;
     }
+}
 
-    printf("\n\r");
+/*
+ * Parse a batch of the buffered advertisement reports. The job posts itself
+ * again while reports remain, so that BLE events are processed in between.
+ */
+void processAdvertisements(void)
+{
+    processingScheduled = false;
+
+    const AdvertisementReport_t *report;
+    for (unsigned i = 0; i < ADVERTISEMENT_BATCH_SIZE && (report = advertisementRing.front()) != NULL; i++) {
+        parseAdvertisement(report);
+        advertisementRing.pop();
+    }
+
+    if (advertisementRing.front() != NULL && !processingScheduled) {
+        processingScheduled = true;
+        if (eventQueue.call(processAdvertisements) == 0) {
+            processingScheduled = false;
+        }
+    }
 }
 
 /*
- * This function is called every time we scan an advertisement.
+ * This function is called every time we scan an advertisement. The report is
+ * only copied here, it is parsed later by processAdvertisements.
  */
 void advertisementCallback(const Gap::AdvertisementCallbackParams_t *params)
 {
-    struct AdvertisingData_t {
-        uint8_t                        length; /* doesn't include itself */
-        GapAdvertisingData::DataType_t dataType;
-        uint8_t                        data[1];
-    } AdvDataPacket;
-
-    struct ApplicationData_t {
-        uint8_t applicationSpecificId[2];
-        uint8_t frameType;
-        uint8_t advPowerLevels;
-        uint8_t uriData[URI_MAX_LENGTH];
-    } AppDataPacket;
-
-    const uint8_t BEACON_UUID[sizeof(UUID::ShortUUIDBytes_t)] = {0xAA, 0xFE};
-    const uint8_t FRAME_TYPE_URL                              = 0x10;
-    const uint8_t APPLICATION_DATA_OFFSET                     = sizeof(ApplicationData_t) + sizeof(AdvDataPacket.dataType) - sizeof(AppDataPacket.uriData);
-
-    AdvertisingData_t *pAdvData;
-    size_t index = 0;
-    while(index < params->advertisingDataLen) {
-        pAdvData = (AdvertisingData_t *)&params->advertisingData[index];
-        if (pAdvData->dataType == GapAdvertisingData::SERVICE_DATA) {
-            ApplicationData_t *pAppData = (ApplicationData_t *) pAdvData->data;
-            if (!memcmp(pAppData->applicationSpecificId, BEACON_UUID, sizeof(BEACON_UUID)) && (pAppData->frameType == FRAME_TYPE_URL)) {
-                decodeURI(pAppData->uriData, pAdvData->length - APPLICATION_DATA_OFFSET);
-                break;
-            }
+    advertisementCount++;
+
+    if (advertisementRing.push(params) && !processingScheduled) {
+        processingScheduled = true;
+        if (eventQueue.call(processAdvertisements) == 0) {
+            processingScheduled = false;
         }
-        index += (pAdvData->length + 1);
     }
 }
 
+/*
+ * Program the accept list into the controller whitelist if it changed, and
+ * restart scanning with the controller filter on or off as needed.
+ */
+void updateScanFilter(void)
+{
+    Gap &gap   = BLE::Instance().gap();
+    bool stale = acceptList.isWhitelistStale();
+
+    filterUpdateScheduled = false;
+
+    if (!stale && (controllerFiltering == (!discoveryWindow && whitelistProgrammed))) {
+        /* Nothing to change */
+        return;
+    }
+
+    /* The whitelist and the scanning policy can't change during a scan */
+    gap.stopScan();
+    if (stale) {
+        whitelistProgrammed = acceptList.programWhitelist(gap);
+    }
+
+    bool filter = !discoveryWindow && whitelistProgrammed;
+    if (gap.setScanningPolicyMode(filter ? Gap::SCAN_POLICY_FILTER_ALL_ADV : Gap::SCAN_POLICY_IGNORE_WHITELIST) != BLE_ERROR_NONE) {
+        /* Fall back to filtering in software */
+        filter = false;
+    }
+    controllerFiltering = filter;
+
+    gap.startScan(advertisementCallback);
+}
+
+void stopDiscovery(void)
+{
+    discoveryWindow = false;
+    updateScanFilter();
+}
+
+void startDiscovery(void)
+{
+    discoveryWindow = true;
+    updateScanFilter();
+    eventQueue.call_in(DISCOVERY_WINDOW_SECONDS * 1000, stopDiscovery);
+}
+
+void printWakeups(void)
+{
+    static uint32_t lastCount = 0;
+
+    CONSOLE_PRINTF("%lu wakeups/s (%s filtering), %lu reports dropped\r\n",
+           (unsigned long) ((advertisementCount - lastCount) / WAKEUP_REPORT_PERIOD_SECONDS),
+           controllerFiltering ? "controller" : "software",
+           (unsigned long) advertisementRing.getDropped());
+    lastCount = advertisementCount;
+
+#if MBED_CONF_APP_UPLINK_ENABLED
+    uplink.sendStats(advertisementCount, advertisementRing.getDropped());
+#endif
+}
+
 void onBleInitError(BLE &ble, ble_error_t error)
 {
    /* Initialization error handling should go here */
@@ -137,8 +378,26 @@ void bleInitComplete(BLE::InitializationCompleteCallbackContext *params)
         return;
     }
 
+    acceptList.addNamespace(acceptedNamespaceID);
+
     ble.gap().setScanParams(1800 /* scan interval */, 1500 /* scan window */);
     ble.gap().startScan(advertisementCallback);
+
+    if (acceptList.hasNamespaces()) {
+        startDiscovery();
+        eventQueue.call_every(DISCOVERY_PERIOD_SECONDS * 1000, startDiscovery);
+    } else {
+        updateScanFilter();
+    }
+    eventQueue.call_every(WAKEUP_REPORT_PERIOD_SECONDS * 1000, printWakeups);
+
+    uptime.start();
+    eventQueue.call_every(BeaconTable::TICK_MSEC, expireBeacons);
+    eventQueue.call_every(BEACON_SUMMARY_PERIOD_SECONDS * 1000, printBeaconSummary);
+
+#if MBED_CONF_APP_UPLINK_ENABLED
+    eventQueue.call_every(UPLINK_FLUSH_PERIOD_MSEC, &uplink, &ReportUplink::flush);
+#endif
 }
 
 void scheduleBleEventsProcessing(BLE::OnEventsToProcessCallbackContext* context) {
@@ -0,0 +1,279 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2006-2015 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Energy model of a beacon running EddystoneService, projecting the battery
+ * lifetime with and without the battery policy (setBatteryPolicy()).
+ *
+ * The current figures of the board are inputs: the sleep current, and the
+ * charge drawn by one advertising event at each TX power mode, as measured
+ * on the board or taken from the datasheets. Every frame period is taken as
+ * one advertising event of that frame. The battery voltage is modelled as
+ * falling linearly with the charge used, from its initial voltage to its
+ * cutoff voltage; the battery policy is applied to that voltage as
+ * EddystoneService does (the hysteresis plays no part as the voltage never
+ * rises).
+ *
+ * Build it with:
+ *     g++ -O2 -o battery_lifetime battery_lifetime.cpp
+ *
+ * Usage:
+ *     battery_lifetime -c capacity -s sleep -q charges [-v initial,cutoff] [-p url,uid,tlm,eid]
+ *                      [-t txPowerMode] [-b full,empty,multiplier,minTxPowerMode]
+ * where
+ *     -c  battery capacity in mAh
+ *     -s  sleep current in uA
+ *     -q  charge of one advertising event in uC, at the TX power modes
+ *         LOWEST, LOW, MEDIUM and HIGH
+ *     -v  initial and cutoff battery voltages in mV (default 3000,2000)
+ *     -p  URL, UID, TLM and EID frame periods in ms, zero disables a frame
+ *         (default 700,300,2000,0, the defaults of config.json)
+ *     -t  TX power mode, 0 to 3 (default 1, TX_POWER_MODE_LOW)
+ *     -b  battery policy: full and empty voltages in mV, period multiplier
+ *         at empty and lowest TX power mode (default 2800,2200,4,0)
+ * For example, for a 220 mAh CR2032 cell, with current figures that only
+ * illustrate the orders of magnitude and must be replaced with the board's:
+ *     ./battery_lifetime -c 220 -s 2.5 -q 12,14,17,22
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+
+/**
+ * Same values as in EddystoneService.
+ */
+static const unsigned NUM_TX_POWER_MODES = 4;
+static const unsigned NUM_BATTERY_LEVELS = 4;
+
+/**
+ * Frames advertised periodically: URL, UID, TLM and EID.
+ */
+static const unsigned NUM_FRAMES = 4;
+
+/**
+ * Bounds of a non-connectable advertising interval, applied by
+ * EddystoneService::correctAdvertisementPeriod().
+ */
+static const uint32_t MIN_PERIOD_MSEC = 100;
+static const uint32_t MAX_PERIOD_MSEC = 10240;
+
+/**
+ * Step of the simulation of the discharge.
+ */
+static const double STEP_HOURS = 1.0;
+
+struct BatteryPolicy_t {
+    uint16_t fullVoltage;
+    uint16_t emptyVoltage;
+    uint8_t  maxPeriodMultiplier;
+    uint8_t  minTxPowerMode;
+};
+
+struct Model_t {
+    double          capacityMah;
+    double          sleepMicroAmps;
+    double          eventMicroCoulombs[NUM_TX_POWER_MODES];
+    double          initialVoltage;
+    double          cutoffVoltage;
+    uint32_t        framePeriods[NUM_FRAMES];
+    uint8_t         txPowerMode;
+    BatteryPolicy_t batteryPolicy;
+};
+
+/**
+ * As EddystoneService::computeBatteryLevel().
+ */
+static uint8_t computeBatteryLevel(const BatteryPolicy_t &policy, uint16_t batteryVoltage)
+{
+    if (batteryVoltage >= policy.fullVoltage) {
+        return 0;
+    } else if (batteryVoltage <= policy.emptyVoltage) {
+        return NUM_BATTERY_LEVELS - 1;
+    }
+
+    uint32_t range = policy.fullVoltage - policy.emptyVoltage;
+    uint32_t drop  = policy.fullVoltage - batteryVoltage;
+    return (drop * (NUM_BATTERY_LEVELS - 1) + range - 1) / range;
+}
+
+/**
+ * As EddystoneService::getAdaptedFramePeriod(), without the density backoff.
+ */
+static uint32_t getAdaptedFramePeriod(const BatteryPolicy_t &policy, uint8_t batteryLevel, uint32_t framePeriod)
+{
+    uint32_t adaptedPeriod = framePeriod;
+    if (batteryLevel != 0 && policy.maxPeriodMultiplier > 1) {
+        adaptedPeriod += framePeriod * (policy.maxPeriodMultiplier - 1) * batteryLevel / (NUM_BATTERY_LEVELS - 1);
+    }
+    if (adaptedPeriod > 0xFFFF) {
+        adaptedPeriod = 0xFFFF;
+    }
+    if (adaptedPeriod < MIN_PERIOD_MSEC) {
+        return MIN_PERIOD_MSEC;
+    }
+    return (adaptedPeriod > MAX_PERIOD_MSEC) ? MAX_PERIOD_MSEC : adaptedPeriod;
+}
+
+/**
+ * As EddystoneService::getAdaptedTxPowerMode().
+ */
+static uint8_t getAdaptedTxPowerMode(const BatteryPolicy_t &policy, uint8_t batteryLevel, uint8_t txPowerMode)
+{
+    if (batteryLevel == 0 || txPowerMode <= policy.minTxPowerMode) {
+        return txPowerMode;
+    }
+    return (txPowerMode - policy.minTxPowerMode > batteryLevel) ? txPowerMode - batteryLevel : policy.minTxPowerMode;
+}
+
+/**
+ * Average current in uA at a battery level.
+ */
+static double averageCurrent(const Model_t &model, const BatteryPolicy_t &policy, uint8_t batteryLevel)
+{
+    double  current     = model.sleepMicroAmps;
+    uint8_t txPowerMode = getAdaptedTxPowerMode(policy, batteryLevel, model.txPowerMode);
+    for (unsigned frame = 0; frame < NUM_FRAMES; frame++) {
+        if (model.framePeriods[frame] != 0) {
+            uint32_t period = getAdaptedFramePeriod(policy, batteryLevel, model.framePeriods[frame]);
+            current += model.eventMicroCoulombs[txPowerMode] * 1000.0 / period;
+        }
+    }
+    return current;
+}
+
+/**
+ * Discharge the battery and print the time spent at each battery level.
+ *
+ * @return The lifetime in days.
+ */
+static double project(const Model_t &model, const BatteryPolicy_t &policy, const char *name)
+{
+    double capacityMicroAmpHours = model.capacityMah * 1000.0;
+    double used                  = 0;
+    double hours                 = 0;
+    double levelHours[NUM_BATTERY_LEVELS] = {0};
+
+    while (used < capacityMicroAmpHours) {
+        double  voltage      = model.initialVoltage - (model.initialVoltage - model.cutoffVoltage) * used / capacityMicroAmpHours;
+        uint8_t batteryLevel = (policy.fullVoltage == 0) ? 0 : computeBatteryLevel(policy, (uint16_t) voltage);
+        double  current      = averageCurrent(model, policy, batteryLevel);
+        double  step         = STEP_HOURS;
+        if (used + current * step > capacityMicroAmpHours) {
+            step = (capacityMicroAmpHours - used) / current;
+        }
+        used                     += current * step;
+        hours                    += step;
+        levelHours[batteryLevel] += step;
+    }
+
+    printf("%s: %.0f days\n", name, hours / 24);
+    for (uint8_t level = 0; level < NUM_BATTERY_LEVELS; level++) {
+        if (policy.fullVoltage == 0 && level != 0) {
+            break;
+        }
+        printf("    level %u: %6.2f uA, TX power mode %u, %6.0f days\n", level, averageCurrent(model, policy, level),
+               getAdaptedTxPowerMode(policy, level, model.txPowerMode), levelHours[level] / 24);
+    }
+    return hours / 24;
+}
+
+/**
+ * Parse a comma separated list of exactly @p count numbers.
+ */
+static bool parseList(const char *text, double *values, unsigned count)
+{
+    for (unsigned i = 0; i < count; i++) {
+        char *end;
+        values[i] = strtod(text, &end);
+        if (end == text || (i + 1 < count && *end != ',') || (i + 1 == count && *end != '\0')) {
+            return false;
+        }
+        text = end + 1;
+    }
+    return true;
+}
+
+static int usage(const char *program)
+{
+    fprintf(stderr, "usage: %s -c capacity -s sleep -q charges [-v initial,cutoff] [-p url,uid,tlm,eid]\n"
+                    "       [-t txPowerMode] [-b full,empty,multiplier,minTxPowerMode]\n", program);
+    return 2;
+}
+
+int main(int argc, char *argv[])
+{
+    Model_t model = {0, 0, {0}, 3000, 2000, {700, 300, 2000, 0}, 1, {2800, 2200, 4, 0}};
+    bool    haveCapacity = false, haveSleep = false, haveCharges = false;
+    double  values[NUM_FRAMES];
+    int     option;
+
+    while ((option = getopt(argc, argv, "c:s:q:v:p:t:b:")) != -1) {
+        switch (option) {
+            case 'c':
+                haveCapacity = parseList(optarg, &model.capacityMah, 1) && model.capacityMah > 0;
+                break;
+            case 's':
+                haveSleep = parseList(optarg, &model.sleepMicroAmps, 1) && model.sleepMicroAmps >= 0;
+                break;
+            case 'q':
+                haveCharges = parseList(optarg, model.eventMicroCoulombs, NUM_TX_POWER_MODES);
+                break;
+            case 'v':
+                if (!parseList(optarg, values, 2) || values[1] >= values[0]) {
+                    return usage(argv[0]);
+                }
+                model.initialVoltage = values[0];
+                model.cutoffVoltage  = values[1];
+                break;
+            case 'p':
+                if (!parseList(optarg, values, NUM_FRAMES)) {
+                    return usage(argv[0]);
+                }
+                for (unsigned frame = 0; frame < NUM_FRAMES; frame++) {
+                    model.framePeriods[frame] = (uint32_t) values[frame];
+                }
+                break;
+            case 't':
+                if (!parseList(optarg, values, 1) || values[0] < 0 || values[0] >= NUM_TX_POWER_MODES) {
+                    return usage(argv[0]);
+                }
+                model.txPowerMode = (uint8_t) values[0];
+                break;
+            case 'b':
+                if (!parseList(optarg, values, 4) || values[1] >= values[0] || values[3] >= NUM_TX_POWER_MODES) {
+                    return usage(argv[0]);
+                }
+                model.batteryPolicy.fullVoltage         = (uint16_t) values[0];
+                model.batteryPolicy.emptyVoltage        = (uint16_t) values[1];
+                model.batteryPolicy.maxPeriodMultiplier = (uint8_t) values[2];
+                model.batteryPolicy.minTxPowerMode      = (uint8_t) values[3];
+                break;
+            default:
+                return usage(argv[0]);
+        }
+    }
+    if (!haveCapacity || !haveSleep || !haveCharges) {
+        return usage(argv[0]);
+    }
+
+    BatteryPolicy_t disabled = {0, 0, 1, 0};
+    double withoutPolicy = project(model, disabled, "without battery policy");
+    double withPolicy    = project(model, model.batteryPolicy, "with battery policy");
+    printf("lifetime x%.2f\n", withPolicy / withoutPolicy);
+    return 0;
+}
@@ -0,0 +1,163 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2006-2015 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Simulation of the collisions between beacons that advertise in the same
+ * place, to size the advertising jitter (setAdvertisingJitter()) and the
+ * density backoff (setDensityBackoff()).
+ *
+ * Every beacon puts an advertising event on air every period, stretched by
+ * the period multiplier of the density backoff, plus the random advDelay of
+ * the link layer (0 to 10 ms) and the random jitter of EddystoneService. An
+ * event is taken to last EVENT_DURATION_MSEC, on all three channels, and is
+ * lost if another event starts during it or ends after it started. The
+ * beacons either start at the same time, as when they are powered on
+ * together, or at a random phase.
+ *
+ * Build it with:
+ *     g++ -O2 -o collision_simulator collision_simulator.cpp
+ *
+ * Usage:
+ *     collision_simulator [-n beacons] [-t period] [-j jitter] [-m multiplier] [-s] [-d duration]
+ * where -t, -j and -d are in ms and -s starts the beacons together. Without
+ * any option, the scenarios quoted when the jitter and the density backoff
+ * were added are run: 50, 200 and 500 beacons advertising every second,
+ * started together with and without 50 ms of jitter, and twice at a random
+ * phase, the second time with the periods of 200 and 500 beacons stretched
+ * 3 times. The random phases weigh on the results, so these are run with
+ * the sequence of rand() seeded with 1; the quoted figures come from glibc,
+ * and other C libraries give figures a few hundredths apart.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <vector>
+#include <algorithm>
+
+/**
+ * Air time of an advertising event: a 31 byte PDU on each of the three
+ * advertising channels, and the switches between the channels.
+ */
+static const double EVENT_DURATION_MSEC = 0.376 * 3 + 0.3;
+
+/**
+ * Upper bound of the advDelay added by the link layer to every advertising
+ * interval.
+ */
+static const double ADV_DELAY_MSEC = 10;
+
+struct Scenario_t {
+    unsigned beacons;
+    double   periodMsec;
+    double   jitterMsec;
+    unsigned periodMultiplier;
+    bool     startTogether;
+    double   durationMsec;
+};
+
+static double nextRandom(void)
+{
+    return rand() / (RAND_MAX + 1.0);
+}
+
+static void simulate(const Scenario_t &scenario)
+{
+    double              period = scenario.periodMsec * scenario.periodMultiplier;
+    std::vector<double> events;
+
+    for (unsigned beacon = 0; beacon < scenario.beacons; beacon++) {
+        double time = scenario.startTogether ? 0 : nextRandom() * period;
+        while (time < scenario.durationMsec) {
+            events.push_back(time);
+            time += period + nextRandom() * ADV_DELAY_MSEC + nextRandom() * scenario.jitterMsec;
+        }
+    }
+    std::sort(events.begin(), events.end());
+
+    size_t received = 0;
+    for (size_t i = 0; i < events.size(); i++) {
+        bool collided = (i > 0 && events[i] - events[i - 1] < EVENT_DURATION_MSEC) ||
+                        (i + 1 < events.size() && events[i + 1] - events[i] < EVENT_DURATION_MSEC);
+        received += collided ? 0 : 1;
+    }
+
+    printf("%4u beacons, %4.0f ms x%u, jitter %3.0f ms, %-13s collision probability %.3f, %.3f events/s received per beacon\n",
+           scenario.beacons, scenario.periodMsec, scenario.periodMultiplier, scenario.jitterMsec,
+           scenario.startTogether ? "together:" : "random phase:",
+           1 - (double) received / events.size(), received / (scenario.durationMsec / 1000) / scenario.beacons);
+}
+
+int main(int argc, char *argv[])
+{
+    Scenario_t scenario = {200, 1000, 0, 1, false, 600000};
+    int        option;
+
+    srand(1);
+    if (argc == 1) {
+        static const unsigned beacons[] = {50, 200, 500};
+        static const Scenario_t variants[] = {
+            {0, 1000,  0, 1, true,  600000},
+            {0, 1000,  0, 1, false, 600000},
+            {0, 1000, 50, 1, true,  600000},
+            {0, 1000,  0, 3, false, 600000}
+        };
+        for (unsigned i = 0; i < sizeof(beacons) / sizeof(beacons[0]); i++) {
+            for (unsigned j = 0; j < sizeof(variants) / sizeof(variants[0]); j++) {
+                scenario         = variants[j];
+                scenario.beacons = beacons[i];
+                if (scenario.beacons < 200) {
+                    scenario.periodMultiplier = 1;
+                }
+                simulate(scenario);
+            }
+        }
+        return 0;
+    }
+
+    while ((option = getopt(argc, argv, "n:t:j:m:sd:")) != -1) {
+        switch (option) {
+            case 'n':
+                scenario.beacons = atoi(optarg);
+                break;
+            case 't':
+                scenario.periodMsec = atof(optarg);
+                break;
+            case 'j':
+                scenario.jitterMsec = atof(optarg);
+                break;
+            case 'm':
+                scenario.periodMultiplier = atoi(optarg);
+                break;
+            case 's':
+                scenario.startTogether = true;
+                break;
+            case 'd':
+                scenario.durationMsec = atof(optarg);
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-n beacons] [-t period] [-j jitter] [-m multiplier] [-s] [-d duration]\n", argv[0]);
+                return 2;
+        }
+    }
+    if (scenario.beacons == 0 || scenario.periodMsec <= 0 || scenario.periodMultiplier == 0) {
+        fprintf(stderr, "%s: the number of beacons, the period and the multiplier must be positive\n", argv[0]);
+        return 2;
+    }
+
+    simulate(scenario);
+    return 0;
+}
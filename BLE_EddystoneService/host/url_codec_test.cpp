@@ -0,0 +1,229 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2006-2015 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Host checks of EddystoneURLCodec.h:
+ *   - the encoder produces the same bytes as the encoder URLFrame used
+ *     before the codec, which compared every position against all the
+ *     expansions, on known URLs and on random URLs built from fragments of
+ *     the expansions;
+ *   - every URL with an encoded scheme that fits in a frame decodes back to
+ *     itself, and a decode that does not fit in the buffer fails;
+ *   - the time taken by both encoders on the same URL is printed.
+ *
+ * Build it with:
+ *     g++ -O2 -I../source -o url_codec_test url_codec_test.cpp
+ *
+ * The exit status is the number of failed checks.
+ */
+
+#include <stdio.h>
+#include <time.h>
+#include "EddystoneURLCodec.h"
+
+/**
+ * Size of the encoded URL in an Eddystone-URL frame.
+ */
+static const size_t URL_DATA_MAX = 18;
+
+/**
+ * Number of random URLs compared.
+ */
+static const unsigned RANDOM_URLS = 200000;
+
+/**
+ * Number of times each encoder is run for the timing.
+ */
+static const unsigned TIMING_RUNS = 2000000;
+
+static unsigned failures = 0;
+
+#define CHECK(condition, ...)                   \
+    do {                                        \
+        if (!(condition)) {                     \
+            failures++;                         \
+            if (failures <= 10) {               \
+                printf("FAIL: " __VA_ARGS__);   \
+                printf("\n");                   \
+            }                                   \
+        }                                       \
+    } while (0)
+
+/**
+ * The encoder URLFrame used before EddystoneURLCodec.h.
+ */
+static size_t referenceEncode(const char *url, uint8_t *encoded, size_t encodedSize)
+{
+    static const char *prefixes[] = {"http://www.", "https://www.", "http://", "https://"};
+    static const char *suffixes[] = {".com/", ".org/", ".edu/", ".net/", ".info/", ".biz/", ".gov/",
+                                     ".com",  ".org",  ".edu",  ".net",  ".info",  ".biz",  ".gov"};
+    const size_t NUM_PREFIXES = sizeof(prefixes) / sizeof(char *);
+    const size_t NUM_SUFFIXES = sizeof(suffixes) / sizeof(char *);
+    size_t       encodedLength = 0;
+
+    if ((url == NULL) || (strlen(url) == 0)) {
+        return 0;
+    }
+
+    for (size_t i = 0; i < NUM_PREFIXES; i++) {
+        size_t prefixLen = strlen(prefixes[i]);
+        if (strncmp(url, prefixes[i], prefixLen) == 0) {
+            encoded[encodedLength++] = i;
+            url += prefixLen;
+            break;
+        }
+    }
+
+    while (*url && (encodedLength < encodedSize)) {
+        size_t i;
+        for (i = 0; i < NUM_SUFFIXES; i++) {
+            size_t suffixLen = strlen(suffixes[i]);
+            if (strncmp(url, suffixes[i], suffixLen) == 0) {
+                encoded[encodedLength++] = i;
+                url += suffixLen;
+                break;
+            }
+        }
+        if (i == NUM_SUFFIXES) {
+            encoded[encodedLength++] = *url++;
+        }
+    }
+
+    return encodedLength;
+}
+
+/**
+ * A small xorshift generator, so that the random URLs are the same on every
+ * host.
+ */
+static uint32_t nextRandom(void)
+{
+    static uint32_t state = 2463534242u;
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+static void checkEncoding(const char *url)
+{
+    uint8_t reference[URL_DATA_MAX];
+    uint8_t encoded[URL_DATA_MAX];
+    size_t  referenceLength = referenceEncode(url, reference, sizeof(reference));
+    size_t  encodedLength   = encodeEddystoneURL(url, encoded, sizeof(encoded));
+
+    CHECK(encodedLength == referenceLength && memcmp(encoded, reference, encodedLength) == 0,
+          "'%s' is not encoded as before", url);
+
+    /* Only URLs with an encoded scheme that were not truncated decode back */
+    size_t  prefixLength;
+    uint8_t longer[URL_DATA_MAX + 1];
+    if (matchEddystoneURLPrefix(url, prefixLength) == EDDYSTONE_URL_NUM_PREFIXES ||
+        encodeEddystoneURL(url, longer, sizeof(longer)) > sizeof(encoded)) {
+        return;
+    }
+
+    char decoded[EDDYSTONE_URL_DECODED_SIZE(URL_DATA_MAX)];
+    int  decodedLength = decodeEddystoneURL(encoded, encodedLength, decoded, sizeof(decoded));
+    CHECK(decodedLength == (int) strlen(url) && strcmp(decoded, url) == 0,
+          "'%s' decodes to '%s'", url, (decodedLength < 0) ? "" : decoded);
+
+    if (decodedLength > 0) {
+        CHECK(decodeEddystoneURL(encoded, encodedLength, decoded, decodedLength) == -1,
+              "'%s' decodes into a buffer that is too small", url);
+    }
+}
+
+static void checkKnownURLs(void)
+{
+    static const char *urls[] = {
+        "https://www.mbed.com/",
+        "http://www.example.org/index.html",
+        "http://goo.gl/S6zT6P",
+        "https://developer.mbed.org/teams/Bluetooth-Low-Energy/",
+        "https://www.info.info/info",
+        "http://x.co",
+        "http://www.com.com",
+        "ftp://example.com/",
+        "www.example.com",
+        ".com/.org/",
+        "https://www.",
+        "http:/",
+        ""
+    };
+    for (size_t i = 0; i < sizeof(urls) / sizeof(urls[0]); i++) {
+        checkEncoding(urls[i]);
+    }
+
+    /* The first bytes of a known frame */
+    uint8_t encoded[URL_DATA_MAX];
+    static const uint8_t expected[] = {0x01, 'm', 'b', 'e', 'd', 0x00};
+    CHECK(encodeEddystoneURL("https://www.mbed.com/", encoded, sizeof(encoded)) == sizeof(expected) &&
+          memcmp(encoded, expected, sizeof(expected)) == 0, "https://www.mbed.com/ is not encoded as in the spec");
+
+    /* The decoder also understands the UriBeacon scheme */
+    static const uint8_t urn[] = {0x04, 'a', 'b'};
+    char decoded[EDDYSTONE_URL_DECODED_SIZE(sizeof(urn))];
+    CHECK(decodeEddystoneURL(urn, sizeof(urn), decoded, sizeof(decoded)) == 11 && strcmp(decoded, "urn:uuid:ab") == 0,
+          "urn:uuid: is not decoded");
+
+    /* Unknown schemes are not decoded */
+    static const uint8_t unknown[] = {0x05, 'a'};
+    CHECK(decodeEddystoneURL(unknown, sizeof(unknown), decoded, sizeof(decoded)) == -1, "unknown scheme is decoded");
+}
+
+static void checkRandomURLs(void)
+{
+    static const char *fragments[] = {
+        "http://", "https://", "www.", "http", "s", ".com", ".com/", ".org", ".info", "/", ".in", ".inf",
+        ".biz/", "a", "b", "x", ".", "go", ".gov", "e", "du", ".edu/", ":", "ww", ".net", ".ne"
+    };
+    const size_t NUM_FRAGMENTS = sizeof(fragments) / sizeof(fragments[0]);
+
+    for (unsigned i = 0; i < RANDOM_URLS; i++) {
+        char     url[64] = "";
+        unsigned count   = nextRandom() % 8;
+        for (unsigned j = 0; j < count && strlen(url) <= 40; j++) {
+            strcat(url, fragments[nextRandom() % NUM_FRAGMENTS]);
+        }
+        checkEncoding(url);
+    }
+}
+
+static double timeEncoder(size_t (*encode)(const char *, uint8_t *, size_t), const char *url)
+{
+    uint8_t         encoded[URL_DATA_MAX];
+    volatile size_t total = 0;
+    clock_t         start = clock();
+    for (unsigned i = 0; i < TIMING_RUNS; i++) {
+        total += encode(url, encoded, sizeof(encoded));
+    }
+    return (double) (clock() - start) * 1e9 / CLOCKS_PER_SEC / TIMING_RUNS;
+}
+
+int main(void)
+{
+    checkKnownURLs();
+    checkRandomURLs();
+
+    const char *url       = "https://www.mbed.com/en/info.org/x";
+    double      reference = timeEncoder(referenceEncode, url);
+    double      codec     = timeEncoder(encodeEddystoneURL, url);
+    printf("%s: %.1f ns before, %.1f ns with the codec (%.1fx)\n", url, reference, codec, reference / codec);
+
+    printf("%u failures\n", failures);
+    return failures;
+}
@@ -0,0 +1,102 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2006-2015 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __AES128_H__
+#define __AES128_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * Class that encapsulates a single AES-128 key and encrypts (or decrypts)
+ * one 16-byte block at a time, as needed by Eddystone-EID and eTLM.
+ *
+ * On nRF5 targets the block encryption is done by the ECB peripheral through
+ * the SoftDevice. Elsewhere, or if the SoftDevice refuses the request, a
+ * table-driven software implementation is used instead.
+ */
+class AES128
+{
+public:
+    /**
+     * The size in bytes of an AES block.
+     */
+    static const size_t BLOCK_SIZE = 16;
+    /**
+     * The size in bytes of an AES-128 key.
+     */
+    static const size_t KEY_SIZE   = 16;
+
+    /**
+     * Construct a new instance of this class with an all-zero key.
+     */
+    AES128(void);
+
+    /**
+     * Set the key used by subsequent encryptBlock() and decryptBlock() calls.
+     *
+     * @param[in] keyIn
+     *              Pointer to the KEY_SIZE bytes of the new key.
+     */
+    void setKey(const uint8_t *keyIn);
+
+    /**
+     * Encrypt a single block with AES-128 in ECB mode.
+     *
+     * @param[in] plaintext
+     *              Pointer to the BLOCK_SIZE bytes to encrypt.
+     * @param[out] ciphertext
+     *              Pointer to where the BLOCK_SIZE encrypted bytes will be
+     *              stored. This may be the same as @p plaintext.
+     */
+    void encryptBlock(const uint8_t *plaintext, uint8_t *ciphertext);
+
+    /**
+     * Decrypt a single block with AES-128 in ECB mode.
+     *
+     * @param[in] ciphertext
+     *              Pointer to the BLOCK_SIZE bytes to decrypt.
+     * @param[out] plaintext
+     *              Pointer to where the BLOCK_SIZE decrypted bytes will be
+     *              stored. This may be the same as @p ciphertext.
+     *
+     * @note This is only needed to unwrap keys written over GATT, so it is
+     *       always done in software and is not optimised for speed.
+     */
+    void decryptBlock(const uint8_t *ciphertext, uint8_t *plaintext);
+
+private:
+    /**
+     * Number of rounds of AES-128.
+     */
+    static const uint8_t NUM_ROUNDS = 10;
+
+    /**
+     * Encrypt a block with the software implementation.
+     */
+    void softwareEncryptBlock(const uint8_t *plaintext, uint8_t *ciphertext) const;
+
+    /**
+     * The current key.
+     */
+    uint8_t  key[KEY_SIZE];
+    /**
+     * The expanded key schedule used by the software implementation.
+     */
+    uint32_t roundKeys[4 * (NUM_ROUNDS + 1)];
+};
+
+#endif  /* __AES128_H__ */
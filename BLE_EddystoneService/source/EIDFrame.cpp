@@ -0,0 +1,140 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2006-2015 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "EIDFrame.h"
+
+EIDFrame::EIDFrame(void) :
+    rotationExponent(0),
+    identityKeySet(false),
+    beaconTime(0),
+    lastBeaconTimeRead(0),
+    ephemeralIDWindow(0),
+    ephemeralIDValid(false)
+{
+    memset(identityKey, 0, sizeof(EIDIdentityKey_t));
+    memset(ephemeralID, 0, sizeof(ephemeralID));
+}
+
+void EIDFrame::setEIDData(const EIDIdentityKey_t &identityKeyIn, uint8_t rotationExponentIn, uint32_t beaconTimeIn, uint32_t nowInMicros)
+{
+    memcpy(identityKey, identityKeyIn, sizeof(EIDIdentityKey_t));
+    rotationExponent   = (rotationExponentIn > MAX_ROTATION_EXPONENT) ? MAX_ROTATION_EXPONENT : rotationExponentIn;
+    identityKeySet     = true;
+    beaconTime         = beaconTimeIn;
+    lastBeaconTimeRead = nowInMicros;
+    ephemeralIDValid   = false;
+}
+
+bool EIDFrame::hasIdentityKey(void) const
+{
+    return identityKeySet;
+}
+
+void EIDFrame::updateBeaconTime(uint32_t nowInMicros)
+{
+    /* Unsigned subtraction yields the right elapsed time across a wrap */
+    uint32_t seconds = (nowInMicros - lastBeaconTimeRead) / 1000000;
+
+    beaconTime         += seconds;
+    lastBeaconTimeRead += seconds * 1000000;
+}
+
+bool EIDFrame::updateEphemeralID(void)
+{
+    if (!identityKeySet) {
+        return false;
+    }
+
+    uint32_t window = beaconTime >> rotationExponent;
+    if (ephemeralIDValid && window == ephemeralIDWindow) {
+        /* Still in the same rotation window, nothing to do */
+        return false;
+    }
+
+    computeEphemeralID();
+    ephemeralIDWindow = window;
+    ephemeralIDValid  = true;
+    return true;
+}
+
+uint32_t EIDFrame::getMillisToNextRotation(uint32_t nowInMicros) const
+{
+    uint32_t nextRotation  = ((beaconTime >> rotationExponent) + 1) << rotationExponent;
+    uint32_t millisElapsed = (nowInMicros - lastBeaconTimeRead) / 1000;
+    uint32_t millisLeft    = (nextRotation - beaconTime) * 1000;
+
+    return (millisLeft > millisElapsed) ? (millisLeft - millisElapsed) : 0;
+}
+
+void EIDFrame::computeEphemeralID(void)
+{
+    uint8_t block[AES128::BLOCK_SIZE];
+    uint8_t temporaryKey[AES128::KEY_SIZE];
+
+    /* Temporary key: AES(identity key, 11 x 0x00 | 0xFF salt | 0x00 0x00 | time[31:16]) */
+    memset(block, 0, sizeof(block));
+    block[11] = 0xFF;
+    block[14] = (uint8_t)(beaconTime >> 24);
+    block[15] = (uint8_t)(beaconTime >> 16);
+    aes.setKey(identityKey);
+    aes.encryptBlock(block, temporaryKey);
+
+    /* Ephemeral ID: AES(temporary key, 11 x 0x00 | K | time with the K lowest bits cleared) */
+    uint32_t quantizedTime = (beaconTime >> rotationExponent) << rotationExponent;
+    memset(block, 0, sizeof(block));
+    block[11] = rotationExponent;
+    block[12] = (uint8_t)(quantizedTime >> 24);
+    block[13] = (uint8_t)(quantizedTime >> 16);
+    block[14] = (uint8_t)(quantizedTime >> 8);
+    block[15] = (uint8_t)(quantizedTime >> 0);
+    aes.setKey(temporaryKey);
+    aes.encryptBlock(block, block);
+
+    memcpy(ephemeralID, block, EID_EPHEMERAL_ID_SIZE);
+    memset(temporaryKey, 0, sizeof(temporaryKey));
+}
+
+void EIDFrame::constructEIDFrame(uint8_t *rawFrame, int8_t advPowerLevel)
+{
+    size_t index = 0;
+
+    rawFrame[index++] = EDDYSTONE_UUID[0];                                   // 16-bit Eddystone UUID
+    rawFrame[index++] = EDDYSTONE_UUID[1];
+    rawFrame[index++] = FRAME_TYPE_EID;                                      // 1B  Type
+    rawFrame[index++] = advPowerLevel;                                       // 1B  Power @ 0meter
+
+    memcpy(rawFrame + index, ephemeralID, EID_EPHEMERAL_ID_SIZE);            // 8B  Ephemeral ID
+}
+
+size_t EIDFrame::getRawFrameSize(void) const
+{
+    return RAW_FRAME_SIZE;
+}
+
+const uint8_t* EIDFrame::getIdentityKey(void) const
+{
+    return identityKey;
+}
+
+uint8_t EIDFrame::getRotationExponent(void) const
+{
+    return rotationExponent;
+}
+
+uint32_t EIDFrame::getBeaconTime(void) const
+{
+    return beaconTime;
+}
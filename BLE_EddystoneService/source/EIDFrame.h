@@ -0,0 +1,208 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2006-2015 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __EIDFRAME_H__
+#define __EIDFRAME_H__
+
+#include <string.h>
+#include "EddystoneTypes.h"
+#include "AES128.h"
+
+/**
+ * Class that encapsulates data that belongs to the Eddystone-EID frame. For
+ * more information refer to https://github.com/google/eddystone/tree/master/eddystone-eid.
+ *
+ * The ephemeral identifier only changes once every 2^K seconds (K being the
+ * rotation exponent), so it is only recomputed when the beacon time crosses
+ * into a new rotation window.
+ */
+class EIDFrame
+{
+public:
+    /**
+     * The largest rotation exponent accepted. The rotation period is 2^K
+     * seconds, so this gives a period of about 9 hours.
+     */
+    static const uint8_t MAX_ROTATION_EXPONENT = 15;
+
+    /**
+     * Construct a new instance of this class. No Eddystone-EID frames can be
+     * built until an identity key is set with setEIDData().
+     */
+    EIDFrame(void);
+
+    /**
+     * Set the identity key, rotation exponent and beacon time.
+     *
+     * @param[in] identityKeyIn
+     *              The 128-bit identity key shared with the resolver.
+     * @param[in] rotationExponentIn
+     *              The rotation exponent K. Values above
+     *              MAX_ROTATION_EXPONENT are clamped.
+     * @param[in] beaconTimeIn
+     *              The current beacon time in seconds.
+     * @param[in] nowInMicros
+     *              The current value of the free-running microsecond ticker
+     *              that is later passed to updateBeaconTime().
+     */
+    void setEIDData(const EIDIdentityKey_t &identityKeyIn, uint8_t rotationExponentIn, uint32_t beaconTimeIn, uint32_t nowInMicros);
+
+    /**
+     * Check whether an identity key has been set.
+     *
+     * @return true if Eddystone-EID frames can be built.
+     */
+    bool hasIdentityKey(void) const;
+
+    /**
+     * Advance the beacon time. Only whole seconds are added, the remainder is
+     * carried over to the next update.
+     *
+     * @param[in] nowInMicros
+     *              A free-running microsecond timestamp. It may wrap around
+     *              at 32 bits, but it must be read at least once per wrap
+     *              period.
+     */
+    void updateBeaconTime(uint32_t nowInMicros);
+
+    /**
+     * Recompute the ephemeral identifier if the beacon time has moved into a
+     * different rotation window since it was last computed.
+     *
+     * @return true if the ephemeral identifier was recomputed and the raw
+     *         frame needs to be constructed again.
+     */
+    bool updateEphemeralID(void);
+
+    /**
+     * Get the time until the beacon time enters the next rotation window.
+     *
+     * @param[in] nowInMicros
+     *              The same free-running microsecond timestamp passed to
+     *              updateBeaconTime().
+     *
+     * @return The time in milliseconds until the next rotation.
+     */
+    uint32_t getMillisToNextRotation(uint32_t nowInMicros) const;
+
+    /**
+     * Construct the raw bytes of the Eddystone-EID frame that will be directly
+     * used in the advertising packets.
+     *
+     * @param[in] rawFrame
+     *              Pointer to the location where the raw frame will be stored.
+     * @param[in] advPowerLevel
+     *              Power level value included within the raw frame.
+     */
+    void constructEIDFrame(uint8_t *rawFrame, int8_t advPowerLevel);
+
+    /**
+     * Get the size of the Eddystone-EID frame constructed with the
+     * current state of the EIDFrame object.
+     *
+     * @return The size in bytes of the Eddystone-EID frame.
+     */
+    size_t getRawFrameSize(void) const;
+
+    /**
+     * Get the Eddystone-EID identity key.
+     *
+     * @return A pointer to the identity key.
+     */
+    const uint8_t* getIdentityKey(void) const;
+
+    /**
+     * Get the Eddystone-EID rotation exponent.
+     *
+     * @return The rotation exponent K.
+     */
+    uint8_t getRotationExponent(void) const;
+
+    /**
+     * Get the beacon time.
+     *
+     * @return The beacon time in seconds as of the last call to
+     *         updateBeaconTime().
+     */
+    uint32_t getBeaconTime(void) const;
+
+private:
+    /**
+     * Compute the ephemeral identifier for the current beacon time as
+     * described in the Eddystone-EID specification. This takes two AES-128
+     * block encryptions: one to derive the temporary key and one to derive
+     * the identifier.
+     */
+    void computeEphemeralID(void);
+
+    /**
+     * The byte ID of an Eddystone-EID frame.
+     */
+    static const uint8_t FRAME_TYPE_EID = 0x30;
+    /**
+     * The size (in bytes) of an Eddystone-EID frame.
+     */
+    static const uint8_t FRAME_SIZE_EID = 10;
+
+public:
+    /**
+     * The size (in bytes) of the raw Eddystone-EID frame built by
+     * constructEIDFrame(), including the 16-bit Eddystone UUID.
+     */
+    static const uint8_t RAW_FRAME_SIZE = FRAME_SIZE_EID + EDDYSTONE_UUID_SIZE;
+
+private:
+    /**
+     * The Eddystone-EID identity key.
+     */
+    EIDIdentityKey_t     identityKey;
+    /**
+     * The Eddystone-EID rotation exponent K.
+     */
+    uint8_t              rotationExponent;
+    /**
+     * Whether an identity key has been set.
+     */
+    bool                 identityKeySet;
+    /**
+     * The beacon time in seconds.
+     */
+    uint32_t             beaconTime;
+    /**
+     * Timestamp in microseconds up to which the beacon time has been
+     * accounted for.
+     */
+    uint32_t             lastBeaconTimeRead;
+    /**
+     * The rotation window (beacon time >> K) of the current ephemeral
+     * identifier.
+     */
+    uint32_t             ephemeralIDWindow;
+    /**
+     * Whether ephemeralID holds a value computed for ephemeralIDWindow.
+     */
+    bool                 ephemeralIDValid;
+    /**
+     * The current Eddystone-EID ephemeral identifier.
+     */
+    uint8_t              ephemeralID[EID_EPHEMERAL_ID_SIZE];
+    /**
+     * AES-128 block cipher used to compute the ephemeral identifier.
+     */
+    AES128               aes;
+};
+
+#endif  /* __EIDFRAME_H__ */
@@ -16,6 +16,25 @@
 
 #include "EddystoneService.h"
 
+#if defined(TARGET_NRF5)
+    #include "nrf_soc.h"
+#endif
+
+/* Random salt for the eTLM nonce. The SoftDevice RNG is used when possible,
+ * the salt only has to make nonce reuse unlikely so rand() is an acceptable
+ * fallback.
+ */
+static uint16_t randomUint16(void)
+{
+#if defined(TARGET_NRF5)
+    uint8_t salt[sizeof(uint16_t)];
+    if (sd_rand_application_vector_get(salt, sizeof(salt)) == NRF_SUCCESS) {
+        return (uint16_t)((salt[0] << 8) | salt[1]);
+    }
+#endif
+    return (uint16_t)rand();
+}
+
 /* Initialise the EddystoneService using parameters from persistent storage */
 EddystoneService::EddystoneService(BLE                 &bleIn,
                                    EddystoneParams_t   &paramsIn,
@@ -27,16 +46,44 @@ EddystoneService::EddystoneService(BLE                 &bleIn,
     urlFrame(paramsIn.urlData, paramsIn.urlDataLength),
     uidFrame(paramsIn.uidNamespaceID, paramsIn.uidInstanceID),
     tlmFrame(paramsIn.tlmVersion),
+    eidFrame(),
     resetFlag(false),
-    rawUrlFrame(NULL),
-    rawUidFrame(NULL),
-    rawTlmFrame(NULL),
+    eidFramePeriod(DEFAULT_EID_FRAME_PERIOD_MSEC),
+    iBeaconFramePeriod(DEFAULT_IBEACON_FRAME_PERIOD_MSEC),
+    iBeaconFrame(),
+    iBeaconRadioTxPower(0),
+    currentRadioTxPower(0),
+    batteryPolicy(),
+    batteryLevel(0),
+    advJitter(DEFAULT_ADV_JITTER_MSEC),
+    densityAdvertisersPerStep(0),
+    densityMaxPeriodMultiplier(1),
+    densityPeriodMultiplier(1),
+    advertiserDensity(0),
+    densityScanCount(0),
+    lockStateChar(UUID_LOCK_STATE_CHAR, &lockState),
+    lockChar(UUID_LOCK_CHAR, lock),
+    unlockChar(UUID_UNLOCK_CHAR, unlock),
+    urlDataChar(UUID_URL_DATA_CHAR, urlFrame.getEncodedURLData(), 0, URL_DATA_MAX, GattCharacteristic::BLE_GATT_CHAR_PROPERTIES_READ | GattCharacteristic::BLE_GATT_CHAR_PROPERTIES_WRITE),
+    flagsChar(UUID_FLAGS_CHAR, &flags),
+    advPowerLevelsChar(UUID_ADV_POWER_LEVELS_CHAR, advPowerLevels),
+    txPowerModeChar(UUID_TX_POWER_MODE_CHAR, &txPowerMode),
+    beaconPeriodChar(UUID_BEACON_PERIOD_CHAR, &urlFramePeriod),
+    resetChar(UUID_RESET_CHAR, &resetFlag),
+    eidIdentityKeyChar(UUID_EID_IDENTITY_KEY_CHAR, eidIdentityKeyValue),
+    applyConfigChar(UUID_APPLY_CONFIG_CHAR, NULL, 0, APPLY_CONFIG_MAX_SIZE, GattCharacteristic::BLE_GATT_CHAR_PROPERTIES_WRITE),
     tlmBatteryVoltageCallback(NULL),
     tlmBeaconTemperatureCallback(NULL),
     uidFrameCallbackHandle(),
     urlFrameCallbackHandle(),
     tlmFrameCallbackHandle(),
+    tlmSensorsCallbackHandle(),
+    eidFrameCallbackHandle(),
+    eidRotationCallbackHandle(),
+    iBeaconFrameCallbackHandle(),
     radioManagerCallbackHandle(),
+    densityScanCallbackHandle(),
+    densityScanStopCallbackHandle(),
     deviceName(DEFAULT_DEVICE_NAME),
     eventQueue(evQ)
 {
@@ -46,11 +93,20 @@ EddystoneService::EddystoneService(BLE                 &bleIn,
     urlFramePeriod = correctAdvertisementPeriod(paramsIn.urlFramePeriod);
     uidFramePeriod = correctAdvertisementPeriod(paramsIn.uidFramePeriod);
     tlmFramePeriod = correctAdvertisementPeriod(paramsIn.tlmFramePeriod);
+    eidFramePeriod = correctAdvertisementPeriod(paramsIn.eidFramePeriod);
 
     memcpy(lock,   paramsIn.lock,   sizeof(Lock_t));
     memcpy(unlock, paramsIn.unlock, sizeof(Lock_t));
 
     eddystoneConstructorHelper(paramsIn.advPowerLevels, radioPowerLevelsIn, advConfigIntervalIn);
+
+    if (paramsIn.eidIdentityKeySet) {
+        /* The timer is only started by the helper. The saved beacon time may
+         * be up to one save period old, skip over the time already advertised */
+        eidFrame.setEIDData(paramsIn.eidIdentityKey, paramsIn.eidRotationExponent,
+                            paramsIn.eidBeaconTime + EID_BEACON_TIME_SAVE_PERIOD_SECONDS, readTickerMicros());
+        tlmFrame.setEncryptionKey(paramsIn.eidIdentityKey);
+    }
 }
 
 /* When using this constructor we need to call setURLData,
@@ -66,6 +122,7 @@ EddystoneService::EddystoneService(BLE                 &bleIn,
     urlFrame(),
     uidFrame(),
     tlmFrame(),
+    eidFrame(),
     lockState(false),
     resetFlag(false),
     lock(),
@@ -75,15 +132,42 @@ EddystoneService::EddystoneService(BLE                 &bleIn,
     urlFramePeriod(DEFAULT_URL_FRAME_PERIOD_MSEC),
     uidFramePeriod(DEFAULT_UID_FRAME_PERIOD_MSEC),
     tlmFramePeriod(DEFAULT_TLM_FRAME_PERIOD_MSEC),
-    rawUrlFrame(NULL),
-    rawUidFrame(NULL),
-    rawTlmFrame(NULL),
+    eidFramePeriod(DEFAULT_EID_FRAME_PERIOD_MSEC),
+    iBeaconFramePeriod(DEFAULT_IBEACON_FRAME_PERIOD_MSEC),
+    iBeaconFrame(),
+    iBeaconRadioTxPower(0),
+    currentRadioTxPower(0),
+    batteryPolicy(),
+    batteryLevel(0),
+    advJitter(DEFAULT_ADV_JITTER_MSEC),
+    densityAdvertisersPerStep(0),
+    densityMaxPeriodMultiplier(1),
+    densityPeriodMultiplier(1),
+    advertiserDensity(0),
+    densityScanCount(0),
+    lockStateChar(UUID_LOCK_STATE_CHAR, &lockState),
+    lockChar(UUID_LOCK_CHAR, lock),
+    unlockChar(UUID_UNLOCK_CHAR, unlock),
+    urlDataChar(UUID_URL_DATA_CHAR, urlFrame.getEncodedURLData(), 0, URL_DATA_MAX, GattCharacteristic::BLE_GATT_CHAR_PROPERTIES_READ | GattCharacteristic::BLE_GATT_CHAR_PROPERTIES_WRITE),
+    flagsChar(UUID_FLAGS_CHAR, &flags),
+    advPowerLevelsChar(UUID_ADV_POWER_LEVELS_CHAR, advPowerLevels),
+    txPowerModeChar(UUID_TX_POWER_MODE_CHAR, &txPowerMode),
+    beaconPeriodChar(UUID_BEACON_PERIOD_CHAR, &urlFramePeriod),
+    resetChar(UUID_RESET_CHAR, &resetFlag),
+    eidIdentityKeyChar(UUID_EID_IDENTITY_KEY_CHAR, eidIdentityKeyValue),
+    applyConfigChar(UUID_APPLY_CONFIG_CHAR, NULL, 0, APPLY_CONFIG_MAX_SIZE, GattCharacteristic::BLE_GATT_CHAR_PROPERTIES_WRITE),
     tlmBatteryVoltageCallback(NULL),
     tlmBeaconTemperatureCallback(NULL),
     uidFrameCallbackHandle(),
     urlFrameCallbackHandle(),
     tlmFrameCallbackHandle(),
+    tlmSensorsCallbackHandle(),
+    eidFrameCallbackHandle(),
+    eidRotationCallbackHandle(),
+    iBeaconFrameCallbackHandle(),
     radioManagerCallbackHandle(),
+    densityScanCallbackHandle(),
+    densityScanStopCallbackHandle(),
     deviceName(DEFAULT_DEVICE_NAME),
     eventQueue(evQ)
 {
@@ -105,6 +189,10 @@ void EddystoneService::onTLMBeaconTemperatureUpdate(TlmUpdateCallback_t tlmBeaco
 void EddystoneService::setTLMData(uint8_t tlmVersionIn)
 {
    tlmFrame.setTLMData(tlmVersionIn);
+   if (operationMode == EDDYSTONE_MODE_BEACON && tlmFramePeriod && !tlmFrame.isEncrypted()) {
+       /* The version is not patched per transmission, so rebuild the frame */
+       tlmFrame.constructTLMFrame(rawTlmFrame);
+   }
 }
 
 void EddystoneService::setURLData(const char *urlDataIn)
@@ -117,6 +205,58 @@ void EddystoneService::setUIDData(const UIDNamespaceID_t &uidNamespaceIDIn, cons
     uidFrame.setUIDData(uidNamespaceIDIn, uidInstanceIDIn);
 }
 
+void EddystoneService::setEIDData(const EIDIdentityKey_t &identityKeyIn, uint8_t rotationExponentIn, uint32_t beaconTimeIn)
+{
+    eidFrame.setEIDData(identityKeyIn, rotationExponentIn, beaconTimeIn, readTickerMicros());
+    /* Once an identity key is set TLM frames are sent encrypted */
+    tlmFrame.setEncryptionKey(identityKeyIn);
+    if (operationMode == EDDYSTONE_MODE_BEACON && tlmFramePeriod) {
+        /* The frame size changes, so rebuild the whole payload */
+        constructTLMAdvertisingPayload();
+    }
+    if (operationMode == EDDYSTONE_MODE_BEACON && eidFramePeriod) {
+        /* The rotation window changed, so reschedule the rotation from now */
+        if (eidRotationCallbackHandle) {
+            eventQueue.cancel(eidRotationCallbackHandle);
+        }
+        rotateEID();
+        if (!eidFrameCallbackHandle) {
+            /* This is the first identity key, so EID frames were not enabled */
+            eidFrameCallbackHandle = checkEventPosted(eventQueue.call_every(
+                eidFramePeriod,
+                Callback<void(FrameType)>(this, &EddystoneService::enqueueFrame),
+                EDDYSTONE_FRAME_EID
+            ));
+        }
+    }
+}
+
+uint32_t EddystoneService::getEIDRotationTime(void) const
+{
+    return eidRotationTime;
+}
+
+void EddystoneService::setIBeaconData(const IBeaconProximityUUID_t &proximityUUIDIn,
+                                      uint16_t                     majorNumberIn,
+                                      uint16_t                     minorNumberIn,
+                                      int8_t                       measuredPowerIn,
+                                      int8_t                       radioTxPowerIn)
+{
+    iBeaconFrame.setIBeaconData(proximityUUIDIn, majorNumberIn, minorNumberIn, measuredPowerIn);
+    iBeaconRadioTxPower = radioTxPowerIn;
+    if (operationMode == EDDYSTONE_MODE_BEACON && iBeaconFramePeriod) {
+        constructIBeaconAdvertisingPayload();
+    }
+}
+
+uint32_t EddystoneService::getAdvertisedFrameCount(FrameType frameType) const
+{
+    if (frameType >= NUM_EDDYSTONE_FRAMES) {
+        return 0;
+    }
+    return advertisedFrameCount[frameType];
+}
+
 EddystoneService::EddystoneError_t EddystoneService::startConfigService(void)
 {
     if (operationMode == EDDYSTONE_MODE_CONFIG) {
@@ -150,15 +290,14 @@ EddystoneService::EddystoneError_t EddystoneService::startBeaconService(void)
     if (operationMode == EDDYSTONE_MODE_BEACON) {
         /* Nothing to do, we are already in beacon mode */
         return EDDYSTONE_ERROR_NONE;
-    } else if (!urlFramePeriod && !uidFramePeriod && !tlmFramePeriod) {
+    } else if (!urlFramePeriod && !uidFramePeriod && !tlmFramePeriod && !iBeaconFramePeriod &&
+               !(eidFramePeriod && eidFrame.hasIdentityKey())) {
         /* Nothing to do, the period is 0 for all frames */
         return EDDYSTONE_ERROR_INVALID_ADVERTISING_INTERVAL;
     }
 
     if (operationMode == EDDYSTONE_MODE_CONFIG) {
         ble.shutdown();
-        /* Free unused memory */
-        freeConfigCharacteristics();
     }
 
     if (!ble.hasInitialized()) {
@@ -186,7 +325,6 @@ EddystoneService::EddystoneError_t EddystoneService::stopCurrentService(void)
         break;
     case EDDYSTONE_MODE_CONFIG:
         ble.shutdown();
-        freeConfigCharacteristics();
         break;
     default:
         /* Some error occurred */
@@ -235,6 +373,13 @@ void EddystoneService::getEddystoneParams(EddystoneParams_t &params)
     params.tlmVersion     = tlmFrame.getTLMVersion();
     params.urlDataLength  = urlFrame.getEncodedURLDataLength();
 
+    eidFrame.updateBeaconTime(readTickerMicros());
+    params.eidFramePeriod      = eidFramePeriod;
+    params.eidIdentityKeySet   = eidFrame.hasIdentityKey();
+    params.eidRotationExponent = eidFrame.getRotationExponent();
+    params.eidBeaconTime       = eidFrame.getBeaconTime();
+    memcpy(params.eidIdentityKey, eidFrame.getIdentityKey(), sizeof(EIDIdentityKey_t));
+
     memcpy(params.advPowerLevels, advPowerLevels,               sizeof(PowerLevels_t));
     memcpy(params.lock,           lock,                         sizeof(Lock_t));
     memcpy(params.unlock,         unlock,                       sizeof(Lock_t));
@@ -266,13 +411,45 @@ void EddystoneService::eddystoneConstructorHelper(const PowerLevels_t &advPowerL
 
     memcpy(radioPowerLevels, radioPowerLevelsIn, sizeof(PowerLevels_t));
     memcpy(advPowerLevels,   advPowerLevelsIn,   sizeof(PowerLevels_t));
-
-    /* TODO: Note that this timer is started from the time EddystoneService
-     * is initialised and NOT from when the device is booted. So app needs
-     * to take care that EddystoneService is one of the first things to be
+    memset(advertisedFrameCount, 0, sizeof(advertisedFrameCount));
+    memset(eidIdentityKeyValue, 0, sizeof(eidIdentityKeyValue));
+    eidRotationTime = 0;
+
+    /* The config characteristics live as long as this object, so they only
+     * need to be wired up once */
+    lockChar.setWriteAuthorizationCallback(this, &EddystoneService::lockAuthorizationCallback);
+    unlockChar.setWriteAuthorizationCallback(this, &EddystoneService::unlockAuthorizationCallback);
+    urlDataChar.setWriteAuthorizationCallback(this, &EddystoneService::urlDataWriteAuthorizationCallback);
+    flagsChar.setWriteAuthorizationCallback(this, &EddystoneService::basicAuthorizationCallback<uint8_t>);
+    advPowerLevelsChar.setWriteAuthorizationCallback(this, &EddystoneService::basicAuthorizationCallback<PowerLevels_t>);
+    txPowerModeChar.setWriteAuthorizationCallback(this, &EddystoneService::powerModeAuthorizationCallback);
+    beaconPeriodChar.setWriteAuthorizationCallback(this, &EddystoneService::basicAuthorizationCallback<uint16_t>);
+    resetChar.setWriteAuthorizationCallback(this, &EddystoneService::basicAuthorizationCallback<bool>);
+    eidIdentityKeyChar.setWriteAuthorizationCallback(this, &EddystoneService::eidIdentityKeyAuthorizationCallback);
+    applyConfigChar.setWriteAuthorizationCallback(this, &EddystoneService::applyConfigAuthorizationCallback);
+
+    charTable[0] = &lockStateChar;
+    charTable[1] = &lockChar;
+    charTable[2] = &unlockChar;
+    charTable[3] = &urlDataChar;
+    charTable[4] = &flagsChar;
+    charTable[5] = &advPowerLevelsChar;
+    charTable[6] = &txPowerModeChar;
+    charTable[7] = &beaconPeriodChar;
+    charTable[8] = &resetChar;
+    charTable[9] = &eidIdentityKeyChar;
+    charTable[10] = &applyConfigChar;
+
+    /* Note that this timer is started from the time EddystoneService is
+     * initialised and NOT from when the device is booted. So app needs to
+     * take care that EddystoneService is one of the first things to be
      * started!
      */
     timeSinceBootTimer.start();
+    timeSinceBootCallbackHandle = checkEventPosted(eventQueue.call_every(
+        TIME_SINCE_BOOT_UPDATE_PERIOD_MSEC,
+        Callback<void()>(this, &EddystoneService::updateTimeSinceBoot)
+    ));
 
     /* Set the device name at startup */
     ble.gap().setDeviceName(reinterpret_cast<const uint8_t *>(deviceName));
@@ -307,16 +484,35 @@ void EddystoneService::bleInitComplete(BLE::InitializationCompleteCallbackContex
 
 void EddystoneService::swapAdvertisedFrame(FrameType frameType)
 {
+    /* iBeacon frames may be calibrated for a different radio power */
+    int8_t radioTxPower = (frameType == EDDYSTONE_FRAME_IBEACON) ? iBeaconRadioTxPower : radioPowerLevels[getAdaptedTxPowerMode()];
+    if (radioTxPower != currentRadioTxPower) {
+        ble.gap().setTxPower(radioTxPower);
+        currentRadioTxPower = radioTxPower;
+    }
+
     switch(frameType) {
     case EDDYSTONE_FRAME_URL:
-        updateAdvertisementPacket(rawUrlFrame, urlFrame.getRawFrameSize());
+        ble.gap().setAdvertisingPayload(urlAdvPayload);
         break;
     case EDDYSTONE_FRAME_UID:
-        updateAdvertisementPacket(rawUidFrame, uidFrame.getRawFrameSize());
+        ble.gap().setAdvertisingPayload(uidAdvPayload);
         break;
     case EDDYSTONE_FRAME_TLM:
-        updateRawTLMFrame();
-        updateAdvertisementPacket(rawTlmFrame, tlmFrame.getRawFrameSize());
+        if (!tlmFrame.isEncrypted()) {
+            updateRawTLMFrame();
+            /* The TLM frame has a fixed size, so only patch the service data */
+            tlmAdvPayload.updateData(GapAdvertisingData::SERVICE_DATA, rawTlmFrame, tlmFrame.getRawFrameSize());
+        }
+        /* eTLM frames are encrypted by enqueueFrame(), no crypto is done here */
+        ble.gap().setAdvertisingPayload(tlmAdvPayload);
+        break;
+    case EDDYSTONE_FRAME_EID:
+        /* Kept up to date by rotateEID(), no crypto is done here */
+        ble.gap().setAdvertisingPayload(eidAdvPayload);
+        break;
+    case EDDYSTONE_FRAME_IBEACON:
+        ble.gap().setAdvertisingPayload(iBeaconAdvPayload);
         break;
     default:
         /* Some error occurred */
@@ -331,45 +527,384 @@ void EddystoneService::swapAdvertisedFrame(FrameType frameType)
  * Eddystone specification.
  */
 void EddystoneService::updateRawTLMFrame(void)
+{
+    updateTimeSinceBoot();
+    tlmFrame.patchTLMFrame(rawTlmFrame);
+}
+
+void EddystoneService::constructTLMAdvertisingPayload(void)
+{
+    if (tlmFrame.isEncrypted()) {
+        prepareETLMFrame();
+    } else {
+        tlmFrame.constructTLMFrame(rawTlmFrame);
+    }
+    constructAdvertisingPayload(tlmAdvPayload, rawTlmFrame, tlmFrame.getRawFrameSize());
+}
+
+void EddystoneService::prepareETLMNonce(void)
+{
+    /* The nonce uses the beacon time of the current EID rotation window */
+    uint8_t  rotationExponent = eidFrame.getRotationExponent();
+    uint32_t nonceTime        = (eidFrame.getBeaconTime() >> rotationExponent) << rotationExponent;
+    tlmFrame.prepareETLMNonce(nonceTime, randomUint16());
+}
+
+void EddystoneService::prepareETLMFrame(void)
+{
+    updateTimeSinceBoot();
+    if (!tlmFrame.isETLMNonceReady()) {
+        prepareETLMNonce();
+    }
+    tlmFrame.constructETLMFrame(rawTlmFrame);
+
+    /* Get the nonce MAC and keystream for the following frame ready now, so
+     * that encrypting it only takes the ciphertext MAC */
+    prepareETLMNonce();
+}
+
+uint32_t EddystoneService::readTickerMicros(void)
+{
+    /* Only the low 32 bits are kept, the users of the time handle the wrap */
+    return (uint32_t) timeSinceBootTimer.read_us();
+}
+
+void EddystoneService::updateTimeSinceBoot(void)
+{
+    uint32_t now = readTickerMicros();
+    tlmFrame.updateTimeSinceBoot(now);
+    eidFrame.updateBeaconTime(now);
+}
+
+void EddystoneService::rotateEID(void)
+{
+    uint32_t startTimeRotateEID = readTickerMicros();
+
+    eidFrame.updateBeaconTime(startTimeRotateEID);
+    if (eidFrame.updateEphemeralID()) {
+        eidFrame.constructEIDFrame(rawEidFrame, advPowerLevels[getAdaptedTxPowerMode()]);
+        constructAdvertisingPayload(eidAdvPayload, rawEidFrame, eidFrame.getRawFrameSize());
+        if (tlmFrame.isEncrypted()) {
+            /* The prepared eTLM nonce belongs to the previous window */
+            prepareETLMNonce();
+        }
+        eidRotationTime = readTickerMicros() - startTimeRotateEID;
+    }
+
+    /* Wake up again only when the next rotation window starts. If this
+     * callback runs slightly early the identifier is unchanged and it is
+     * simply posted again for the remaining time. */
+    eidRotationCallbackHandle = checkEventPosted(eventQueue.call_in(
+        eidFrame.getMillisToNextRotation(readTickerMicros()) + 1,
+        Callback<void()>(this, &EddystoneService::rotateEID)
+    ));
+}
+
+/* Battery Voltage and Temperature change slowly and reading them may involve
+ * the ADC, so they are sampled on their own cadence. The new values only get
+ * written to the raw frame the next time it is advertised.
+ */
+void EddystoneService::sampleTLMSensors(void)
 {
     if (tlmBeaconTemperatureCallback != NULL) {
         tlmFrame.updateBeaconTemperature((*tlmBeaconTemperatureCallback)(tlmFrame.getBeaconTemperature()));
     }
     if (tlmBatteryVoltageCallback != NULL) {
         tlmFrame.updateBatteryVoltage((*tlmBatteryVoltageCallback)(tlmFrame.getBatteryVoltage()));
+        updateBatteryLevel(tlmFrame.getBatteryVoltage());
     }
-    tlmFrame.updateTimeSinceBoot(timeSinceBootTimer.read_ms());
-    tlmFrame.constructTLMFrame(rawTlmFrame);
 }
 
-void EddystoneService::updateAdvertisementPacket(const uint8_t* rawFrame, size_t rawFrameLength)
+void EddystoneService::setBatteryPolicy(const BatteryPolicy_t &batteryPolicyIn)
 {
-    ble.gap().clearAdvertisingPayload();
-    ble.gap().accumulateAdvertisingPayload(GapAdvertisingData::BREDR_NOT_SUPPORTED | GapAdvertisingData::LE_GENERAL_DISCOVERABLE);
-    ble.gap().accumulateAdvertisingPayload(GapAdvertisingData::COMPLETE_LIST_16BIT_SERVICE_IDS, EDDYSTONE_UUID, sizeof(EDDYSTONE_UUID));
-    ble.gap().accumulateAdvertisingPayload(GapAdvertisingData::SERVICE_DATA, rawFrame, rawFrameLength);
+    batteryPolicy = batteryPolicyIn;
+    if (batteryPolicy.fullVoltage <= batteryPolicy.emptyVoltage) {
+        /* Invalid range, disable the policy */
+        batteryPolicy.fullVoltage = 0;
+    }
+    if (batteryPolicy.maxPeriodMultiplier == 0) {
+        batteryPolicy.maxPeriodMultiplier = 1;
+    }
+
+    /* Start again from the full level, the next sample moves to the right
+     * level for the new policy */
+    if (batteryLevel != 0) {
+        batteryLevel = 0;
+        applyBatteryPolicy();
+    }
+}
+
+uint8_t EddystoneService::getBatteryLevel(void) const
+{
+    return batteryLevel;
+}
+
+uint8_t EddystoneService::computeBatteryLevel(uint16_t batteryVoltage) const
+{
+    if (batteryVoltage >= batteryPolicy.fullVoltage) {
+        return 0;
+    } else if (batteryVoltage <= batteryPolicy.emptyVoltage) {
+        return NUM_BATTERY_LEVELS - 1;
+    }
+
+    /* Any voltage below full is at least level 1 */
+    uint32_t range = batteryPolicy.fullVoltage - batteryPolicy.emptyVoltage;
+    uint32_t drop  = batteryPolicy.fullVoltage - batteryVoltage;
+    return (drop * (NUM_BATTERY_LEVELS - 1) + range - 1) / range;
+}
+
+void EddystoneService::updateBatteryLevel(uint16_t batteryVoltage)
+{
+    if (batteryPolicy.fullVoltage == 0) {
+        /* The policy is disabled */
+        return;
+    }
+
+    uint8_t newBatteryLevel = computeBatteryLevel(batteryVoltage);
+    if (newBatteryLevel == batteryLevel) {
+        return;
+    } else if (newBatteryLevel < batteryLevel) {
+        /* Only move back up once the voltage is clearly above the boundary */
+        uint16_t lowerVoltage = (batteryVoltage > BATTERY_LEVEL_HYSTERESIS_MV) ? batteryVoltage - BATTERY_LEVEL_HYSTERESIS_MV : 0;
+        newBatteryLevel = computeBatteryLevel(lowerVoltage);
+        if (newBatteryLevel >= batteryLevel) {
+            return;
+        }
+    }
+
+    batteryLevel = newBatteryLevel;
+    applyBatteryPolicy();
+}
+
+uint16_t EddystoneService::getAdaptedFramePeriod(uint16_t framePeriod) const
+{
+    if ((batteryLevel == 0 || batteryPolicy.maxPeriodMultiplier <= 1) && densityPeriodMultiplier <= 1) {
+        return framePeriod;
+    }
+
+    /* Scale linearly from 1x at full to maxPeriodMultiplier at empty */
+    uint32_t adaptedPeriod = framePeriod +
+        (uint32_t) framePeriod * (batteryPolicy.maxPeriodMultiplier - 1) * batteryLevel / (NUM_BATTERY_LEVELS - 1);
+    adaptedPeriod *= densityPeriodMultiplier;
+    return correctAdvertisementPeriod((adaptedPeriod > 0xFFFF) ? 0xFFFF : adaptedPeriod);
+}
+
+uint8_t EddystoneService::getAdaptedTxPowerMode(void) const
+{
+    if (batteryLevel == 0 || txPowerMode <= batteryPolicy.minTxPowerMode) {
+        return txPowerMode;
+    }
+    /* One mode lower per battery level, but not below minTxPowerMode */
+    return (txPowerMode - batteryPolicy.minTxPowerMode > batteryLevel) ? txPowerMode - batteryLevel : batteryPolicy.minTxPowerMode;
+}
+
+void EddystoneService::applyBatteryPolicy(void)
+{
+    if (operationMode != EDDYSTONE_MODE_BEACON) {
+        /* Picked up by setupBeaconService() */
+        return;
+    }
+
+    /* The advertised power level must match the radio power, which
+     * swapAdvertisedFrame() picks up on its own */
+    int8_t advPowerLevel = advPowerLevels[getAdaptedTxPowerMode()];
+    if (urlFramePeriod) {
+        urlFrame.constructURLFrame(rawUrlFrame, advPowerLevel);
+        constructAdvertisingPayload(urlAdvPayload, rawUrlFrame, urlFrame.getRawFrameSize());
+    }
+    if (uidFramePeriod) {
+        uidFrame.constructUIDFrame(rawUidFrame, advPowerLevel);
+        constructAdvertisingPayload(uidAdvPayload, rawUidFrame, uidFrame.getRawFrameSize());
+    }
+    if (eidFrameCallbackHandle) {
+        eidFrame.constructEIDFrame(rawEidFrame, advPowerLevel);
+        constructAdvertisingPayload(eidAdvPayload, rawEidFrame, eidFrame.getRawFrameSize());
+    }
+
+    rescheduleFrameCallbacks();
+}
+
+void EddystoneService::rescheduleFrameCallbacks(void)
+{
+    rescheduleFrameCallback(urlFrameCallbackHandle, urlFramePeriod, EDDYSTONE_FRAME_URL);
+    rescheduleFrameCallback(uidFrameCallbackHandle, uidFramePeriod, EDDYSTONE_FRAME_UID);
+    rescheduleFrameCallback(tlmFrameCallbackHandle, tlmFramePeriod, EDDYSTONE_FRAME_TLM);
+}
+
+void EddystoneService::setAdvertisingJitter(uint16_t advJitterIn)
+{
+    advJitter = advJitterIn;
+}
+
+uint16_t EddystoneService::getAdvertisingJitter(void) const
+{
+    return advJitter ? randomUint16() % (advJitter + 1) : 0;
+}
+
+void EddystoneService::setDensityBackoff(uint8_t advertisersPerStepIn, uint8_t maxPeriodMultiplierIn)
+{
+    densityAdvertisersPerStep  = advertisersPerStepIn;
+    densityMaxPeriodMultiplier = (maxPeriodMultiplierIn > 1) ? maxPeriodMultiplierIn : 1;
+
+    if (operationMode != EDDYSTONE_MODE_BEACON) {
+        /* The scans are started by setupBeaconService() */
+        return;
+    }
+
+    if (densityAdvertisersPerStep && !densityScanCallbackHandle) {
+        densityScanCallbackHandle = checkEventPosted(eventQueue.call_every(
+            DENSITY_SCAN_PERIOD_MSEC,
+            Callback<void()>(this, &EddystoneService::startDensityScan)
+        ));
+    } else if (!densityAdvertisersPerStep) {
+        if (densityScanCallbackHandle) {
+            eventQueue.cancel(densityScanCallbackHandle);
+            densityScanCallbackHandle = 0;
+        }
+        if (densityScanStopCallbackHandle) {
+            eventQueue.cancel(densityScanStopCallbackHandle);
+            densityScanStopCallbackHandle = 0;
+            ble.gap().stopScan();
+        }
+        if (densityPeriodMultiplier != 1) {
+            densityPeriodMultiplier = 1;
+            rescheduleFrameCallbacks();
+        }
+    }
+}
+
+uint8_t EddystoneService::getAdvertiserDensity(void) const
+{
+    return advertiserDensity;
+}
+
+void EddystoneService::startDensityScan(void)
+{
+    if (densityScanStopCallbackHandle) {
+        /* The previous scan is still running */
+        return;
+    }
+
+    densityScanCount = 0;
+    ble.gap().setScanParams(DENSITY_SCAN_WINDOW_MSEC /* scan interval */, DENSITY_SCAN_WINDOW_MSEC /* scan window */);
+    if (ble.gap().startScan(this, &EddystoneService::densityScanCallback) != BLE_ERROR_NONE) {
+        return;
+    }
+    densityScanStopCallbackHandle = checkEventPosted(eventQueue.call_in(
+        DENSITY_SCAN_WINDOW_MSEC,
+        Callback<void()>(this, &EddystoneService::stopDensityScan)
+    ));
+}
+
+void EddystoneService::stopDensityScan(void)
+{
+    densityScanStopCallbackHandle = 0;
+    ble.gap().stopScan();
+    advertiserDensity = densityScanCount;
+
+    /* One more times the configured period for every step of advertisers */
+    uint32_t multiplier = 1 + advertiserDensity / densityAdvertisersPerStep;
+    if (multiplier > densityMaxPeriodMultiplier) {
+        multiplier = densityMaxPeriodMultiplier;
+    }
+    if (multiplier != densityPeriodMultiplier) {
+        densityPeriodMultiplier = multiplier;
+        rescheduleFrameCallbacks();
+    }
+}
+
+void EddystoneService::densityScanCallback(const Gap::AdvertisementCallbackParams_t *params)
+{
+    if (params->isScanResponse || densityScanCount >= MAX_DENSITY_ADVERTISERS) {
+        return;
+    }
+
+    for (uint8_t i = 0; i < densityScanCount; i++) {
+        if (memcmp(densityScanAddresses[i], params->peerAddr, sizeof(Gap::Address_t)) == 0) {
+            /* Already counted */
+            return;
+        }
+    }
+    memcpy(densityScanAddresses[densityScanCount++], params->peerAddr, sizeof(Gap::Address_t));
+}
+
+int EddystoneService::checkEventPosted(int callbackHandle)
+{
+    if (!callbackHandle) {
+        /* A zero handle also means that the callback is not scheduled */
+        error("EddystoneService event queue is full, see EddystoneService::EVENT_QUEUE_SIZE");
+    }
+    return callbackHandle;
+}
+
+void EddystoneService::rescheduleFrameCallback(int &callbackHandle, uint16_t framePeriod, FrameType frameType)
+{
+    if (!callbackHandle) {
+        /* The frame is disabled */
+        return;
+    }
+
+    /* Currently the only way to change the period of a callback is to
+     * cancel it and reschedule */
+    eventQueue.cancel(callbackHandle);
+    callbackHandle = checkEventPosted(eventQueue.call_every(
+        getAdaptedFramePeriod(framePeriod),
+        Callback<void(FrameType)>(this, &EddystoneService::enqueueFrame),
+        frameType
+    ));
+}
+
+void EddystoneService::constructAdvertisingPayload(GapAdvertisingData &payload, const uint8_t* rawFrame, size_t rawFrameLength)
+{
+    payload.clear();
+    payload.addFlags(GapAdvertisingData::BREDR_NOT_SUPPORTED | GapAdvertisingData::LE_GENERAL_DISCOVERABLE);
+    payload.addData(GapAdvertisingData::COMPLETE_LIST_16BIT_SERVICE_IDS, EDDYSTONE_UUID, sizeof(EDDYSTONE_UUID));
+    payload.addData(GapAdvertisingData::SERVICE_DATA, rawFrame, rawFrameLength);
+}
+
+void EddystoneService::constructIBeaconAdvertisingPayload(void)
+{
+    iBeaconFrame.constructIBeaconFrame(rawIBeaconFrame);
+    iBeaconAdvPayload.clear();
+    iBeaconAdvPayload.addFlags(GapAdvertisingData::BREDR_NOT_SUPPORTED | GapAdvertisingData::LE_GENERAL_DISCOVERABLE);
+    iBeaconAdvPayload.addData(GapAdvertisingData::MANUFACTURER_SPECIFIC_DATA, rawIBeaconFrame, iBeaconFrame.getRawFrameSize());
 }
 
 void EddystoneService::setupBeaconService(void)
 {
-    /* Initialise arrays to hold constructed raw frames */
+    /* Construct the raw frames and build the advertising payloads around them */
     if (urlFramePeriod) {
-        rawUrlFrame = new uint8_t[urlFrame.getRawFrameSize()];
-        urlFrame.constructURLFrame(rawUrlFrame, advPowerLevels[txPowerMode]);
+        urlFrame.constructURLFrame(rawUrlFrame, advPowerLevels[getAdaptedTxPowerMode()]);
+        constructAdvertisingPayload(urlAdvPayload, rawUrlFrame, urlFrame.getRawFrameSize());
     }
 
     if (uidFramePeriod) {
-        rawUidFrame = new uint8_t[uidFrame.getRawFrameSize()];
-        uidFrame.constructUIDFrame(rawUidFrame, advPowerLevels[txPowerMode]);
+        uidFrame.constructUIDFrame(rawUidFrame, advPowerLevels[getAdaptedTxPowerMode()]);
+        constructAdvertisingPayload(uidAdvPayload, rawUidFrame, uidFrame.getRawFrameSize());
     }
 
     if (tlmFramePeriod) {
-        rawTlmFrame = new uint8_t[tlmFrame.getRawFrameSize()];
-        /* Do not initialise because we have to reconstruct every 0.1 secs */
+        /* The content is patched every time it is advertised, but the payload
+         * layout does not change so it is built only once here */
+        sampleTLMSensors();
+        constructTLMAdvertisingPayload();
+    }
+
+    if (eidFramePeriod && eidFrame.hasIdentityKey()) {
+        /* Bring the identifier up to date and schedule its rotation, then
+         * build the frame with the current TX power mode */
+        rotateEID();
+        eidFrame.constructEIDFrame(rawEidFrame, advPowerLevels[getAdaptedTxPowerMode()]);
+        constructAdvertisingPayload(eidAdvPayload, rawEidFrame, eidFrame.getRawFrameSize());
+    }
+
+    if (iBeaconFramePeriod) {
+        constructIBeaconAdvertisingPayload();
     }
 
     /* Configure advertisements */
-    ble.gap().setTxPower(radioPowerLevels[txPowerMode]);
+    currentRadioTxPower = radioPowerLevels[getAdaptedTxPowerMode()];
+    ble.gap().setTxPower(currentRadioTxPower);
     ble.gap().setAdvertisingType(GapAdvertisingParams::ADV_NON_CONNECTABLE_UNDIRECTED);
     ble.gap().setAdvertisingInterval(ble.gap().getMaxAdvertisingInterval());
 
@@ -379,27 +914,54 @@ void EddystoneService::setupBeaconService(void)
      * add initial frame so that we have something to advertise on startup */
     if (uidFramePeriod) {
         advFrameQueue.push(EDDYSTONE_FRAME_UID);
-        uidFrameCallbackHandle = eventQueue.call_every(
-            uidFramePeriod,
+        uidFrameCallbackHandle = checkEventPosted(eventQueue.call_every(
+            getAdaptedFramePeriod(uidFramePeriod),
             Callback<void(FrameType)>(this, &EddystoneService::enqueueFrame),
             EDDYSTONE_FRAME_UID
-        );
+        ));
     }
     if (tlmFramePeriod) {
         advFrameQueue.push(EDDYSTONE_FRAME_TLM);
-        tlmFrameCallbackHandle = eventQueue.call_every(
-            tlmFramePeriod,
+        tlmFrameCallbackHandle = checkEventPosted(eventQueue.call_every(
+            getAdaptedFramePeriod(tlmFramePeriod),
             Callback<void(FrameType)>(this, &EddystoneService::enqueueFrame),
             EDDYSTONE_FRAME_TLM
-        );
+        ));
+        tlmSensorsCallbackHandle = checkEventPosted(eventQueue.call_every(
+            TLM_SENSOR_SAMPLE_PERIOD_MSEC,
+            Callback<void()>(this, &EddystoneService::sampleTLMSensors)
+        ));
+    }
+    if (eidFramePeriod && eidFrame.hasIdentityKey()) {
+        advFrameQueue.push(EDDYSTONE_FRAME_EID);
+        eidFrameCallbackHandle = checkEventPosted(eventQueue.call_every(
+            eidFramePeriod,
+            Callback<void(FrameType)>(this, &EddystoneService::enqueueFrame),
+            EDDYSTONE_FRAME_EID
+        ));
     }
     if (urlFramePeriod) {
         advFrameQueue.push(EDDYSTONE_FRAME_URL);
-        tlmFrameCallbackHandle = eventQueue.call_every(
-            urlFramePeriod,
+        urlFrameCallbackHandle = checkEventPosted(eventQueue.call_every(
+            getAdaptedFramePeriod(urlFramePeriod),
             Callback<void(FrameType)>(this, &EddystoneService::enqueueFrame),
             EDDYSTONE_FRAME_URL
-        );
+        ));
+    }
+    if (iBeaconFramePeriod) {
+        advFrameQueue.push(EDDYSTONE_FRAME_IBEACON);
+        iBeaconFrameCallbackHandle = checkEventPosted(eventQueue.call_every(
+            iBeaconFramePeriod,
+            Callback<void(FrameType)>(this, &EddystoneService::enqueueFrame),
+            EDDYSTONE_FRAME_IBEACON
+        ));
+    }
+
+    if (densityAdvertisersPerStep) {
+        densityScanCallbackHandle = checkEventPosted(eventQueue.call_every(
+            DENSITY_SCAN_PERIOD_MSEC,
+            Callback<void()>(this, &EddystoneService::startDensityScan)
+        ));
     }
 
     /* Start advertising */
@@ -408,18 +970,31 @@ void EddystoneService::setupBeaconService(void)
 
 void EddystoneService::enqueueFrame(FrameType frameType)
 {
+    if (frameType == EDDYSTONE_FRAME_TLM && tlmFrame.isEncrypted()) {
+        /* Encrypt the eTLM frame now rather than when it is swapped in */
+        prepareETLMFrame();
+        tlmAdvPayload.updateData(GapAdvertisingData::SERVICE_DATA, rawTlmFrame, tlmFrame.getRawFrameSize());
+    }
     advFrameQueue.push(frameType);
     if (!radioManagerCallbackHandle) {
         /* Advertising stopped and there is not callback posted in the scheduler. Just
-         * execute the manager to resume advertising */
-        manageRadio();
+         * execute the manager to resume advertising, after a random delay if the
+         * jitter is enabled */
+        if (advJitter) {
+            radioManagerCallbackHandle = checkEventPosted(eventQueue.call_in(
+                getAdvertisingJitter(),
+                Callback<void()>(this, &EddystoneService::manageRadio)
+            ));
+        } else {
+            manageRadio();
+        }
     }
 }
 
 void EddystoneService::manageRadio(void)
 {
     FrameType frameType;
-    uint32_t  startTimeManageRadio = timeSinceBootTimer.read_ms();
+    uint32_t  startTimeManageRadio = readTickerMicros();
 
     /* Signal that there is currently no callback posted */
     radioManagerCallbackHandle = 0;
@@ -434,14 +1009,15 @@ void EddystoneService::manageRadio(void)
 
         /* Increase the advertised packet count in TLM frame */
         tlmFrame.updatePduCount();
+        advertisedFrameCount[frameType]++;
 
         /* Post a callback to itself to stop the advertisement or pop the next
          * frame from the queue. However, take into account the time taken to
          * swap in this frame. */
-        radioManagerCallbackHandle = eventQueue.call_in(
-            ble.gap().getMinNonConnectableAdvertisingInterval() - (timeSinceBootTimer.read_ms() - startTimeManageRadio),
+        radioManagerCallbackHandle = checkEventPosted(eventQueue.call_in(
+            ble.gap().getMinNonConnectableAdvertisingInterval() - (readTickerMicros() - startTimeManageRadio) / 1000 + getAdvertisingJitter(),
             Callback<void()>(this, &EddystoneService::manageRadio)
-        );
+        ));
     } else if (ble.gap().getState().advertising) {
         /* Nothing else to advertise, stop advertising and do not schedule any callbacks */
         ble.gap().stopAdvertising();
@@ -450,35 +1026,6 @@ void EddystoneService::manageRadio(void)
 
 void EddystoneService::setupConfigService(void)
 {
-    lockStateChar      = new ReadOnlyGattCharacteristic<bool>(UUID_LOCK_STATE_CHAR, &lockState);
-    lockChar           = new WriteOnlyArrayGattCharacteristic<uint8_t, sizeof(Lock_t)>(UUID_LOCK_CHAR, lock);
-    unlockChar         = new WriteOnlyArrayGattCharacteristic<uint8_t, sizeof(Lock_t)>(UUID_UNLOCK_CHAR, unlock);
-    urlDataChar        = new GattCharacteristic(UUID_URL_DATA_CHAR, urlFrame.getEncodedURLData(), 0, URL_DATA_MAX, GattCharacteristic::BLE_GATT_CHAR_PROPERTIES_READ | GattCharacteristic::BLE_GATT_CHAR_PROPERTIES_WRITE);
-    flagsChar          = new ReadWriteGattCharacteristic<uint8_t>(UUID_FLAGS_CHAR, &flags);
-    advPowerLevelsChar = new ReadWriteArrayGattCharacteristic<int8_t, sizeof(PowerLevels_t)>(UUID_ADV_POWER_LEVELS_CHAR, advPowerLevels);
-    txPowerModeChar    = new ReadWriteGattCharacteristic<uint8_t>(UUID_TX_POWER_MODE_CHAR, &txPowerMode);
-    beaconPeriodChar   = new ReadWriteGattCharacteristic<uint16_t>(UUID_BEACON_PERIOD_CHAR, &urlFramePeriod);
-    resetChar          = new WriteOnlyGattCharacteristic<bool>(UUID_RESET_CHAR, &resetFlag);
-
-    lockChar->setWriteAuthorizationCallback(this, &EddystoneService::lockAuthorizationCallback);
-    unlockChar->setWriteAuthorizationCallback(this, &EddystoneService::unlockAuthorizationCallback);
-    urlDataChar->setWriteAuthorizationCallback(this, &EddystoneService::urlDataWriteAuthorizationCallback);
-    flagsChar->setWriteAuthorizationCallback(this, &EddystoneService::basicAuthorizationCallback<uint8_t>);
-    advPowerLevelsChar->setWriteAuthorizationCallback(this, &EddystoneService::basicAuthorizationCallback<PowerLevels_t>);
-    txPowerModeChar->setWriteAuthorizationCallback(this, &EddystoneService::powerModeAuthorizationCallback);
-    beaconPeriodChar->setWriteAuthorizationCallback(this, &EddystoneService::basicAuthorizationCallback<uint16_t>);
-    resetChar->setWriteAuthorizationCallback(this, &EddystoneService::basicAuthorizationCallback<bool>);
-
-    charTable[0] = lockStateChar;
-    charTable[1] = lockChar;
-    charTable[2] = unlockChar;
-    charTable[3] = urlDataChar;
-    charTable[4] = flagsChar;
-    charTable[5] = advPowerLevelsChar;
-    charTable[6] = txPowerModeChar;
-    charTable[7] = beaconPeriodChar;
-    charTable[8] = resetChar;
-
     GattService configService(UUID_URL_BEACON_SERVICE, charTable, sizeof(charTable) / sizeof(GattCharacteristic *));
 
     ble.gattServer().addService(configService);
@@ -487,35 +1034,8 @@ void EddystoneService::setupConfigService(void)
     setupEddystoneConfigAdvertisements();
 }
 
-void EddystoneService::freeConfigCharacteristics(void)
-{
-    delete lockStateChar;
-    delete lockChar;
-    delete unlockChar;
-    delete urlDataChar;
-    delete flagsChar;
-    delete advPowerLevelsChar;
-    delete txPowerModeChar;
-    delete beaconPeriodChar;
-    delete resetChar;
-}
-
 void EddystoneService::stopBeaconService(void)
 {
-    /* Free unused memory */
-    if (rawUrlFrame) {
-        delete[] rawUrlFrame;
-        rawUrlFrame = NULL;
-    }
-    if (rawUidFrame) {
-        delete[] rawUidFrame;
-        rawUidFrame = NULL;
-    }
-    if (rawTlmFrame) {
-        delete[] rawTlmFrame;
-        rawTlmFrame = NULL;
-    }
-
     /* Unschedule callbacks */
     if (urlFrameCallbackHandle) {
         eventQueue.cancel(urlFrameCallbackHandle);
@@ -529,10 +1049,34 @@ void EddystoneService::stopBeaconService(void)
         eventQueue.cancel(tlmFrameCallbackHandle);
         tlmFrameCallbackHandle = 0;
     }
+    if (tlmSensorsCallbackHandle) {
+        eventQueue.cancel(tlmSensorsCallbackHandle);
+        tlmSensorsCallbackHandle = 0;
+    }
+    if (eidFrameCallbackHandle) {
+        eventQueue.cancel(eidFrameCallbackHandle);
+        eidFrameCallbackHandle = 0;
+    }
+    if (eidRotationCallbackHandle) {
+        eventQueue.cancel(eidRotationCallbackHandle);
+        eidRotationCallbackHandle = 0;
+    }
+    if (iBeaconFrameCallbackHandle) {
+        eventQueue.cancel(iBeaconFrameCallbackHandle);
+        iBeaconFrameCallbackHandle = 0;
+    }
     if (radioManagerCallbackHandle) {
         eventQueue.cancel(radioManagerCallbackHandle);
         radioManagerCallbackHandle = 0;
     }
+    if (densityScanCallbackHandle) {
+        eventQueue.cancel(densityScanCallbackHandle);
+        densityScanCallbackHandle = 0;
+    }
+    if (densityScanStopCallbackHandle) {
+        eventQueue.cancel(densityScanStopCallbackHandle);
+        densityScanStopCallbackHandle = 0;
+    }
 }
 
 /*
@@ -541,14 +1085,14 @@ void EddystoneService::stopBeaconService(void)
  */
 void EddystoneService::updateCharacteristicValues(void)
 {
-    ble.gattServer().write(lockStateChar->getValueHandle(), reinterpret_cast<uint8_t *>(&lockState), sizeof(bool));
-    ble.gattServer().write(urlDataChar->getValueHandle(), urlFrame.getEncodedURLData(), urlFrame.getEncodedURLDataLength());
-    ble.gattServer().write(flagsChar->getValueHandle(), &flags, sizeof(uint8_t));
-    ble.gattServer().write(beaconPeriodChar->getValueHandle(), reinterpret_cast<uint8_t *>(&urlFramePeriod), sizeof(uint16_t));
-    ble.gattServer().write(txPowerModeChar->getValueHandle(), &txPowerMode, sizeof(uint8_t));
-    ble.gattServer().write(advPowerLevelsChar->getValueHandle(), reinterpret_cast<uint8_t *>(advPowerLevels), sizeof(PowerLevels_t));
-    ble.gattServer().write(lockChar->getValueHandle(), lock, sizeof(PowerLevels_t));
-    ble.gattServer().write(unlockChar->getValueHandle(), unlock, sizeof(PowerLevels_t));
+    ble.gattServer().write(lockStateChar.getValueHandle(), reinterpret_cast<uint8_t *>(&lockState), sizeof(bool));
+    ble.gattServer().write(urlDataChar.getValueHandle(), urlFrame.getEncodedURLData(), urlFrame.getEncodedURLDataLength());
+    ble.gattServer().write(flagsChar.getValueHandle(), &flags, sizeof(uint8_t));
+    ble.gattServer().write(beaconPeriodChar.getValueHandle(), reinterpret_cast<uint8_t *>(&urlFramePeriod), sizeof(uint16_t));
+    ble.gattServer().write(txPowerModeChar.getValueHandle(), &txPowerMode, sizeof(uint8_t));
+    ble.gattServer().write(advPowerLevelsChar.getValueHandle(), reinterpret_cast<uint8_t *>(advPowerLevels), sizeof(PowerLevels_t));
+    ble.gattServer().write(lockChar.getValueHandle(), lock, sizeof(PowerLevels_t));
+    ble.gattServer().write(unlockChar.getValueHandle(), unlock, sizeof(PowerLevels_t));
 }
 
 void EddystoneService::setupEddystoneConfigAdvertisements(void)
@@ -647,6 +1191,138 @@ void EddystoneService::powerModeAuthorizationCallback(GattWriteAuthCallbackParam
     }
 }
 
+void EddystoneService::eidIdentityKeyAuthorizationCallback(GattWriteAuthCallbackParams *authParams)
+{
+    if (lockState) {
+        authParams->authorizationReply = AUTH_CALLBACK_REPLY_ATTERR_INSUF_AUTHORIZATION;
+    } else if (authParams->len != sizeof(eidIdentityKeyValue)) {
+        authParams->authorizationReply = AUTH_CALLBACK_REPLY_ATTERR_INVALID_ATT_VAL_LENGTH;
+    } else if (authParams->offset != 0) {
+        authParams->authorizationReply = AUTH_CALLBACK_REPLY_ATTERR_INVALID_OFFSET;
+    } else if (authParams->data[EID_IDENTITY_KEY_SIZE] > EIDFrame::MAX_ROTATION_EXPONENT) {
+        authParams->authorizationReply = AUTH_CALLBACK_REPLY_ATTERR_WRITE_NOT_PERMITTED;
+    } else {
+        authParams->authorizationReply = AUTH_CALLBACK_REPLY_SUCCESS;
+    }
+}
+
+/*
+ * The Apply Config value is usually longer than the ATT MTU. The BLE stack
+ * reassembles the prepared writes of a long write and authorizes the complete
+ * value once, at offset 0, when the client executes the write.
+ */
+void EddystoneService::applyConfigAuthorizationCallback(GattWriteAuthCallbackParams *authParams)
+{
+    if (lockState) {
+        authParams->authorizationReply = AUTH_CALLBACK_REPLY_ATTERR_INSUF_AUTHORIZATION;
+    } else if (authParams->offset != 0) {
+        authParams->authorizationReply = AUTH_CALLBACK_REPLY_ATTERR_INVALID_OFFSET;
+    } else {
+        authParams->authorizationReply = processApplyConfig(authParams->data, authParams->len, false);
+    }
+}
+
+GattAuthCallbackReply_t EddystoneService::processApplyConfig(const uint8_t *data, uint16_t len, bool apply)
+{
+    if (len < 1 || len > APPLY_CONFIG_MAX_SIZE) {
+        return AUTH_CALLBACK_REPLY_ATTERR_INVALID_ATT_VAL_LENGTH;
+    } else if (data[0] != APPLY_CONFIG_VERSION) {
+        return AUTH_CALLBACK_REPLY_ATTERR_WRITE_NOT_PERMITTED;
+    }
+
+    /* Bitmap of the tags seen so far, to reject duplicates */
+    uint16_t tagsSeen = 0;
+    bool     lockSet  = false;
+
+    for (uint16_t index = 1; index < len; ) {
+        if (len - index < 2 || len - index - 2 < data[index + 1]) {
+            return AUTH_CALLBACK_REPLY_ATTERR_INVALID_ATT_VAL_LENGTH;
+        }
+        uint8_t        tag      = data[index];
+        uint8_t        valueLen = data[index + 1];
+        const uint8_t *value    = data + index + 2;
+        bool           validLen;
+
+        switch (tag) {
+            case APPLY_CONFIG_TAG_URL_DATA:
+                validLen = (valueLen <= URL_DATA_MAX);
+                break;
+            case APPLY_CONFIG_TAG_UID:
+                validLen = (valueLen == UID_NAMESPACEID_SIZE + UID_INSTANCEID_SIZE);
+                break;
+            case APPLY_CONFIG_TAG_TX_POWER_MODE:
+                validLen = (valueLen == sizeof(uint8_t));
+                break;
+            case APPLY_CONFIG_TAG_ADV_POWER_LEVELS:
+                validLen = (valueLen == sizeof(PowerLevels_t));
+                break;
+            case APPLY_CONFIG_TAG_URL_FRAME_PERIOD:
+            case APPLY_CONFIG_TAG_UID_FRAME_PERIOD:
+            case APPLY_CONFIG_TAG_TLM_FRAME_PERIOD:
+                validLen = (valueLen == sizeof(uint16_t));
+                break;
+            case APPLY_CONFIG_TAG_LOCK:
+                validLen = (valueLen == sizeof(Lock_t));
+                break;
+            default:
+                return AUTH_CALLBACK_REPLY_ATTERR_WRITE_NOT_PERMITTED;
+        }
+        if (!validLen) {
+            return AUTH_CALLBACK_REPLY_ATTERR_INVALID_ATT_VAL_LENGTH;
+        } else if (tagsSeen & (1 << tag)) {
+            return AUTH_CALLBACK_REPLY_ATTERR_WRITE_NOT_PERMITTED;
+        } else if (tag == APPLY_CONFIG_TAG_TX_POWER_MODE && value[0] >= NUM_POWER_MODES) {
+            return AUTH_CALLBACK_REPLY_ATTERR_WRITE_NOT_PERMITTED;
+        }
+        tagsSeen |= (1 << tag);
+        index    += 2 + valueLen;
+
+        if (!apply) {
+            continue;
+        }
+
+        uint16_t period = (valueLen == sizeof(uint16_t)) ? (value[0] | (value[1] << 8)) : 0;
+        switch (tag) {
+            case APPLY_CONFIG_TAG_URL_DATA:
+                urlFrame.setEncodedURLData(value, valueLen);
+                break;
+            case APPLY_CONFIG_TAG_UID:
+                uidFrame.setUIDData(*reinterpret_cast<const UIDNamespaceID_t *>(value),
+                                    *reinterpret_cast<const UIDInstanceID_t *>(value + UID_NAMESPACEID_SIZE));
+                break;
+            case APPLY_CONFIG_TAG_TX_POWER_MODE:
+                txPowerMode = value[0];
+                break;
+            case APPLY_CONFIG_TAG_ADV_POWER_LEVELS:
+                memcpy(advPowerLevels, value, sizeof(PowerLevels_t));
+                break;
+            case APPLY_CONFIG_TAG_URL_FRAME_PERIOD:
+                urlFramePeriod = correctAdvertisementPeriod(period);
+                break;
+            case APPLY_CONFIG_TAG_UID_FRAME_PERIOD:
+                uidFramePeriod = correctAdvertisementPeriod(period);
+                break;
+            case APPLY_CONFIG_TAG_TLM_FRAME_PERIOD:
+                tlmFramePeriod = correctAdvertisementPeriod(period);
+                break;
+            case APPLY_CONFIG_TAG_LOCK:
+                /* Locking takes effect once every other record is applied */
+                memcpy(lock, value, sizeof(Lock_t));
+                lockSet = true;
+                break;
+        }
+    }
+
+    if (apply) {
+        if (lockSet) {
+            lockState = true;
+        }
+        /* Refresh the GATT database once for the whole update */
+        updateCharacteristicValues();
+    }
+    return AUTH_CALLBACK_REPLY_SUCCESS;
+}
+
 template <typename T>
 void EddystoneService::basicAuthorizationCallback(GattWriteAuthCallbackParams *authParams)
 {
@@ -670,36 +1346,48 @@ void EddystoneService::onDataWrittenCallback(const GattWriteCallbackParams *writ
 {
     uint16_t handle = writeParams->handle;
 
-    if (handle == lockChar->getValueHandle()) {
+    if (handle == lockChar.getValueHandle()) {
         memcpy(lock, writeParams->data, sizeof(Lock_t));
         /* Set the state to be locked by the lock code (note: zeros are a valid lock) */
         lockState = true;
-        ble.gattServer().write(lockChar->getValueHandle(), lock, sizeof(PowerLevels_t));
-        ble.gattServer().write(lockStateChar->getValueHandle(), reinterpret_cast<uint8_t *>(&lockState), sizeof(bool));
-    } else if (handle == unlockChar->getValueHandle()) {
+        ble.gattServer().write(lockChar.getValueHandle(), lock, sizeof(PowerLevels_t));
+        ble.gattServer().write(lockStateChar.getValueHandle(), reinterpret_cast<uint8_t *>(&lockState), sizeof(bool));
+    } else if (handle == unlockChar.getValueHandle()) {
         /* Validated earlier */
         lockState = false;
-        ble.gattServer().write(unlockChar->getValueHandle(), unlock, sizeof(PowerLevels_t));
-        ble.gattServer().write(lockStateChar->getValueHandle(), reinterpret_cast<uint8_t *>(&lockState), sizeof(bool));
-    } else if (handle == urlDataChar->getValueHandle()) {
+        ble.gattServer().write(unlockChar.getValueHandle(), unlock, sizeof(PowerLevels_t));
+        ble.gattServer().write(lockStateChar.getValueHandle(), reinterpret_cast<uint8_t *>(&lockState), sizeof(bool));
+    } else if (handle == urlDataChar.getValueHandle()) {
         urlFrame.setEncodedURLData(writeParams->data, writeParams->len);
-        ble.gattServer().write(urlDataChar->getValueHandle(), urlFrame.getEncodedURLData(), urlFrame.getEncodedURLDataLength());
-    } else if (handle == flagsChar->getValueHandle()) {
+        ble.gattServer().write(urlDataChar.getValueHandle(), urlFrame.getEncodedURLData(), urlFrame.getEncodedURLDataLength());
+    } else if (handle == flagsChar.getValueHandle()) {
         flags = *(writeParams->data);
-        ble.gattServer().write(flagsChar->getValueHandle(), &flags, sizeof(uint8_t));
-    } else if (handle == advPowerLevelsChar->getValueHandle()) {
+        ble.gattServer().write(flagsChar.getValueHandle(), &flags, sizeof(uint8_t));
+    } else if (handle == advPowerLevelsChar.getValueHandle()) {
         memcpy(advPowerLevels, writeParams->data, sizeof(PowerLevels_t));
-        ble.gattServer().write(advPowerLevelsChar->getValueHandle(), reinterpret_cast<uint8_t *>(advPowerLevels), sizeof(PowerLevels_t));
-    } else if (handle == txPowerModeChar->getValueHandle()) {
+        ble.gattServer().write(advPowerLevelsChar.getValueHandle(), reinterpret_cast<uint8_t *>(advPowerLevels), sizeof(PowerLevels_t));
+    } else if (handle == txPowerModeChar.getValueHandle()) {
         txPowerMode = *(writeParams->data);
-        ble.gattServer().write(txPowerModeChar->getValueHandle(), &txPowerMode, sizeof(uint8_t));
-    } else if (handle == beaconPeriodChar->getValueHandle()) {
+        ble.gattServer().write(txPowerModeChar.getValueHandle(), &txPowerMode, sizeof(uint8_t));
+    } else if (handle == beaconPeriodChar.getValueHandle()) {
         uint16_t tmpBeaconPeriod = correctAdvertisementPeriod(*((uint16_t *)(writeParams->data)));
         if (tmpBeaconPeriod != urlFramePeriod) {
             urlFramePeriod = tmpBeaconPeriod;
-            ble.gattServer().write(beaconPeriodChar->getValueHandle(), reinterpret_cast<uint8_t *>(&urlFramePeriod), sizeof(uint16_t));
+            ble.gattServer().write(beaconPeriodChar.getValueHandle(), reinterpret_cast<uint8_t *>(&urlFramePeriod), sizeof(uint16_t));
         }
-    } else if (handle == resetChar->getValueHandle() && (*((uint8_t *)writeParams->data) != 0)) {
+    } else if (handle == eidIdentityKeyChar.getValueHandle()) {
+        /* The identity key is encrypted with the lock code so that it is
+         * never sent over the air in the clear */
+        EIDIdentityKey_t identityKey;
+        AES128           aes;
+        aes.setKey(lock);
+        aes.decryptBlock(writeParams->data, identityKey);
+        setEIDData(identityKey, writeParams->data[EID_IDENTITY_KEY_SIZE]);
+        memset(identityKey, 0, sizeof(EIDIdentityKey_t));
+    } else if (handle == applyConfigChar.getValueHandle()) {
+        /* Validated earlier */
+        processApplyConfig(writeParams->data, writeParams->len, true);
+    } else if (handle == resetChar.getValueHandle() && (*((uint8_t *)writeParams->data) != 0)) {
         /* Reset characteristics to default values */
         flags          = 0;
         txPowerMode    = TX_POWER_MODE_LOW;
@@ -708,11 +1396,11 @@ void EddystoneService::onDataWrittenCallback(const GattWriteCallbackParams *writ
         urlFrame.setURLData(DEFAULT_URL);
         memset(lock, 0, sizeof(Lock_t));
 
-        ble.gattServer().write(urlDataChar->getValueHandle(), urlFrame.getEncodedURLData(), urlFrame.getEncodedURLDataLength());
-        ble.gattServer().write(flagsChar->getValueHandle(), &flags, sizeof(uint8_t));
-        ble.gattServer().write(txPowerModeChar->getValueHandle(), &txPowerMode, sizeof(uint8_t));
-        ble.gattServer().write(beaconPeriodChar->getValueHandle(), reinterpret_cast<uint8_t *>(&urlFramePeriod), sizeof(uint16_t));
-        ble.gattServer().write(lockChar->getValueHandle(), lock, sizeof(PowerLevels_t));
+        ble.gattServer().write(urlDataChar.getValueHandle(), urlFrame.getEncodedURLData(), urlFrame.getEncodedURLDataLength());
+        ble.gattServer().write(flagsChar.getValueHandle(), &flags, sizeof(uint8_t));
+        ble.gattServer().write(txPowerModeChar.getValueHandle(), &txPowerMode, sizeof(uint8_t));
+        ble.gattServer().write(beaconPeriodChar.getValueHandle(), reinterpret_cast<uint8_t *>(&urlFramePeriod), sizeof(uint16_t));
+        ble.gattServer().write(lockChar.getValueHandle(), lock, sizeof(PowerLevels_t));
     }
 }
 
@@ -744,10 +1432,10 @@ void EddystoneService::setURLFrameAdvertisingInterval(uint16_t urlFrameIntervalI
             eventQueue.cancel(urlFrameCallbackHandle);
         } else {
             /* This frame was just enabled */
-            if (!rawUidFrame && urlFramePeriod) {
-                /* Allocate memory for this frame and construct it */
-                rawUrlFrame = new uint8_t[urlFrame.getRawFrameSize()];
-                urlFrame.constructURLFrame(rawUrlFrame, advPowerLevels[txPowerMode]);
+            if (urlFramePeriod) {
+                /* Construct this frame */
+                urlFrame.constructURLFrame(rawUrlFrame, advPowerLevels[getAdaptedTxPowerMode()]);
+                constructAdvertisingPayload(urlAdvPayload, rawUrlFrame, urlFrame.getRawFrameSize());
             }
         }
 
@@ -755,16 +1443,16 @@ void EddystoneService::setURLFrameAdvertisingInterval(uint16_t urlFrameIntervalI
             /* Currently the only way to change the period of a callback
              * is to cancel it and reschedule
              */
-            urlFrameCallbackHandle = eventQueue.call_every(
-                urlFramePeriod,
+            urlFrameCallbackHandle = checkEventPosted(eventQueue.call_every(
+                getAdaptedFramePeriod(urlFramePeriod),
                 Callback<void(FrameType)>(this, &EddystoneService::enqueueFrame),
                 EDDYSTONE_FRAME_URL
-            );
+            ));
         } else {
             urlFrameCallbackHandle = 0;
         }
     } else if (operationMode == EDDYSTONE_MODE_CONFIG) {
-        ble.gattServer().write(beaconPeriodChar->getValueHandle(), reinterpret_cast<uint8_t *>(&urlFramePeriod), sizeof(uint16_t));
+        ble.gattServer().write(beaconPeriodChar.getValueHandle(), reinterpret_cast<uint8_t *>(&urlFramePeriod), sizeof(uint16_t));
     }
 }
 
@@ -784,10 +1472,10 @@ void EddystoneService::setUIDFrameAdvertisingInterval(uint16_t uidFrameIntervalI
             eventQueue.cancel(uidFrameCallbackHandle);
         } else {
             /* This frame was just enabled */
-            if (!rawUidFrame && uidFramePeriod) {
-                /* Allocate memory for this frame and construct it */
-                rawUidFrame = new uint8_t[uidFrame.getRawFrameSize()];
-                uidFrame.constructUIDFrame(rawUidFrame, advPowerLevels[txPowerMode]);
+            if (uidFramePeriod) {
+                /* Construct this frame */
+                uidFrame.constructUIDFrame(rawUidFrame, advPowerLevels[getAdaptedTxPowerMode()]);
+                constructAdvertisingPayload(uidAdvPayload, rawUidFrame, uidFrame.getRawFrameSize());
             }
         }
 
@@ -795,11 +1483,11 @@ void EddystoneService::setUIDFrameAdvertisingInterval(uint16_t uidFrameIntervalI
             /* Currently the only way to change the period of a callback
              * is to cancel it and reschedule
              */
-            uidFrameCallbackHandle = eventQueue.call_every(
-                uidFramePeriod,
+            uidFrameCallbackHandle = checkEventPosted(eventQueue.call_every(
+                getAdaptedFramePeriod(uidFramePeriod),
                 Callback<void(FrameType)>(this, &EddystoneService::enqueueFrame),
                 EDDYSTONE_FRAME_UID
-            );
+            ));
         } else {
             uidFrameCallbackHandle = 0;
         }
@@ -822,10 +1510,15 @@ void EddystoneService::setTLMFrameAdvertisingInterval(uint16_t tlmFrameIntervalI
             eventQueue.cancel(tlmFrameCallbackHandle);
         } else {
             /* This frame was just enabled */
-            if (!rawTlmFrame && tlmFramePeriod) {
-                /* Allocate memory for this frame and construct it */
-                rawTlmFrame = new uint8_t[tlmFrame.getRawFrameSize()];
-                /* Do not construct the TLM frame because this changes every 0.1 seconds */
+            if (tlmFramePeriod) {
+                /* Build the payload layout now, the TLM content is patched in
+                 * place every time it is advertised */
+                sampleTLMSensors();
+                constructTLMAdvertisingPayload();
+                tlmSensorsCallbackHandle = checkEventPosted(eventQueue.call_every(
+                    TLM_SENSOR_SAMPLE_PERIOD_MSEC,
+                    Callback<void()>(this, &EddystoneService::sampleTLMSensors)
+                ));
             }
         }
 
@@ -833,13 +1526,99 @@ void EddystoneService::setTLMFrameAdvertisingInterval(uint16_t tlmFrameIntervalI
             /* Currently the only way to change the period of a callback
              * is to cancel it and reschedule
              */
-            tlmFrameCallbackHandle = eventQueue.call_every(
-                tlmFramePeriod,
+            tlmFrameCallbackHandle = checkEventPosted(eventQueue.call_every(
+                getAdaptedFramePeriod(tlmFramePeriod),
                 Callback<void(FrameType)>(this, &EddystoneService::enqueueFrame),
                 EDDYSTONE_FRAME_TLM
-            );
+            ));
         } else {
             tlmFrameCallbackHandle = 0;
+            /* No TLM frames to sample sensors for */
+            if (tlmSensorsCallbackHandle) {
+                eventQueue.cancel(tlmSensorsCallbackHandle);
+                tlmSensorsCallbackHandle = 0;
+            }
+        }
+    }
+}
+
+void EddystoneService::setIBeaconFrameAdvertisingInterval(uint16_t iBeaconFrameIntervalIn)
+{
+    if (iBeaconFrameIntervalIn == iBeaconFramePeriod) {
+        /* Do nothing */
+        return;
+    }
+
+    /* Make sure the input period is within bounds */
+    iBeaconFramePeriod = correctAdvertisementPeriod(iBeaconFrameIntervalIn);
+
+    if (operationMode == EDDYSTONE_MODE_BEACON) {
+        if (iBeaconFrameCallbackHandle) {
+            /* The advertisement interval changes, update periodic callback */
+            eventQueue.cancel(iBeaconFrameCallbackHandle);
+        } else {
+            /* This frame was just enabled */
+            if (iBeaconFramePeriod) {
+                /* Construct this frame */
+                constructIBeaconAdvertisingPayload();
+            }
+        }
+
+        if (iBeaconFramePeriod) {
+            /* Currently the only way to change the period of a callback
+             * is to cancel it and reschedule
+             */
+            iBeaconFrameCallbackHandle = checkEventPosted(eventQueue.call_every(
+                iBeaconFramePeriod,
+                Callback<void(FrameType)>(this, &EddystoneService::enqueueFrame),
+                EDDYSTONE_FRAME_IBEACON
+            ));
+        } else {
+            iBeaconFrameCallbackHandle = 0;
+        }
+    }
+}
+
+void EddystoneService::setEIDFrameAdvertisingInterval(uint16_t eidFrameIntervalIn)
+{
+    if (eidFrameIntervalIn == eidFramePeriod) {
+        /* Do nothing */
+        return;
+    }
+
+    /* Make sure the input period is within bounds */
+    eidFramePeriod = correctAdvertisementPeriod(eidFrameIntervalIn);
+
+    if (operationMode == EDDYSTONE_MODE_BEACON && eidFrame.hasIdentityKey()) {
+        if (eidFrameCallbackHandle) {
+            /* The advertisement interval changes, update periodic callback */
+            eventQueue.cancel(eidFrameCallbackHandle);
+        } else {
+            /* This frame was just enabled */
+            if (eidFramePeriod) {
+                /* Construct this frame and schedule its rotation */
+                rotateEID();
+                eidFrame.constructEIDFrame(rawEidFrame, advPowerLevels[getAdaptedTxPowerMode()]);
+                constructAdvertisingPayload(eidAdvPayload, rawEidFrame, eidFrame.getRawFrameSize());
+            }
+        }
+
+        if (eidFramePeriod) {
+            /* Currently the only way to change the period of a callback
+             * is to cancel it and reschedule
+             */
+            eidFrameCallbackHandle = checkEventPosted(eventQueue.call_every(
+                eidFramePeriod,
+                Callback<void(FrameType)>(this, &EddystoneService::enqueueFrame),
+                EDDYSTONE_FRAME_EID
+            ));
+        } else {
+            eidFrameCallbackHandle = 0;
+            /* No EID frames to rotate */
+            if (eidRotationCallbackHandle) {
+                eventQueue.cancel(eidRotationCallbackHandle);
+                eidRotationCallbackHandle = 0;
+            }
         }
     }
 }
@@ -23,6 +23,8 @@
 #include "URLFrame.h"
 #include "UIDFrame.h"
 #include "TLMFrame.h"
+#include "EIDFrame.h"
+#include "IBeaconFrame.h"
 #include <string.h>
 #ifdef YOTTA_CFG_MBED_OS
     #include <mbed.h>
@@ -44,6 +46,30 @@
     #define YOTTA_CFG_EDDYSTONE_DEFAULT_TLM_FRAME_INTERVAL 2000
 #endif
 
+#ifndef YOTTA_CFG_EDDYSTONE_DEFAULT_EID_FRAME_INTERVAL
+    #define YOTTA_CFG_EDDYSTONE_DEFAULT_EID_FRAME_INTERVAL 1000
+#endif
+
+#ifndef YOTTA_CFG_EDDYSTONE_DEFAULT_IBEACON_FRAME_INTERVAL
+    #define YOTTA_CFG_EDDYSTONE_DEFAULT_IBEACON_FRAME_INTERVAL 0
+#endif
+
+#ifndef YOTTA_CFG_EDDYSTONE_DEFAULT_TLM_SENSOR_SAMPLE_INTERVAL
+    #define YOTTA_CFG_EDDYSTONE_DEFAULT_TLM_SENSOR_SAMPLE_INTERVAL 10000
+#endif
+
+#ifndef YOTTA_CFG_EDDYSTONE_DEFAULT_ADV_JITTER
+    #define YOTTA_CFG_EDDYSTONE_DEFAULT_ADV_JITTER 0
+#endif
+
+#ifndef YOTTA_CFG_EDDYSTONE_DENSITY_SCAN_INTERVAL
+    #define YOTTA_CFG_EDDYSTONE_DENSITY_SCAN_INTERVAL 60000
+#endif
+
+#ifndef YOTTA_CFG_EDDYSTONE_DENSITY_SCAN_WINDOW
+    #define YOTTA_CFG_EDDYSTONE_DENSITY_SCAN_WINDOW 300
+#endif
+
 #ifndef YOTTA_CFG_EDDYSTONE_DEFAULT_EDDYSTONE_URL_CONFIG_ADV_INTERVAL
     #define YOTTA_CFG_EDDYSTONE_DEFAULT_EDDYSTONE_URL_CONFIG_ADV_INTERVAL 1000
 #endif
@@ -60,7 +86,7 @@ public:
      * Total number of GATT Characteristics in the Eddystonei-URL Configuration
      * Service.
      */
-    static const uint16_t TOTAL_CHARACTERISTICS = 9;
+    static const uint16_t TOTAL_CHARACTERISTICS = 11;
 
     /**
      * Default interval for advertising packets for the Eddystone-URL
@@ -82,6 +108,44 @@ public:
      * frames.
      */
     static const uint16_t DEFAULT_TLM_FRAME_PERIOD_MSEC = YOTTA_CFG_EDDYSTONE_DEFAULT_TLM_FRAME_INTERVAL;
+    /**
+     * Interval at which the Eddystone-TLM Battery Voltage and Beacon
+     * Temperature callbacks are invoked. This is independent of (and
+     * normally slower than) the Eddystone-TLM frame interval.
+     */
+    static const uint16_t TLM_SENSOR_SAMPLE_PERIOD_MSEC = YOTTA_CFG_EDDYSTONE_DEFAULT_TLM_SENSOR_SAMPLE_INTERVAL;
+    /**
+     * Recommended interval for advertising packets containing Eddystone EID
+     * frames. EID frames are only advertised once an identity key is set.
+     */
+    static const uint16_t DEFAULT_EID_FRAME_PERIOD_MSEC = YOTTA_CFG_EDDYSTONE_DEFAULT_EID_FRAME_INTERVAL;
+    /**
+     * Default interval for advertising packets containing iBeacon frames. The
+     * default of zero means that iBeacon frames are not interleaved with the
+     * Eddystone frames.
+     */
+    static const uint16_t DEFAULT_IBEACON_FRAME_PERIOD_MSEC = YOTTA_CFG_EDDYSTONE_DEFAULT_IBEACON_FRAME_INTERVAL;
+    /**
+     * Default upper bound of the random delay added before each frame is put
+     * on air, on top of the advDelay added by the link layer. The default of
+     * zero disables the jitter.
+     */
+    static const uint16_t DEFAULT_ADV_JITTER_MSEC       = YOTTA_CFG_EDDYSTONE_DEFAULT_ADV_JITTER;
+    /**
+     * Interval at which the beacon listens to estimate the number of
+     * advertisers around it when the density backoff is enabled.
+     */
+    static const uint32_t DENSITY_SCAN_PERIOD_MSEC      = YOTTA_CFG_EDDYSTONE_DENSITY_SCAN_INTERVAL;
+    /**
+     * How long the beacon listens for other advertisers every
+     * DENSITY_SCAN_PERIOD_MSEC milliseconds.
+     */
+    static const uint16_t DENSITY_SCAN_WINDOW_MSEC      = YOTTA_CFG_EDDYSTONE_DENSITY_SCAN_WINDOW;
+    /**
+     * The maximum number of distinct advertisers counted during a density
+     * scan.
+     */
+    static const uint8_t  MAX_DENSITY_ADVERTISERS       = 32;
 
     /**
      * Enumeration that defines the various operation modes of the
@@ -89,23 +153,22 @@ public:
      *
      * @note The main app can change the mode of EddystoneService at any point
      *       of time by calling startConfigService() or startBeaconService().
-     *       Resources from the previous mode will be freed.
+     *       Callbacks from the previous mode will be cancelled.
      *
      * @note It is currently NOT possible to force EddystoneService back into
      *       EDDYSTONE_MODE_NONE.
      */
     enum OperationModes {
         /**
-         * NONE: EddystoneService has been initialized but no memory has been
-         * dynamically allocated. Additionally, no services are running
-         * nothing is being advertised.
+         * NONE: EddystoneService has been initialized but no services are
+         * running nothing is being advertised.
          */
         EDDYSTONE_MODE_NONE,
         /**
-         * CONFIG: EddystoneService has been initialized, the configuration
-         *         service started and memory has been allocated for BLE
-         *         characteristics. Memory consumption peaks during CONFIG
-         *         mode.
+         * CONFIG: EddystoneService has been initialized and the configuration
+         *         service started. The BLE characteristics are stored
+         *         within the EddystoneService object, so no memory is
+         *         dynamically allocated when switching modes.
          */
         EDDYSTONE_MODE_CONFIG,
         /**
@@ -190,6 +253,32 @@ public:
          * The configured version of the Eddystone-TLM frames.
          */
         uint8_t          tlmVersion;
+        /**
+         * The configured interval (in milliseconds) of the Eddystone-EID
+         * frames.
+         *
+         * @note A value of zero disables Eddystone-EID frame transmissions.
+         */
+        uint16_t         eidFramePeriod;
+        /**
+         * Whether EddystoneParams_t::eidIdentityKey holds a provisioned key.
+         */
+        bool             eidIdentityKeySet;
+        /**
+         * The configured Eddystone-EID rotation exponent.
+         */
+        uint8_t          eidRotationExponent;
+        /**
+         * The Eddystone-EID beacon time in seconds when the parameters were
+         * retrieved. It must not go backwards across restarts, so the
+         * parameters are saved every EID_BEACON_TIME_SAVE_PERIOD_SECONDS and
+         * the constructor moves the restored time forward by that period.
+         */
+        uint32_t         eidBeaconTime;
+        /**
+         * The Eddystone-EID identity key shared with the resolver.
+         */
+        EIDIdentityKey_t eidIdentityKey;
         /**
          * The length of the encoded URL in EddystoneParams_t::urlData used
          * within Eddystone-URL frames.
@@ -214,6 +303,39 @@ public:
         UIDInstanceID_t  uidInstanceID;
     };
 
+    /**
+     * Structure that describes how the beacon saves energy as the battery
+     * voltage reported by the Eddystone-TLM Battery Voltage callback falls.
+     * The voltage range between fullVoltage and emptyVoltage is split into
+     * NUM_BATTERY_LEVELS levels. Every level below full stretches the
+     * Eddystone-URL, UID and TLM frame periods a bit more, up to
+     * maxPeriodMultiplier at emptyVoltage, and drops the TX power mode by one,
+     * down to minTxPowerMode.
+     */
+    struct BatteryPolicy_t {
+        /**
+         * The battery voltage (in mV) at or above which the configured
+         * periods and TX power mode are used unchanged. Zero disables the
+         * policy.
+         */
+        uint16_t fullVoltage;
+        /**
+         * The battery voltage (in mV) at or below which the most energy is
+         * saved. It must be lower than fullVoltage.
+         */
+        uint16_t emptyVoltage;
+        /**
+         * The factor applied to the frame periods at emptyVoltage. One leaves
+         * the periods unchanged.
+         */
+        uint8_t  maxPeriodMultiplier;
+        /**
+         * The lowest TX power mode the policy may drop to. A configured TX
+         * power mode that is already lower is left unchanged.
+         */
+        uint8_t  minTxPowerMode;
+    };
+
     /**
      * Enumeration that defines the various error codes for EddystoneService.
      */
@@ -260,12 +382,35 @@ public:
          * https://github.com/google/eddystone/tree/master/eddystone-tlm.
          */
         EDDYSTONE_FRAME_TLM,
+        /**
+         * The Eddystone-EID frame. Refer to
+         * https://github.com/google/eddystone/tree/master/eddystone-eid.
+         */
+        EDDYSTONE_FRAME_EID,
+        /**
+         * An iBeacon frame interleaved with the Eddystone frames. This is
+         * not part of the Eddystone specification and is only advertised if
+         * setIBeaconFrameAdvertisingInterval() is given a non-zero interval.
+         */
+        EDDYSTONE_FRAME_IBEACON,
         /**
          * The total number Eddystone frame types.
          */
         NUM_EDDYSTONE_FRAMES
     };
 
+    /**
+     * The number of battery levels of the battery policy, from full (0) to
+     * empty (NUM_BATTERY_LEVELS - 1).
+     */
+    static const uint8_t NUM_BATTERY_LEVELS = 4;
+    /**
+     * The margin (in mV) by which the battery voltage must rise above a level
+     * boundary before the battery policy moves back to a higher level, so
+     * that a voltage sagging under load does not make the level flap.
+     */
+    static const uint16_t BATTERY_LEVEL_HYSTERESIS_MV = 50;
+
     /**
      * The size of the advertising frame queue.
      *
@@ -275,6 +420,47 @@ public:
      */
     static const uint16_t ADV_FRAME_QUEUE_SIZE = NUM_EDDYSTONE_FRAMES;
 
+    /**
+     * Interval at which the time since boot is refreshed even if no TLM
+     * frames are advertised. The time is read as a 32-bit microsecond count
+     * that wraps every ~71 minutes, so it must be read more often than that.
+     */
+    static const uint32_t TIME_SINCE_BOOT_UPDATE_PERIOD_MSEC = 30 * 60 * 1000;
+
+    /**
+     * Interval at which the application saves the parameters while in beacon
+     * mode, so that the Eddystone-EID beacon time survives a restart. The
+     * constructor taking persisted parameters adds this period to the
+     * restored time: after a reset the clock may skip ahead by up to one
+     * period, but it never repeats a time that was already advertised.
+     *
+     * @note Each save writes one 32-byte journal record when only the beacon
+     *       time changed, so an hourly save fills a 512-byte journal bank in
+     *       about 16 hours, and a 1 KB one in about 32 hours.
+     */
+    static const uint32_t EID_BEACON_TIME_SAVE_PERIOD_SECONDS = 60 * 60;
+
+    /**
+     * The largest number of events the service keeps posted at once on the
+     * event queue: the time since boot refresh, the TLM sensor sampling, one
+     * periodic callback per frame type, the EID rotation, the radio manager,
+     * and the start and stop of the density scan. One more is counted for a
+     * one-shot callback that posts its successor, such as manageRadio(), as
+     * its own event is only freed once it returns.
+     */
+    static const unsigned MAX_EVENTS = 2 + NUM_EDDYSTONE_FRAMES + 4 + 1;
+    /**
+     * The size of an event of the service on the event queue. The frame
+     * callbacks carry their FrameType argument besides the callback, so they
+     * are larger than EVENTS_EVENT_SIZE by one word.
+     */
+    static const unsigned EVENT_SIZE = EVENTS_EVENT_SIZE + sizeof(void *);
+    /**
+     * The space the service needs on the event queue passed to its
+     * constructor, on top of the events of the application.
+     */
+    static const unsigned EVENT_QUEUE_SIZE = MAX_EVENTS * EVENT_SIZE;
+
 
     /**
      * Constructor that Initializes the EddystoneService using parameters from
@@ -327,6 +513,10 @@ public:
      *
      * @param[in] tlmBatteryVoltageCallbackIn
      *              The callback being registered.
+     *
+     * @note The callback is invoked every TLM_SENSOR_SAMPLE_PERIOD_MSEC
+     *       milliseconds while in EDDYSTONE_MODE_BEACON, never from the
+     *       frame swapping path.
      */
     void onTLMBatteryVoltageUpdate(TlmUpdateCallback_t tlmBatteryVoltageCallbackIn);
 
@@ -335,14 +525,18 @@ public:
      *
      * @param[in] tlmBeaconTemperatureCallbackIn
      *              The callback being registered.
+     *
+     * @note The callback is invoked every TLM_SENSOR_SAMPLE_PERIOD_MSEC
+     *       milliseconds while in EDDYSTONE_MODE_BEACON, never from the
+     *       frame swapping path.
      */
     void onTLMBeaconTemperatureUpdate(TlmUpdateCallback_t tlmBeaconTemperatureCallbackIn);
 
     /**
-     * Set the Eddystone-TLM frame version. The other components of
-     * Eddystone-TLM frames are updated just before the frame is broadcast
-     * since information such as beacon temperature and time since boot changes
-     * relatively quickly.
+     * Set the Eddystone-TLM frame version. The PDU count and time since boot
+     * of Eddystone-TLM frames are updated just before the frame is broadcast,
+     * while the beacon temperature and battery voltage are sampled every
+     * TLM_SENSOR_SAMPLE_PERIOD_MSEC milliseconds.
      *
      * @param[in] tlmVersionIn
      *              The Eddyston-TLM version to set.
@@ -401,6 +595,151 @@ public:
      */
     void setTLMFrameAdvertisingInterval(uint16_t tlmFrameIntervalIn = DEFAULT_TLM_FRAME_PERIOD_MSEC);
 
+    /**
+     * Set the Eddystone-EID identity key and rotation exponent. The
+     * ephemeral identifier is recomputed only when the beacon time enters a
+     * new rotation window of 2^K seconds. Once the identity key is set,
+     * Eddystone-TLM frames are sent as encrypted eTLM frames keyed by it.
+     *
+     * @param[in] identityKeyIn
+     *              The 128-bit identity key shared with the resolver.
+     * @param[in] rotationExponentIn
+     *              The rotation exponent K, at most
+     *              EIDFrame::MAX_ROTATION_EXPONENT.
+     * @param[in] beaconTimeIn
+     *              The beacon time in seconds to start counting from.
+     */
+    void setEIDData(const EIDIdentityKey_t &identityKeyIn, uint8_t rotationExponentIn, uint32_t beaconTimeIn = 0);
+
+    /**
+     * Set the interval for the Eddystone-EID frames.
+     *
+     * @param[in] eidFrameIntervalIn
+     *              The new frame interval in milliseconds. The default is
+     *              DEFAULT_EID_FRAME_PERIOD_MSEC.
+     *
+     * @note A value of zero disables Eddystone-EID frames.
+     */
+    void setEIDFrameAdvertisingInterval(uint16_t eidFrameIntervalIn = DEFAULT_EID_FRAME_PERIOD_MSEC);
+
+    /**
+     * Get the time taken by the last Eddystone-EID rotation, i.e. computing
+     * the new ephemeral identifier and rebuilding the advertising payload.
+     *
+     * @return The time in microseconds, measured with the timer used for
+     *         the time since boot.
+     */
+    uint32_t getEIDRotationTime(void) const;
+
+    /**
+     * Set the contents of the iBeacon frames interleaved with the Eddystone
+     * frames.
+     *
+     * @param[in] proximityUUIDIn
+     *              The 128-bit iBeacon proximity UUID.
+     * @param[in] majorNumberIn
+     *              The iBeacon major number.
+     * @param[in] minorNumberIn
+     *              The iBeacon minor number.
+     * @param[in] measuredPowerIn
+     *              The calibrated RSSI at 1m advertised in the iBeacon frame.
+     * @param[in] radioTxPowerIn
+     *              The value set internally into the radio tx power while an
+     *              iBeacon frame is advertised. Eddystone frames use the
+     *              radio power level of the configured TX Power Mode.
+     */
+    void setIBeaconData(const IBeaconProximityUUID_t &proximityUUIDIn,
+                        uint16_t                     majorNumberIn,
+                        uint16_t                     minorNumberIn,
+                        int8_t                       measuredPowerIn,
+                        int8_t                       radioTxPowerIn);
+
+    /**
+     * Set the interval for the iBeacon frames.
+     *
+     * @param[in] iBeaconFrameIntervalIn
+     *              The new frame interval in milliseconds. The default is
+     *              DEFAULT_IBEACON_FRAME_PERIOD_MSEC.
+     *
+     * @note A value of zero disables iBeacon frames.
+     */
+    void setIBeaconFrameAdvertisingInterval(uint16_t iBeaconFrameIntervalIn = DEFAULT_IBEACON_FRAME_PERIOD_MSEC);
+
+    /**
+     * Get the number of times a frame of the given type was put on air since
+     * the EddystoneService was constructed. Each swap starts a fresh
+     * advertising event and the frame is replaced before the next one would
+     * be due, so this matches the number of advertising PDUs sent for the
+     * frame type.
+     *
+     * @param[in] frameType
+     *              The frame type to query.
+     *
+     * @return The number of times the frame was advertised.
+     */
+    uint32_t getAdvertisedFrameCount(FrameType frameType) const;
+
+    /**
+     * Set the policy used to save energy as the battery voltage falls. The
+     * battery level is updated every time the Eddystone-TLM Battery Voltage
+     * callback is sampled, and a change of level is applied by rescheduling
+     * the frame callbacks without restarting the beacon service.
+     *
+     * @param[in] batteryPolicyIn
+     *              The new battery policy.
+     *
+     * @note The battery voltage is only sampled while Eddystone-TLM frames
+     *       are enabled and a Battery Voltage callback is registered.
+     */
+    void setBatteryPolicy(const BatteryPolicy_t &batteryPolicyIn);
+
+    /**
+     * Get the battery level currently applied by the battery policy.
+     *
+     * @return The battery level, zero if the battery is full or the policy
+     *         is disabled.
+     */
+    uint8_t getBatteryLevel(void) const;
+
+    /**
+     * Set the upper bound of the random delay added before each frame is put
+     * on air. Beacons that advertise at the same fixed interval otherwise
+     * tend to stay aligned and keep colliding.
+     *
+     * @param[in] advJitterIn
+     *              The maximum delay in milliseconds. The default is
+     *              DEFAULT_ADV_JITTER_MSEC, zero disables the jitter.
+     */
+    void setAdvertisingJitter(uint16_t advJitterIn = DEFAULT_ADV_JITTER_MSEC);
+
+    /**
+     * Enable the density backoff. Every DENSITY_SCAN_PERIOD_MSEC milliseconds
+     * the beacon scans for DENSITY_SCAN_WINDOW_MSEC milliseconds and counts
+     * the other advertisers it hears. The Eddystone-URL, UID and TLM frame
+     * periods are then multiplied by one more for every
+     * @p advertisersPerStepIn advertisers, up to @p maxPeriodMultiplierIn.
+     *
+     * @param[in] advertisersPerStepIn
+     *              The number of advertisers that stretch the periods by one
+     *              more times the configured period. Zero disables the
+     *              density backoff.
+     * @param[in] maxPeriodMultiplierIn
+     *              The largest factor applied to the frame periods.
+     *
+     * @note Scanning while advertising requires a BLE stack that supports
+     *       both roles at the same time, such as the S130 SoftDevice.
+     */
+    void setDensityBackoff(uint8_t advertisersPerStepIn, uint8_t maxPeriodMultiplierIn);
+
+    /**
+     * Get the number of other advertisers heard during the last density
+     * scan.
+     *
+     * @return The number of distinct advertisers, saturated at
+     *         MAX_DENSITY_ADVERTISERS.
+     */
+    uint8_t getAdvertiserDensity(void) const;
+
     /**
      * Change the EddystoneService OperationMode to EDDYSTONE_MODE_CONFIG.
      *
@@ -409,9 +748,8 @@ public:
      *         advertising interval is zero.
      *
      * @note If EddystoneService was previously in EDDYSTONE_MODE_BEACON, then
-     *       the resources allocated to that mode of operation such as memory
-     *       are freed and the BLE instance shutdown before the new operation
-     *       mode is configured.
+     *       the callbacks of that mode of operation are cancelled and the BLE
+     *       instance shutdown before the new operation mode is configured.
      */
     EddystoneError_t startConfigService(void);
 
@@ -423,9 +761,8 @@ public:
      *         advertising interval is zero.
      *
      * @note If EddystoneService was previously in EDDYSTONE_MODE_CONFIG, then
-     *       the resources allocated to that mode of operation such as memory
-     *       are freed and the BLE instance shutdown before the new operation
-     *       mode is configured.
+     *       the BLE instance is shutdown before the new operation mode is
+     *       configured.
      */
     EddystoneError_t startBeaconService(void);
 
@@ -437,9 +774,9 @@ public:
      *         EddystoneService already is EDDYSTONE_MODE_NONE.
      *
      * @note If EddystoneService was previously in EDDYSTONE_MODE_CONFIG or
-     *       EDDYSTONE_MODE_BEACON, then the resources allocated to that mode
-     *       of operation such as memory are freed and the BLE instance
-     *       shutdown before the new operation mode is configured.
+     *       EDDYSTONE_MODE_BEACON, then the callbacks of that mode of
+     *       operation are cancelled and the BLE instance shutdown before the
+     *       new operation mode is configured.
      */
     EddystoneError_t stopCurrentService(void);
 
@@ -515,7 +852,9 @@ private:
     /**
      * When in EDDYSTONE_MODE_BEACON this function is called to update the
      * advertising payload to contain the information related to the specified
-     * FrameType.
+     * FrameType. The payloads are prepared in advance by
+     * constructAdvertisingPayload(), so this only hands a ready-made buffer
+     * to the BLE API.
      *
      * @param[in] frameType
      *              The frame to populate the advertising payload with.
@@ -538,6 +877,36 @@ private:
      */
     void manageRadio(void);
 
+    /**
+     * Get a random delay to add before the next frame is put on air.
+     *
+     * @return A delay in milliseconds between zero and the configured
+     *         advertising jitter.
+     */
+    uint16_t getAdvertisingJitter(void) const;
+
+    /**
+     * Start listening for other advertisers. This is invoked every
+     * DENSITY_SCAN_PERIOD_MSEC milliseconds while the density backoff is
+     * enabled.
+     */
+    void startDensityScan(void);
+
+    /**
+     * Stop a density scan and update the frame periods with the number of
+     * advertisers heard.
+     */
+    void stopDensityScan(void);
+
+    /**
+     * Callback registered to the BLE API to count the advertisers heard
+     * during a density scan.
+     *
+     * @param[in] params
+     *              Information about the received advertisement.
+     */
+    void densityScanCallback(const Gap::AdvertisementCallbackParams_t *params);
+
     /**
      * Regular callbacks posted at the rate of urlFramePeriod, uidFramePeriod
      * and tlmFramePeriod milliseconds enqueue frames to be advertised. If the
@@ -550,26 +919,88 @@ private:
     void enqueueFrame(FrameType frameType);
 
     /**
-     * Helper function that updates the advertising payload when in
-     * EDDYSTONE_MODE_BEACON to contain a new frame.
+     * Helper function that builds the complete advertising payload (flags,
+     * Eddystone UUID list and service data) used in EDDYSTONE_MODE_BEACON
+     * for a frame. This is done once per configuration change rather than
+     * every time the frame is advertised.
      *
+     * @param[out] payload
+     *              The advertising payload to (re)build.
      * @param[in] rawFrame
      *              The raw bytes of the frame to advertise.
      * @param[in] rawFrameLength
      *              The length in bytes of the array pointed to by @p rawFrame.
      */
-    void updateAdvertisementPacket(const uint8_t* rawFrame, size_t rawFrameLength);
+    void constructAdvertisingPayload(GapAdvertisingData &payload, const uint8_t* rawFrame, size_t rawFrameLength);
+
+    /**
+     * Helper function that builds the raw iBeacon frame and the complete
+     * advertising payload (flags and manufacturer specific data) used to
+     * advertise it in EDDYSTONE_MODE_BEACON.
+     */
+    void constructIBeaconAdvertisingPayload(void);
 
     /**
      * Helper function that updates the information in the Eddystone-TLM frames
-     * Internally, this function executes the registered callbacks to update
-     * beacon Battery Voltage and Temperature (if available). Furthermore, this
-     * function updates the raw frame data. This operation must be done fairly
-     * often because the Eddystone-TLM frame Time Since Boot must have a 0.1
-     * seconds resolution according to the Eddystone specification.
+     * Internally, this function patches the PDU count and Time Since Boot into
+     * the raw frame data, as well as the Battery Voltage and Temperature if
+     * they changed since the last transmission. This operation must be done
+     * fairly often because the Eddystone-TLM frame Time Since Boot must have a
+     * 0.1 seconds resolution according to the Eddystone specification.
      */
     void updateRawTLMFrame(void);
 
+    /**
+     * Helper function that builds the raw Eddystone-TLM (or eTLM) frame and
+     * the advertising payload around it. This is needed whenever the frame
+     * size may have changed.
+     */
+    void constructTLMAdvertisingPayload(void);
+
+    /**
+     * Helper function that encrypts the current telemetry into the raw eTLM
+     * frame and then prepares the AES-EAX nonce for the next one. It is
+     * called when an Eddystone-TLM frame is enqueued so that
+     * swapAdvertisedFrame() never does any crypto.
+     */
+    void prepareETLMFrame(void);
+
+    /**
+     * Helper function that prepares a new eTLM nonce from the current
+     * Eddystone-EID rotation window and a random salt.
+     */
+    void prepareETLMNonce(void);
+
+    /**
+     * Periodic callback that executes the registered callbacks to update
+     * beacon Battery Voltage and Temperature (if available). This is kept
+     * out of updateRawTLMFrame() so that sensor sampling (e.g. ADC reads) does
+     * not happen while swapping advertised frames.
+     */
+    void sampleTLMSensors(void);
+
+    /**
+     * Read timeSinceBootTimer.
+     *
+     * @return The time since the service was initialised in microseconds,
+     *         modulo 2^32.
+     */
+    uint32_t readTickerMicros(void);
+
+    /**
+     * Accumulate the time elapsed on timeSinceBootTimer into the
+     * Eddystone-TLM frame Time Since Boot.
+     */
+    void updateTimeSinceBoot(void);
+
+    /**
+     * Callback posted when the Eddystone-EID beacon time enters a new
+     * rotation window. It recomputes the ephemeral identifier, rebuilds the
+     * advertising payload and posts itself again for the next window, so no
+     * AES work is done while the identifier is unchanged.
+     */
+    void rotateEID(void);
+
     /**
      * Initialize the resources required when switching to
      * EDDYSTONE_MODE_BEACON.
@@ -578,19 +1009,14 @@ private:
 
     /**
      * Initialize the resources required when switching to
-     * EDDYSTONE_MODE_CONFIG. This includes the GATT services and
+     * EDDYSTONE_MODE_CONFIG. This registers the GATT service and
      * characteristics required by the Eddystone-URL Configuration Service.
      */
     void setupConfigService(void);
 
     /**
-     * Free the resources acquired by a call to setupConfigService().
-     */
-    void freeConfigCharacteristics(void);
-
-    /**
-     * Free the resources acquired by a call to setupBeaconService() and
-     * cancel all pending callbacks that operate the radio and frame queue.
+     * Cancel all pending callbacks posted by setupBeaconService() that
+     * operate the radio and frame queue.
      *
      * @note This call will not modify the current state of the BLE device.
      *       EddystoneService::stopBeaconService should only be called after
@@ -645,6 +1071,42 @@ private:
 
     void powerModeAuthorizationCallback(GattWriteAuthCallbackParams *authParams);
 
+    /**
+     * Callback registered to the BLE API to authorize write operations to the
+     * Eddystone-EID Identity Key characteristic.
+     *
+     * @param[in] authParams
+     *              Write authentication information.
+     */
+    void eidIdentityKeyAuthorizationCallback(GattWriteAuthCallbackParams *authParams);
+
+    /**
+     * Callback registered to the BLE API to authorize write operations to the
+     * Apply Config characteristic. The whole value is validated here so that
+     * it is either applied entirely or rejected.
+     *
+     * @param[in] authParams
+     *              Write authentication information.
+     */
+    void applyConfigAuthorizationCallback(GattWriteAuthCallbackParams *authParams);
+
+    /**
+     * Walk the TLV records of an Apply Config characteristic value and
+     * optionally apply them to the internal state of the service object.
+     *
+     * @param[in] data
+     *              The characteristic value.
+     * @param[in] len
+     *              The length of the characteristic value in bytes.
+     * @param[in] apply
+     *              false to only validate the value, true to apply it. The
+     *              value must have been validated before it is applied.
+     *
+     * @return AUTH_CALLBACK_REPLY_SUCCESS if the value is valid, otherwise
+     *         the error to report to the GATT client.
+     */
+    GattAuthCallbackReply_t processApplyConfig(const uint8_t *data, uint16_t len, bool apply);
+
     /**
      * Callback registered to the BLE API to authorize write operations to the
      * following Eddystone-URL Configuration Service characteristics:
@@ -683,6 +1145,88 @@ private:
      */
     uint16_t correctAdvertisementPeriod(uint16_t beaconPeriodIn) const;
 
+    /**
+     * Get the battery level for a battery voltage according to the battery
+     * policy.
+     *
+     * @param[in] batteryVoltage
+     *              The battery voltage in mV.
+     *
+     * @return The battery level, between 0 and NUM_BATTERY_LEVELS - 1.
+     */
+    uint8_t computeBatteryLevel(uint16_t batteryVoltage) const;
+
+    /**
+     * Update the battery level from a new battery voltage sample and apply
+     * the battery policy if the level changed.
+     *
+     * @param[in] batteryVoltage
+     *              The battery voltage in mV.
+     */
+    void updateBatteryLevel(uint16_t batteryVoltage);
+
+    /**
+     * Stretch a configured frame period according to the current battery
+     * level, from 1x at full to the maxPeriodMultiplier of the battery policy
+     * at empty, then by densityPeriodMultiplier, the factor set by the
+     * density backoff from the number of advertisers nearby. The result is
+     * capped at 0xFFFF ms and corrected to a valid advertising period.
+     *
+     * @param[in] framePeriod
+     *              The configured frame period in milliseconds.
+     *
+     * @return The frame period to schedule the frame callbacks with.
+     */
+    uint16_t getAdaptedFramePeriod(uint16_t framePeriod) const;
+
+    /**
+     * Get the TX power mode used for Eddystone frames at the current
+     * battery level.
+     *
+     * @return An index into the advertised and radio power levels.
+     */
+    uint8_t getAdaptedTxPowerMode(void) const;
+
+    /**
+     * Apply the battery policy to a running beacon service: rebuild the
+     * frames that carry the advertised power level and reschedule the frame
+     * callbacks with the adapted periods.
+     */
+    void applyBatteryPolicy(void);
+
+    /**
+     * Reschedule the Eddystone-URL, UID and TLM frame callbacks with the
+     * periods adapted to the battery level and advertiser density.
+     */
+    void rescheduleFrameCallbacks(void);
+
+    /**
+     * Check the handle of an event posted on the event queue. A zero handle
+     * means the queue ran out of space, which would silently disable the
+     * callback, so it is reported as a fatal error.
+     *
+     * @param[in] callbackHandle
+     *              The handle returned by EventQueue::call_in() or
+     *              EventQueue::call_every().
+     *
+     * @return callbackHandle.
+     */
+    int checkEventPosted(int callbackHandle);
+
+    /**
+     * Cancel a periodic frame callback and post it again with a new period.
+     *
+     * @param[in] callbackHandle
+     *              The handle of the periodic callback, updated with the
+     *              handle of the new callback.
+     * @param[in] framePeriod
+     *              The configured period in milliseconds, which is adapted
+     *              with getAdaptedFramePeriod().
+     * @param[in] frameType
+     *              The frame type enqueued by the callback.
+     */
+    void rescheduleFrameCallback(int &callbackHandle, uint16_t framePeriod, FrameType frameType);
+
     /**
      * BLE instance that EddystoneService will operate on.
      */
@@ -709,6 +1253,10 @@ private:
      * Encapsulation of a TLM frame.
      */
     TLMFrame                                                        tlmFrame;
+    /**
+     * Encapsulation of an EID frame.
+     */
+    EIDFrame                                                        eidFrame;
 
     /**
      * The value set internally into the radion tx power.
@@ -764,68 +1312,185 @@ private:
      * The advertising interval (in milliseconds) of Eddystone-TLM frames.
      */
     uint16_t                                                        tlmFramePeriod;
+    /**
+     * The advertising interval (in milliseconds) of Eddystone-EID frames.
+     */
+    uint16_t                                                        eidFramePeriod;
+    /**
+     * The advertising interval (in milliseconds) of iBeacon frames.
+     */
+    uint16_t                                                        iBeaconFramePeriod;
+    /**
+     * Encapsulation of an iBeacon frame.
+     */
+    IBeaconFrame                                                    iBeaconFrame;
+    /**
+     * The value set internally into the radio tx power when advertising
+     * iBeacon frames.
+     */
+    int8_t                                                          iBeaconRadioTxPower;
+    /**
+     * The value currently set into the radio tx power, used to avoid
+     * reprogramming the radio when consecutive frames share a power level.
+     */
+    int8_t                                                          currentRadioTxPower;
+
+    /**
+     * The policy used to save energy as the battery voltage falls.
+     */
+    BatteryPolicy_t                                                 batteryPolicy;
+    /**
+     * The battery level currently applied by the battery policy.
+     */
+    uint8_t                                                         batteryLevel;
+    /**
+     * The upper bound (in milliseconds) of the random delay added before
+     * each frame is put on air.
+     */
+    uint16_t                                                        advJitter;
+    /**
+     * The number of advertisers that stretch the frame periods by one more
+     * times the configured period. Zero disables the density backoff.
+     */
+    uint8_t                                                         densityAdvertisersPerStep;
+    /**
+     * The largest factor applied to the frame periods by the density
+     * backoff.
+     */
+    uint8_t                                                         densityMaxPeriodMultiplier;
+    /**
+     * The factor currently applied to the frame periods by the density
+     * backoff.
+     */
+    uint8_t                                                         densityPeriodMultiplier;
+    /**
+     * The number of advertisers heard during the last density scan.
+     */
+    uint8_t                                                         advertiserDensity;
+    /**
+     * The number of distinct advertisers heard so far in the current
+     * density scan.
+     */
+    uint8_t                                                         densityScanCount;
+    /**
+     * The addresses of the advertisers heard so far in the current density
+     * scan.
+     */
+    Gap::Address_t                                                  densityScanAddresses[MAX_DENSITY_ADVERTISERS];
 
     /**
-     * Pointer to the BLE API characteristic encapsulation for the Eddystone-URL
+     * BLE API characteristic encapsulation for the Eddystone-URL
      * Configuration Service Lock State characteristic.
      */
-    ReadOnlyGattCharacteristic<bool>                                *lockStateChar;
+    ReadOnlyGattCharacteristic<bool>                                lockStateChar;
     /**
-     * Pointer to the BLE API characteristic encapsulation for the Eddystone-URL
+     * BLE API characteristic encapsulation for the Eddystone-URL
      * Configuration Service Lock characteristic.
      */
-    WriteOnlyArrayGattCharacteristic<uint8_t, sizeof(Lock_t)>       *lockChar;
+    WriteOnlyArrayGattCharacteristic<uint8_t, sizeof(Lock_t)>       lockChar;
     /**
-     * Pointer to the BLE API characteristic encapsulation for the Eddystone-URL
+     * BLE API characteristic encapsulation for the Eddystone-URL
      * Configuration Service Unlock characteristic.
      */
-    WriteOnlyArrayGattCharacteristic<uint8_t, sizeof(Lock_t)>       *unlockChar;
+    WriteOnlyArrayGattCharacteristic<uint8_t, sizeof(Lock_t)>       unlockChar;
     /**
-     * Pointer to the BLE API characteristic encapsulation for the Eddystone-URL
+     * BLE API characteristic encapsulation for the Eddystone-URL
      * Configuration Service URI Data characteristic.
      */
-    GattCharacteristic                                              *urlDataChar;
+    GattCharacteristic                                              urlDataChar;
     /**
-     * Pointer to the BLE API characteristic encapsulation for the Eddystone-URL
+     * BLE API characteristic encapsulation for the Eddystone-URL
      * Configuration Service Flags characteristic.
      */
-    ReadWriteGattCharacteristic<uint8_t>                            *flagsChar;
+    ReadWriteGattCharacteristic<uint8_t>                            flagsChar;
     /**
-     * Pointer to the BLE API characteristic encapsulation for the Eddystone-URL
+     * BLE API characteristic encapsulation for the Eddystone-URL
      * Configuration Service Advertised TX Power Levels characteristic.
      */
-    ReadWriteArrayGattCharacteristic<int8_t, sizeof(PowerLevels_t)> *advPowerLevelsChar;
+    ReadWriteArrayGattCharacteristic<int8_t, sizeof(PowerLevels_t)> advPowerLevelsChar;
     /**
-     * Pointer to the BLE API characteristic encapsulation for the Eddystone-URL
+     * BLE API characteristic encapsulation for the Eddystone-URL
      * Configuration Service TX Power Mode characteristic.
      */
-    ReadWriteGattCharacteristic<uint8_t>                            *txPowerModeChar;
+    ReadWriteGattCharacteristic<uint8_t>                            txPowerModeChar;
     /**
-     * Pointer to the BLE API characteristic encapsulation for the Eddystone-URL
+     * BLE API characteristic encapsulation for the Eddystone-URL
      * Configuration Service Beacon Period characteristic.
      */
-    ReadWriteGattCharacteristic<uint16_t>                           *beaconPeriodChar;
+    ReadWriteGattCharacteristic<uint16_t>                           beaconPeriodChar;
     /**
-     * Pointer to the BLE API characteristic encapsulation for the Eddystone-URL
+     * BLE API characteristic encapsulation for the Eddystone-URL
      * Configuration Service Reset characteristic.
      */
-    WriteOnlyGattCharacteristic<bool>                               *resetChar;
+    WriteOnlyGattCharacteristic<bool>                               resetChar;
+    /**
+     * The last value written to the Eddystone-EID Identity Key
+     * characteristic: the identity key encrypted with the lock code using
+     * AES-128-ECB, followed by the rotation exponent.
+     */
+    uint8_t                                                         eidIdentityKeyValue[EID_IDENTITY_KEY_SIZE + 1];
+    /**
+     * BLE API characteristic encapsulation for the Eddystone-EID Identity
+     * Key characteristic.
+     */
+    WriteOnlyArrayGattCharacteristic<uint8_t, EID_IDENTITY_KEY_SIZE + 1> eidIdentityKeyChar;
+    /**
+     * BLE API characteristic encapsulation for the Apply Config
+     * characteristic.
+     */
+    GattCharacteristic                                              applyConfigChar;
 
     /**
-     * Pointer to the raw bytes that will be used to populate Eddystone-URL
-     * frames.
+     * The raw bytes that will be used to populate Eddystone-URL frames.
      */
-    uint8_t                                                         *rawUrlFrame;
+    uint8_t                                                         rawUrlFrame[URLFrame::MAX_RAW_FRAME_SIZE];
     /**
-     * Pointer to the raw bytes that will be used to populate Eddystone-UID
-     * frames.
+     * The raw bytes that will be used to populate Eddystone-UID frames.
      */
-    uint8_t                                                         *rawUidFrame;
+    uint8_t                                                         rawUidFrame[UIDFrame::RAW_FRAME_SIZE];
     /**
-     * Pointer to the raw bytes that will be used to populate Eddystone-TLM
-     * frames.
+     * The raw bytes that will be used to populate Eddystone-TLM frames.
+     */
+    uint8_t                                                         rawTlmFrame[TLMFrame::MAX_RAW_FRAME_SIZE];
+    /**
+     * The raw bytes that will be used to populate Eddystone-EID frames.
      */
-    uint8_t                                                         *rawTlmFrame;
+    uint8_t                                                         rawEidFrame[EIDFrame::RAW_FRAME_SIZE];
+    /**
+     * The raw bytes that will be used to populate iBeacon frames.
+     */
+    uint8_t                                                         rawIBeaconFrame[IBeaconFrame::RAW_FRAME_SIZE];
+
+    /**
+     * Complete advertising payload for Eddystone-URL frames.
+     */
+    GapAdvertisingData                                              urlAdvPayload;
+    /**
+     * Complete advertising payload for Eddystone-UID frames.
+     */
+    GapAdvertisingData                                              uidAdvPayload;
+    /**
+     * Complete advertising payload for Eddystone-TLM frames. Only the service
+     * data is patched in place before each transmission.
+     */
+    GapAdvertisingData                                              tlmAdvPayload;
+    /**
+     * Complete advertising payload for Eddystone-EID frames.
+     */
+    GapAdvertisingData                                              eidAdvPayload;
+    /**
+     * Complete advertising payload for iBeacon frames.
+     */
+    GapAdvertisingData                                              iBeaconAdvPayload;
+
+    /**
+     * Number of times each frame type was advertised.
+     */
+    uint32_t                                                        advertisedFrameCount[NUM_EDDYSTONE_FRAMES];
+    /**
+     * Time in microseconds taken by the last rotateEID() call.
+     */
+    uint32_t                                                        eidRotationTime;
 
     /**
      * Circular buffer that represents of Eddystone frames to be advertised.
@@ -844,9 +1509,21 @@ private:
     TlmUpdateCallback_t                                             tlmBeaconTemperatureCallback;
 
     /**
-     * Timer that keeps track of the time since boot.
+     * Timer that keeps track of the time since boot. The LowPowerTimer is
+     * clocked by the 32 kHz RTC, so unlike a Timer it does not keep the high
+     * frequency clock running while the device sleeps between
+     * advertisements.
      */
+#if DEVICE_LOWPOWERTIMER
+    LowPowerTimer                                                   timeSinceBootTimer;
+#else
     Timer                                                           timeSinceBootTimer;
+#endif
+    /**
+     * Callback handle to keep track of the periodic updateTimeSinceBoot()
+     * callbacks that prevent missing a wrap of the 32-bit time.
+     */
+    int                                                             timeSinceBootCallbackHandle;
 
     /**
      * Callback handle to keep track of periodic
@@ -866,10 +1543,42 @@ private:
      * advFrameQueue.
      */
     int                                                             tlmFrameCallbackHandle;
+    /**
+     * Callback handle to keep track of periodic sampleTLMSensors()
+     * callbacks.
+     */
+    int                                                             tlmSensorsCallbackHandle;
+    /**
+     * Callback handle to keep track of periodic
+     * enqueueFrame(EDDYSTONE_FRAME_EID) callbacks that populate the
+     * advFrameQueue.
+     */
+    int                                                             eidFrameCallbackHandle;
+    /**
+     * Callback handle to keep track of the rotateEID() callback posted for
+     * the next rotation window.
+     */
+    int                                                             eidRotationCallbackHandle;
+    /**
+     * Callback handle to keep track of periodic
+     * enqueueFrame(EDDYSTONE_FRAME_IBEACON) callbacks that populate the
+     * advFrameQueue.
+     */
+    int                                                             iBeaconFrameCallbackHandle;
     /**
      * Minar callback handle to keep track of manageRadio() callbacks.
      */
     int                                                             radioManagerCallbackHandle;
+    /**
+     * Callback handle to keep track of the periodic startDensityScan()
+     * callbacks.
+     */
+    int                                                             densityScanCallbackHandle;
+    /**
+     * Callback handle to keep track of the stopDensityScan() callback that
+     * ends the current density scan.
+     */
+    int                                                             densityScanStopCallbackHandle;
 
     /**
      * GattCharacteristic table used to populate the BLE ATT table in the
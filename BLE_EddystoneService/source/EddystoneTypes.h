@@ -90,6 +90,17 @@ const uint8_t UUID_BEACON_PERIOD_CHAR[]    = UUID_URL_BEACON(0x20, 0x88);
  * characteristic.
  */
 const uint8_t UUID_RESET_CHAR[]            = UUID_URL_BEACON(0x20, 0x89);
+/**
+ * 128-bit UUID for the Eddystone-EID Identity Key characteristic. This is an
+ * extension to the Eddystone-URL Configuration Service.
+ */
+const uint8_t UUID_EID_IDENTITY_KEY_CHAR[] = UUID_URL_BEACON(0x20, 0x8A);
+/**
+ * 128-bit UUID for the Apply Config characteristic. This is an extension to
+ * the Eddystone-URL Configuration Service that sets several parameters with a
+ * single (long) write.
+ */
+const uint8_t UUID_APPLY_CONFIG_CHAR[]     = UUID_URL_BEACON(0x20, 0x8B);
 
 /**
  * Default name for the BLE Device Name characteristic.
@@ -166,6 +177,87 @@ const size_t UID_INSTANCEID_SIZE = 6;
  */
 typedef uint8_t UIDInstanceID_t[UID_INSTANCEID_SIZE];
 
+/**
+ * Version of the value format of the Apply Config characteristic. The value
+ * is this version byte followed by TLV records, each made of a 1-byte tag from
+ * ApplyConfigTags, a 1-byte length and the record value. Multi-byte integers
+ * are little endian, like the Beacon Period characteristic.
+ */
+const uint8_t APPLY_CONFIG_VERSION = 0x01;
+
+/**
+ * Enumeration that defines the record tags of the Apply Config characteristic
+ * value. Each tag may appear at most once.
+ */
+enum ApplyConfigTags {
+    /**
+     * Encoded URL, the same value as the URI Data characteristic.
+     */
+    APPLY_CONFIG_TAG_URL_DATA = 0x01,
+    /**
+     * UID namespace ID followed by the UID instance ID.
+     */
+    APPLY_CONFIG_TAG_UID = 0x02,
+    /**
+     * TX power mode, one of PowerModes.
+     */
+    APPLY_CONFIG_TAG_TX_POWER_MODE = 0x03,
+    /**
+     * Advertised TX power levels, one byte per power mode.
+     */
+    APPLY_CONFIG_TAG_ADV_POWER_LEVELS = 0x04,
+    /**
+     * 16-bit Eddystone-URL frame period in milliseconds.
+     */
+    APPLY_CONFIG_TAG_URL_FRAME_PERIOD = 0x05,
+    /**
+     * 16-bit Eddystone-UID frame period in milliseconds.
+     */
+    APPLY_CONFIG_TAG_UID_FRAME_PERIOD = 0x06,
+    /**
+     * 16-bit Eddystone-TLM frame period in milliseconds.
+     */
+    APPLY_CONFIG_TAG_TLM_FRAME_PERIOD = 0x07,
+    /**
+     * Lock code. The beacon is locked once the other records are applied.
+     */
+    APPLY_CONFIG_TAG_LOCK = 0x08
+};
+
+/**
+ * Maximum size of the Apply Config characteristic value, with every record
+ * present once.
+ */
+const uint16_t APPLY_CONFIG_MAX_SIZE = 1 +
+                                       2 + URL_DATA_MAX +
+                                       2 + UID_NAMESPACEID_SIZE + UID_INSTANCEID_SIZE +
+                                       2 + sizeof(uint8_t) +
+                                       2 + sizeof(PowerLevels_t) +
+                                       3 * (2 + sizeof(uint16_t)) +
+                                       2 + sizeof(Lock_t);
+
+/**
+ * Size in bytes of the iBeacon proximity UUID.
+ */
+const size_t IBEACON_PROXIMITY_UUID_SIZE = 16;
+/**
+ * Type for the iBeacon proximity UUID.
+ */
+typedef uint8_t IBeaconProximityUUID_t[IBEACON_PROXIMITY_UUID_SIZE];
+
+/**
+ * Size in bytes of the Eddystone-EID identity key.
+ */
+const size_t EID_IDENTITY_KEY_SIZE = 16;
+/**
+ * Type for the Eddystone-EID identity key.
+ */
+typedef uint8_t EIDIdentityKey_t[EID_IDENTITY_KEY_SIZE];
+/**
+ * Size in bytes of the Eddystone-EID ephemeral identifier.
+ */
+const size_t EID_EPHEMERAL_ID_SIZE = 8;
+
 /**
  * Type for callbacks to update Eddystone-TLM frame Batery Voltage and Beacon
  * Temperature.
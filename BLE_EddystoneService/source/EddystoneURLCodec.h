@@ -0,0 +1,238 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2006-2015 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __EDDYSTONEURLCODEC_H__
+#define __EDDYSTONEURLCODEC_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+/*
+ * Header-only implementation of the Eddystone-URL HTTP URL encoding, refer to
+ * https://github.com/google/eddystone/tree/master/eddystone-url#eddystone-url-http-url-encoding.
+ * It has no dependency on the rest of the EddystoneService sources, and
+ * BLE_EddystoneObserver links to this file to decode the URLs it receives.
+ */
+
+/**
+ * An expansion of the Eddystone-URL encoding: the text and its length.
+ */
+struct EddystoneURLExpansion_t {
+    const char *text;
+    uint8_t     length;
+};
+
+/**
+ * URL scheme prefixes, indexed by their encoded value. The last one is the
+ * UriBeacon "urn:uuid:" scheme, which is understood by the decoder but never
+ * produced by the encoder.
+ */
+static const EddystoneURLExpansion_t EDDYSTONE_URL_PREFIXES[] = {
+    {"http://www.",  11},
+    {"https://www.", 12},
+    {"http://",       7},
+    {"https://",      8},
+    {"urn:uuid:",     9}
+};
+static const uint8_t EDDYSTONE_URL_NUM_PREFIXES = sizeof(EDDYSTONE_URL_PREFIXES) / sizeof(EddystoneURLExpansion_t);
+
+/**
+ * Top-level domain expansions, indexed by their encoded value. The first
+ * EDDYSTONE_URL_NUM_TLDS entries are followed by a '/', the others are the
+ * same domains in the same order without it.
+ */
+static const EddystoneURLExpansion_t EDDYSTONE_URL_SUFFIXES[] = {
+    {".com/",  5},
+    {".org/",  5},
+    {".edu/",  5},
+    {".net/",  5},
+    {".info/", 6},
+    {".biz/",  5},
+    {".gov/",  5},
+    {".com",   4},
+    {".org",   4},
+    {".edu",   4},
+    {".net",   4},
+    {".info",  5},
+    {".biz",   4},
+    {".gov",   4}
+};
+static const uint8_t EDDYSTONE_URL_NUM_SUFFIXES = sizeof(EDDYSTONE_URL_SUFFIXES) / sizeof(EddystoneURLExpansion_t);
+static const uint8_t EDDYSTONE_URL_NUM_TLDS     = EDDYSTONE_URL_NUM_SUFFIXES / 2;
+
+/**
+ * Size of a buffer large enough for any URL decoded from @p encodedLength
+ * bytes, including the null terminator.
+ */
+#define EDDYSTONE_URL_DECODED_SIZE(encodedLength) (12 + 6 * ((encodedLength) - 1) + 1)
+
+/**
+ * Match the URL scheme at the start of a URL.
+ *
+ * @param[in] url
+ *              The null terminated URL.
+ * @param[out] prefixLength
+ *              The number of characters matched.
+ *
+ * @return The encoded prefix, or EDDYSTONE_URL_NUM_PREFIXES if the URL does
+ *         not start with an Eddystone-URL scheme.
+ */
+inline uint8_t matchEddystoneURLPrefix(const char *url, size_t &prefixLength)
+{
+    /* The encoded schemes all start with "http", so dispatch on the first
+     * character and then walk the optional 's' and "www." */
+    if (url[0] == 'h' && strncmp(url, "http", 4) == 0) {
+        uint8_t secure = (url[4] == 's') ? 1 : 0;
+        size_t  index  = 4 + secure;
+        if (strncmp(url + index, "://", 3) != 0) {
+            return EDDYSTONE_URL_NUM_PREFIXES;
+        }
+        index += 3;
+        if (strncmp(url + index, "www.", 4) == 0) {
+            prefixLength = index + 4;
+            return secure;
+        }
+        prefixLength = index;
+        return 2 + secure;
+    }
+    return EDDYSTONE_URL_NUM_PREFIXES;
+}
+
+/**
+ * Match a top-level domain expansion at a '.' of a URL.
+ *
+ * @param[in] url
+ *              The null terminated URL, pointing at a '.'.
+ * @param[out] suffixLength
+ *              The number of characters matched.
+ *
+ * @return The encoded suffix, or EDDYSTONE_URL_NUM_SUFFIXES if there is no
+ *         expansion at this position.
+ */
+inline uint8_t matchEddystoneURLSuffix(const char *url, size_t &suffixLength)
+{
+    /* The domains all start with a different letter, so at most one of them
+     * is compared in full */
+    for (uint8_t i = 0; i < EDDYSTONE_URL_NUM_TLDS; i++) {
+        const EddystoneURLExpansion_t &tld = EDDYSTONE_URL_SUFFIXES[EDDYSTONE_URL_NUM_TLDS + i];
+        if (url[1] != tld.text[1]) {
+            continue;
+        }
+        if (strncmp(url + 2, tld.text + 2, tld.length - 2) != 0) {
+            break;
+        }
+        if (url[tld.length] == '/') {
+            suffixLength = tld.length + 1;
+            return i;
+        }
+        suffixLength = tld.length;
+        return EDDYSTONE_URL_NUM_TLDS + i;
+    }
+    return EDDYSTONE_URL_NUM_SUFFIXES;
+}
+
+/**
+ * Encode a URL with the Eddystone-URL HTTP URL encoding. Every character of
+ * the URL is looked at once.
+ *
+ * @param[in] url
+ *              The null terminated URL to encode.
+ * @param[out] encoded
+ *              Pointer to where the encoded URL will be stored.
+ * @param[in] encodedSize
+ *              The size of the @p encoded buffer. Longer URLs are truncated.
+ *
+ * @return The length of the encoded URL in bytes.
+ */
+inline size_t encodeEddystoneURL(const char *url, uint8_t *encoded, size_t encodedSize)
+{
+    size_t encodedLength = 0;
+
+    if (url == NULL || *url == '\0' || encodedSize == 0) {
+        return 0;
+    }
+
+    size_t  length;
+    uint8_t code = matchEddystoneURLPrefix(url, length);
+    if (code != EDDYSTONE_URL_NUM_PREFIXES) {
+        encoded[encodedLength++] = code;
+        url += length;
+    }
+
+    while (*url && encodedLength < encodedSize) {
+        if (*url == '.' && (code = matchEddystoneURLSuffix(url, length)) != EDDYSTONE_URL_NUM_SUFFIXES) {
+            encoded[encodedLength++] = code;
+            url += length;
+        } else {
+            encoded[encodedLength++] = *url++;
+        }
+    }
+
+    return encodedLength;
+}
+
+/**
+ * Decode a URL encoded with the Eddystone-URL HTTP URL encoding.
+ *
+ * @param[in] encoded
+ *              The encoded URL, starting with the URL scheme prefix.
+ * @param[in] encodedLength
+ *              The length of the encoded URL in bytes.
+ * @param[out] decoded
+ *              Pointer to where the null terminated URL will be stored.
+ * @param[in] decodedSize
+ *              The size of the @p decoded buffer.
+ *              EDDYSTONE_URL_DECODED_SIZE(encodedLength) bytes are always
+ *              enough.
+ *
+ * @return The length of the decoded URL, or -1 if the URL scheme is not
+ *         encoded or the URL does not fit in @p decoded.
+ */
+inline int decodeEddystoneURL(const uint8_t *encoded, size_t encodedLength, char *decoded, size_t decodedSize)
+{
+    if (encodedLength == 0 || encoded[0] >= EDDYSTONE_URL_NUM_PREFIXES) {
+        return -1;
+    }
+
+    const EddystoneURLExpansion_t &prefix = EDDYSTONE_URL_PREFIXES[encoded[0]];
+    if (prefix.length >= decodedSize) {
+        return -1;
+    }
+    memcpy(decoded, prefix.text, prefix.length);
+    size_t decodedLength = prefix.length;
+
+    for (size_t index = 1; index < encodedLength; index++) {
+        if (encoded[index] < EDDYSTONE_URL_NUM_SUFFIXES) {
+            const EddystoneURLExpansion_t &suffix = EDDYSTONE_URL_SUFFIXES[encoded[index]];
+            if (decodedLength + suffix.length >= decodedSize) {
+                return -1;
+            }
+            memcpy(decoded + decodedLength, suffix.text, suffix.length);
+            decodedLength += suffix.length;
+        } else {
+            if (decodedLength + 1 >= decodedSize) {
+                return -1;
+            }
+            decoded[decodedLength++] = encoded[index];
+        }
+    }
+
+    decoded[decodedLength] = '\0';
+    return decodedLength;
+}
+
+#endif  /* __EDDYSTONEURLCODEC_H__ */
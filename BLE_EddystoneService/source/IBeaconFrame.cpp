@@ -0,0 +1,60 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2006-2015 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "IBeaconFrame.h"
+
+IBeaconFrame::IBeaconFrame(void) :
+    majorNumber(0),
+    minorNumber(0),
+    measuredPower(0)
+{
+    memset(proximityUUID, 0, sizeof(IBeaconProximityUUID_t));
+}
+
+void IBeaconFrame::setIBeaconData(const IBeaconProximityUUID_t &proximityUUIDIn,
+                                  uint16_t                     majorNumberIn,
+                                  uint16_t                     minorNumberIn,
+                                  int8_t                       measuredPowerIn)
+{
+    memcpy(proximityUUID, proximityUUIDIn, sizeof(IBeaconProximityUUID_t));
+    majorNumber   = majorNumberIn;
+    minorNumber   = minorNumberIn;
+    measuredPower = measuredPowerIn;
+}
+
+void IBeaconFrame::constructIBeaconFrame(uint8_t *rawFrame)
+{
+    size_t index = 0;
+
+    rawFrame[index++] = (uint8_t)(COMPANY_ID_APPLE >> 0);                     // Company ID (little endian)
+    rawFrame[index++] = (uint8_t)(COMPANY_ID_APPLE >> 8);
+    rawFrame[index++] = IBEACON_TYPE;                                         // 1B  Type
+    rawFrame[index++] = IBEACON_LENGTH;                                       // 1B  Length
+
+    memcpy(rawFrame + index, proximityUUID, sizeof(IBeaconProximityUUID_t));  // 16B Proximity UUID
+    index += sizeof(IBeaconProximityUUID_t);
+
+    rawFrame[index++] = (uint8_t)(majorNumber >> 8);                          // 2B  Major (big endian)
+    rawFrame[index++] = (uint8_t)(majorNumber >> 0);
+    rawFrame[index++] = (uint8_t)(minorNumber >> 8);                          // 2B  Minor (big endian)
+    rawFrame[index++] = (uint8_t)(minorNumber >> 0);
+    rawFrame[index++] = measuredPower;                                        // 1B  Power @ 1meter
+}
+
+size_t IBeaconFrame::getRawFrameSize(void) const
+{
+    return RAW_FRAME_SIZE;
+}
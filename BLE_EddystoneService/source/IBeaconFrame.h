@@ -0,0 +1,111 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2006-2015 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __IBEACONFRAME_H__
+#define __IBEACONFRAME_H__
+
+#include <string.h>
+#include "EddystoneTypes.h"
+
+/**
+ * Class that encapsulates data that belongs to an iBeacon frame. This allows
+ * EddystoneService to interleave iBeacon advertisements with the Eddystone
+ * frames from a single firmware image. The frame is carried as manufacturer
+ * specific data rather than Eddystone service data.
+ */
+class IBeaconFrame
+{
+public:
+    /**
+     * Construct a new instance of this class.
+     */
+    IBeaconFrame(void);
+
+    /**
+     * Set the iBeacon proximity UUID, major and minor numbers and the
+     * measured power.
+     *
+     * @param[in] proximityUUIDIn
+     *              The 128-bit iBeacon proximity UUID.
+     * @param[in] majorNumberIn
+     *              The iBeacon major number.
+     * @param[in] minorNumberIn
+     *              The iBeacon minor number.
+     * @param[in] measuredPowerIn
+     *              The calibrated RSSI at 1m included within the raw frame.
+     */
+    void setIBeaconData(const IBeaconProximityUUID_t &proximityUUIDIn,
+                        uint16_t                     majorNumberIn,
+                        uint16_t                     minorNumberIn,
+                        int8_t                       measuredPowerIn);
+
+    /**
+     * Construct the raw bytes of the iBeacon manufacturer specific data that
+     * will be directly used in the advertising packets.
+     *
+     * @param[in] rawFrame
+     *              Pointer to the location where the raw frame will be stored.
+     */
+    void constructIBeaconFrame(uint8_t *rawFrame);
+
+    /**
+     * Get the size of the iBeacon frame.
+     *
+     * @return The size in bytes of the iBeacon frame.
+     */
+    size_t getRawFrameSize(void) const;
+
+private:
+    /**
+     * Apple's Bluetooth SIG company identifier.
+     */
+    static const uint16_t COMPANY_ID_APPLE = 0x004C;
+    /**
+     * The iBeacon type identifier.
+     */
+    static const uint8_t  IBEACON_TYPE     = 0x02;
+    /**
+     * The length of the iBeacon data following the type and length bytes.
+     */
+    static const uint8_t  IBEACON_LENGTH   = 0x15;
+
+public:
+    /**
+     * The size (in bytes) of the raw iBeacon frame built by
+     * constructIBeaconFrame(), including the company identifier.
+     */
+    static const uint8_t RAW_FRAME_SIZE = sizeof(uint16_t) + 2 + IBEACON_LENGTH;
+
+private:
+    /**
+     * The iBeacon proximity UUID.
+     */
+    IBeaconProximityUUID_t proximityUUID;
+    /**
+     * The iBeacon major number.
+     */
+    uint16_t               majorNumber;
+    /**
+     * The iBeacon minor number.
+     */
+    uint16_t               minorNumber;
+    /**
+     * The calibrated RSSI at 1m.
+     */
+    int8_t                 measuredPower;
+};
+
+#endif  /* __IBEACONFRAME_H__ */
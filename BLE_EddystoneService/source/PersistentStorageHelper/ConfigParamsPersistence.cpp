@@ -16,9 +16,9 @@
 
 #include "ConfigParamsPersistence.h"
 
-#ifndef TARGET_NRF51822 /* Persistent storage supported on nrf51 platforms */
+#if !defined(TARGET_NRF51822) && !defined(TARGET_NRF5) /* Persistent storage supported on nrf5x platforms */
     /**
-     * When not using an nRF51-based target then persistent storage is not available.
+     * When not using an nRF5x-based target then persistent storage is not available.
      */
     #warning "EddystoneService is not configured to store configuration data in non-volatile memory"
 
@@ -42,4 +42,9 @@
         /* Do nothing... */
         return;
     }
-#endif /* #ifdef TARGET_NRF51822 */
+
+    void getEddystoneServiceConfigParamsPersistenceStats(ConfigParamsPersistenceStats_t *statsP)
+    {
+        memset(statsP, 0, sizeof(ConfigParamsPersistenceStats_t));
+    }
+#endif /* #if !defined(TARGET_NRF51822) && !defined(TARGET_NRF5) */
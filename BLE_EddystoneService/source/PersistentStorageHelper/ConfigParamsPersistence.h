@@ -19,6 +19,33 @@
 
 #include "../EddystoneService.h"
 
+/**
+ * Statistics about the persistent storage of the Eddystone Service
+ * configuration parameters.
+ */
+struct ConfigParamsPersistenceStats_t {
+    /**
+     * Number of times the flash used for the parameters has been erased over
+     * the lifetime of the device.
+     */
+    uint32_t eraseCount;
+    /**
+     * Time in microseconds taken by the last call to
+     * loadEddystoneServiceConfigParams(), including the scan of the flash.
+     */
+    uint32_t loadTimeMicros;
+    /**
+     * Number of records written to flash since boot.
+     */
+    uint32_t recordsWritten;
+    /**
+     * Size in bytes of each of the two flash banks holding the parameters.
+     * Zero if no flash could be reserved, in which case the parameters are
+     * not persisted.
+     */
+    uint32_t bankSize;
+};
+
 /**
  * Generic API to load the Eddystone Service configuration parameters from persistent
  * storage. If persistent storage isn't available, the persistenceSignature
@@ -50,4 +77,14 @@ bool loadEddystoneServiceConfigParams(EddystoneService::EddystoneParams_t *param
  */
 void saveEddystoneServiceConfigParams(const EddystoneService::EddystoneParams_t *paramsP);
 
+/**
+ * Generic API to retrieve statistics about the persistent storage of the
+ * Eddystone Service configuration parameters.
+ *
+ * @param[out] statsP
+ *                 The statistics. All fields are zero if persistent storage
+ *                 isn't available.
+ */
+void getEddystoneServiceConfigParamsPersistenceStats(ConfigParamsPersistenceStats_t *statsP);
+
 #endif /* #ifndef __BLE_CONFIG_PARAMS_PERSISTENCE_H__*/
@@ -14,42 +14,180 @@
  * limitations under the License.
  */
 
-#ifdef TARGET_NRF51822 /* Persistent storage supported on nrf51 platforms */
+#if defined(TARGET_NRF51822) || defined(TARGET_NRF5) /* Persistent storage supported on nrf5x platforms */
 
 extern "C" {
     #include "pstorage.h"
 }
 
+#include <stddef.h>
 #include "nrf_error.h"
-#include "../../EddystoneService.h"
+#include "hal/us_ticker_api.h"
+#include "platform/mbed_critical.h"
+#include "../ConfigParamsPersistence.h"
+
+/*
+ * The parameters are kept in a small append-only journal. The
+ * EddystoneParams_t structure is split into fixed size chunks and every save
+ * only appends a record for each chunk that differs from what is already in
+ * flash. The journal is split into two banks: records are appended to the
+ * active bank until it is full, then the latest value of every chunk is
+ * written to the other (erased) bank and the old bank is erased in the
+ * background by pstorage. At boot the journal is scanned in place and the
+ * record with the highest sequence number wins for each chunk.
+ *
+ * Page budget: the journal takes two flash pages from the pstorage area
+ * (PSTORAGE_NUM_OF_PAGES in pstorage_platform.h) when they are free, and
+ * otherwise shares what is left of the pages with the other pstorage users,
+ * down to two banks of MIN_BANK_SIZE bytes. The nRF5 SDK 11 configuration
+ * used by the mbed OS 5 NRF5 targets reserves a single page, which the
+ * device manager also uses for bonding information, so the banks are
+ * usually smaller than a page there.
+ */
 
 /**
- * Nordic specific structure used to store params persistently.
- * It extends EddystoneService::EddystoneParams_t with a persistence signature.
+ * Number of bytes of EddystoneParams_t carried by a record.
  */
-struct PersistentParams_t {
-    EddystoneService::EddystoneParams_t params;
-    uint32_t                         persistenceSignature; /* This isn't really a parameter, but having the expected
-                                                            * magic value in this field indicates persistence. */
+static const size_t CHUNK_SIZE = 22;
 
-    static const uint32_t MAGIC = 0x1BEAC000;              /* Magic that identifies persistence */
+/**
+ * Number of chunks the EddystoneParams_t structure is split into.
+ */
+static const size_t NUM_CHUNKS = (sizeof(EddystoneService::EddystoneParams_t) + CHUNK_SIZE - 1) / CHUNK_SIZE;
+
+/**
+ * A journal record. The size is a multiple of 4 bytes as required by
+ * pstorage, and the sequence number comes first so that a record that was
+ * only partially written is never mistaken for an erased slot.
+ */
+struct JournalRecord_t {
+    uint32_t sequence;          /* Monotonically increasing, 0xFFFFFFFF in erased flash */
+    uint16_t eraseCount;        /* Number of bank erases so far, carried from record to record */
+    uint8_t  chunkIndex;        /* Which chunk of EddystoneParams_t this record holds */
+    uint8_t  paramsSize;        /* sizeof(EddystoneParams_t) when written, detects layout changes */
+    uint8_t  data[CHUNK_SIZE];
+    uint16_t crc;               /* CRC-16/CCITT of all the preceding bytes */
 };
 
+/* Compile time checks, C++98 has no static_assert */
+typedef char JournalRecordSizeCheck[(sizeof(JournalRecord_t) % 4 == 0) ? 1 : -1];
+typedef char ParamsSizeCheck[(sizeof(EddystoneService::EddystoneParams_t) <= 0xFF) ? 1 : -1];
+
 /**
- * The following is a module-local variable to hold configuration parameters for
- * short periods during flash access. This is necessary because the pstorage
- * APIs don't copy in the memory provided as data source. The memory cannot be
- * freed or reused by the application until this flash access is complete. The
- * load and store operations in this module initialize persistentParams and then
- * pass it on to the 'pstorage' APIs.
+ * Value of the sequence number in an erased slot.
  */
-static PersistentParams_t persistentParams;
+static const uint32_t ERASED_SEQUENCE = 0xFFFFFFFF;
+
+/**
+ * Each bank is a pstorage block. When a bank is a whole flash page, clearing
+ * it is a single page erase; a smaller bank shares its page and pstorage
+ * clears it through its swap page, which costs two more erases. Pages are
+ * 1KB on nRF51 and 4KB on nRF52, so the size of the banks, and the number of
+ * slots of a bank, are set at run time from what pstorage accepts.
+ */
+static const size_t NUM_BANKS     = 2;
+static const size_t MIN_BANK_SIZE = 256;
+
+/* A bank must be able to hold a full copy of the parameters */
+typedef char BankSizeCheck[(MIN_BANK_SIZE / sizeof(JournalRecord_t) >= NUM_CHUNKS) ? 1 : -1];
+
+/**
+ * Value of chunkBank[] for a chunk that has no record in the journal.
+ */
+static const uint8_t NO_BANK = 0xFF;
+
+/**
+ * Number of records that can wait for pstorage at the same time. A save never
+ * appends more than NUM_CHUNKS records.
+ */
+static const size_t NUM_PENDING_RECORDS = 2 * NUM_CHUNKS;
+
+/**
+ * The pstorage APIs don't copy in the memory provided as data source, so
+ * records are built in this ring and must stay untouched until pstorage
+ * reports that they have been written. pstorage completes operations in the
+ * order they were queued.
+ */
+static JournalRecord_t          pendingRecords[NUM_PENDING_RECORDS];
+static size_t                   pendingRecordsHead;
+static volatile uint32_t        pendingRecordsCount;
+
+static pstorage_handle_t        pstorageHandle;
+static bool                     journalInitialised = false;
+static bool                     journalAvailable   = false;
+static size_t                   bankSize;
+static size_t                   slotsPerBank;
+
+/**
+ * The parameters as they are currently stored in the journal, used to find
+ * the dirty chunks on every save, and the bank holding the latest record of
+ * each chunk.
+ */
+static EddystoneService::EddystoneParams_t journalParams;
+static uint8_t                  chunkBank[NUM_CHUNKS];
+static bool                     journalParamsValid;
+
+static uint8_t                  activeBank;
+static bool                     otherBankErased;
+static size_t                   nextSlot;
+static uint32_t                 nextSequence;
+static uint16_t                 eraseCount;
+
+static ConfigParamsPersistenceStats_t persistenceStats;
+
+/**
+ * CRC-16/CCITT (polynomial 0x1021, initial value 0xFFFF).
+ */
+static uint16_t crc16(const uint8_t *data, size_t length)
+{
+    uint16_t crc = 0xFFFF;
+    while (length--) {
+        crc ^= (uint16_t)(*data++) << 8;
+        for (uint8_t bit = 0; bit < 8; bit++) {
+            crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x1021) : (uint16_t)(crc << 1);
+        }
+    }
+    return crc;
+}
 
-static pstorage_handle_t pstorageHandle;
+static size_t chunkLength(size_t chunkIndex)
+{
+    size_t offset = chunkIndex * CHUNK_SIZE;
+    size_t left   = sizeof(EddystoneService::EddystoneParams_t) - offset;
+    return (left < CHUNK_SIZE) ? left : CHUNK_SIZE;
+}
+
+static bool isRecordValid(const JournalRecord_t *record)
+{
+    return (record->chunkIndex < NUM_CHUNKS) &&
+           (record->paramsSize == sizeof(EddystoneService::EddystoneParams_t)) &&
+           (record->crc == crc16(reinterpret_cast<const uint8_t *>(record), offsetof(JournalRecord_t, crc)));
+}
+
+static bool isSlotErased(const JournalRecord_t *record)
+{
+    const uint32_t *words = reinterpret_cast<const uint32_t *>(record);
+    for (size_t i = 0; i < sizeof(JournalRecord_t) / sizeof(uint32_t); i++) {
+        if (words[i] != 0xFFFFFFFF) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool areAllChunksStored(void)
+{
+    for (size_t chunk = 0; chunk < NUM_CHUNKS; chunk++) {
+        if (chunkBank[chunk] == NO_BANK) {
+            return false;
+        }
+    }
+    return true;
+}
 
 /**
- * Dummy callback handler needed by Nordic's pstorage module. This is called
- * after every flash access.
+ * Callback handler needed by Nordic's pstorage module. This is called after
+ * every flash access and releases the record buffers of completed stores.
  */
 static void pstorageNotificationCallback(pstorage_handle_t *p_handle,
                                          uint8_t            op_code,
@@ -59,39 +197,237 @@ static void pstorageNotificationCallback(pstorage_handle_t *p_handle,
 {
     /* Supress compiler warnings */
     (void) p_handle;
-    (void) op_code;
     (void) result;
     (void) p_data;
     (void) data_len;
 
-    /* APP_ERROR_CHECK(result); */
+    if (op_code == PSTORAGE_STORE_OP_CODE) {
+        core_util_atomic_decr_u32(&pendingRecordsCount, 1);
+    }
+}
+
+/**
+ * Get the slots of a bank, read in place as flash is memory mapped.
+ */
+static const JournalRecord_t *bankSlots(uint8_t bank)
+{
+    pstorage_handle_t bankHandle;
+    pstorage_block_identifier_get(&pstorageHandle, bank, &bankHandle);
+    return reinterpret_cast<const JournalRecord_t *>(bankHandle.block_id);
+}
+
+static bool clearBank(uint8_t bank)
+{
+    pstorage_handle_t bankHandle;
+    pstorage_block_identifier_get(&pstorageHandle, bank, &bankHandle);
+    if (pstorage_clear(&bankHandle, bankSize) != NRF_SUCCESS) {
+        return false;
+    }
+    eraseCount++;
+    return true;
+}
+
+/**
+ * Append a record holding a chunk of the parameters to the active bank, and
+ * update journalParams with it.
+ *
+ * @return false if the active bank is full or pstorage has no room for the
+ *         record yet; the chunk is then left as it is in the journal.
+ */
+static bool appendRecord(size_t chunkIndex, const EddystoneService::EddystoneParams_t *paramsP)
+{
+    /* pstorage completions are processed from the same thread as the saves,
+     * so waiting for a record buffer here would never end */
+    if (pendingRecordsCount >= NUM_PENDING_RECORDS || nextSlot >= slotsPerBank) {
+        return false;
+    }
+
+    JournalRecord_t *record = &pendingRecords[pendingRecordsHead];
+    size_t           offset = chunkIndex * CHUNK_SIZE;
+
+    memset(record, 0xFF, sizeof(JournalRecord_t));
+    record->sequence   = nextSequence;
+    record->eraseCount = eraseCount;
+    record->chunkIndex = chunkIndex;
+    record->paramsSize = sizeof(EddystoneService::EddystoneParams_t);
+    memcpy(record->data, reinterpret_cast<const uint8_t *>(paramsP) + offset, chunkLength(chunkIndex));
+    record->crc        = crc16(reinterpret_cast<const uint8_t *>(record), offsetof(JournalRecord_t, crc));
+
+    pstorage_handle_t bankHandle;
+    pstorage_block_identifier_get(&pstorageHandle, activeBank, &bankHandle);
+
+    core_util_atomic_incr_u32(&pendingRecordsCount, 1);
+    if (pstorage_store(&bankHandle, reinterpret_cast<uint8_t *>(record), sizeof(JournalRecord_t),
+                       nextSlot * sizeof(JournalRecord_t)) != NRF_SUCCESS) {
+        core_util_atomic_decr_u32(&pendingRecordsCount, 1);
+        return false;
+    }
+
+    pendingRecordsHead = (pendingRecordsHead + 1) % NUM_PENDING_RECORDS;
+    nextSlot++;
+    nextSequence++;
+    persistenceStats.recordsWritten++;
+
+    if (paramsP != &journalParams) {
+        memcpy(reinterpret_cast<uint8_t *>(&journalParams) + offset, record->data, chunkLength(chunkIndex));
+    }
+    chunkBank[chunkIndex] = activeBank;
+    return true;
+}
+
+/**
+ * Finish a compaction: copy to the active bank the chunks whose latest
+ * record is still in the other bank, then erase the other bank. A
+ * compaction is left unfinished when power is lost partway, or when pstorage
+ * has no room for all the records of the snapshot.
+ *
+ * @return true once the other bank is erased, or queued to be.
+ */
+static bool completeCompaction(void)
+{
+    if (otherBankErased) {
+        return true;
+    }
+
+    uint8_t otherBank = activeBank ^ 1;
+    for (size_t chunk = 0; chunk < NUM_CHUNKS; chunk++) {
+        if (chunkBank[chunk] == otherBank && !appendRecord(chunk, &journalParams)) {
+            return false;
+        }
+    }
+
+    /* pstorage runs operations in order, so the other bank is only erased
+     * once the copies have been written */
+    otherBankErased = clearBank(otherBank);
+    return otherBankErased;
+}
+
+/**
+ * Scan the journal in place (flash is memory mapped, so nothing is copied)
+ * and rebuild journalParams from the latest valid record of each chunk.
+ */
+static void scanJournal(void)
+{
+    uint32_t chunkSequence[NUM_CHUNKS];
+    uint32_t maxSequence   = 0;
+    bool     found         = false;
+    uint8_t  latestBank    = 0;
+
+    memset(&journalParams, 0, sizeof(journalParams));
+    memset(chunkBank, NO_BANK, sizeof(chunkBank));
+
+    for (uint8_t bank = 0; bank < NUM_BANKS; bank++) {
+        const JournalRecord_t *slots = bankSlots(bank);
+        for (size_t slot = 0; slot < slotsPerBank; slot++) {
+            const JournalRecord_t *record = &slots[slot];
+            if (record->sequence == ERASED_SEQUENCE || !isRecordValid(record)) {
+                continue;
+            }
+
+            uint8_t chunk = record->chunkIndex;
+            if (chunkBank[chunk] == NO_BANK || record->sequence > chunkSequence[chunk]) {
+                memcpy(reinterpret_cast<uint8_t *>(&journalParams) + chunk * CHUNK_SIZE, record->data, chunkLength(chunk));
+                chunkSequence[chunk] = record->sequence;
+                chunkBank[chunk]     = bank;
+            }
+            if (!found || record->sequence > maxSequence) {
+                found       = true;
+                maxSequence = record->sequence;
+                latestBank  = bank;
+                eraseCount  = record->eraseCount;
+            }
+        }
+    }
+
+    journalParamsValid = areAllChunksStored();
+
+    if (!found) {
+        activeBank   = 0;
+        nextSequence = 0;
+        eraseCount   = 0;
+    } else {
+        activeBank   = latestBank;
+        nextSequence = maxSequence + 1;
+    }
+
+    /* Append after the last used slot of the active bank, including slots
+     * holding corrupted records */
+    const JournalRecord_t *slots = bankSlots(activeBank);
+    nextSlot = slotsPerBank;
+    while (nextSlot > 0 && isSlotErased(&slots[nextSlot - 1])) {
+        nextSlot--;
+    }
+
+    /* The other bank is not erased if power was lost during a compaction or
+     * before the background erase completed. It may then still hold the
+     * latest record of some chunks, which are copied before it is erased. */
+    const JournalRecord_t *otherSlots = bankSlots(activeBank ^ 1);
+    otherBankErased = true;
+    for (size_t slot = 0; slot < slotsPerBank && otherBankErased; slot++) {
+        otherBankErased = isSlotErased(&otherSlots[slot]);
+    }
+    completeCompaction();
+}
+
+static void initialiseJournal(void)
+{
+    if (journalInitialised) {
+        return;
+    }
+    journalInitialised = true;
+
+    pstorage_init();
+
+    /* Take a page per bank if pstorage has enough of them, else share the
+     * pages. Other modules may already hold part of the pages, so the banks
+     * are halved until pstorage finds room for them. */
+    bankSize = PSTORAGE_FLASH_PAGE_SIZE;
+    if (PSTORAGE_NUM_OF_PAGES < NUM_BANKS) {
+        bankSize = (PSTORAGE_FLASH_PAGE_SIZE * PSTORAGE_NUM_OF_PAGES) / NUM_BANKS;
+    }
+
+    static pstorage_module_param_t pstorageParams = {
+        .cb          = pstorageNotificationCallback,
+        .block_size  = 0,
+        .block_count = NUM_BANKS
+    };
+    for (; bankSize >= MIN_BANK_SIZE; bankSize /= 2) {
+        bankSize -= bankSize % sizeof(JournalRecord_t);
+        pstorageParams.block_size = bankSize;
+        if (pstorage_register(&pstorageParams, &pstorageHandle) == NRF_SUCCESS) {
+            journalAvailable = true;
+            break;
+        }
+    }
+
+    if (!journalAvailable) {
+        /* Not enough flash reserved for pstorage, see the page budget above.
+         * The parameters are not persisted and bankSize reports it. */
+        bankSize = 0;
+        return;
+    }
+
+    slotsPerBank = bankSize / sizeof(JournalRecord_t);
+    scanJournal();
 }
 
 /* Platform-specific implementation for persistence on the nRF5x. Based on the
  * pstorage module provided by the Nordic SDK. */
 bool loadEddystoneServiceConfigParams(EddystoneService::EddystoneParams_t *paramsP)
 {
-    static bool pstorageInitied = false;
-    if (!pstorageInitied) {
-        pstorage_init();
-
-        static pstorage_module_param_t pstorageParams = {
-            .cb          = pstorageNotificationCallback,
-            .block_size  = sizeof(PersistentParams_t),
-            .block_count = 1
-        };
-        pstorage_register(&pstorageParams, &pstorageHandle);
-        pstorageInitied = true;
-    }
+    uint32_t startTime = us_ticker_read();
+    initialiseJournal();
+    persistenceStats.loadTimeMicros = us_ticker_read() - startTime;
+    persistenceStats.eraseCount     = eraseCount;
+    persistenceStats.bankSize       = bankSize;
 
-    if ((pstorage_load(reinterpret_cast<uint8_t *>(&persistentParams), &pstorageHandle, sizeof(PersistentParams_t), 0) != NRF_SUCCESS) ||
-        (persistentParams.persistenceSignature != PersistentParams_t::MAGIC)) {
+    if (!journalAvailable || !journalParamsValid) {
         // On failure zero out and let the service reset to defaults
         memset(paramsP, 0, sizeof(EddystoneService::EddystoneParams_t));
         return false;
     }
 
-    memcpy(paramsP, &persistentParams.params, sizeof(EddystoneService::EddystoneParams_t));
+    memcpy(paramsP, &journalParams, sizeof(EddystoneService::EddystoneParams_t));
     return true;
 }
 
@@ -99,19 +435,63 @@ bool loadEddystoneServiceConfigParams(EddystoneService::EddystoneParams_t *param
  * pstorage module provided by the Nordic SDK. */
 void saveEddystoneServiceConfigParams(const EddystoneService::EddystoneParams_t *paramsP)
 {
-    memcpy(&persistentParams.params, paramsP, sizeof(EddystoneService::EddystoneParams_t));
-    if (persistentParams.persistenceSignature != PersistentParams_t::MAGIC) {
-        persistentParams.persistenceSignature = PersistentParams_t::MAGIC;
-        pstorage_store(&pstorageHandle,
-                       reinterpret_cast<uint8_t *>(&persistentParams),
-                       sizeof(PersistentParams_t),
-                       0 /* offset */);
+    initialiseJournal();
+    if (!journalAvailable) {
+        return;
+    }
+
+    /* The chunks left in the other bank by an unfinished compaction must be
+     * copied before the active bank takes new records, or a later compaction
+     * could not erase the other bank. Chunks that could not be saved stay
+     * dirty and are retried by the next save. */
+    if (!completeCompaction()) {
+        return;
+    }
+
+    bool   dirty[NUM_CHUNKS];
+    size_t numDirty = 0;
+    for (size_t chunk = 0; chunk < NUM_CHUNKS; chunk++) {
+        size_t offset = chunk * CHUNK_SIZE;
+        dirty[chunk] = (chunkBank[chunk] == NO_BANK) ||
+                       memcmp(reinterpret_cast<const uint8_t *>(paramsP) + offset,
+                              reinterpret_cast<const uint8_t *>(&journalParams) + offset,
+                              chunkLength(chunk)) != 0;
+        numDirty += dirty[chunk] ? 1 : 0;
+    }
+
+    if (numDirty == 0) {
+        /* Nothing changed since the last save, don't touch the flash */
+        return;
+    }
+
+    if (nextSlot + numDirty > slotsPerBank) {
+        /* Compaction: write every chunk to the other bank, then erase the old
+         * one. If a record cannot be written, the old bank is kept until the
+         * compaction is completed */
+        activeBank      = activeBank ^ 1;
+        nextSlot        = 0;
+        otherBankErased = false;
+        for (size_t chunk = 0; chunk < NUM_CHUNKS; chunk++) {
+            if (!appendRecord(chunk, paramsP)) {
+                break;
+            }
+        }
+        completeCompaction();
     } else {
-        pstorage_update(&pstorageHandle,
-                        reinterpret_cast<uint8_t *>(&persistentParams),
-                        sizeof(PersistentParams_t),
-                        0 /* offset */);
+        for (size_t chunk = 0; chunk < NUM_CHUNKS; chunk++) {
+            if (dirty[chunk]) {
+                appendRecord(chunk, paramsP);
+            }
+        }
     }
+
+    journalParamsValid          = areAllChunksStored();
+    persistenceStats.eraseCount = eraseCount;
+}
+
+void getEddystoneServiceConfigParamsPersistenceStats(ConfigParamsPersistenceStats_t *statsP)
+{
+    memcpy(statsP, &persistenceStats, sizeof(ConfigParamsPersistenceStats_t));
 }
 
-#endif /* #ifdef TARGET_NRF51822 */
+#endif /* #if defined(TARGET_NRF51822) || defined(TARGET_NRF5) */
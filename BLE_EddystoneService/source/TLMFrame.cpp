@@ -14,6 +14,7 @@
  * limitations under the License.
  */
 
+#include <string.h>
 #include "TLMFrame.h"
 
 TLMFrame::TLMFrame(uint8_t  tlmVersionIn,
@@ -26,7 +27,12 @@ TLMFrame::TLMFrame(uint8_t  tlmVersionIn,
     tlmBatteryVoltage(tlmBatteryVoltageIn),
     tlmBeaconTemperature(tlmBeaconTemperatureIn),
     tlmPduCount(tlmPduCountIn),
-    tlmTimeSinceBoot(tlmTimeSinceBootIn)
+    tlmTimeSinceBoot(tlmTimeSinceBootIn),
+    batteryVoltageChanged(true),
+    beaconTemperatureChanged(true),
+    encrypted(false),
+    etlmNonceReady(false),
+    etlmSalt(0)
 {
 }
 
@@ -40,6 +46,9 @@ void TLMFrame::setTLMData(uint8_t tlmVersionIn)
     tlmBeaconTemperature = 0x8000;
     tlmPduCount          = 0;
     tlmTimeSinceBoot     = 0;
+
+    batteryVoltageChanged    = true;
+    beaconTemperatureChanged = true;
 }
 
 void TLMFrame::constructTLMFrame(uint8_t *rawFrame)
@@ -61,27 +70,205 @@ void TLMFrame::constructTLMFrame(uint8_t *rawFrame)
     rawFrame[index++] = (uint8_t)(tlmTimeSinceBoot >> 16);    // Time Since Boot [1]
     rawFrame[index++] = (uint8_t)(tlmTimeSinceBoot >> 8);     // Time Since Boot [2]
     rawFrame[index++] = (uint8_t)(tlmTimeSinceBoot >> 0);     // Time Since Boot [3]
+
+    batteryVoltageChanged    = false;
+    beaconTemperatureChanged = false;
+}
+
+void TLMFrame::patchTLMFrame(uint8_t *rawFrame)
+{
+    size_t index;
+
+    if (batteryVoltageChanged) {
+        index = BATTERY_VOLTAGE_OFFSET;
+        rawFrame[index++] = (uint8_t)(tlmBatteryVoltage >> 8);    // Battery Voltage[0]
+        rawFrame[index++] = (uint8_t)(tlmBatteryVoltage >> 0);    // Battery Voltage[1]
+        batteryVoltageChanged = false;
+    }
+    if (beaconTemperatureChanged) {
+        index = BEACON_TEMPERATURE_OFFSET;
+        rawFrame[index++] = (uint8_t)(tlmBeaconTemperature >> 8); // Beacon Temp[0]
+        rawFrame[index++] = (uint8_t)(tlmBeaconTemperature >> 0); // Beacon Temp[1]
+        beaconTemperatureChanged = false;
+    }
+
+    index = PDU_COUNT_OFFSET;
+    rawFrame[index++] = (uint8_t)(tlmPduCount >> 24);         // PDU Count [0]
+    rawFrame[index++] = (uint8_t)(tlmPduCount >> 16);         // PDU Count [1]
+    rawFrame[index++] = (uint8_t)(tlmPduCount >> 8);          // PDU Count [2]
+    rawFrame[index++] = (uint8_t)(tlmPduCount >> 0);          // PDU Count [3]
+    rawFrame[index++] = (uint8_t)(tlmTimeSinceBoot >> 24);    // Time Since Boot [0]
+    rawFrame[index++] = (uint8_t)(tlmTimeSinceBoot >> 16);    // Time Since Boot [1]
+    rawFrame[index++] = (uint8_t)(tlmTimeSinceBoot >> 8);     // Time Since Boot [2]
+    rawFrame[index++] = (uint8_t)(tlmTimeSinceBoot >> 0);     // Time Since Boot [3]
+}
+
+/* CMAC doubling in GF(2^128) used to derive the subkeys */
+static void doubleBlock(const uint8_t *in, uint8_t *out)
+{
+    uint8_t carry = (in[0] & 0x80) ? 0x87 : 0x00;
+    for (size_t i = 0; i < AES128::BLOCK_SIZE - 1; i++) {
+        out[i] = (uint8_t)((in[i] << 1) | (in[i + 1] >> 7));
+    }
+    out[AES128::BLOCK_SIZE - 1] = (uint8_t)(in[AES128::BLOCK_SIZE - 1] << 1) ^ carry;
+}
+
+void TLMFrame::setEncryptionKey(const uint8_t *identityKeyIn)
+{
+    etlmNonceReady = false;
+    if (identityKeyIn == NULL) {
+        encrypted = false;
+        return;
+    }
+
+    uint8_t block[AES128::BLOCK_SIZE];
+    uint8_t subkey1[AES128::BLOCK_SIZE];
+
+    etlmAes.setKey(identityKeyIn);
+
+    /* L = E(0) is also the encrypted OMAC tweak [0] used for the nonce */
+    memset(block, 0, sizeof(block));
+    etlmAes.encryptBlock(block, etlmNonceTweakMac);
+    doubleBlock(etlmNonceTweakMac, subkey1);
+    doubleBlock(subkey1, etlmSubkey);
+
+    /* The header is empty, so its OMAC is just the tweak block [1], which
+     * is a complete block and therefore uses the first subkey */
+    memcpy(block, subkey1, sizeof(block));
+    block[AES128::BLOCK_SIZE - 1] ^= 1;
+    etlmAes.encryptBlock(block, etlmHeaderMac);
+
+    /* Encrypted OMAC tweak [2] for the ciphertext */
+    memset(block, 0, sizeof(block));
+    block[AES128::BLOCK_SIZE - 1] = 2;
+    etlmAes.encryptBlock(block, etlmCiphertextTweakMac);
+
+    encrypted = true;
+}
+
+bool TLMFrame::isEncrypted(void) const
+{
+    return encrypted;
+}
+
+void TLMFrame::computeOMACFinalBlock(const uint8_t *prefixMac, const uint8_t *data, size_t dataLength, uint8_t *mac)
+{
+    uint8_t block[AES128::BLOCK_SIZE];
+
+    /* Pad the partial block with 10..0 and mix in the second subkey */
+    memset(block, 0, sizeof(block));
+    memcpy(block, data, dataLength);
+    block[dataLength] = 0x80;
+    for (size_t i = 0; i < AES128::BLOCK_SIZE; i++) {
+        block[i] ^= prefixMac[i] ^ etlmSubkey[i];
+    }
+    etlmAes.encryptBlock(block, mac);
+}
+
+void TLMFrame::prepareETLMNonce(uint32_t nonceTime, uint16_t saltIn)
+{
+    uint8_t nonce[ETLM_NONCE_SIZE];
+    uint8_t nonceMac[AES128::BLOCK_SIZE];
+    uint8_t counter[AES128::BLOCK_SIZE];
+
+    if (!encrypted) {
+        return;
+    }
+
+    nonce[0] = (uint8_t)(nonceTime >> 24);
+    nonce[1] = (uint8_t)(nonceTime >> 16);
+    nonce[2] = (uint8_t)(nonceTime >> 8);
+    nonce[3] = (uint8_t)(nonceTime >> 0);
+    nonce[4] = (uint8_t)(saltIn >> 8);
+    nonce[5] = (uint8_t)(saltIn >> 0);
+
+    /* N' = OMAC0(nonce), which is also the initial CTR counter */
+    computeOMACFinalBlock(etlmNonceTweakMac, nonce, sizeof(nonce), nonceMac);
+    etlmAes.encryptBlock(nonceMac, counter);
+    memcpy(etlmKeystream, counter, ETLM_DATA_SIZE);
+
+    for (size_t i = 0; i < AES128::BLOCK_SIZE; i++) {
+        etlmTagBase[i] = nonceMac[i] ^ etlmHeaderMac[i];
+    }
+    etlmSalt       = saltIn;
+    etlmNonceReady = true;
+}
+
+bool TLMFrame::isETLMNonceReady(void) const
+{
+    return etlmNonceReady;
+}
+
+void TLMFrame::constructETLMFrame(uint8_t *rawFrame)
+{
+    uint8_t ciphertextMac[AES128::BLOCK_SIZE];
+    size_t  index = 0;
+
+    rawFrame[index++] = EDDYSTONE_UUID[0];                    // 16-bit Eddystone UUID
+    rawFrame[index++] = EDDYSTONE_UUID[1];
+    rawFrame[index++] = FRAME_TYPE_TLM;                       // Eddystone frame type = Telemetry
+    rawFrame[index++] = ETLM_VERSION;                         // eTLM Version Number
+
+    uint8_t *data = rawFrame + index;
+    data[0]  = (uint8_t)(tlmBatteryVoltage >> 8);             // Battery Voltage[0]
+    data[1]  = (uint8_t)(tlmBatteryVoltage >> 0);             // Battery Voltage[1]
+    data[2]  = (uint8_t)(tlmBeaconTemperature >> 8);          // Beacon Temp[0]
+    data[3]  = (uint8_t)(tlmBeaconTemperature >> 0);          // Beacon Temp[1]
+    data[4]  = (uint8_t)(tlmPduCount >> 24);                  // PDU Count [0]
+    data[5]  = (uint8_t)(tlmPduCount >> 16);                  // PDU Count [1]
+    data[6]  = (uint8_t)(tlmPduCount >> 8);                   // PDU Count [2]
+    data[7]  = (uint8_t)(tlmPduCount >> 0);                   // PDU Count [3]
+    data[8]  = (uint8_t)(tlmTimeSinceBoot >> 24);             // Time Since Boot [0]
+    data[9]  = (uint8_t)(tlmTimeSinceBoot >> 16);             // Time Since Boot [1]
+    data[10] = (uint8_t)(tlmTimeSinceBoot >> 8);              // Time Since Boot [2]
+    data[11] = (uint8_t)(tlmTimeSinceBoot >> 0);              // Time Since Boot [3]
+    for (size_t i = 0; i < ETLM_DATA_SIZE; i++) {
+        data[i] ^= etlmKeystream[i];                          // CTR encryption
+    }
+    index += ETLM_DATA_SIZE;
+
+    rawFrame[index++] = (uint8_t)(etlmSalt >> 8);             // Salt[0]
+    rawFrame[index++] = (uint8_t)(etlmSalt >> 0);             // Salt[1]
+
+    /* Tag = N' ^ H' ^ OMAC2(ciphertext), truncated to 16 bits */
+    computeOMACFinalBlock(etlmCiphertextTweakMac, data, ETLM_DATA_SIZE, ciphertextMac);
+    rawFrame[index++] = etlmTagBase[0] ^ ciphertextMac[0];   // Message Integrity Check[0]
+    rawFrame[index++] = etlmTagBase[1] ^ ciphertextMac[1];   // Message Integrity Check[1]
+
+    /* A nonce must never be used twice */
+    etlmNonceReady           = false;
+    batteryVoltageChanged    = false;
+    beaconTemperatureChanged = false;
 }
 
 size_t TLMFrame::getRawFrameSize(void) const
 {
-    return FRAME_SIZE_TLM + EDDYSTONE_UUID_SIZE;
+    return encrypted ? ETLM_RAW_FRAME_SIZE : RAW_FRAME_SIZE;
 }
 
-void TLMFrame::updateTimeSinceBoot(uint32_t nowInMillis)
+void TLMFrame::updateTimeSinceBoot(uint32_t nowInMicros)
 {
-    tlmTimeSinceBoot      += (nowInMillis - lastTimeSinceBootRead) / 100;
-    lastTimeSinceBootRead  = nowInMillis;
+    /* Unsigned subtraction yields the right elapsed time across a wrap */
+    uint32_t tenthsOfSecond = (nowInMicros - lastTimeSinceBootRead) / TIME_SINCE_BOOT_RESOLUTION_USEC;
+
+    tlmTimeSinceBoot      += tenthsOfSecond;
+    lastTimeSinceBootRead += tenthsOfSecond * TIME_SINCE_BOOT_RESOLUTION_USEC;
 }
 
 void TLMFrame::updateBatteryVoltage(uint16_t tlmBatteryVoltageIn)
 {
-    tlmBatteryVoltage = tlmBatteryVoltageIn;
+    if (tlmBatteryVoltage != tlmBatteryVoltageIn) {
+        tlmBatteryVoltage     = tlmBatteryVoltageIn;
+        batteryVoltageChanged = true;
+    }
 }
 
 void TLMFrame::updateBeaconTemperature(uint16_t tlmBeaconTemperatureIn)
 {
-    tlmBeaconTemperature = tlmBeaconTemperatureIn;
+    if (tlmBeaconTemperature != tlmBeaconTemperatureIn) {
+        tlmBeaconTemperature     = tlmBeaconTemperatureIn;
+        beaconTemperatureChanged = true;
+    }
 }
 
 void TLMFrame::updatePduCount(void)
@@ -18,10 +18,17 @@
 #define __TLMFRAME_H__
 
 #include "EddystoneTypes.h"
+#include "AES128.h"
 
 /**
  * Class that encapsulates data that belongs to the Eddystone-TLM frame. For
  * more information refer to https://github.com/google/eddystone/tree/master/eddystone-tlm.
+ *
+ * When an encryption key is set the frame is sent as an encrypted
+ * Eddystone-TLM (eTLM) frame, using AES-EAX as described in
+ * https://github.com/google/eddystone/blob/master/eddystone-tlm/tlm-encrypted.md.
+ * Everything that only depends on the key or the nonce is computed ahead of
+ * time, so encrypting a frame costs a single AES block operation.
  */
 class TLMFrame
 {
@@ -61,6 +68,71 @@ public:
      */
     void constructTLMFrame(uint8_t *rawFrame);
 
+    /**
+     * Patch the raw bytes of an Eddystone-TLM frame previously built with
+     * constructTLMFrame(). The Advertising PDU Count and Time Since Boot are
+     * always rewritten, the Battery Voltage and Beacon Temperature only if
+     * they changed since the frame was last constructed or patched.
+     *
+     * @param[in,out] rawFrame
+     *              Pointer to the raw frame to update.
+     */
+    void patchTLMFrame(uint8_t *rawFrame);
+
+    /**
+     * Set the key used to encrypt eTLM frames, which is the Eddystone-EID
+     * identity key. This precomputes the parts of AES-EAX that only depend
+     * on the key.
+     *
+     * @param[in] identityKeyIn
+     *              Pointer to the EID_IDENTITY_KEY_SIZE bytes of the key, or
+     *              NULL to go back to sending plain Eddystone-TLM frames.
+     *
+     * @note Changing the key invalidates any nonce prepared with
+     *       prepareETLMNonce().
+     */
+    void setEncryptionKey(const uint8_t *identityKeyIn);
+
+    /**
+     * Check whether the frame is sent as eTLM.
+     *
+     * @return true if an encryption key is set.
+     */
+    bool isEncrypted(void) const;
+
+    /**
+     * Prepare the nonce for the next eTLM frame and precompute the AES-EAX
+     * nonce MAC and CTR keystream derived from it. This should be done well
+     * ahead of the time the frame is needed.
+     *
+     * @param[in] nonceTime
+     *              The Eddystone-EID beacon time with the K lowest bits
+     *              cleared.
+     * @param[in] saltIn
+     *              A random 16-bit salt. A nonce must never be reused with
+     *              the same key.
+     */
+    void prepareETLMNonce(uint32_t nonceTime, uint16_t saltIn);
+
+    /**
+     * Check whether a nonce prepared with prepareETLMNonce() is available
+     * for the next call to constructETLMFrame().
+     *
+     * @return true if a fresh nonce is available.
+     */
+    bool isETLMNonceReady(void) const;
+
+    /**
+     * Construct the raw bytes of an eTLM frame from the current telemetry
+     * values using the prepared nonce, which is then consumed.
+     *
+     * @param[in] rawFrame
+     *              Pointer to the location where the raw frame will be stored.
+     *
+     * @note isETLMNonceReady() must return true before calling this.
+     */
+    void constructETLMFrame(uint8_t *rawFrame);
+
     /**
      * Get the size of the Eddystone-TLM frame constructed with the
      * current state of the TLMFrame object.
@@ -70,15 +142,20 @@ public:
     size_t getRawFrameSize(void) const;
 
     /**
-     * Update the time since boot.
+     * Update the time since boot. Only whole 0.1 second steps are added to
+     * the Eddystone-TLM value, the remainder is carried over to the next
+     * update so that no time is lost between reads.
      *
-     * @param[in] nowInMillis
-     *              The time since boot in milliseconds.
+     * @param[in] nowInMicros
+     *              A free-running microsecond timestamp (e.g. from the
+     *              lp_ticker). It may wrap around at 32 bits, but it must
+     *              be read at least once per wrap period.
      */
-    void updateTimeSinceBoot(uint32_t nowInMillis);
+    void updateTimeSinceBoot(uint32_t nowInMicros);
 
     /**
-     * Update the Battery Voltage.
+     * Update the Battery Voltage. The raw frame is only marked for patching
+     * if the value differs from the current one.
      *
      * @param[in] tlmBatteryVoltageIn
      *              The new Battery Voltage value.
@@ -86,7 +163,8 @@ public:
     void updateBatteryVoltage(uint16_t tlmBatteryVoltageIn);
 
     /**
-     * Update the Beacon Temperature.
+     * Update the Beacon Temperature. The raw frame is only marked for
+     * patching if the value differs from the current one.
      *
      * @param[in] tlmBeaconTemperatureIn
      *              The new Beacon Temperature value.
@@ -128,13 +206,69 @@ private:
      * The size of an Eddystone-TLM frame.
      */
     static const uint8_t FRAME_SIZE_TLM = 14;
+    /**
+     * Offset of the Battery Voltage within the raw frame.
+     */
+    static const uint8_t BATTERY_VOLTAGE_OFFSET   = 4;
+    /**
+     * Offset of the Beacon Temperature within the raw frame.
+     */
+    static const uint8_t BEACON_TEMPERATURE_OFFSET = 6;
+    /**
+     * Offset of the Advertising PDU Count within the raw frame.
+     */
+    static const uint8_t PDU_COUNT_OFFSET          = 8;
+    /**
+     * Offset of the Time Since Boot within the raw frame.
+     */
+    static const uint8_t TIME_SINCE_BOOT_OFFSET    = 12;
+    /**
+     * Resolution of the Eddystone-TLM time since boot in microseconds.
+     */
+    static const uint32_t TIME_SINCE_BOOT_RESOLUTION_USEC = 100000;
+    /**
+     * The version number of eTLM frames.
+     */
+    static const uint8_t ETLM_VERSION = 0x01;
+    /**
+     * The size of the encrypted telemetry within an eTLM frame.
+     */
+    static const uint8_t ETLM_DATA_SIZE = 12;
+    /**
+     * The size of an eTLM frame: type, version, encrypted data, salt and
+     * message integrity check.
+     */
+    static const uint8_t FRAME_SIZE_ETLM = 2 + ETLM_DATA_SIZE + 2 + 2;
+    /**
+     * The size of the AES-EAX nonce: beacon time and salt.
+     */
+    static const uint8_t ETLM_NONCE_SIZE = 6;
+
+public:
+    /**
+     * The size (in bytes) of the raw Eddystone-TLM frame built by
+     * constructTLMFrame(), including the 16-bit Eddystone UUID.
+     */
+    static const uint8_t RAW_FRAME_SIZE = FRAME_SIZE_TLM + EDDYSTONE_UUID_SIZE;
+    /**
+     * The size (in bytes) of the raw eTLM frame built by
+     * constructETLMFrame(), including the 16-bit Eddystone UUID.
+     */
+    static const uint8_t ETLM_RAW_FRAME_SIZE = FRAME_SIZE_ETLM + EDDYSTONE_UUID_SIZE;
+    /**
+     * The size (in bytes) of the largest raw frame built by this class.
+     */
+    static const uint8_t MAX_RAW_FRAME_SIZE = ETLM_RAW_FRAME_SIZE;
+
+private:
 
     /**
      * Eddystone-TLM version value.
      */
     uint8_t              tlmVersion;
     /**
-     * Time since boot in milliseconds.
+     * Timestamp in microseconds up to which the time since boot has been
+     * accounted for.
      */
     uint32_t             lastTimeSinceBootRead;
     /**
@@ -153,6 +287,74 @@ private:
      * Eddystone-TLM time since boot with 0.1 second resolution.
      */
     uint32_t             tlmTimeSinceBoot;
+    /**
+     * Whether the Battery Voltage changed since the raw frame was last
+     * written.
+     */
+    bool                 batteryVoltageChanged;
+    /**
+     * Whether the Beacon Temperature changed since the raw frame was last
+     * written.
+     */
+    bool                 beaconTemperatureChanged;
+
+    /**
+     * Helper that computes the last step of an OMAC (CMAC) over a prefix
+     * block whose encryption is @p prefixMac and a final partial block.
+     *
+     * @param[in] prefixMac
+     *              The encrypted OMAC tweak block.
+     * @param[in] data
+     *              The final block, shorter than AES128::BLOCK_SIZE.
+     * @param[in] dataLength
+     *              The length of @p data.
+     * @param[out] mac
+     *              The resulting MAC.
+     */
+    void computeOMACFinalBlock(const uint8_t *prefixMac, const uint8_t *data, size_t dataLength, uint8_t *mac);
+
+    /**
+     * Whether frames are sent as eTLM.
+     */
+    bool                 encrypted;
+    /**
+     * Whether etlmNonceMac and etlmKeystream belong to an unused nonce.
+     */
+    bool                 etlmNonceReady;
+    /**
+     * The salt of the prepared nonce.
+     */
+    uint16_t             etlmSalt;
+    /**
+     * AES-128 keyed with the identity key.
+     */
+    AES128               etlmAes;
+    /**
+     * CMAC subkey K2, used because the nonce and the ciphertext are shorter
+     * than a block.
+     */
+    uint8_t              etlmSubkey[AES128::BLOCK_SIZE];
+    /**
+     * Encryption of the OMAC tweak block [0], which is also the CMAC L value.
+     */
+    uint8_t              etlmNonceTweakMac[AES128::BLOCK_SIZE];
+    /**
+     * Encryption of the OMAC tweak block [2] used for the ciphertext.
+     */
+    uint8_t              etlmCiphertextTweakMac[AES128::BLOCK_SIZE];
+    /**
+     * The OMAC of the empty header XORed with the OMAC of the prepared nonce,
+     * i.e. the tag before the ciphertext MAC is added.
+     */
+    uint8_t              etlmTagBase[AES128::BLOCK_SIZE];
+    /**
+     * The OMAC of the empty header.
+     */
+    uint8_t              etlmHeaderMac[AES128::BLOCK_SIZE];
+    /**
+     * The CTR keystream for the prepared nonce.
+     */
+    uint8_t              etlmKeystream[ETLM_DATA_SIZE];
 };
 
 #endif  /* __TLMFRAME_H__ */
@@ -53,7 +53,7 @@ void UIDFrame::constructUIDFrame(uint8_t *rawFrame, int8_t advPowerLevel)
 
 size_t UIDFrame::getRawFrameSize(void) const
 {
-    return FRAME_SIZE_UID + EDDYSTONE_UUID_SIZE;
+    return RAW_FRAME_SIZE;
 }
 
 uint8_t* UIDFrame::getUIDNamespaceID(void)
@@ -95,6 +95,15 @@ private:
      */
     static const uint8_t FRAME_SIZE_UID = 20;
 
+public:
+    /**
+     * The size (in bytes) of the raw Eddystone-UID frame built by
+     * constructUIDFrame(), including the 16-bit Eddystone UUID.
+     */
+    static const uint8_t RAW_FRAME_SIZE = FRAME_SIZE_UID + EDDYSTONE_UUID_SIZE;
+
+private:
+
     /**
      * The Eddystone-UID namespace ID.
      */
@@ -15,6 +15,7 @@
  */
 
 #include "URLFrame.h"
+#include "EddystoneURLCodec.h"
 
 URLFrame::URLFrame(void)
 {
@@ -71,68 +72,6 @@ void URLFrame::setEncodedURLData(const uint8_t* urlEncodedDataIn, const uint8_t
 
 void URLFrame::encodeURL(const char *urlDataIn)
 {
-    const char  *prefixes[] = {
-        "http://www.",
-        "https://www.",
-        "http://",
-        "https://",
-    };
-    const size_t NUM_PREFIXES = sizeof(prefixes) / sizeof(char *);
-    const char  *suffixes[]   = {
-        ".com/",
-        ".org/",
-        ".edu/",
-        ".net/",
-        ".info/",
-        ".biz/",
-        ".gov/",
-        ".com",
-        ".org",
-        ".edu",
-        ".net",
-        ".info",
-        ".biz",
-        ".gov"
-    };
-    const size_t NUM_SUFFIXES = sizeof(suffixes) / sizeof(char *);
-
-    urlDataLength = 0;
     memset(urlData, 0, sizeof(UrlData_t));
-
-    if ((urlDataIn == NULL) || (strlen(urlDataIn) == 0)) {
-        return;
-    }
-
-    /*
-     * handle prefix
-     */
-    for (size_t i = 0; i < NUM_PREFIXES; i++) {
-        size_t prefixLen = strlen(prefixes[i]);
-        if (strncmp(urlDataIn, prefixes[i], prefixLen) == 0) {
-            urlData[urlDataLength++]  = i;
-            urlDataIn                      += prefixLen;
-            break;
-        }
-    }
-
-    /*
-     * handle suffixes
-     */
-    while (*urlDataIn && (urlDataLength < URL_DATA_MAX)) {
-        /* check for suffix match */
-        size_t i;
-        for (i = 0; i < NUM_SUFFIXES; i++) {
-            size_t suffixLen = strlen(suffixes[i]);
-            if (strncmp(urlDataIn, suffixes[i], suffixLen) == 0) {
-                urlData[urlDataLength++]  = i;
-                urlDataIn                      += suffixLen;
-                break; /* from the for loop for checking against suffixes */
-            }
-        }
-        /* This is the default case where we've got an ordinary character which doesn't match a suffix. */
-        if (i == NUM_SUFFIXES) {
-            urlData[urlDataLength++] = *urlDataIn;
-            ++urlDataIn;
-        }
-    }
+    urlDataLength = encodeEddystoneURL(urlDataIn, urlData, URL_DATA_MAX);
 }
@@ -122,6 +122,15 @@ private:
      */
     static const uint8_t FRAME_MIN_SIZE_URL = 2;
 
+public:
+    /**
+     * The maximum size (in bytes) of the raw Eddystone-URL frame built by
+     * constructURLFrame(), including the 16-bit Eddystone UUID.
+     */
+    static const uint8_t MAX_RAW_FRAME_SIZE = FRAME_MIN_SIZE_URL + URL_DATA_MAX + EDDYSTONE_UUID_SIZE;
+
+private:
+
     /**
      * The length of the encoded URL.
      */
@@ -22,6 +22,10 @@
 
 #include "PersistentStorageHelper/ConfigParamsPersistence.h"
 
+#ifdef MBED_HEAP_STATS_ENABLED
+    #include "platform/mbed_stats.h"
+#endif
+
 EddystoneService *eddyServicePtr;
 
 /* Duration after power-on that config service is available. */
@@ -34,15 +38,66 @@ static const UIDInstanceID_t  uidInstanceID  = {0xAA, 0xBB, 0xCC, 0xDD, 0xEE, 0x
 /* Default version in TLM frame */
 static const uint8_t tlmVersion = 0x00;
 
+/* Default iBeacon frame data, interleaved with the Eddystone frames if
+ * EddystoneService::DEFAULT_IBEACON_FRAME_PERIOD_MSEC is not zero */
+static const IBeaconProximityUUID_t iBeaconUUID = {0xE2, 0x0A, 0x39, 0xF4, 0x73, 0xF5, 0x4B, 0xC4,
+                                                    0xA1, 0x2F, 0x17, 0xD1, 0xAD, 0x07, 0xA9, 0x61};
+static const uint16_t iBeaconMajorNumber        = 1122;
+static const uint16_t iBeaconMinorNumber        = 3344;
+static const int8_t   iBeaconMeasuredPower      = -56;
+static const int8_t   iBeaconRadioPower         = 0;
+
+/* Interval at which the number of advertised frames is reported */
+static const int FRAME_RATE_REPORT_PERIOD_SECONDS = 10;
+
 /* Values for ADV packets related to firmware levels, calibrated based on measured values at 1m */
 static const PowerLevels_t defaultAdvPowerLevels = {-47, -33, -21, -13};
 /* Values for radio power levels, provided by manufacturer. */
 static const PowerLevels_t radioPowerLevels      = {-30, -16, -4, 4};
 
-static EventQueue eventQueue(/* event count */ 16 * EVENTS_EVENT_SIZE);
+/* Events of the application: the blinky, the config mode timeout or the frame
+ * rate report, the periodic save of the parameters, and the BLE event
+ * processing, which the stack may post a few times before it runs */
+static const unsigned APP_EVENTS = 8;
+
+static EventQueue eventQueue(EddystoneService::EVENT_QUEUE_SIZE + APP_EVENTS * EVENTS_EVENT_SIZE);
 
 DigitalOut led(LED1, 1);
 
+/**
+ * Print the heap usage and high-water mark. This is only available when the
+ * application is built with MBED_HEAP_STATS_ENABLED=1.
+ */
+static void printHeapStats(const char *when)
+{
+#ifdef MBED_HEAP_STATS_ENABLED
+    mbed_stats_heap_t heapStats;
+    mbed_stats_heap_get(&heapStats);
+    printf("heap (%s): current %lu bytes, max %lu bytes\r\n",
+           when, (unsigned long) heapStats.current_size, (unsigned long) heapStats.max_size);
+#else
+    (void) when;
+#endif
+}
+
+/**
+ * Print the rate at which each frame type was put on air since the last report.
+ */
+static void printFrameRates(void)
+{
+    static const char *frameNames[EddystoneService::NUM_EDDYSTONE_FRAMES] = {"URL", "UID", "TLM", "EID", "iBeacon"};
+    static uint32_t lastCount[EddystoneService::NUM_EDDYSTONE_FRAMES];
+
+    for (int i = 0; i < EddystoneService::NUM_EDDYSTONE_FRAMES; i++) {
+        uint32_t count = eddyServicePtr->getAdvertisedFrameCount(static_cast<EddystoneService::FrameType>(i));
+        printf("%s: %lu PDUs (%lu.%lu/s)  ", frameNames[i], (unsigned long) count,
+               (unsigned long) ((count - lastCount[i]) / FRAME_RATE_REPORT_PERIOD_SECONDS),
+               (unsigned long) (((count - lastCount[i]) * 10 / FRAME_RATE_REPORT_PERIOD_SECONDS) % 10));
+        lastCount[i] = count;
+    }
+    printf("EID rotation: %lu us\r\n", (unsigned long) eddyServicePtr->getEIDRotationTime());
+}
+
 /**
  * Callback triggered upon a disconnection event.
  */
@@ -52,6 +107,16 @@ static void disconnectionCallback(const Gap::DisconnectionCallbackParams_t *cbPa
     BLE::Instance().gap().startAdvertising();
 }
 
+/**
+ * Save the current parameters, including the Eddystone-EID beacon time.
+ */
+static void saveConfigParams(void)
+{
+    EddystoneService::EddystoneParams_t params;
+    eddyServicePtr->getEddystoneParams(params);
+    saveEddystoneServiceConfigParams(&params);
+}
+
 /**
  * Callback triggered some time after application started to switch to beacon mode.
  */
@@ -61,9 +126,10 @@ static void timeout(void)
     state = BLE::Instance().gap().getState();
     if (!state.connected) { /* don't switch if we're in a connected state. */
         eddyServicePtr->startBeaconService();
-        EddystoneService::EddystoneParams_t params;
-        eddyServicePtr->getEddystoneParams(params);
-        saveEddystoneServiceConfigParams(&params);
+        saveConfigParams();
+        printHeapStats("beacon mode");
+        eventQueue.call_every(FRAME_RATE_REPORT_PERIOD_SECONDS * 1000, printFrameRates);
+        eventQueue.call_every(EddystoneService::EID_BEACON_TIME_SAVE_PERIOD_SECONDS * 1000, saveConfigParams);
     } else {
         eventQueue.call_in(CONFIG_ADVERTISEMENT_TIMEOUT_SECONDS * 1000, timeout);
     }
@@ -111,8 +177,21 @@ static void bleInitComplete(BLE::InitializationCompleteCallbackContext* initCont
         initializeEddystoneToDefaults(ble);
     }
 
+    ConfigParamsPersistenceStats_t persistenceStats;
+    getEddystoneServiceConfigParamsPersistenceStats(&persistenceStats);
+    if (persistenceStats.bankSize == 0) {
+        printf("config params: no flash reserved, parameters are not persisted\r\n");
+    } else {
+        printf("config params: loaded in %lu us, %lu flash erases, %lu byte banks\r\n",
+               (unsigned long) persistenceStats.loadTimeMicros, (unsigned long) persistenceStats.eraseCount,
+               (unsigned long) persistenceStats.bankSize);
+    }
+
+    eddyServicePtr->setIBeaconData(iBeaconUUID, iBeaconMajorNumber, iBeaconMinorNumber, iBeaconMeasuredPower, iBeaconRadioPower);
+
     /* Start Eddystone in config mode */
    eddyServicePtr->startConfigService();
+   printHeapStats("config mode");
 
    eventQueue.call_in(CONFIG_ADVERTISEMENT_TIMEOUT_SECONDS * 1000, timeout);
 }
@@ -0,0 +1 @@
+../../BLE_LED/source/ConnectionManager.h
\ No newline at end of file
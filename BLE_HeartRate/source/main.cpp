@@ -19,6 +19,7 @@
 #include "ble/BLE.h"
 #include "ble/Gap.h"
 #include "ble/services/HeartRateService.h"
+#include "ConnectionManager.h"
 
 DigitalOut led1(LED1, 1);
 
@@ -30,11 +31,55 @@ static HeartRateService *hrServicePtr;
 
 static EventQueue eventQueue(/* event count */ 16 * EVENTS_EVENT_SIZE);
 
+/* While the measurements are notified: 100 to 200 ms */
+static const Gap::ConnectionParams_t streamingParams = {
+    /* minConnectionInterval        */ 80,
+    /* maxConnectionInterval        */ 160,
+    /* slaveLatency                 */ 0,
+    /* connectionSupervisionTimeout */ 400
+};
+
+/* Without subscriber: 400 to 500 ms, with up to 4 connection events skipped */
+static const Gap::ConnectionParams_t idleParams = {
+    /* minConnectionInterval        */ 320,
+    /* maxConnectionInterval        */ 400,
+    /* slaveLatency                 */ 4,
+    /* connectionSupervisionTimeout */ 600
+};
+
+/* A few measurement periods */
+static const uint32_t IDLE_TIMEOUT_MSEC = 2000;
+
+static Timer             uptime;
+static ConnectionManager connectionManager(streamingParams, idleParams, IDLE_TIMEOUT_MSEC);
+static bool              notificationsEnabled = false;
+
+void connectionCallback(const Gap::ConnectionCallbackParams_t *params)
+{
+    connectionManager.connected(params, uptime.read_ms());
+}
+
 void disconnectionCallback(const Gap::DisconnectionCallbackParams_t *params)
 {
+    notificationsEnabled = false;
+    connectionManager.disconnected();
     BLE::Instance().gap().startAdvertising(); // restart advertising
 }
 
+/* The heart rate measurement is the only characteristic which notifies */
+void updatesEnabledCallback(GattAttribute::Handle_t handle)
+{
+    (void)handle;
+    notificationsEnabled = true;
+    connectionManager.activity(uptime.read_ms());
+}
+
+void updatesDisabledCallback(GattAttribute::Handle_t handle)
+{
+    (void)handle;
+    notificationsEnabled = false;
+}
+
 void updateSensorValue() {
     // Do blocking calls or whatever is necessary for sensor polling.
     // In our case, we simply update the HRM measurement.
@@ -46,6 +91,9 @@ void updateSensorValue() {
     }
 
     hrServicePtr->updateHeartRate(hrmCounter);
+    if (notificationsEnabled) {
+        connectionManager.activity(uptime.read_ms());
+    }
 }
 
 void periodicCallback(void)
@@ -54,6 +102,7 @@ void periodicCallback(void)
 
     if (BLE::Instance().getGapState().connected) {
         eventQueue.call(updateSensorValue);
+        connectionManager.poll(uptime.read_ms());
     }
 }
 
@@ -78,7 +127,11 @@ void bleInitComplete(BLE::InitializationCompleteCallbackContext *params)
         return;
     }
 
+    ble.gap().onConnection(connectionCallback);
     ble.gap().onDisconnection(disconnectionCallback);
+    ble.gattServer().onUpdatesEnabled(updatesEnabledCallback);
+    ble.gattServer().onUpdatesDisabled(updatesDisabledCallback);
+    connectionManager.init();
 
     /* Setup primary service. */
     hrServicePtr = new HeartRateService(ble, hrmCounter, HeartRateService::LOCATION_FINGER);
@@ -100,6 +153,7 @@ void scheduleBleEventsProcessing(BLE::OnEventsToProcessCallbackContext* context)
 
 int main()
 {
+    uptime.start();
     eventQueue.call_every(500, periodicCallback);
 
     BLE &ble = BLE::Instance();
@@ -0,0 +1,257 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2006-2015 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __CONNECTIONMANAGER_H__
+#define __CONNECTIONMANAGER_H__
+
+#include "ble/BLE.h"
+
+/**
+ * Adapt the parameters of the connection of a peripheral to its traffic:
+ * a short connection interval while data is streamed, and a long interval
+ * with slave latency once the link has been idle for a while, to save power
+ * on both sides.
+ *
+ * The application reports its traffic with activity(), and calls poll()
+ * periodically. Updates are requested from the central at most every
+ * UPDATE_SPACING_MSEC, which may accept or refuse them.
+ *
+ * The values in use on the connection are exposed with getNegotiated(), so
+ * that the application can size its notifications, and the parameters of
+ * the last update accepted by the stack with getRequested(). The ATT MTU exchange,
+ * the LE Data Length Extension and the 2M PHY are not supported by this
+ * version of the BLE API and the SoftDevices it runs on, so these values
+ * stay at the BLE 4.0 defaults.
+ *
+ * Usage:
+ *     manager.init() once BLE is initialized,
+ *     manager.connected() and manager.disconnected() from the Gap callbacks,
+ *     manager.activity() whenever data is sent or received,
+ *     manager.poll() periodically.
+ */
+class ConnectionManager
+{
+public:
+    /**
+     * Parameters in use on the connection.
+     */
+    struct Negotiated_t {
+        /**
+         * Connection interval, in 1.25 ms units, slave latency in connection
+         * events and supervision timeout, in 10 ms units, as reported when
+         * the connection was established. This version of the API does not
+         * report the parameters chosen by the central after an update, so
+         * they are not changed by the updates requested since.
+         */
+        uint16_t connectionInterval;
+        uint16_t slaveLatency;
+        uint16_t supervisionTimeout;
+        uint16_t attMtu;
+        /**
+         * Largest link layer payload sent.
+         */
+        uint16_t maxTxOctets;
+        uint8_t  phy;
+    };
+
+    static const uint16_t DEFAULT_ATT_MTU     = 23;
+    static const uint16_t DEFAULT_MAX_OCTETS  = 27;
+    static const uint8_t  PHY_1M              = 1;
+    static const uint8_t  PHY_2M              = 2;
+    /**
+     * Minimum time between two connection parameter update requests.
+     */
+    static const uint32_t UPDATE_SPACING_MSEC = 2000;
+
+    /**
+     * Construct a manager for a disconnected peripheral.
+     *
+     * @param[in] streamingParams
+     *              The parameters requested while data is streamed.
+     * @param[in] idleParams
+     *              The parameters requested when the link is idle, also the
+     *              preferred parameters of the peripheral.
+     * @param[in] idleTimeoutMsec
+     *              The time without activity after which the link is idle.
+     */
+    ConnectionManager(const Gap::ConnectionParams_t &streamingParams, const Gap::ConnectionParams_t &idleParams, uint32_t idleTimeoutMsec) :
+        streamingParams(streamingParams),
+        idleParams(idleParams),
+        idleTimeoutMsec(idleTimeoutMsec),
+        connected_(false),
+        handle(0),
+        streaming(false),
+        requestedStreaming(false),
+        requestAccepted(false),
+        lastActivity(0),
+        lastRequest(0)
+    {
+        resetNegotiated();
+    }
+
+    /**
+     * Publish the idle parameters as the preferred connection parameters of
+     * the peripheral. Should be called once BLE is initialized.
+     */
+    void init(void)
+    {
+        BLE::Instance().gap().setPreferredConnectionParams(&idleParams);
+    }
+
+    /**
+     * Called when a connection is established.
+     */
+    void connected(const Gap::ConnectionCallbackParams_t *params, uint32_t now)
+    {
+        connected_         = true;
+        handle             = params->handle;
+        streaming          = false;
+        /* Whatever the central chose, ask for the idle parameters */
+        requestedStreaming = true;
+        requestAccepted    = false;
+        lastActivity       = now;
+        lastRequest        = now - UPDATE_SPACING_MSEC;
+
+        resetNegotiated();
+        if (params->connectionParams != NULL) {
+            negotiated.connectionInterval = params->connectionParams->maxConnectionInterval;
+            negotiated.slaveLatency       = params->connectionParams->slaveLatency;
+            negotiated.supervisionTimeout = params->connectionParams->connectionSupervisionTimeout;
+        }
+    }
+
+    /**
+     * Called when the connection is lost.
+     */
+    void disconnected(void)
+    {
+        connected_      = false;
+        requestAccepted = false;
+        resetNegotiated();
+    }
+
+    /**
+     * Report data sent or received, which switches to the streaming
+     * parameters.
+     */
+    void activity(uint32_t now)
+    {
+        lastActivity = now;
+        if (connected_ && !streaming) {
+            streaming = true;
+            update(now);
+        }
+    }
+
+    /**
+     * Switch to the idle parameters once the link has been idle long
+     * enough, and retry the updates that could not be requested yet. Should
+     * be called periodically.
+     */
+    void poll(uint32_t now)
+    {
+        if (!connected_) {
+            return;
+        }
+        if (streaming && (now - lastActivity) >= idleTimeoutMsec) {
+            streaming = false;
+        }
+        update(now);
+    }
+
+    bool isConnected(void) const
+    {
+        return connected_;
+    }
+
+    bool isStreaming(void) const
+    {
+        return streaming;
+    }
+
+    const Negotiated_t &getNegotiated(void) const
+    {
+        return negotiated;
+    }
+
+    /**
+     * Get the parameters of the last update accepted by the stack on this
+     * connection, or NULL if none was. The central may still have refused
+     * them, or chosen other values within their range.
+     */
+    const Gap::ConnectionParams_t *getRequested(void) const
+    {
+        if (!requestAccepted) {
+            return NULL;
+        }
+        return requestedStreaming ? &streamingParams : &idleParams;
+    }
+
+    /**
+     * Get the largest value that fits in a notification.
+     */
+    uint16_t getMaxNotificationPayload(void) const
+    {
+        /* Opcode and attribute handle */
+        return negotiated.attMtu - 3;
+    }
+
+private:
+    void resetNegotiated(void)
+    {
+        memset(&negotiated, 0, sizeof(negotiated));
+        negotiated.attMtu      = DEFAULT_ATT_MTU;
+        negotiated.maxTxOctets = DEFAULT_MAX_OCTETS;
+        negotiated.phy         = PHY_1M;
+    }
+
+    /**
+     * Request the parameters of the current mode if they were not requested
+     * yet and the last request is old enough.
+     */
+    void update(uint32_t now)
+    {
+        if (requestedStreaming == streaming || (now - lastRequest) < UPDATE_SPACING_MSEC) {
+            return;
+        }
+
+        const Gap::ConnectionParams_t *params = streaming ? &streamingParams : &idleParams;
+        lastRequest = now;
+        if (BLE::Instance().gap().updateConnectionParams(handle, params) == BLE_ERROR_NONE) {
+            requestedStreaming = streaming;
+            requestAccepted    = true;
+        }
+    }
+
+    Gap::ConnectionParams_t streamingParams;
+    Gap::ConnectionParams_t idleParams;
+    uint32_t                idleTimeoutMsec;
+
+    bool                    connected_;
+    Gap::Handle_t           handle;
+    /**
+     * The current mode, the mode whose parameters were last requested, and
+     * whether the stack accepted a request on this connection.
+     */
+    bool                    streaming;
+    bool                    requestedStreaming;
+    bool                    requestAccepted;
+    uint32_t                lastActivity;
+    uint32_t                lastRequest;
+    Negotiated_t            negotiated;
+};
+
+#endif  /* __CONNECTIONMANAGER_H__ */
@@ -18,6 +18,7 @@
 #include <mbed.h>
 #include "ble/BLE.h"
 #include "LEDService.h"
+#include "ConnectionManager.h"
 
 DigitalOut myLED(LED1, 0);
 DigitalOut actuatedLED(LED2, 0);
@@ -29,12 +30,73 @@ static EventQueue eventQueue(/* event count */ 10 * EVENTS_EVENT_SIZE);
 
 LEDService *ledServicePtr;
 
+/* While the LED is written: 7.5 to 15 ms */
+static const Gap::ConnectionParams_t streamingParams = {
+    /* minConnectionInterval        */ 6,
+    /* maxConnectionInterval        */ 12,
+    /* slaveLatency                 */ 0,
+    /* connectionSupervisionTimeout */ 400
+};
+
+/* Once idle: 400 to 500 ms, with up to 4 connection events skipped */
+static const Gap::ConnectionParams_t idleParams = {
+    /* minConnectionInterval        */ 320,
+    /* maxConnectionInterval        */ 400,
+    /* slaveLatency                 */ 4,
+    /* connectionSupervisionTimeout */ 600
+};
+
+static const uint32_t IDLE_TIMEOUT_MSEC = 3000;
+
+static Timer             uptime;
+static ConnectionManager connectionManager(streamingParams, idleParams, IDLE_TIMEOUT_MSEC);
+
+static void printNegotiated(void)
+{
+    const ConnectionManager::Negotiated_t &negotiated = connectionManager.getNegotiated();
+    const Gap::ConnectionParams_t         *requested  = connectionManager.getRequested();
+    printf("%s: interval %u.%02u ms, latency %u, timeout %u ms, MTU %u, max payload %u, PHY %uM\r\n",
+           connectionManager.isStreaming() ? "streaming" : "idle",
+           negotiated.connectionInterval * 5 / 4, (negotiated.connectionInterval * 125) % 100,
+           negotiated.slaveLatency, negotiated.supervisionTimeout * 10,
+           negotiated.attMtu, connectionManager.getMaxNotificationPayload(), negotiated.phy);
+    if (requested != NULL) {
+        printf("    requested: interval %u.%02u to %u.%02u ms, latency %u, timeout %u ms\r\n",
+               requested->minConnectionInterval * 5 / 4, (requested->minConnectionInterval * 125) % 100,
+               requested->maxConnectionInterval * 5 / 4, (requested->maxConnectionInterval * 125) % 100,
+               requested->slaveLatency, requested->connectionSupervisionTimeout * 10);
+    }
+}
+
+void connectionCallback(const Gap::ConnectionCallbackParams_t *params)
+{
+    connectionManager.connected(params, uptime.read_ms());
+    printNegotiated();
+}
+
 void disconnectionCallback(const Gap::DisconnectionCallbackParams_t *params)
 {
     (void) params;
+    connectionManager.disconnected();
     BLE::Instance().gap().startAdvertising();
 }
 
+/**
+ * Move the connection to the parameters matching the traffic.
+ */
+void pollConnection(void)
+{
+    bool streaming = connectionManager.isStreaming();
+    const Gap::ConnectionParams_t *requested = connectionManager.getRequested();
+
+    connectionManager.poll(uptime.read_ms());
+
+    if (connectionManager.isConnected() &&
+        (connectionManager.isStreaming() != streaming || connectionManager.getRequested() != requested)) {
+        printNegotiated();
+    }
+}
+
 void blinkCallback(void)
 {
     myLED = !myLED; /* Do blinky on LED1 to indicate system my. */
@@ -49,6 +111,7 @@ void blinkCallback(void)
 void onDataWrittenCallback(const GattWriteCallbackParams *params) {
     if ((params->handle == ledServicePtr->getValueHandle()) && (params->len == 1)) {
         actuatedLED = *(params->data);
+        connectionManager.activity(uptime.read_ms());
     }
 }
 
@@ -79,9 +142,12 @@ void bleInitComplete(BLE::InitializationCompleteCallbackContext *params)
         return;
     }
 
+    ble.gap().onConnection(connectionCallback);
     ble.gap().onDisconnection(disconnectionCallback);
     ble.gattServer().onDataWritten(onDataWrittenCallback);
 
+    connectionManager.init();
+
     bool initialValueForLEDCharacteristic = false;
     ledServicePtr = new LEDService(ble, initialValueForLEDCharacteristic);
 
@@ -101,7 +167,9 @@ void scheduleBleEventsProcessing(BLE::OnEventsToProcessCallbackContext* context)
 
 int main()
 {
+    uptime.start();
     eventQueue.call_every(500, blinkCallback);
+    eventQueue.call_every(500, pollConnection);
 
     BLE &ble = BLE::Instance();
     ble.onEventsToProcess(scheduleBleEventsProcessing);
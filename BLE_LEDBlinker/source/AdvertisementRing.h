@@ -0,0 +1 @@
+../../BLE_EddystoneObserver/source/AdvertisementRing.h
\ No newline at end of file
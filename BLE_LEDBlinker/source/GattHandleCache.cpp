@@ -0,0 +1,115 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2006-2015 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "GattHandleCache.h"
+#include "PersistentStorageHelper/GattHandleCachePersistence.h"
+
+GattHandleCache::GattHandleCache(void) :
+    useCount(0)
+{
+    memset(records, 0, sizeof(records));
+    memset(&stats, 0, sizeof(stats));
+}
+
+void GattHandleCache::load(void)
+{
+    if (!loadGattHandleCacheRecords(records, ENTRIES)) {
+        memset(records, 0, sizeof(records));
+    }
+
+    useCount = 0;
+    for (unsigned i = 0; i < ENTRIES; i++) {
+        if (records[i].valueHandle != 0 && records[i].lastUsed > useCount) {
+            useCount = records[i].lastUsed;
+        }
+    }
+}
+
+uint16_t GattHandleCache::find(const BLEProtocol::AddressBytes_t address, uint16_t serviceUUID, uint16_t characteristicUUID,
+                               uint16_t &cccdHandle)
+{
+    GattHandleCacheRecord_t *record = lookup(address, serviceUUID, characteristicUUID);
+    if (record == NULL) {
+        stats.misses++;
+        cccdHandle = 0;
+        return 0;
+    }
+
+    /* Not saved, to spare the flash */
+    record->lastUsed = ++useCount;
+    stats.hits++;
+    cccdHandle = record->cccdHandle;
+    return record->valueHandle;
+}
+
+void GattHandleCache::store(const BLEProtocol::AddressBytes_t address, uint16_t serviceUUID, uint16_t characteristicUUID,
+                            uint16_t valueHandle, uint16_t cccdHandle)
+{
+    GattHandleCacheRecord_t *record = lookup(address, serviceUUID, characteristicUUID);
+    if (record != NULL) {
+        if (record->valueHandle == valueHandle && record->cccdHandle == cccdHandle) {
+            return;
+        }
+        stats.stale++;
+    } else {
+        /* Take a free record, or the least recently used one */
+        record = &records[0];
+        for (unsigned i = 0; i < ENTRIES && record->valueHandle != 0; i++) {
+            if (records[i].valueHandle == 0 || records[i].lastUsed < record->lastUsed) {
+                record = &records[i];
+            }
+        }
+    }
+
+    memcpy(record->address, address, sizeof(record->address));
+    record->serviceUUID        = serviceUUID;
+    record->characteristicUUID = characteristicUUID;
+    record->valueHandle        = valueHandle;
+    record->cccdHandle         = cccdHandle;
+    record->lastUsed           = ++useCount;
+    save(record);
+}
+
+void GattHandleCache::invalidate(const BLEProtocol::AddressBytes_t address, uint16_t serviceUUID, uint16_t characteristicUUID)
+{
+    GattHandleCacheRecord_t *record = lookup(address, serviceUUID, characteristicUUID);
+    if (record == NULL) {
+        return;
+    }
+
+    record->valueHandle = 0;
+    record->cccdHandle  = 0;
+    stats.stale++;
+    save(record);
+}
+
+GattHandleCacheRecord_t *GattHandleCache::lookup(const BLEProtocol::AddressBytes_t address, uint16_t serviceUUID, uint16_t characteristicUUID)
+{
+    for (unsigned i = 0; i < ENTRIES; i++) {
+        GattHandleCacheRecord_t &record = records[i];
+        if (record.valueHandle != 0 && record.serviceUUID == serviceUUID &&
+            record.characteristicUUID == characteristicUUID &&
+            !memcmp(record.address, address, sizeof(record.address))) {
+            return &record;
+        }
+    }
+    return NULL;
+}
+
+void GattHandleCache::save(GattHandleCacheRecord_t *record)
+{
+    saveGattHandleCacheRecord(record - records, record);
+}
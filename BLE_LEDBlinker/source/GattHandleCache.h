@@ -0,0 +1,126 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2006-2015 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __GATTHANDLECACHE_H__
+#define __GATTHANDLECACHE_H__
+
+#include "ble/BLE.h"
+
+/**
+ * The handles of a characteristic discovered on a peer, as kept in the cache
+ * and in persistent storage.
+ */
+struct GattHandleCacheRecord_t {
+    BLEProtocol::AddressBytes_t address;
+    uint16_t                    serviceUUID;
+    uint16_t                    characteristicUUID;
+    /**
+     * The value handle of the characteristic, 0 if the record is unused.
+     */
+    uint16_t                    valueHandle;
+    /**
+     * The handle of the client characteristic configuration descriptor of
+     * the characteristic, 0 if it has none.
+     */
+    uint16_t                    cccdHandle;
+    /**
+     * Use counter, the least recently used record is replaced first. Only
+     * saved along with a new handle, so it is approximate after a reboot.
+     */
+    uint32_t                    lastUsed;
+};
+
+/**
+ * Statistics about the use of the cache since boot.
+ */
+struct GattHandleCacheStats_t {
+    uint32_t hits;
+    uint32_t misses;
+    /**
+     * Number of cached handles replaced by a new discovery, or invalidated.
+     */
+    uint32_t stale;
+};
+
+/**
+ * Cache of the characteristic handles discovered on peers, the value handle
+ * and the handle of the client characteristic configuration descriptor, so
+ * that a
+ * reconnection can skip service discovery. Records are keyed by the address
+ * of the peer and the UUIDs of the service and characteristic, and are
+ * saved to persistent storage when they change.
+ *
+ * A cached handle may be out of date if the peer changed its GATT database;
+ * PeripheralLink checks it against the characteristic declaration before
+ * use, and the hub discovers again on mismatch.
+ */
+class GattHandleCache
+{
+public:
+    static const unsigned ENTRIES = MBED_CONF_APP_GATT_HANDLE_CACHE_ENTRIES;
+
+    /**
+     * Construct an empty cache.
+     */
+    GattHandleCache(void);
+
+    /**
+     * Load the records from persistent storage. Should be called once BLE
+     * is initialized.
+     */
+    void load(void);
+
+    /**
+     * Look up the handles of a characteristic of a peer.
+     *
+     * @param[out] cccdHandle
+     *              The handle of the client characteristic configuration
+     *              descriptor, 0 if the characteristic has none or if it is
+     *              not cached.
+     *
+     * @return the value handle, or 0 if it is not cached.
+     */
+    uint16_t find(const BLEProtocol::AddressBytes_t address, uint16_t serviceUUID, uint16_t characteristicUUID,
+                  uint16_t &cccdHandle);
+
+    /**
+     * Record the handles of a characteristic of a peer, replacing the least
+     * recently used record if needed.
+     */
+    void store(const BLEProtocol::AddressBytes_t address, uint16_t serviceUUID, uint16_t characteristicUUID,
+               uint16_t valueHandle, uint16_t cccdHandle);
+
+    /**
+     * Forget the handles of a characteristic of a peer.
+     */
+    void invalidate(const BLEProtocol::AddressBytes_t address, uint16_t serviceUUID, uint16_t characteristicUUID);
+
+    const GattHandleCacheStats_t &getStats(void) const
+    {
+        return stats;
+    }
+
+private:
+    GattHandleCacheRecord_t *lookup(const BLEProtocol::AddressBytes_t address, uint16_t serviceUUID, uint16_t characteristicUUID);
+
+    void save(GattHandleCacheRecord_t *record);
+
+    GattHandleCacheRecord_t records[ENTRIES];
+    uint32_t                useCount;
+    GattHandleCacheStats_t  stats;
+};
+
+#endif  /* __GATTHANDLECACHE_H__ */
@@ -0,0 +1,458 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2006-2015 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "PeripheralLink.h"
+
+PeripheralLink::PeripheralLink(void) :
+    state(STATE_IDLE),
+    stateTime(0),
+    profile(NULL),
+    handle(0),
+    interval(0),
+    valueHandle(0),
+    cccdHandle(0),
+    characteristic(),
+    connectionTime(0),
+    dataSeen(false),
+    requestPending(false),
+    requestTime(0),
+    issuingCommands(false),
+    lastNotification(0),
+    notificationSeen(false)
+{
+    memset(address, 0, sizeof(address));
+    memset(&requests, 0, sizeof(requests));
+    memset(&commands, 0, sizeof(commands));
+    memset(&stats, 0, sizeof(stats));
+}
+
+void PeripheralLink::startConnecting(const Profile_t *profileIn, const BLEProtocol::AddressBytes_t addressIn, uint32_t now)
+{
+    profile = profileIn;
+    memcpy(address, addressIn, sizeof(address));
+    setState(STATE_CONNECTING, now);
+}
+
+void PeripheralLink::connected(Gap::Handle_t handleIn, uint16_t intervalIn, uint16_t cachedValueHandle, uint16_t cachedCCCDHandle,
+                               uint32_t now)
+{
+    handle           = handleIn;
+    interval         = intervalIn;
+    valueHandle      = cachedValueHandle;
+    cccdHandle       = (cachedValueHandle != 0) ? cachedCCCDHandle : 0;
+    connectionTime   = now;
+    dataSeen         = false;
+    requestPending   = false;
+    notificationSeen = false;
+    memset(&stats, 0, sizeof(stats));
+
+    if (valueHandle == 0) {
+        setState(STATE_DISCOVERY_PENDING, now);
+        return;
+    }
+    setState(STATE_VERIFYING, now);
+    if (!read(valueHandle - 1, declarationRead, now)) {
+        cachedHandlesStale(now);
+    }
+}
+
+void PeripheralLink::disconnected(uint32_t now)
+{
+    /* Idle first, so that callbacks can't queue new operations */
+    state = STATE_IDLE;
+
+    failRequests(BLE_ERROR_INVALID_STATE, now);
+    while (commands.count != 0) {
+        Operation_t operation = commands.front();
+        commands.pop();
+        notifyCompletion(operation, BLE_ERROR_INVALID_STATE, operation.value, operation.length, now);
+    }
+}
+
+void PeripheralLink::discoveryStarted(uint32_t now)
+{
+    setState(STATE_DISCOVERING, now);
+}
+
+void PeripheralLink::characteristicDiscovered(const DiscoveredCharacteristic *characteristicP)
+{
+    if (characteristicP->getUUID().getShortUUID() == profile->characteristicUUID) {
+        characteristic = *characteristicP;
+        valueHandle    = characteristic.getValueHandle();
+    }
+}
+
+bool PeripheralLink::discoveryTerminated(uint32_t now)
+{
+    if (valueHandle == 0) {
+        return false;
+    }
+
+    cccdHandle = 0;
+    const DiscoveredCharacteristic::Properties_t &properties = characteristic.getProperties();
+    if (properties.notify() || properties.indicate()) {
+        setState(STATE_DISCOVERING_DESCRIPTORS, now);
+        return true;
+    }
+    activate(now);
+    return true;
+}
+
+void PeripheralLink::descriptorDiscovered(const DiscoveredCharacteristicDescriptor &descriptor)
+{
+    if (descriptor.getUUID() == UUID(BLE_UUID_DESCRIPTOR_CLIENT_CHAR_CONFIG)) {
+        cccdHandle = descriptor.getAttributeHandle();
+    }
+}
+
+bool PeripheralLink::descriptorDiscoveryTerminated(ble_error_t status, uint32_t now)
+{
+    if (status != BLE_ERROR_NONE) {
+        return false;
+    }
+
+    activate(now);
+    return true;
+}
+
+bool PeripheralLink::read(uint16_t attribute, CompletionCallback_t callback, uint32_t now)
+{
+    if (!isOperational() || !setOperation(requests.push(), OPERATION_READ, attribute, NULL, 0, callback)) {
+        return false;
+    }
+    issueRequest(now);
+    return true;
+}
+
+bool PeripheralLink::write(uint16_t attribute, const uint8_t *value, uint8_t length, CompletionCallback_t callback, uint32_t now)
+{
+    if (!isOperational() || length > MAX_VALUE_SIZE ||
+        !setOperation(requests.push(), OPERATION_WRITE, attribute, value, length, callback)) {
+        return false;
+    }
+    issueRequest(now);
+    return true;
+}
+
+bool PeripheralLink::writeCommand(uint16_t attribute, const uint8_t *value, uint8_t length, CompletionCallback_t callback, uint32_t now)
+{
+    if (!isOperational() || length > MAX_VALUE_SIZE ||
+        !setOperation(commands.push(), OPERATION_WRITE_COMMAND, attribute, value, length, callback)) {
+        return false;
+    }
+    issueCommands(now);
+    return true;
+}
+
+bool PeripheralLink::subscribe(CompletionCallback_t callback, uint32_t now)
+{
+    static const uint8_t ENABLE_NOTIFICATIONS[] = {0x01, 0x00};
+    if (cccdHandle == 0) {
+        return false;
+    }
+    return write(cccdHandle, ENABLE_NOTIFICATIONS, sizeof(ENABLE_NOTIFICATIONS), callback, now);
+}
+
+void PeripheralLink::dataRead(const GattReadCallbackParams *params, uint32_t now)
+{
+    if (!requestPending || requests.front().type != OPERATION_READ || params->handle != requests.front().attribute) {
+        return;
+    }
+    completeRequest(params->data, params->len, now);
+}
+
+void PeripheralLink::dataWritten(const GattWriteCallbackParams *params, uint32_t now)
+{
+    if (!requestPending || requests.front().type != OPERATION_WRITE || params->handle != requests.front().attribute) {
+        return;
+    }
+    const Operation_t &operation = requests.front();
+    completeRequest(operation.value, operation.length, now);
+}
+
+void PeripheralLink::dataSent(uint32_t now)
+{
+    issueCommands(now);
+}
+
+void PeripheralLink::notified(const GattHVXCallbackParams *params, uint32_t now)
+{
+    if (params->handle != valueHandle) {
+        return;
+    }
+
+    if (notificationSeen && now - lastNotification > stats.maxGap) {
+        stats.maxGap = now - lastNotification;
+    }
+    lastNotification = now;
+    notificationSeen = true;
+    stats.notifications++;
+    stats.bytes += params->len;
+    dataReceived(now);
+}
+
+bool PeripheralLink::poll(uint32_t now)
+{
+    issueCommands(now);
+    if (!requestPending) {
+        issueRequest(now);
+        return true;
+    }
+    if ((now - requestTime) < OPERATION_TIMEOUT_MSEC) {
+        return true;
+    }
+
+    /* No other request can be issued on the connection */
+    failRequests(BLE_ERROR_UNSPECIFIED, now);
+    return false;
+}
+
+void PeripheralLink::printStats(unsigned index, uint32_t elapsed)
+{
+    if (state == STATE_IDLE) {
+        return;
+    }
+
+    printf("link %u %s [%02x %02x %02x %02x %02x %02x] ", index, profile->name,
+           address[5], address[4], address[3], address[2], address[1], address[0]);
+    if (state != STATE_ACTIVE) {
+        printf("state %u\r\n", state);
+        return;
+    }
+    if (elapsed == 0) {
+        elapsed = 1;
+    }
+
+    /* Operations per connection interval, in tenths: the interval is in
+     * 1.25 ms units */
+    uint32_t operations         = stats.requests + stats.commands;
+    uint32_t operationsInterval = (uint32_t) ((uint64_t) operations * interval * 25 / (2 * elapsed));
+    printf("%lu notifications/s, %lu B/s, max gap %lu ms, %lu requests/s, %lu commands/s, "
+           "%lu.%lu operations/interval, latency avg %lu max %lu ms\r\n",
+           (unsigned long) (stats.notifications * 1000 / elapsed), (unsigned long) (stats.bytes * 1000 / elapsed),
+           (unsigned long) stats.maxGap, (unsigned long) (stats.requests * 1000 / elapsed),
+           (unsigned long) (stats.commands * 1000 / elapsed),
+           (unsigned long) (operationsInterval / 10), (unsigned long) (operationsInterval % 10),
+           (unsigned long) (stats.requests ? stats.latencySum / stats.requests : 0), (unsigned long) stats.maxLatency);
+
+    memset(&stats, 0, sizeof(stats));
+}
+
+bool PeripheralLink::isFor(const BLEProtocol::AddressBytes_t peerAddress) const
+{
+    return (state != STATE_IDLE) && !memcmp(address, peerAddress, sizeof(address));
+}
+
+bool PeripheralLink::isBusy(ble_error_t error)
+{
+    return (error == BLE_STACK_BUSY) || (error == BLE_ERROR_NO_MEM);
+}
+
+bool PeripheralLink::hasCCCD(uint8_t properties)
+{
+    return (properties & (GattCharacteristic::BLE_GATT_CHAR_PROPERTIES_NOTIFY |
+                          GattCharacteristic::BLE_GATT_CHAR_PROPERTIES_INDICATE)) != 0;
+}
+
+void PeripheralLink::declarationRead(PeripheralLink *link, const Completion_t *completion, uint32_t now)
+{
+    if (link->state != STATE_VERIFYING) {
+        /* Disconnected while the read was pending */
+        return;
+    }
+
+    /* The declaration holds the properties, the value handle and the UUID. A
+     * characteristic that can be notified or indicated has a client
+     * characteristic configuration descriptor. If it can't be read, the
+     * handles are rediscovered rather than trusted */
+    const uint8_t *declaration = completion->data;
+    if ((completion->status != BLE_ERROR_NONE) ||
+        (completion->length != 5) ||
+        ((declaration[1] | (declaration[2] << 8)) != link->valueHandle) ||
+        ((declaration[3] | (declaration[4] << 8)) != link->profile->characteristicUUID) ||
+        (hasCCCD(declaration[0]) != (link->cccdHandle != 0))) {
+        link->cachedHandlesStale(now);
+        return;
+    }
+
+    if (link->cccdHandle == 0) {
+        link->activate(now);
+    } else if (!link->read(link->cccdHandle, cccdRead, now)) {
+        link->cachedHandlesStale(now);
+    }
+}
+
+void PeripheralLink::cccdRead(PeripheralLink *link, const Completion_t *completion, uint32_t now)
+{
+    if (link->state != STATE_VERIFYING) {
+        /* Disconnected while the read was pending */
+        return;
+    }
+
+    /* The descriptor holds the notification and indication bits */
+    if ((completion->status != BLE_ERROR_NONE) || (completion->length != 2)) {
+        link->cachedHandlesStale(now);
+        return;
+    }
+    link->activate(now);
+}
+
+void PeripheralLink::activate(uint32_t now)
+{
+    setState(STATE_ACTIVE, now);
+    profile->start(this, now);
+}
+
+void PeripheralLink::cachedHandlesStale(uint32_t now)
+{
+    printf("%s cached handles %u, %u are stale\r\n", profile->name, valueHandle, cccdHandle);
+    valueHandle = 0;
+    cccdHandle  = 0;
+    setState(STATE_DISCOVERY_PENDING, now);
+}
+
+void PeripheralLink::dataReceived(uint32_t now)
+{
+    if (dataSeen || state != STATE_ACTIVE) {
+        return;
+    }
+
+    dataSeen = true;
+    printf("%s first data %lu ms after connection\r\n", profile->name, (unsigned long) (now - connectionTime));
+}
+
+bool PeripheralLink::setOperation(Operation_t *operation, OperationType_t type, uint16_t attribute,
+                                  const uint8_t *value, uint8_t length, CompletionCallback_t callback)
+{
+    if (operation == NULL) {
+        return false;
+    }
+
+    operation->type      = type;
+    operation->attribute = attribute;
+    operation->length    = length;
+    operation->callback  = callback;
+    if (length != 0) {
+        memcpy(operation->value, value, length);
+    }
+    return true;
+}
+
+void PeripheralLink::notifyCompletion(const Operation_t &operation, ble_error_t status, const uint8_t *data, uint16_t length, uint32_t now)
+{
+    if (operation.callback == NULL) {
+        return;
+    }
+
+    Completion_t completion;
+    completion.type      = (OperationType_t) operation.type;
+    completion.attribute = operation.attribute;
+    completion.status    = status;
+    completion.data      = data;
+    completion.length    = length;
+    operation.callback(this, &completion, now);
+}
+
+void PeripheralLink::issueRequest(uint32_t now)
+{
+    while (!requestPending && requests.count != 0 && isOperational()) {
+        GattClient        &client    = BLE::Instance().gattClient();
+        const Operation_t &operation = requests.front();
+        ble_error_t        error;
+        if (operation.type == OPERATION_READ) {
+            error = client.read(handle, operation.attribute, 0);
+        } else {
+            error = client.write(GattClient::GATT_OP_WRITE_REQ, handle, operation.attribute, operation.length, operation.value);
+        }
+
+        if (error == BLE_ERROR_NONE) {
+            requestPending = true;
+            requestTime    = now;
+        } else if (isBusy(error)) {
+            /* Retried by poll() */
+            return;
+        } else {
+            Operation_t failed = operation;
+            requests.pop();
+            notifyCompletion(failed, error, failed.value, 0, now);
+        }
+    }
+}
+
+void PeripheralLink::issueCommands(uint32_t now)
+{
+    if (issuingCommands) {
+        return;
+    }
+
+    issuingCommands = true;
+    while (commands.count != 0 && isOperational()) {
+        Operation_t operation = commands.front();
+        ble_error_t error     = BLE::Instance().gattClient().write(GattClient::GATT_OP_WRITE_CMD, handle, operation.attribute,
+                                                                    operation.length, operation.value);
+        if (isBusy(error)) {
+            /* The stack buffers are full, resumed by dataSent() */
+            break;
+        }
+
+        commands.pop();
+        if (error == BLE_ERROR_NONE) {
+            stats.commands++;
+        }
+        notifyCompletion(operation, error, operation.value, operation.length, now);
+    }
+    issuingCommands = false;
+}
+
+void PeripheralLink::completeRequest(const uint8_t *data, uint16_t length, uint32_t now)
+{
+    uint32_t latency = now - requestTime;
+    stats.requests++;
+    stats.latencySum += latency;
+    if (latency > stats.maxLatency) {
+        stats.maxLatency = latency;
+    }
+
+    /* The callback may queue operations, and data may point into the
+     * operation being popped */
+    Operation_t operation = requests.front();
+    if (data == requests.front().value) {
+        data = operation.value;
+    }
+    requests.pop();
+    requestPending = false;
+    if (operation.type == OPERATION_READ && length != 0) {
+        dataReceived(now);
+    }
+    notifyCompletion(operation, BLE_ERROR_NONE, data, length, now);
+    issueRequest(now);
+}
+
+void PeripheralLink::failRequests(ble_error_t status, uint32_t now)
+{
+    while (requests.count != 0) {
+        Operation_t operation = requests.front();
+        requests.pop();
+        notifyCompletion(operation, status, operation.value, 0, now);
+    }
+    requestPending = false;
+}
+
+void PeripheralLink::setState(State_t newState, uint32_t now)
+{
+    state     = newState;
+    stateTime = now;
+}
@@ -0,0 +1,532 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2006-2015 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __PERIPHERALLINK_H__
+#define __PERIPHERALLINK_H__
+
+#include "ble/BLE.h"
+#include "ble/DiscoveredCharacteristic.h"
+
+/**
+ * The connection of the hub to one peripheral: its state machine, its queues
+ * of GATT operations and its statistics.
+ *
+ * ATT allows a single request in flight on a connection, so read and write
+ * requests are queued and issued one at a time, each waiting for its
+ * response. Write commands have no response: they are queued separately and
+ * handed to the stack back to back, also while a request is pending, until
+ * its buffers are full; dataSent() resumes them. Notifications are not
+ * queued at all.
+ *
+ * An operation can have a completion callback, called when a request gets
+ * its response or a command is handed to the stack, or with an error status
+ * when the operation is dropped. A request without response within
+ * OPERATION_TIMEOUT_MSEC fails the link, as ATT allows no other request on
+ * the connection after that.
+ *
+ * The client characteristic configuration descriptor of a characteristic
+ * that can be notified or indicated is found by discovering the descriptors
+ * of the characteristic, once its service discovery ends.
+ *
+ * A link reconnecting to a peer whose handles are cached skips service
+ * discovery: it reads the characteristic declaration, which precedes the
+ * value, and the cached descriptor if any. It becomes active if the
+ * declaration still points to the value with the expected UUID, and if the
+ * descriptor is still a 2 byte value. On mismatch it falls back to discovery.
+ *
+ * The scheduling of the connections and of the service discoveries, which
+ * the stack can only run one at a time, is left to the hub.
+ */
+class PeripheralLink
+{
+public:
+    enum OperationType_t {
+        OPERATION_READ,
+        OPERATION_WRITE,
+        OPERATION_WRITE_COMMAND
+    };
+
+    /**
+     * Outcome of an operation, passed to its completion callback.
+     */
+    struct Completion_t {
+        OperationType_t type;
+        uint16_t        attribute;
+        /**
+         * BLE_ERROR_NONE if the operation succeeded.
+         */
+        ble_error_t     status;
+        /**
+         * The value read or written, valid during the callback.
+         */
+        const uint8_t  *data;
+        uint16_t        length;
+    };
+
+    typedef void (*CompletionCallback_t)(PeripheralLink *link, const Completion_t *completion, uint32_t now);
+
+    /**
+     * Kind of peripheral the hub connects to.
+     */
+    struct Profile_t {
+        /**
+         * Complete local name the peripheral advertises, also used in the
+         * console output.
+         */
+        const char *name;
+        /**
+         * Service the peripheral advertises, and the characteristic used.
+         */
+        uint16_t    serviceUUID;
+        uint16_t    characteristicUUID;
+        /**
+         * Called once the characteristic is discovered, to queue the first
+         * operations of the link.
+         */
+        void      (*start)(PeripheralLink *link, uint32_t now);
+    };
+
+    enum State_t {
+        STATE_IDLE,
+        STATE_CONNECTING,
+        /**
+         * Connected, waiting for its turn to discover the characteristic.
+         */
+        STATE_DISCOVERY_PENDING,
+        STATE_DISCOVERING,
+        /**
+         * Discovering the descriptors of the characteristic, launched by the
+         * hub once discoveryTerminated() moved the link to this state.
+         */
+        STATE_DISCOVERING_DESCRIPTORS,
+        /**
+         * Checking the cached handles.
+         */
+        STATE_VERIFYING,
+        STATE_ACTIVE
+    };
+
+    /**
+     * Number of requests and of write commands that can be queued on a link.
+     */
+    static const uint8_t  REQUEST_QUEUE_SIZE     = 4;
+    static const uint8_t  COMMAND_QUEUE_SIZE     = 8;
+    /**
+     * Largest value written, the payload of the default ATT MTU.
+     */
+    static const uint8_t  MAX_VALUE_SIZE         = 20;
+    /**
+     * Time after which a request without response fails the link.
+     */
+    static const uint32_t OPERATION_TIMEOUT_MSEC = 5000;
+
+    /**
+     * Construct an idle link.
+     */
+    PeripheralLink(void);
+
+    /**
+     * Start connecting to a peripheral.
+     *
+     * @param[in] profile
+     *              The kind of peripheral.
+     * @param[in] address
+     *              The address of the peripheral.
+     * @param[in] now
+     *              The current time in milliseconds.
+     */
+    void startConnecting(const Profile_t *profile, const BLEProtocol::AddressBytes_t address, uint32_t now);
+
+    /**
+     * Called when the connection is established.
+     *
+     * @param[in] handle
+     *              The handle of the connection.
+     * @param[in] interval
+     *              The connection interval, in 1.25 ms units.
+     * @param[in] cachedValueHandle
+     *              The value handle of the characteristic found on a previous
+     *              connection, or 0 to discover it.
+     * @param[in] cachedCCCDHandle
+     *              The handle of the client characteristic configuration
+     *              descriptor found along with cachedValueHandle, or 0 if the
+     *              characteristic has none.
+     * @param[in] now
+     *              The current time in milliseconds.
+     */
+    void connected(Gap::Handle_t handle, uint16_t interval, uint16_t cachedValueHandle, uint16_t cachedCCCDHandle, uint32_t now);
+
+    /**
+     * Called when the connection is lost or could not be established. The
+     * link becomes idle and its queued operations fail.
+     */
+    void disconnected(uint32_t now);
+
+    /**
+     * Called when the service discovery of the link is launched.
+     */
+    void discoveryStarted(uint32_t now);
+
+    /**
+     * Called for each characteristic discovered.
+     */
+    void characteristicDiscovered(const DiscoveredCharacteristic *characteristic);
+
+    /**
+     * Called when the service discovery ends. Moves the link to
+     * STATE_DISCOVERING_DESCRIPTORS if the characteristic can be notified or
+     * indicated, or else starts the profile.
+     *
+     * @return false if the characteristic was not found.
+     */
+    bool discoveryTerminated(uint32_t now);
+
+    /**
+     * Called for each descriptor of the characteristic discovered.
+     */
+    void descriptorDiscovered(const DiscoveredCharacteristicDescriptor &descriptor);
+
+    /**
+     * Called when the descriptor discovery ends. Starts the profile.
+     *
+     * @param[in] status
+     *              The status of the descriptor discovery.
+     * @param[in] now
+     *              The current time in milliseconds.
+     *
+     * @return false if the discovery failed.
+     */
+    bool descriptorDiscoveryTerminated(ble_error_t status, uint32_t now);
+
+    /**
+     * Queue a read request.
+     *
+     * @param[in] attribute
+     *              The handle of the attribute.
+     * @param[in] callback
+     *              Called with the value read, or NULL.
+     * @param[in] now
+     *              The current time in milliseconds.
+     *
+     * @return false if the link is not active or its queue is full.
+     */
+    bool read(uint16_t attribute, CompletionCallback_t callback, uint32_t now);
+
+    /**
+     * Queue a write request.
+     *
+     * @param[in] attribute
+     *              The handle of the attribute.
+     * @param[in] value
+     *              The value, copied.
+     * @param[in] length
+     *              The length of the value, at most MAX_VALUE_SIZE.
+     * @param[in] callback
+     *              Called once the peripheral acknowledged the write, or NULL.
+     * @param[in] now
+     *              The current time in milliseconds.
+     *
+     * @return false if the link is not active or its queue is full.
+     */
+    bool write(uint16_t attribute, const uint8_t *value, uint8_t length, CompletionCallback_t callback, uint32_t now);
+
+    /**
+     * Queue a write command, which is not acknowledged by the peripheral.
+     * The callback is called once the stack accepted it.
+     *
+     * @see write()
+     */
+    bool writeCommand(uint16_t attribute, const uint8_t *value, uint8_t length, CompletionCallback_t callback, uint32_t now);
+
+    /**
+     * Enable the notifications of the characteristic, by writing its client
+     * characteristic configuration descriptor.
+     *
+     * @return false if the characteristic has no such descriptor, if the
+     *         link is not active or if its queue is full.
+     */
+    bool subscribe(CompletionCallback_t callback, uint32_t now);
+
+    /**
+     * Called when a read response arrives on the connection.
+     */
+    void dataRead(const GattReadCallbackParams *params, uint32_t now);
+
+    /**
+     * Called when a write response arrives on the connection.
+     */
+    void dataWritten(const GattWriteCallbackParams *params, uint32_t now);
+
+    /**
+     * Called when the stack sent packets, and has room for more commands.
+     */
+    void dataSent(uint32_t now);
+
+    /**
+     * Called when a notification or indication arrives on the connection.
+     */
+    void notified(const GattHVXCallbackParams *params, uint32_t now);
+
+    /**
+     * Retry the operations the stack was too busy to accept, and check the
+     * timeout of the pending request. Should be called periodically.
+     *
+     * @return false if the pending request timed out.
+     */
+    bool poll(uint32_t now);
+
+    /**
+     * Print and reset the statistics gathered since the last call.
+     *
+     * @param[in] index
+     *              The index of the link, printed.
+     * @param[in] elapsed
+     *              The time since the last call in milliseconds.
+     */
+    void printStats(unsigned index, uint32_t elapsed);
+
+    State_t getState(void) const
+    {
+        return state;
+    }
+
+    Gap::Handle_t getHandle(void) const
+    {
+        return handle;
+    }
+
+    const Profile_t *getProfile(void) const
+    {
+        return profile;
+    }
+
+    /**
+     * Get the value handle of the characteristic of the profile.
+     */
+    uint16_t getValueHandle(void) const
+    {
+        return valueHandle;
+    }
+
+    /**
+     * Get the handle of the client characteristic configuration descriptor of
+     * the characteristic, 0 if it has none.
+     */
+    uint16_t getCCCDHandle(void) const
+    {
+        return cccdHandle;
+    }
+
+    /**
+     * Get the characteristic found by the service discovery, valid in
+     * STATE_DISCOVERING_DESCRIPTORS.
+     */
+    const DiscoveredCharacteristic &getCharacteristic(void) const
+    {
+        return characteristic;
+    }
+
+    /**
+     * Get the address of the peer.
+     */
+    const uint8_t *getAddress(void) const
+    {
+        return address;
+    }
+
+    /**
+     * Get the number of write commands that can still be queued.
+     */
+    uint8_t getCommandSpace(void) const
+    {
+        return COMMAND_QUEUE_SIZE - commands.count;
+    }
+
+    /**
+     * Get the time the link entered its current state.
+     */
+    uint32_t getStateTime(void) const
+    {
+        return stateTime;
+    }
+
+    /**
+     * Whether the link is connected or connecting to an address.
+     */
+    bool isFor(const BLEProtocol::AddressBytes_t peerAddress) const;
+
+private:
+    struct Operation_t {
+        uint8_t              type;
+        uint8_t              length;
+        uint16_t             attribute;
+        CompletionCallback_t callback;
+        uint8_t              value[MAX_VALUE_SIZE];
+    };
+
+    /**
+     * Fixed size FIFO of operations.
+     */
+    template <unsigned SIZE>
+    struct OperationQueue_t {
+        Operation_t operations[SIZE];
+        uint8_t     head;
+        uint8_t     count;
+
+        Operation_t &front(void)
+        {
+            return operations[head];
+        }
+
+        Operation_t *push(void)
+        {
+            if (count == SIZE) {
+                return NULL;
+            }
+            return &operations[(head + count++) % SIZE];
+        }
+
+        void pop(void)
+        {
+            head = (head + 1) % SIZE;
+            count--;
+        }
+    };
+
+    /**
+     * Statistics over a reporting period.
+     */
+    struct Stats_t {
+        uint32_t notifications;
+        uint32_t bytes;
+        uint32_t maxGap;
+        uint32_t requests;
+        uint32_t commands;
+        uint32_t latencySum;
+        uint32_t maxLatency;
+    };
+
+    static bool isBusy(ble_error_t error);
+
+    /**
+     * Whether a characteristic with these properties has a client
+     * characteristic configuration descriptor.
+     */
+    static bool hasCCCD(uint8_t properties);
+
+    /**
+     * Completion of the read of the characteristic declaration.
+     */
+    static void declarationRead(PeripheralLink *link, const Completion_t *completion, uint32_t now);
+
+    /**
+     * Completion of the read of the cached client characteristic
+     * configuration descriptor.
+     */
+    static void cccdRead(PeripheralLink *link, const Completion_t *completion, uint32_t now);
+
+    /**
+     * Start the profile once the handles are known.
+     */
+    void activate(uint32_t now);
+
+    /**
+     * Drop the cached handles, found out of date, and wait for a discovery.
+     */
+    void cachedHandlesStale(uint32_t now);
+
+    /**
+     * Whether operations can be issued.
+     */
+    bool isOperational(void) const
+    {
+        return (state == STATE_VERIFYING) || (state == STATE_ACTIVE);
+    }
+
+    /**
+     * Record the time of the first data received on the connection.
+     */
+    void dataReceived(uint32_t now);
+
+    /**
+     * Fill an operation pushed on a queue.
+     */
+    static bool setOperation(Operation_t *operation, OperationType_t type, uint16_t attribute,
+                             const uint8_t *value, uint8_t length, CompletionCallback_t callback);
+
+    /**
+     * Call the completion callback of an operation.
+     */
+    void notifyCompletion(const Operation_t &operation, ble_error_t status, const uint8_t *data, uint16_t length, uint32_t now);
+
+    /**
+     * Issue the request at the head of the queue if none is pending.
+     */
+    void issueRequest(uint32_t now);
+
+    /**
+     * Hand the queued commands to the stack until it is full.
+     */
+    void issueCommands(uint32_t now);
+
+    /**
+     * Complete the pending request and issue the next one.
+     */
+    void completeRequest(const uint8_t *data, uint16_t length, uint32_t now);
+
+    /**
+     * Drop the pending and queued requests.
+     */
+    void failRequests(ble_error_t status, uint32_t now);
+
+    void setState(State_t newState, uint32_t now);
+
+    State_t                                 state;
+    uint32_t                                stateTime;
+    const Profile_t                        *profile;
+    BLEProtocol::AddressBytes_t             address;
+    Gap::Handle_t                           handle;
+    uint16_t                                interval;
+    uint16_t                                valueHandle;
+    uint16_t                                cccdHandle;
+    DiscoveredCharacteristic                characteristic;
+    /**
+     * Time the connection was established, and whether data was received
+     * since, to measure the latency of the first data.
+     */
+    uint32_t                                connectionTime;
+    bool                                    dataSeen;
+
+    OperationQueue_t<REQUEST_QUEUE_SIZE>    requests;
+    bool                                    requestPending;
+    uint32_t                                requestTime;
+    OperationQueue_t<COMMAND_QUEUE_SIZE>    commands;
+    /**
+     * Set while issueCommands() runs, as the callbacks it calls may queue
+     * more commands.
+     */
+    bool                                    issuingCommands;
+
+    Stats_t                                 stats;
+    /**
+     * Time of the last notification, valid if notificationSeen, to measure
+     * the gaps across reporting periods.
+     */
+    uint32_t                                lastNotification;
+    bool                                    notificationSeen;
+};
+
+#endif  /* __PERIPHERALLINK_H__ */
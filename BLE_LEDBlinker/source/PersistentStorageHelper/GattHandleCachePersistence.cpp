@@ -0,0 +1,46 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2006-2015 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "GattHandleCachePersistence.h"
+
+#if !defined(TARGET_NRF51822) && !defined(TARGET_NRF5) /* Persistent storage supported on nrf5x platforms */
+    /**
+     * When not using an nRF5x-based target then persistent storage is not available.
+     */
+    #warning "The GATT handle cache is not configured to be stored in non-volatile memory"
+
+    bool loadGattHandleCacheRecords(GattHandleCacheRecord_t *recordsP, size_t count)
+    {
+        /* Avoid compiler warnings */
+        (void) recordsP;
+        (void) count;
+
+        /*
+         * Do nothing and let the cache start empty
+         */
+        return false;
+    }
+
+    void saveGattHandleCacheRecord(size_t index, const GattHandleCacheRecord_t *recordP)
+    {
+        /* Avoid compiler warnings */
+        (void) index;
+        (void) recordP;
+
+        /* Do nothing... */
+        return;
+    }
+#endif /* #if !defined(TARGET_NRF51822) && !defined(TARGET_NRF5) */
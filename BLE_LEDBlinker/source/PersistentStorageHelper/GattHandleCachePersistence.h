@@ -0,0 +1,50 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2006-2015 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __GATT_HANDLE_CACHE_PERSISTENCE_H__
+#define __GATT_HANDLE_CACHE_PERSISTENCE_H__
+
+#include "../GattHandleCache.h"
+
+/**
+ * Generic API to load the GATT handle cache records from persistent storage.
+ *
+ * @param[out] recordsP
+ *                 The records to be filled in from persistent storage.
+ *                 Records that were never saved or are corrupted are zeroed,
+ *                 which marks them unused.
+ * @param[in] count
+ *                 The number of records, GattHandleCache::ENTRIES.
+ *
+ * @return true if persistent storage is available.
+ */
+bool loadGattHandleCacheRecords(GattHandleCacheRecord_t *recordsP, size_t count);
+
+/**
+ * Generic API to save a GATT handle cache record to persistent storage.
+ *
+ * @param[in] index
+ *                 The index of the record.
+ * @param[in] recordP
+ *                 The record, copied.
+ *
+ * @note The save operation is asynchronous. A record saved again while its
+ *       previous save is in progress is written once that save completes,
+ *       with the value of the last save.
+ */
+void saveGattHandleCacheRecord(size_t index, const GattHandleCacheRecord_t *recordP);
+
+#endif /* #ifndef __GATT_HANDLE_CACHE_PERSISTENCE_H__*/
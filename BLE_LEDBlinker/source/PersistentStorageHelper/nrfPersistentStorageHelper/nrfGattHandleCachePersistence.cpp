@@ -0,0 +1,188 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2006-2015 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#if defined(TARGET_NRF51822) || defined(TARGET_NRF5) /* Persistent storage supported on nrf5x platforms */
+
+extern "C" {
+    #include "pstorage.h"
+}
+
+#include <stddef.h>
+#include "nrf_error.h"
+#include "../GattHandleCachePersistence.h"
+
+/*
+ * Each record of the cache has its own pstorage block, rewritten in place
+ * with pstorage_update() when the record changes. Records only change after
+ * a service discovery, so the flash wears slowly.
+ */
+
+/**
+ * A record as stored in flash. The size is a multiple of 4 bytes as required
+ * by pstorage.
+ */
+struct FlashRecord_t {
+    GattHandleCacheRecord_t record;
+    uint16_t                crc;        /* CRC-16/CCITT of record, detects erased and torn blocks */
+    uint16_t                reserved;
+};
+
+/* Compile time check, C++98 has no static_assert */
+typedef char FlashRecordSizeCheck[(sizeof(FlashRecord_t) % 4 == 0) ? 1 : -1];
+
+static const size_t NUM_RECORDS = GattHandleCache::ENTRIES;
+
+/**
+ * The pstorage APIs don't copy in the memory provided as data source, so
+ * every record has a buffer that must stay untouched until pstorage reports
+ * that it has been written.
+ */
+static FlashRecord_t            pendingRecords[NUM_RECORDS];
+static volatile bool            recordPending[NUM_RECORDS];
+
+/**
+ * A record saved again while its previous update is in progress is kept
+ * here, and marked dirty, until that update completes.
+ */
+static GattHandleCacheRecord_t  dirtyRecords[NUM_RECORDS];
+static volatile bool            recordDirty[NUM_RECORDS];
+
+static pstorage_handle_t        pstorageHandle;
+static bool                     storageInitialised = false;
+static bool                     storageAvailable   = false;
+
+/**
+ * CRC-16/CCITT (polynomial 0x1021, initial value 0xFFFF).
+ */
+static uint16_t crc16(const uint8_t *data, size_t length)
+{
+    uint16_t crc = 0xFFFF;
+    while (length--) {
+        crc ^= (uint16_t)(*data++) << 8;
+        for (uint8_t bit = 0; bit < 8; bit++) {
+            crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x1021) : (uint16_t)(crc << 1);
+        }
+    }
+    return crc;
+}
+
+/**
+ * Start the update of the block of a record.
+ */
+static void updateRecord(size_t index, const GattHandleCacheRecord_t *recordP)
+{
+    FlashRecord_t *flashRecord = &pendingRecords[index];
+    memcpy(&flashRecord->record, recordP, sizeof(GattHandleCacheRecord_t));
+    flashRecord->crc      = crc16(reinterpret_cast<const uint8_t *>(&flashRecord->record), sizeof(GattHandleCacheRecord_t));
+    flashRecord->reserved = 0xFFFF;
+
+    pstorage_handle_t blockHandle;
+    pstorage_block_identifier_get(&pstorageHandle, index, &blockHandle);
+
+    recordPending[index] = true;
+    if (pstorage_update(&blockHandle, reinterpret_cast<uint8_t *>(flashRecord), sizeof(FlashRecord_t), 0) != NRF_SUCCESS) {
+        recordPending[index] = false;
+    }
+}
+
+/**
+ * Callback handler needed by Nordic's pstorage module. This is called after
+ * every flash access and releases the buffers of the updated records. Records
+ * saved again meanwhile are written with their latest value.
+ */
+static void pstorageNotificationCallback(pstorage_handle_t *p_handle,
+                                         uint8_t            op_code,
+                                         uint32_t           result,
+                                         uint8_t           *p_data,
+                                         uint32_t           data_len)
+{
+    /* Supress compiler warnings */
+    (void) p_handle;
+    (void) result;
+    (void) data_len;
+
+    if (op_code == PSTORAGE_UPDATE_OP_CODE) {
+        size_t index = reinterpret_cast<FlashRecord_t *>(p_data) - pendingRecords;
+        if (index < NUM_RECORDS) {
+            recordPending[index] = false;
+            if (recordDirty[index]) {
+                recordDirty[index] = false;
+                updateRecord(index, &dirtyRecords[index]);
+            }
+        }
+    }
+}
+
+static void initialiseStorage(void)
+{
+    if (storageInitialised) {
+        return;
+    }
+    storageInitialised = true;
+
+    pstorage_init();
+
+    static pstorage_module_param_t pstorageParams = {
+        .cb          = pstorageNotificationCallback,
+        .block_size  = sizeof(FlashRecord_t),
+        .block_count = NUM_RECORDS
+    };
+    if (pstorage_register(&pstorageParams, &pstorageHandle) == NRF_SUCCESS) {
+        storageAvailable = true;
+    }
+}
+
+/* Platform-specific implementation for persistence on the nRF5x. Based on the
+ * pstorage module provided by the Nordic SDK. */
+bool loadGattHandleCacheRecords(GattHandleCacheRecord_t *recordsP, size_t count)
+{
+    initialiseStorage();
+    if (!storageAvailable || count != NUM_RECORDS) {
+        return false;
+    }
+
+    /* Flash is memory mapped, records are read in place */
+    const FlashRecord_t *stored = reinterpret_cast<const FlashRecord_t *>(pstorageHandle.block_id);
+    for (size_t i = 0; i < count; i++) {
+        if (stored[i].crc == crc16(reinterpret_cast<const uint8_t *>(&stored[i].record), sizeof(GattHandleCacheRecord_t))) {
+            memcpy(&recordsP[i], &stored[i].record, sizeof(GattHandleCacheRecord_t));
+        } else {
+            memset(&recordsP[i], 0, sizeof(GattHandleCacheRecord_t));
+        }
+    }
+    return true;
+}
+
+/* Platform-specific implementation for persistence on the nRF5x. Based on the
+ * pstorage module provided by the Nordic SDK. */
+void saveGattHandleCacheRecord(size_t index, const GattHandleCacheRecord_t *recordP)
+{
+    initialiseStorage();
+    if (!storageAvailable || index >= NUM_RECORDS) {
+        return;
+    }
+
+    if (recordPending[index]) {
+        /* Written by pstorageNotificationCallback() once the update in
+         * progress completes */
+        memcpy(&dirtyRecords[index], recordP, sizeof(GattHandleCacheRecord_t));
+        recordDirty[index] = true;
+        return;
+    }
+    updateRecord(index, recordP);
+}
+
+#endif /* #if defined(TARGET_NRF51822) || defined(TARGET_NRF5) */
@@ -0,0 +1,256 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2006-2015 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __SCANRESPONSECACHE_H__
+#define __SCANRESPONSECACHE_H__
+
+#include <string.h>
+#include "AdvertisementRing.h"
+
+/**
+ * An advertisement merged with the scan response of the same device.
+ */
+struct MergedAdvertisement_t {
+    /**
+     * The us_ticker time at which the advertisement was received.
+     */
+    uint32_t                    timestamp;
+    BLEProtocol::AddressBytes_t peerAddr;
+    /**
+     * The RSSI of the advertisement.
+     */
+    int8_t                      rssi;
+    uint8_t                     type;
+    uint8_t                     advertisingDataLen;
+    /**
+     * The length of the scan response data, 0 if there is none.
+     */
+    uint8_t                     scanResponseLen;
+    /**
+     * The advertising data followed by the scan response data. They must be
+     * parsed separately, the advertising data may end with padding.
+     */
+    uint8_t                     data[2 * GapAdvertisingData::GAP_ADVERTISING_DATA_MAX_PAYLOAD];
+};
+
+/**
+ * Pair the advertisements of scannable devices with their scan responses
+ * when scanning actively, so that consumers see a single record holding
+ * both payloads.
+ *
+ * An advertisement of a scannable type is held until the scan response of
+ * the same address arrives, normally within the same advertising event. The
+ * last scan response of each address is cached, and merged into the
+ * advertisements whose own response is missed. Entries are recycled in
+ * least recently used order.
+ *
+ * add() and expire() return at most one merged record per call: the
+ * completed pair, or an advertisement that stopped waiting for its scan
+ * response.
+ *
+ * @tparam ENTRIES
+ *              The number of addresses cached.
+ */
+template <unsigned ENTRIES>
+class ScanResponseCache
+{
+public:
+    /**
+     * Time an advertisement waits for its scan response, in microseconds.
+     */
+    static const uint32_t PENDING_TIMEOUT_USEC  = 10000;
+    /**
+     * Age after which a cached scan response is no longer merged into
+     * advertisements, in microseconds.
+     */
+    static const uint32_t RESPONSE_MAX_AGE_USEC = 10000000;
+
+    /**
+     * Construct an empty cache.
+     */
+    ScanResponseCache(void) : useCount(0)
+    {
+        memset(entries, 0, sizeof(entries));
+    }
+
+    /**
+     * Add an advertisement report.
+     *
+     * @param[in] report
+     *              The advertisement or scan response received.
+     * @param[out] merged
+     *              The merged record, if one is ready.
+     *
+     * @return true if a merged record was written.
+     */
+    bool add(const AdvertisementReport_t &report, MergedAdvertisement_t &merged)
+    {
+        if (!report.isScanResponse && !isScannable(report.type)) {
+            /* No scan response to wait for */
+            merge(report, NULL, merged);
+            return true;
+        }
+
+        bool   ready = false;
+        Entry *entry = find(report.peerAddr);
+        if (entry == NULL) {
+            entry = recycle(merged, ready);
+            memcpy(entry->address, report.peerAddr, sizeof(entry->address));
+        }
+        entry->lastUsed = ++useCount;
+
+        if (!report.isScanResponse) {
+            if (entry->pending) {
+                /* The scan response of the previous advertisement was missed */
+                merge(entry->advertisement, entry, merged);
+                ready = true;
+            }
+            entry->advertisement = report;
+            entry->pending       = true;
+            return ready;
+        }
+
+        entry->responseTime = report.timestamp;
+        entry->responseLen  = report.advertisingDataLen;
+        memcpy(entry->response, report.advertisingData, report.advertisingDataLen);
+        if (entry->pending) {
+            /* An entry with a pending advertisement is never recycled for a
+             * scan response, so nothing was written to merged yet */
+            merge(entry->advertisement, entry, merged);
+            entry->pending = false;
+            return true;
+        }
+        return ready;
+    }
+
+    /**
+     * Release an advertisement that waited too long for its scan response.
+     * Should be called until it returns false when no reports are waiting
+     * to be added.
+     *
+     * @param[in] now
+     *              The us_ticker time.
+     * @param[out] merged
+     *              The merged record, if one is ready.
+     *
+     * @return true if a merged record was written.
+     */
+    bool expire(uint32_t now, MergedAdvertisement_t &merged)
+    {
+        for (unsigned i = 0; i < ENTRIES; i++) {
+            Entry &entry = entries[i];
+            if (entry.pending && (now - entry.advertisement.timestamp) >= PENDING_TIMEOUT_USEC) {
+                merge(entry.advertisement, &entry, merged);
+                entry.pending = false;
+                return true;
+            }
+        }
+        return false;
+    }
+
+private:
+    struct Entry {
+        BLEProtocol::AddressBytes_t address;
+        /**
+         * Whether the entry is in use.
+         */
+        bool                        valid;
+        /**
+         * Whether the advertisement waits for its scan response.
+         */
+        bool                        pending;
+        uint32_t                    lastUsed;
+        AdvertisementReport_t       advertisement;
+        /**
+         * The last scan response, responseLen is 0 if there is none.
+         */
+        uint32_t                    responseTime;
+        uint8_t                     responseLen;
+        uint8_t                     response[GapAdvertisingData::GAP_ADVERTISING_DATA_MAX_PAYLOAD];
+    };
+
+    static bool isScannable(uint8_t type)
+    {
+        return (type == GapAdvertisingParams::ADV_CONNECTABLE_UNDIRECTED) ||
+               (type == GapAdvertisingParams::ADV_SCANNABLE_UNDIRECTED);
+    }
+
+    Entry *find(const BLEProtocol::AddressBytes_t address)
+    {
+        for (unsigned i = 0; i < ENTRIES; i++) {
+            if (entries[i].valid && !memcmp(entries[i].address, address, sizeof(entries[i].address))) {
+                return &entries[i];
+            }
+        }
+        return NULL;
+    }
+
+    /**
+     * Take a free entry, or the least recently used one. Prefers entries
+     * without a pending advertisement; if there is none, the pending
+     * advertisement is released into merged.
+     */
+    Entry *recycle(MergedAdvertisement_t &merged, bool &ready)
+    {
+        Entry *victim = NULL;
+        for (unsigned i = 0; i < ENTRIES; i++) {
+            Entry &entry = entries[i];
+            if (!entry.valid) {
+                victim = &entry;
+                break;
+            }
+            if (victim == NULL || (victim->pending && !entry.pending) ||
+                (victim->pending == entry.pending && (int32_t) (entry.lastUsed - victim->lastUsed) < 0)) {
+                victim = &entry;
+            }
+        }
+
+        if (victim->valid && victim->pending) {
+            merge(victim->advertisement, victim, merged);
+            ready = true;
+        }
+        victim->valid       = true;
+        victim->pending     = false;
+        victim->responseLen = 0;
+        return victim;
+    }
+
+    /**
+     * Build a merged record from an advertisement and the cached scan
+     * response of an entry, if it is recent enough.
+     */
+    static void merge(const AdvertisementReport_t &advertisement, const Entry *entry, MergedAdvertisement_t &merged)
+    {
+        merged.timestamp          = advertisement.timestamp;
+        memcpy(merged.peerAddr, advertisement.peerAddr, sizeof(merged.peerAddr));
+        merged.rssi               = advertisement.rssi;
+        merged.type               = advertisement.type;
+        merged.advertisingDataLen = advertisement.advertisingDataLen;
+        memcpy(merged.data, advertisement.advertisingData, advertisement.advertisingDataLen);
+
+        merged.scanResponseLen = 0;
+        if (entry != NULL && entry->responseLen != 0 &&
+            (int32_t) (advertisement.timestamp - entry->responseTime) < (int32_t) RESPONSE_MAX_AGE_USEC) {
+            merged.scanResponseLen = entry->responseLen;
+            memcpy(merged.data + merged.advertisingDataLen, entry->response, entry->responseLen);
+        }
+    }
+
+    Entry    entries[ENTRIES];
+    uint32_t useCount;
+};
+
+#endif  /* __SCANRESPONSECACHE_H__ */
@@ -1,184 +1,554 @@
-/* mbed Microcontroller Library
- * Copyright (c) 2006-2015 ARM Limited
- *
- * Licensed under the Apache License, Version 2.0 (the "License");
- * you may not use this file except in compliance with the License.
- * You may obtain a copy of the License at
- *
- *     http://www.apache.org/licenses/LICENSE-2.0
- *
- * Unless required by applicable law or agreed to in writing, software
- * distributed under the License is distributed on an "AS IS" BASIS,
- * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
- * See the License for the specific language governing permissions and
- * limitations under the License.
- */
-
-#include <events/mbed_events.h>
-#include <mbed.h>
-#include "ble/BLE.h"
-#include "ble/DiscoveredCharacteristic.h"
-#include "ble/DiscoveredService.h"
-
-DigitalOut alivenessLED(LED1, 1);
-static DiscoveredCharacteristic ledCharacteristic;
-static bool triggerLedCharacteristic;
-static const char PEER_NAME[] = "LED";
-
-static EventQueue eventQueue(/* event count */ 16 * EVENTS_EVENT_SIZE);
-
-void periodicCallback(void) {
-    alivenessLED = !alivenessLED; /* Do blinky on LED1 while we're waiting for BLE events */
-}
-
-void advertisementCallback(const Gap::AdvertisementCallbackParams_t *params) {
-    // parse the advertising payload, looking for data type COMPLETE_LOCAL_NAME
-    // The advertising payload is a collection of key/value records where
-    // byte 0: length of the record excluding this byte
-    // byte 1: The key, it is the type of the data
-    // byte [2..N] The value. N is equal to byte0 - 1
-    for (uint8_t i = 0; i < params->advertisingDataLen; ++i) {
-
-        const uint8_t record_length = params->advertisingData[i];
-        if (record_length == 0) {
-            continue;
-        }
-        const uint8_t type = params->advertisingData[i + 1];
-        const uint8_t* value = params->advertisingData + i + 2;
-        const uint8_t value_length = record_length - 1;
-
-        if(type == GapAdvertisingData::COMPLETE_LOCAL_NAME) {
-            if ((value_length == sizeof(PEER_NAME)) && (memcmp(value, PEER_NAME, value_length) == 0)) {
-                printf(
-                    "adv peerAddr[%02x %02x %02x %02x %02x %02x] rssi %d, isScanResponse %u, AdvertisementType %u\r\n",
-                    params->peerAddr[5], params->peerAddr[4], params->peerAddr[3], params->peerAddr[2],
-                    params->peerAddr[1], params->peerAddr[0], params->rssi, params->isScanResponse, params->type
-                );
-                BLE::Instance().gap().connect(params->peerAddr, Gap::ADDR_TYPE_RANDOM_STATIC, NULL, NULL);
-                break;
-            }
-        }
-        i += record_length;
-    }
-}
-
-void serviceDiscoveryCallback(const DiscoveredService *service) {
-    if (service->getUUID().shortOrLong() == UUID::UUID_TYPE_SHORT) {
-        printf("S UUID-%x attrs[%u %u]\r\n", service->getUUID().getShortUUID(), service->getStartHandle(), service->getEndHandle());
-    } else {
-        printf("S UUID-");
-        const uint8_t *longUUIDBytes = service->getUUID().getBaseUUID();
-        for (unsigned i = 0; i < UUID::LENGTH_OF_LONG_UUID; i++) {
-            printf("%02x", longUUIDBytes[i]);
-        }
-        printf(" attrs[%u %u]\r\n", service->getStartHandle(), service->getEndHandle());
-    }
-}
-
-void updateLedCharacteristic(void) {
-    if (!BLE::Instance().gattClient().isServiceDiscoveryActive()) {
-        ledCharacteristic.read();
-    }
-}
-
-void characteristicDiscoveryCallback(const DiscoveredCharacteristic *characteristicP) {
-    printf("  C UUID-%x valueAttr[%u] props[%x]\r\n", characteristicP->getUUID().getShortUUID(), characteristicP->getValueHandle(), (uint8_t)characteristicP->getProperties().broadcast());
-    if (characteristicP->getUUID().getShortUUID() == 0xa001) { /* !ALERT! Alter this filter to suit your device. */
-        ledCharacteristic        = *characteristicP;
-        triggerLedCharacteristic = true;
-    }
-}
-
-void discoveryTerminationCallback(Gap::Handle_t connectionHandle) {
-    printf("terminated SD for handle %u\r\n", connectionHandle);
-    if (triggerLedCharacteristic) {
-        triggerLedCharacteristic = false;
-        eventQueue.call(updateLedCharacteristic);
-    }
-}
-
-void connectionCallback(const Gap::ConnectionCallbackParams_t *params) {
-    if (params->role == Gap::CENTRAL) {
-        BLE &ble = BLE::Instance();
-        ble.gattClient().onServiceDiscoveryTermination(discoveryTerminationCallback);
-        ble.gattClient().launchServiceDiscovery(params->handle, serviceDiscoveryCallback, characteristicDiscoveryCallback, 0xa000, 0xa001);
-    }
-}
-
-void triggerToggledWrite(const GattReadCallbackParams *response) {
-    if (response->handle == ledCharacteristic.getValueHandle()) {
-        printf("triggerToggledWrite: handle %u, offset %u, len %u\r\n", response->handle, response->offset, response->len);
-        for (unsigned index = 0; index < response->len; index++) {
-            printf("%c[%02x]", response->data[index], response->data[index]);
-        }
-        printf("\r\n");
-
-        uint8_t toggledValue = response->data[0] ^ 0x1;
-        ledCharacteristic.write(1, &toggledValue);
-    }
-}
-
-void triggerRead(const GattWriteCallbackParams *response) {
-    if (response->handle == ledCharacteristic.getValueHandle()) {
-        ledCharacteristic.read();
-    }
-}
-
-void disconnectionCallback(const Gap::DisconnectionCallbackParams_t *) {
-    printf("disconnected\r\n");
-    /* Start scanning and try to connect again */
-    BLE::Instance().gap().startScan(advertisementCallback);
-}
-
-void onBleInitError(BLE &ble, ble_error_t error)
-{
-   /* Initialization error handling should go here */
-}
-
-void bleInitComplete(BLE::InitializationCompleteCallbackContext *params)
-{
-    BLE&        ble   = params->ble;
-    ble_error_t error = params->error;
-
-    if (error != BLE_ERROR_NONE) {
-        /* In case of error, forward the error handling to onBleInitError */
-        onBleInitError(ble, error);
-        return;
-    }
-
-    /* Ensure that it is the default instance of BLE */
-    if (ble.getInstanceID() != BLE::DEFAULT_INSTANCE) {
-        return;
-    }
-
-    ble.gap().onDisconnection(disconnectionCallback);
-    ble.gap().onConnection(connectionCallback);
-
-    ble.gattClient().onDataRead(triggerToggledWrite);
-    ble.gattClient().onDataWrite(triggerRead);
-
-    // scan interval: 400ms and scan window: 400ms.
-    // Every 400ms the device will scan for 400ms
-    // This means that the device will scan continuously.
-    ble.gap().setScanParams(400, 400);
-    ble.gap().startScan(advertisementCallback);
-}
-
-void scheduleBleEventsProcessing(BLE::OnEventsToProcessCallbackContext* context) {
-    BLE &ble = BLE::Instance();
-    eventQueue.call(Callback<void()>(&ble, &BLE::processEvents));
-}
-
-int main()
-{
-    triggerLedCharacteristic = false;
-    eventQueue.call_every(500, periodicCallback);
-
-    BLE &ble = BLE::Instance();
-    ble.onEventsToProcess(scheduleBleEventsProcessing);
-    ble.init(bleInitComplete);
-
-    eventQueue.dispatch_forever();
-
-    return 0;
-}
+/* mbed Microcontroller Library
+ * Copyright (c) 2006-2015 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <events/mbed_events.h>
+#include <mbed.h>
+#include "ble/BLE.h"
+#include "ble/DiscoveredCharacteristic.h"
+#include "AdvertisementRing.h"
+#include "AdvertisingDataParser.h"
+#include "ScanResponseCache.h"
+#include "PeripheralLink.h"
+#include "GattHandleCache.h"
+
+DigitalOut alivenessLED(LED1, 1);
+
+/* The LED of BLE_LED is either read and toggled in a loop, each operation
+ * waiting for the response to the previous one, or toggled by a stream of
+ * write commands while it is read back in parallel */
+void toggleLed(PeripheralLink *link, const PeripheralLink::Completion_t *completion, uint32_t now);
+
+void readLed(PeripheralLink *link, const PeripheralLink::Completion_t *completion, uint32_t now) {
+    if (completion->status == BLE_ERROR_NONE) {
+        link->read(link->getValueHandle(), toggleLed, now);
+    }
+}
+
+void toggleLed(PeripheralLink *link, const PeripheralLink::Completion_t *completion, uint32_t now) {
+    if (completion->status == BLE_ERROR_NONE && completion->length > 0) {
+        uint8_t toggledValue = completion->data[0] ^ 0x1;
+        link->write(link->getValueHandle(), &toggledValue, sizeof(toggledValue), readLed, now);
+    }
+}
+
+void startTogglingLed(PeripheralLink *link, uint32_t now) {
+    link->read(link->getValueHandle(), toggleLed, now);
+}
+
+void streamLed(PeripheralLink *link, const PeripheralLink::Completion_t *completion, uint32_t now) {
+    // queue the next toggle as each one is handed to the stack, so that the
+    // stack buffers stay full
+    if (completion->status == BLE_ERROR_NONE) {
+        uint8_t toggledValue = completion->data[0] ^ 0x1;
+        link->writeCommand(link->getValueHandle(), &toggledValue, sizeof(toggledValue), streamLed, now);
+    }
+}
+
+void readLedAgain(PeripheralLink *link, const PeripheralLink::Completion_t *completion, uint32_t now) {
+    if (completion->status == BLE_ERROR_NONE) {
+        link->read(link->getValueHandle(), readLedAgain, now);
+    }
+}
+
+void startStreamingLed(PeripheralLink *link, uint32_t now) {
+    uint8_t value = 0;
+    link->writeCommand(link->getValueHandle(), &value, sizeof(value), streamLed, now);
+    link->read(link->getValueHandle(), readLedAgain, now);
+}
+
+void startNotifications(PeripheralLink *link, uint32_t now) {
+    link->subscribe(NULL, now);
+}
+
+/* Peripherals the hub connects to, recognized by their complete local name
+ * or the service they advertise */
+static const PeripheralLink::Profile_t PROFILES[] = {
+#if MBED_CONF_APP_LED_WRITE_COMMANDS
+    {"LED",     0xA000,                                      0xA001,                                               startStreamingLed},
+#else
+    {"LED",     0xA000,                                      0xA001,                                               startTogglingLed},
+#endif
+    {"HRM",     GattService::UUID_HEART_RATE_SERVICE,        GattCharacteristic::UUID_HEART_RATE_MEASUREMENT_CHAR, startNotifications},
+    {"RSC",     GattService::UUID_RUNNING_SPEED_AND_CADENCE, GattCharacteristic::UUID_RSC_MEASUREMENT_CHAR,        startNotifications},
+    {"BATTERY", GattService::UUID_BATTERY_SERVICE,           GattCharacteristic::UUID_BATTERY_LEVEL_CHAR,          startNotifications},
+};
+static const unsigned NUM_PROFILES = sizeof(PROFILES) / sizeof(PROFILES[0]);
+
+/* Number of advertisement reports buffered between the scan callback and the
+ * job parsing them, and the number parsed before yielding to BLE events */
+static const unsigned ADVERTISEMENT_RING_SLOTS = 32;
+static const unsigned ADVERTISEMENT_BATCH_SIZE = 8;
+
+/* Number of devices whose advertisement and scan response are paired, and
+ * the period at which advertisements missing their scan response are
+ * released */
+static const unsigned SCAN_RESPONSE_CACHE_ENTRIES = 8;
+static const int      SCAN_RESPONSE_EXPIRY_MSEC   = 20;
+
+static const int DROPPED_REPORT_PERIOD_SECONDS = 10;
+
+/* All the links use the same connection interval, long enough for the
+ * connection events of every link to follow each other, 7.5 ms apart, so
+ * that the controller can stagger them without collisions. Connections are
+ * established one at a time, at least CONNECT_SPACING_MSEC apart, so that
+ * each new link gets its own slot in the interval */
+static const unsigned MAX_LINKS                  = MBED_CONF_APP_MAX_LINKS;
+static const uint16_t CONNECTION_INTERVAL        = MAX_LINKS * 6;   /* 1.25 ms units */
+static const uint16_t SUPERVISION_TIMEOUT        = 400;             /* 10 ms units */
+static const uint32_t CONNECT_SPACING_MSEC       = 500;
+static const uint32_t CONNECT_TIMEOUT_MSEC       = 5000;
+static const uint32_t DISCOVERY_TIMEOUT_MSEC     = 10000;
+static const int      LINK_POLL_PERIOD_MSEC      = 100;
+static const int      LINK_STATS_PERIOD_SECONDS  = 10;
+
+static EventQueue eventQueue(/* event count */ 16 * EVENTS_EVENT_SIZE);
+
+static AdvertisementRing<ADVERTISEMENT_RING_SLOTS> advertisementRing;
+static volatile bool                               processingScheduled = false;
+
+static ScanResponseCache<SCAN_RESPONSE_CACHE_ENTRIES> scanResponseCache;
+
+static Timer           uptime;
+static PeripheralLink  links[MAX_LINKS];
+static GattHandleCache handleCache;
+static uint32_t        lastConnectTime = 0;
+static bool            scanning        = false;
+
+void advertisementCallback(const Gap::AdvertisementCallbackParams_t *params);
+
+void periodicCallback(void) {
+    alivenessLED = !alivenessLED; /* Do blinky on LED1 while we're waiting for BLE events */
+}
+
+PeripheralLink *findLink(Gap::Handle_t handle) {
+    for (unsigned i = 0; i < MAX_LINKS; i++) {
+        PeripheralLink::State_t state = links[i].getState();
+        if (state != PeripheralLink::STATE_IDLE && state != PeripheralLink::STATE_CONNECTING &&
+            links[i].getHandle() == handle) {
+            return &links[i];
+        }
+    }
+    return NULL;
+}
+
+PeripheralLink *findLinkInState(PeripheralLink::State_t state) {
+    for (unsigned i = 0; i < MAX_LINKS; i++) {
+        if (links[i].getState() == state) {
+            return &links[i];
+        }
+    }
+    return NULL;
+}
+
+void updateScanning(void) {
+    // scan while a link is free, except while connecting
+    Gap &gap = BLE::Instance().gap();
+    bool scan = findLinkInState(PeripheralLink::STATE_IDLE) != NULL &&
+                findLinkInState(PeripheralLink::STATE_CONNECTING) == NULL;
+    if (scan && !scanning) {
+        scanning = (gap.startScan(advertisementCallback) == BLE_ERROR_NONE);
+    } else if (!scan && scanning) {
+        gap.stopScan();
+        scanning = false;
+    }
+}
+
+bool matchesProfile(const PeripheralLink::Profile_t &profile, const uint8_t *data, uint8_t length) {
+    const uint8_t *name;
+    uint8_t        nameLength;
+    bool           complete;
+    if (adFindLocalName(data, length, name, nameLength, complete) && complete &&
+        (nameLength == strlen(profile.name) + 1) && (memcmp(name, profile.name, nameLength) == 0)) {
+        return true;
+    }
+    return adHasServiceUUID(data, length, profile.serviceUUID);
+}
+
+void parseAdvertisement(const MergedAdvertisement_t *params) {
+    uint32_t now = uptime.read_ms();
+    if (findLinkInState(PeripheralLink::STATE_CONNECTING) != NULL || now - lastConnectTime < CONNECT_SPACING_MSEC) {
+        return;
+    }
+    PeripheralLink *link = findLinkInState(PeripheralLink::STATE_IDLE);
+    if (link == NULL) {
+        return;
+    }
+    for (unsigned i = 0; i < MAX_LINKS; i++) {
+        if (links[i].isFor(params->peerAddr)) {
+            return;
+        }
+    }
+
+    // the name can be in the advertising payload or in the scan response,
+    // which are parsed separately as the first may end with padding
+    for (unsigned i = 0; i < NUM_PROFILES; i++) {
+        if (!matchesProfile(PROFILES[i], params->data, params->advertisingDataLen) &&
+            !matchesProfile(PROFILES[i], params->data + params->advertisingDataLen, params->scanResponseLen)) {
+            continue;
+        }
+
+        printf(
+            "adv %s peerAddr[%02x %02x %02x %02x %02x %02x] rssi %d, scanResponseLen %u, AdvertisementType %u\r\n",
+            PROFILES[i].name, params->peerAddr[5], params->peerAddr[4], params->peerAddr[3], params->peerAddr[2],
+            params->peerAddr[1], params->peerAddr[0], params->rssi, params->scanResponseLen, params->type
+        );
+
+        Gap::ConnectionParams_t connectionParams;
+        connectionParams.minConnectionInterval        = CONNECTION_INTERVAL;
+        connectionParams.maxConnectionInterval        = CONNECTION_INTERVAL;
+        connectionParams.slaveLatency                 = 0;
+        connectionParams.connectionSupervisionTimeout = SUPERVISION_TIMEOUT;
+        if (BLE::Instance().gap().connect(params->peerAddr, Gap::ADDR_TYPE_RANDOM_STATIC, &connectionParams, NULL) == BLE_ERROR_NONE) {
+            link->startConnecting(&PROFILES[i], params->peerAddr, now);
+            lastConnectTime = now;
+            // the stack stops scanning to connect
+            scanning = false;
+        }
+        return;
+    }
+}
+
+void processAdvertisements(void) {
+    processingScheduled = false;
+
+    // parse a batch of reports, and post the job again while some remain so
+    // that BLE events are processed in between
+    // advertisements are parsed once paired with their scan response
+    const AdvertisementReport_t *report;
+    MergedAdvertisement_t        merged;
+    for (unsigned i = 0; i < ADVERTISEMENT_BATCH_SIZE && (report = advertisementRing.front()) != NULL; i++) {
+        if (scanResponseCache.add(*report, merged)) {
+            parseAdvertisement(&merged);
+        }
+        advertisementRing.pop();
+    }
+
+    if (advertisementRing.front() != NULL && !processingScheduled) {
+        processingScheduled = true;
+        if (eventQueue.call(processAdvertisements) == 0) {
+            processingScheduled = false;
+        }
+    }
+}
+
+void advertisementCallback(const Gap::AdvertisementCallbackParams_t *params) {
+    // only copy the report here, it is parsed later by processAdvertisements
+    if (advertisementRing.push(params) && !processingScheduled) {
+        processingScheduled = true;
+        if (eventQueue.call(processAdvertisements) == 0) {
+            processingScheduled = false;
+        }
+    }
+}
+
+void expireScanResponses(void) {
+    // reports still in the ring may hold the scan responses being waited for
+    if (advertisementRing.front() != NULL) {
+        return;
+    }
+
+    MergedAdvertisement_t merged;
+    while (scanResponseCache.expire(us_ticker_read(), merged)) {
+        parseAdvertisement(&merged);
+    }
+}
+
+void printDroppedReports(void) {
+    static uint32_t lastDropped = 0;
+
+    uint32_t dropped = advertisementRing.getDropped();
+    if (dropped != lastDropped) {
+        printf("%lu advertisement reports dropped\r\n", (unsigned long) dropped);
+        lastDropped = dropped;
+    }
+}
+
+void characteristicDiscoveryCallback(const DiscoveredCharacteristic *characteristicP) {
+    PeripheralLink *link = findLink(characteristicP->getConnectionHandle());
+    if (link != NULL) {
+        link->characteristicDiscovered(characteristicP);
+    }
+}
+
+void startNextDiscovery(void) {
+    // the stack runs one service discovery at a time
+    GattClient &client = BLE::Instance().gattClient();
+    if (findLinkInState(PeripheralLink::STATE_DISCOVERING) != NULL || client.isServiceDiscoveryActive()) {
+        return;
+    }
+
+    PeripheralLink *link = findLinkInState(PeripheralLink::STATE_DISCOVERY_PENDING);
+    if (link == NULL) {
+        return;
+    }
+    const PeripheralLink::Profile_t *profile = link->getProfile();
+    if (client.launchServiceDiscovery(link->getHandle(), NULL, characteristicDiscoveryCallback,
+                                      profile->serviceUUID, profile->characteristicUUID) == BLE_ERROR_NONE) {
+        link->discoveryStarted(uptime.read_ms());
+    }
+}
+
+void discoveryFailed(PeripheralLink *link, const char *reason) {
+    const PeripheralLink::Profile_t *profile = link->getProfile();
+    printf("%s %s on handle %u\r\n", profile->name, reason, link->getHandle());
+    handleCache.invalidate(link->getAddress(), profile->serviceUUID, profile->characteristicUUID);
+    BLE::Instance().gap().disconnect(link->getHandle(), Gap::REMOTE_USER_TERMINATED_CONNECTION);
+}
+
+void discoveryCompleted(PeripheralLink *link) {
+    const PeripheralLink::Profile_t *profile = link->getProfile();
+    handleCache.store(link->getAddress(), profile->serviceUUID, profile->characteristicUUID,
+                      link->getValueHandle(), link->getCCCDHandle());
+}
+
+void descriptorDiscoveryCallback(const CharacteristicDescriptorDiscovery::DiscoveryCallbackParams_t *params) {
+    PeripheralLink *link = findLink(params->characteristic.getConnectionHandle());
+    if (link != NULL && link->getState() == PeripheralLink::STATE_DISCOVERING_DESCRIPTORS) {
+        link->descriptorDiscovered(params->descriptor);
+    }
+}
+
+void descriptorDiscoveryTerminationCallback(const CharacteristicDescriptorDiscovery::TerminationCallbackParams_t *params) {
+    PeripheralLink *link = findLink(params->characteristic.getConnectionHandle());
+    if (link == NULL || link->getState() != PeripheralLink::STATE_DISCOVERING_DESCRIPTORS) {
+        return;
+    }
+
+    if (link->descriptorDiscoveryTerminated(params->status, uptime.read_ms())) {
+        discoveryCompleted(link);
+    } else {
+        discoveryFailed(link, "descriptor discovery failed");
+    }
+}
+
+void discoveryTerminationCallback(Gap::Handle_t connectionHandle) {
+    PeripheralLink *link = findLink(connectionHandle);
+    if (link != NULL && link->getState() == PeripheralLink::STATE_DISCOVERING) {
+        if (!link->discoveryTerminated(uptime.read_ms())) {
+            discoveryFailed(link, "characteristic not found");
+        } else if (link->getState() != PeripheralLink::STATE_DISCOVERING_DESCRIPTORS) {
+            discoveryCompleted(link);
+        } else if (link->getCharacteristic().discoverDescriptors(descriptorDiscoveryCallback,
+                                                                 descriptorDiscoveryTerminationCallback) != BLE_ERROR_NONE) {
+            discoveryFailed(link, "descriptor discovery not launched");
+        }
+    }
+    eventQueue.call(startNextDiscovery);
+}
+
+void connectionCallback(const Gap::ConnectionCallbackParams_t *params) {
+    if (params->role != Gap::CENTRAL) {
+        return;
+    }
+
+    PeripheralLink *link = NULL;
+    for (unsigned i = 0; i < MAX_LINKS && link == NULL; i++) {
+        if (links[i].getState() == PeripheralLink::STATE_CONNECTING && links[i].isFor(params->peerAddr)) {
+            link = &links[i];
+        }
+    }
+    if (link == NULL) {
+        // a connection the hub gave up waiting for
+        BLE::Instance().gap().disconnect(params->handle, Gap::REMOTE_USER_TERMINATED_CONNECTION);
+        return;
+    }
+
+    // reuse the handles found on a previous connection, they are checked before use
+    const PeripheralLink::Profile_t *profile = link->getProfile();
+    uint16_t cachedCCCDHandle;
+    uint16_t cachedValueHandle = handleCache.find(params->peerAddr, profile->serviceUUID, profile->characteristicUUID,
+                                                  cachedCCCDHandle);
+    printf("%s connected, handle %u, cached value handle %u, cached CCCD handle %u\r\n", profile->name, params->handle,
+           cachedValueHandle, cachedCCCDHandle);
+    link->connected(params->handle, params->connectionParams->maxConnectionInterval, cachedValueHandle, cachedCCCDHandle,
+                    uptime.read_ms());
+    startNextDiscovery();
+    updateScanning();
+}
+
+void dataReadCallback(const GattReadCallbackParams *response) {
+    PeripheralLink *link = findLink(response->connHandle);
+    if (link != NULL) {
+        link->dataRead(response, uptime.read_ms());
+    }
+}
+
+void dataWriteCallback(const GattWriteCallbackParams *response) {
+    PeripheralLink *link = findLink(response->connHandle);
+    if (link != NULL) {
+        link->dataWritten(response, uptime.read_ms());
+    }
+}
+
+void hvxCallback(const GattHVXCallbackParams *params) {
+    PeripheralLink *link = findLink(params->connHandle);
+    if (link != NULL) {
+        link->notified(params, uptime.read_ms());
+    }
+}
+
+void dataSentCallback(unsigned count) {
+    // the stack reports the packets sent on all the connections at once
+    uint32_t now = uptime.read_ms();
+    for (unsigned i = 0; i < MAX_LINKS; i++) {
+        if (links[i].getState() == PeripheralLink::STATE_ACTIVE) {
+            links[i].dataSent(now);
+        }
+    }
+}
+
+void disconnectionCallback(const Gap::DisconnectionCallbackParams_t *params) {
+    PeripheralLink *link = findLink(params->handle);
+    if (link == NULL) {
+        return;
+    }
+
+    printf("%s disconnected, handle %u, reason 0x%02x\r\n", link->getProfile()->name, params->handle, params->reason);
+    link->disconnected(uptime.read_ms());
+    /* Start scanning and try to connect again */
+    updateScanning();
+    eventQueue.call(startNextDiscovery);
+}
+
+void pollLinks(void) {
+    uint32_t now = uptime.read_ms();
+    Gap     &gap = BLE::Instance().gap();
+
+    for (unsigned i = 0; i < MAX_LINKS; i++) {
+        PeripheralLink &link = links[i];
+        switch (link.getState()) {
+            case PeripheralLink::STATE_CONNECTING:
+                // give up, the connection is dropped if it completes later
+                if (now - link.getStateTime() >= CONNECT_TIMEOUT_MSEC) {
+                    link.disconnected(now);
+                }
+                break;
+
+            case PeripheralLink::STATE_DISCOVERING:
+                if (now - link.getStateTime() >= DISCOVERY_TIMEOUT_MSEC) {
+                    BLE::Instance().gattClient().terminateServiceDiscovery();
+                    gap.disconnect(link.getHandle(), Gap::REMOTE_USER_TERMINATED_CONNECTION);
+                }
+                break;
+
+            case PeripheralLink::STATE_DISCOVERING_DESCRIPTORS:
+                if (now - link.getStateTime() >= DISCOVERY_TIMEOUT_MSEC) {
+                    BLE::Instance().gattClient().terminateCharacteristicDescriptorDiscovery(link.getCharacteristic());
+                    gap.disconnect(link.getHandle(), Gap::REMOTE_USER_TERMINATED_CONNECTION);
+                }
+                break;
+
+            case PeripheralLink::STATE_VERIFYING:
+            case PeripheralLink::STATE_ACTIVE:
+                if (!link.poll(now)) {
+                    printf("%s operation timed out\r\n", link.getProfile()->name);
+                    if (link.getState() == PeripheralLink::STATE_VERIFYING) {
+                        // the cached handles may not exist anymore
+                        const PeripheralLink::Profile_t *profile = link.getProfile();
+                        handleCache.invalidate(link.getAddress(), profile->serviceUUID, profile->characteristicUUID);
+                    }
+                    gap.disconnect(link.getHandle(), Gap::REMOTE_USER_TERMINATED_CONNECTION);
+                }
+                break;
+
+            default:
+                break;
+        }
+    }
+
+    updateScanning();
+    startNextDiscovery();
+}
+
+void printLinkStats(void) {
+    static uint32_t lastTime = 0;
+
+    uint32_t now = uptime.read_ms();
+    for (unsigned i = 0; i < MAX_LINKS; i++) {
+        links[i].printStats(i, now - lastTime);
+    }
+    lastTime = now;
+
+    const GattHandleCacheStats_t &cacheStats = handleCache.getStats();
+    printf("handle cache: %lu hits, %lu misses, %lu stale\r\n", (unsigned long) cacheStats.hits,
+           (unsigned long) cacheStats.misses, (unsigned long) cacheStats.stale);
+}
+
+void onBleInitError(BLE &ble, ble_error_t error)
+{
+   /* Initialization error handling should go here */
+}
+
+void bleInitComplete(BLE::InitializationCompleteCallbackContext *params)
+{
+    BLE&        ble   = params->ble;
+    ble_error_t error = params->error;
+
+    if (error != BLE_ERROR_NONE) {
+        /* In case of error, forward the error handling to onBleInitError */
+        onBleInitError(ble, error);
+        return;
+    }
+
+    /* Ensure that it is the default instance of BLE */
+    if (ble.getInstanceID() != BLE::DEFAULT_INSTANCE) {
+        return;
+    }
+
+    ble.gap().onDisconnection(disconnectionCallback);
+    ble.gap().onConnection(connectionCallback);
+
+    ble.gattClient().onServiceDiscoveryTermination(discoveryTerminationCallback);
+    ble.gattClient().onDataRead(dataReadCallback);
+    ble.gattClient().onDataWrite(dataWriteCallback);
+    ble.gattClient().onHVX(hvxCallback);
+    ble.gattServer().onDataSent(dataSentCallback);
+
+    // scan interval: 400ms and scan window: 400ms.
+    // Every 400ms the device will scan for 400ms
+    // This means that the device will scan continuously.
+    ble.gap().setScanParams(400, 400);
+    // request the scan responses, so that names they carry are found without
+    // waiting for another scan
+    ble.gap().setActiveScanning(true);
+
+    handleCache.load();
+
+    uptime.start();
+    updateScanning();
+    eventQueue.call_every(LINK_POLL_PERIOD_MSEC, pollLinks);
+    eventQueue.call_every(LINK_STATS_PERIOD_SECONDS * 1000, printLinkStats);
+}
+
+void scheduleBleEventsProcessing(BLE::OnEventsToProcessCallbackContext* context) {
+    BLE &ble = BLE::Instance();
+    eventQueue.call(Callback<void()>(&ble, &BLE::processEvents));
+}
+
+int main()
+{
+    eventQueue.call_every(500, periodicCallback);
+    eventQueue.call_every(DROPPED_REPORT_PERIOD_SECONDS * 1000, printDroppedReports);
+    eventQueue.call_every(SCAN_RESPONSE_EXPIRY_MSEC, expireScanResponses);
+
+    BLE &ble = BLE::Instance();
+    ble.onEventsToProcess(scheduleBleEventsProcessing);
+    ble.init(bleInitComplete);
+
+    eventQueue.dispatch_forever();
+
+    return 0;
+}
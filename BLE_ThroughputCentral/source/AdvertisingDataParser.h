@@ -0,0 +1 @@
+../../BLE_EddystoneObserver/source/AdvertisingDataParser.h
\ No newline at end of file
@@ -0,0 +1 @@
+../../BLE_ThroughputPeripheral/source/ThroughputReceiver.h
\ No newline at end of file
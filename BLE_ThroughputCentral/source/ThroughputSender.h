@@ -0,0 +1 @@
+../../BLE_ThroughputPeripheral/source/ThroughputSender.h
\ No newline at end of file
@@ -0,0 +1 @@
+../../BLE_ThroughputPeripheral/source/ThroughputTest.h
\ No newline at end of file
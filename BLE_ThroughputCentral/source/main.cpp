@@ -0,0 +1,412 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2006-2015 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <events/mbed_events.h>
+#include <mbed.h>
+#include "ble/BLE.h"
+#include "ble/DiscoveredCharacteristic.h"
+#include "AdvertisingDataParser.h"
+#include "ThroughputTest.h"
+#include "ThroughputSender.h"
+#include "ThroughputReceiver.h"
+
+DigitalOut alivenessLED(LED1, 1);
+
+/**
+ * A test run against BLE_ThroughputPeripheral.
+ */
+struct TestCase_t {
+    uint8_t  mode;
+    uint8_t  payloadSize;
+    uint16_t connectionInterval;    /* 1.25 ms units */
+    uint16_t attMtu;
+    uint16_t maxOctets;             /* link layer payload */
+    uint8_t  phy;                   /* Mbps */
+};
+
+/* Tests needing a larger ATT MTU, the data length extension or the 2M PHY
+ * are skipped while the stack does not support them */
+static const TestCase_t TEST_CASES[] = {
+    {THROUGHPUT_MODE_NOTIFICATIONS,  20,  6,  23,  27,  1},
+    {THROUGHPUT_MODE_WRITE_COMMANDS, 20,  6,  23,  27,  1},
+    {THROUGHPUT_MODE_NOTIFICATIONS,  4,   6,  23,  27,  1},
+    {THROUGHPUT_MODE_WRITE_COMMANDS, 4,   6,  23,  27,  1},
+    {THROUGHPUT_MODE_NOTIFICATIONS,  20,  24, 23,  27,  1},
+    {THROUGHPUT_MODE_WRITE_COMMANDS, 20,  24, 23,  27,  1},
+    {THROUGHPUT_MODE_NOTIFICATIONS,  20,  80, 23,  27,  1},
+    {THROUGHPUT_MODE_WRITE_COMMANDS, 20,  80, 23,  27,  1},
+    {THROUGHPUT_MODE_NOTIFICATIONS,  244, 6,  247, 27,  1},
+    {THROUGHPUT_MODE_NOTIFICATIONS,  244, 6,  247, 251, 1},
+    {THROUGHPUT_MODE_NOTIFICATIONS,  244, 6,  247, 251, 2},
+    {THROUGHPUT_MODE_WRITE_COMMANDS, 244, 6,  247, 251, 2},
+};
+static const unsigned NUM_TEST_CASES = sizeof(TEST_CASES) / sizeof(TEST_CASES[0]);
+
+/* A connection parameter update takes effect a few connection events after
+ * it is requested; tests are also spaced for the peripheral to report the
+ * previous one */
+static const uint16_t DURATION_SECONDS      = MBED_CONF_APP_DURATION_SECONDS;
+static const uint16_t SUPERVISION_TIMEOUT   = 400;     /* 10 ms units */
+static const uint32_t SETTLE_MSEC           = 2000;
+static const int      TEST_POLL_PERIOD_MSEC = 100;
+
+enum State_t {
+    STATE_SCANNING,
+    STATE_CONNECTING,
+    STATE_DISCOVERING,
+    STATE_SUBSCRIBING,
+    STATE_SETTLING,                 /* before the next test */
+    STATE_RUNNING,
+    STATE_DONE
+};
+
+/**
+ * Results kept for the summary printed after the last test.
+ */
+struct Result_t {
+    bool     run;
+    uint32_t bytesPerSecond;
+    uint32_t packetsPerEvent;       /* hundredths */
+    uint32_t latencyP50;            /* ms, write commands only */
+    uint32_t latencyP99;
+};
+
+static EventQueue eventQueue(/* event count */ 16 * EVENTS_EVENT_SIZE);
+
+static ThroughputSendStatus_t writePacket(const uint8_t *packet, uint8_t length);
+
+static Timer                   uptime;
+static ThroughputSender        sender(writePacket);
+static ThroughputReceiver      receiver;
+static State_t                 state              = STATE_SCANNING;
+static Gap::Handle_t           connectionHandle   = 0;
+static GattAttribute::Handle_t dataHandle         = 0;
+static GattAttribute::Handle_t controlHandle      = 0;
+static uint16_t                connectionInterval = 0;
+static unsigned                currentCase        = 0;
+static uint32_t                settleTime         = 0;
+static Result_t                results[NUM_TEST_CASES];
+
+void advertisementCallback(const Gap::AdvertisementCallbackParams_t *params);
+
+void periodicCallback(void) {
+    alivenessLED = !alivenessLED; /* Do blinky on LED1 while we're waiting for BLE events */
+}
+
+static ThroughputSendStatus_t writePacket(const uint8_t *packet, uint8_t length) {
+    switch (BLE::Instance().gattClient().write(GattClient::GATT_OP_WRITE_CMD, connectionHandle, dataHandle, length, packet)) {
+        case BLE_ERROR_NONE:
+            return THROUGHPUT_SEND_ACCEPTED;
+        case BLE_ERROR_NO_MEM:
+        case BLE_STACK_BUSY:
+            return THROUGHPUT_SEND_BUSY;
+        default:
+            return THROUGHPUT_SEND_FAILED;
+    }
+}
+
+void printCase(unsigned index) {
+    const TestCase_t &test = TEST_CASES[index];
+    printf("[%u/%u] %s, %u byte payload, %u.%02u ms interval, MTU %u, %u octets, %uM PHY\r\n",
+           index + 1, NUM_TEST_CASES, throughputModeName(test.mode), test.payloadSize,
+           test.connectionInterval * 5 / 4, (test.connectionInterval * 125) % 100,
+           test.attMtu, test.maxOctets, test.phy);
+}
+
+bool isSupported(const TestCase_t &test) {
+    return test.attMtu <= THROUGHPUT_SUPPORTED_ATT_MTU && test.maxOctets <= THROUGHPUT_SUPPORTED_OCTETS &&
+           test.phy == THROUGHPUT_SUPPORTED_PHY && test.payloadSize <= THROUGHPUT_MAX_PAYLOAD;
+}
+
+void printSummary(void) {
+    printf("summary:\r\n");
+    printf("  test  mode            payload  interval  MTU  octets  PHY   bytes/s  packets/event  latency p50  p99\r\n");
+    for (unsigned i = 0; i < NUM_TEST_CASES; i++) {
+        const TestCase_t &test   = TEST_CASES[i];
+        const Result_t   &result = results[i];
+
+        printf("  %4u  %-14s  %7u  %5u.%02u  %3u  %6u  %2uM  ",
+               i + 1, throughputModeName(test.mode), test.payloadSize,
+               test.connectionInterval * 5 / 4, (test.connectionInterval * 125) % 100,
+               test.attMtu, test.maxOctets, test.phy);
+        if (!result.run) {
+            printf("skipped\r\n");
+        } else if (test.mode == THROUGHPUT_MODE_WRITE_COMMANDS) {
+            printf("%8lu  %10lu.%02lu  %8lu ms  %3lu ms\r\n",
+                   (unsigned long)result.bytesPerSecond,
+                   (unsigned long)result.packetsPerEvent / 100, (unsigned long)result.packetsPerEvent % 100,
+                   (unsigned long)result.latencyP50, (unsigned long)result.latencyP99);
+        } else {
+            printf("%8lu  %10lu.%02lu\r\n",
+                   (unsigned long)result.bytesPerSecond,
+                   (unsigned long)result.packetsPerEvent / 100, (unsigned long)result.packetsPerEvent % 100);
+        }
+    }
+}
+
+/**
+ * Move to the next test the stack supports, requesting its connection
+ * interval, or print the summary after the last one.
+ */
+void nextCase(void) {
+    while (currentCase < NUM_TEST_CASES && !isSupported(TEST_CASES[currentCase])) {
+        printCase(currentCase);
+        printf("  skipped: not supported by the stack\r\n");
+        currentCase++;
+    }
+
+    if (currentCase == NUM_TEST_CASES) {
+        printSummary();
+        state = STATE_DONE;
+        return;
+    }
+
+    const TestCase_t &test = TEST_CASES[currentCase];
+    if (test.connectionInterval != connectionInterval) {
+        Gap::ConnectionParams_t connectionParams;
+        connectionParams.minConnectionInterval        = test.connectionInterval;
+        connectionParams.maxConnectionInterval        = test.connectionInterval;
+        connectionParams.slaveLatency                 = 0;
+        connectionParams.connectionSupervisionTimeout = SUPERVISION_TIMEOUT;
+        if (BLE::Instance().gap().updateConnectionParams(connectionHandle, &connectionParams) == BLE_ERROR_NONE) {
+            connectionInterval = test.connectionInterval;
+        } else {
+            printf("connection parameters update failed\r\n");
+        }
+    }
+
+    state      = STATE_SETTLING;
+    settleTime = uptime.read_ms() + SETTLE_MSEC;
+}
+
+/**
+ * Write the next test to the control characteristic of the peripheral. The
+ * receiver starts first, as notifications may arrive before the response.
+ */
+void startCase(void) {
+    const TestCase_t  &test   = TEST_CASES[currentCase];
+    ThroughputConfig_t config = {test.mode, test.payloadSize, DURATION_SECONDS, connectionInterval};
+    uint8_t            value[THROUGHPUT_CONFIG_SIZE];
+
+    printCase(currentCase);
+    if (test.mode == THROUGHPUT_MODE_NOTIFICATIONS) {
+        receiver.start(config, uptime.read_ms());
+    }
+
+    throughputEncodeConfig(config, value);
+    if (BLE::Instance().gattClient().write(GattClient::GATT_OP_WRITE_REQ, connectionHandle, controlHandle, sizeof(value), value) != BLE_ERROR_NONE) {
+        printf("  control write failed\r\n");
+        /* an empty result, reported once the receiver times out */
+    }
+    state = STATE_RUNNING;
+}
+
+/**
+ * Start the tests once settled, end them once their duration has elapsed
+ * and report them.
+ */
+void pollTest(void) {
+    uint32_t now = uptime.read_ms();
+
+    if (state == STATE_SETTLING && (int32_t)(now - settleTime) >= 0) {
+        startCase();
+        return;
+    }
+
+    const ThroughputStats *stats = NULL;
+    if (sender.poll(now)) {
+        stats = &sender.getStats();
+        stats->print("sender");
+    }
+    if (receiver.poll(now)) {
+        stats = &receiver.getStats();
+        stats->print("receiver");
+    }
+
+    if (stats != NULL && state == STATE_RUNNING) {
+        Result_t &result       = results[currentCase];
+        result.run             = true;
+        result.bytesPerSecond  = stats->getBytesPerSecond();
+        result.packetsPerEvent = stats->getPacketsPerEvent();
+        result.latencyP50      = stats->getLatencyPercentile(50);
+        result.latencyP99      = stats->getLatencyPercentile(99);
+
+        currentCase++;
+        nextCase();
+    }
+}
+
+void advertisementCallback(const Gap::AdvertisementCallbackParams_t *params) {
+    if (state != STATE_SCANNING ||
+        !adHasServiceUUID(params->advertisingData, params->advertisingDataLen, THROUGHPUT_SERVICE_UUID)) {
+        return;
+    }
+
+    printf(
+        "adv peerAddr[%02x %02x %02x %02x %02x %02x] rssi %d, AdvertisementType %u\r\n",
+        params->peerAddr[5], params->peerAddr[4], params->peerAddr[3], params->peerAddr[2],
+        params->peerAddr[1], params->peerAddr[0], params->rssi, params->type
+    );
+
+    Gap::ConnectionParams_t connectionParams;
+    connectionParams.minConnectionInterval        = TEST_CASES[0].connectionInterval;
+    connectionParams.maxConnectionInterval        = TEST_CASES[0].connectionInterval;
+    connectionParams.slaveLatency                 = 0;
+    connectionParams.connectionSupervisionTimeout = SUPERVISION_TIMEOUT;
+    if (BLE::Instance().gap().connect(params->peerAddr, Gap::ADDR_TYPE_RANDOM_STATIC, &connectionParams, NULL) == BLE_ERROR_NONE) {
+        state = STATE_CONNECTING;
+    }
+}
+
+void characteristicDiscoveryCallback(const DiscoveredCharacteristic *characteristicP) {
+    printf("  C UUID-%x valueAttr[%u]\r\n", characteristicP->getUUID().getShortUUID(), characteristicP->getValueHandle());
+    if (characteristicP->getUUID().getShortUUID() == THROUGHPUT_DATA_UUID) {
+        dataHandle = characteristicP->getValueHandle();
+    } else if (characteristicP->getUUID().getShortUUID() == THROUGHPUT_CONTROL_UUID) {
+        controlHandle = characteristicP->getValueHandle();
+    }
+}
+
+/**
+ * Enable the notifications of the data characteristic. Its CCCD is assumed
+ * to follow its value, as laid out by the peripheral.
+ */
+void discoveryTerminationCallback(Gap::Handle_t handle) {
+    printf("terminated SD for handle %u\r\n", handle);
+    if (state != STATE_DISCOVERING) {
+        return;
+    }
+
+    const uint8_t enableNotifications[] = {0x01, 0x00};
+    if (dataHandle == 0 || controlHandle == 0 ||
+        BLE::Instance().gattClient().write(GattClient::GATT_OP_WRITE_REQ, handle, dataHandle + 1,
+                                           sizeof(enableNotifications), enableNotifications) != BLE_ERROR_NONE) {
+        printf("throughput service not found\r\n");
+        BLE::Instance().gap().disconnect(handle, Gap::REMOTE_USER_TERMINATED_CONNECTION);
+        return;
+    }
+    state = STATE_SUBSCRIBING;
+}
+
+void connectionCallback(const Gap::ConnectionCallbackParams_t *params) {
+    if (params->role != Gap::CENTRAL) {
+        return;
+    }
+
+    connectionHandle   = params->handle;
+    connectionInterval = params->connectionParams->maxConnectionInterval;
+    dataHandle         = 0;
+    controlHandle      = 0;
+    state              = STATE_DISCOVERING;
+
+    BLE::Instance().gattClient().launchServiceDiscovery(params->handle, NULL, characteristicDiscoveryCallback, THROUGHPUT_SERVICE_UUID);
+}
+
+/**
+ * Responses to the writes of the CCCD, which start the tests, and of the
+ * control characteristic, which start the write command tests.
+ */
+void writeResponseCallback(const GattWriteCallbackParams *response) {
+    if (state == STATE_SUBSCRIBING && response->handle == dataHandle + 1) {
+        currentCase = 0;
+        memset(results, 0, sizeof(results));
+        nextCase();
+    } else if (state == STATE_RUNNING && response->handle == controlHandle &&
+               TEST_CASES[currentCase].mode == THROUGHPUT_MODE_WRITE_COMMANDS) {
+        const TestCase_t  &test   = TEST_CASES[currentCase];
+        ThroughputConfig_t config = {test.mode, test.payloadSize, DURATION_SECONDS, connectionInterval};
+        sender.start(config, uptime.read_ms());
+    }
+}
+
+void hvxCallback(const GattHVXCallbackParams *params) {
+    if (params->handle == dataHandle) {
+        receiver.received(params->data, params->len, uptime.read_ms());
+    }
+}
+
+/**
+ * The stack raises a TX complete event for the write commands acknowledged
+ * in each connection event.
+ */
+void dataSentCallback(unsigned count) {
+    sender.dataSent(count, uptime.read_ms());
+}
+
+void disconnectionCallback(const Gap::DisconnectionCallbackParams_t *) {
+    printf("disconnected\r\n");
+    /* The test in progress ends and is reported by pollTest(); the tests
+     * start over on the next connection */
+    sender.stop(uptime.read_ms());
+    state = STATE_SCANNING;
+    BLE::Instance().gap().startScan(advertisementCallback);
+}
+
+void onBleInitError(BLE &ble, ble_error_t error)
+{
+   /* Initialization error handling should go here */
+}
+
+void bleInitComplete(BLE::InitializationCompleteCallbackContext *params)
+{
+    BLE&        ble   = params->ble;
+    ble_error_t error = params->error;
+
+    if (error != BLE_ERROR_NONE) {
+        /* In case of error, forward the error handling to onBleInitError */
+        onBleInitError(ble, error);
+        return;
+    }
+
+    /* Ensure that it is the default instance of BLE */
+    if (ble.getInstanceID() != BLE::DEFAULT_INSTANCE) {
+        return;
+    }
+
+    ble.gap().onDisconnection(disconnectionCallback);
+    ble.gap().onConnection(connectionCallback);
+
+    ble.gattClient().onServiceDiscoveryTermination(discoveryTerminationCallback);
+    ble.gattClient().onDataWrite(writeResponseCallback);
+    ble.gattClient().onHVX(hvxCallback);
+    ble.gattServer().onDataSent(dataSentCallback);
+
+    // scan interval: 400ms and scan window: 400ms.
+    // Every 400ms the device will scan for 400ms
+    // This means that the device will scan continuously.
+    ble.gap().setScanParams(400, 400);
+    ble.gap().startScan(advertisementCallback);
+}
+
+void scheduleBleEventsProcessing(BLE::OnEventsToProcessCallbackContext* context) {
+    BLE &ble = BLE::Instance();
+    eventQueue.call(Callback<void()>(&ble, &BLE::processEvents));
+}
+
+int main()
+{
+    uptime.start();
+    eventQueue.call_every(500, periodicCallback);
+    eventQueue.call_every(TEST_POLL_PERIOD_MSEC, pollTest);
+
+    BLE &ble = BLE::Instance();
+    ble.onEventsToProcess(scheduleBleEventsProcessing);
+    ble.init(bleInitComplete);
+
+    eventQueue.dispatch_forever();
+
+    return 0;
+}
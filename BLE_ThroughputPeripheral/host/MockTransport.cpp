@@ -0,0 +1,246 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2006-2015 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Runs the sender and the receiver of the throughput test on a host, linked
+ * by a mock of the BLE transport, to check their queuing logic without
+ * radios. Built and run from the BLE_ThroughputPeripheral directory:
+ *
+ *     g++ -I source host/MockTransport.cpp -o mock_transport && ./mock_transport
+ *
+ * The exit status is the number of failed scenarios.
+ */
+
+#include <stdio.h>
+#include "ThroughputSender.h"
+#include "ThroughputReceiver.h"
+
+/**
+ * Behaviour of the simulated link.
+ */
+struct LinkModel_t {
+    const char *name;
+    uint16_t    connectionInterval;     /* 1.25 ms units */
+    unsigned    txBuffers;              /* packets the stack holds */
+    unsigned    packetsPerEvent;        /* packets sent per connection event */
+    bool        acknowledged;           /* false: the peer never acknowledges */
+    uint32_t    disconnectAtMsec;       /* 0: stays connected */
+};
+
+/**
+ * Stands for the stack: buffers the packets handed by the sender, and
+ * delivers them to the receiver in connection events.
+ */
+class MockTransport
+{
+public:
+    static const unsigned MAX_BUFFERS = 32;
+
+    void reset(const LinkModel_t &linkModel)
+    {
+        link      = linkModel;
+        connected = true;
+        queued    = 0;
+    }
+
+    ThroughputSendStatus_t send(const uint8_t *data, uint8_t length)
+    {
+        if (!connected) {
+            return THROUGHPUT_SEND_FAILED;
+        }
+        if (queued >= link.txBuffers) {
+            return THROUGHPUT_SEND_BUSY;
+        }
+
+        memcpy(buffers[queued].data, data, length);
+        buffers[queued].length = length;
+        queued++;
+        return THROUGHPUT_SEND_ACCEPTED;
+    }
+
+    /**
+     * Run a connection event.
+     *
+     * @return the number of packets delivered, to be reported to the sender
+     *         as a TX complete event.
+     */
+    unsigned connectionEvent(ThroughputReceiver &receiver, uint32_t now)
+    {
+        if (!connected || !link.acknowledged) {
+            return 0;
+        }
+
+        unsigned count = (queued < link.packetsPerEvent) ? queued : link.packetsPerEvent;
+        for (unsigned i = 0; i < count; i++) {
+            receiver.received(buffers[i].data, buffers[i].length, now);
+        }
+        queued -= count;
+        memmove(buffers, buffers + count, queued * sizeof(buffers[0]));
+        return count;
+    }
+
+    /**
+     * Drop the connection, and the packets the stack still holds.
+     */
+    void disconnect(void)
+    {
+        connected = false;
+        queued    = 0;
+    }
+
+    bool isConnected(void) const
+    {
+        return connected;
+    }
+
+private:
+    struct Buffer_t {
+        uint8_t data[THROUGHPUT_MAX_PAYLOAD];
+        uint8_t length;
+    };
+
+    LinkModel_t link;
+    bool        connected;
+    Buffer_t    buffers[MAX_BUFFERS];
+    unsigned    queued;
+};
+
+static MockTransport transport;
+
+static ThroughputSendStatus_t mockSend(const uint8_t *data, uint8_t length)
+{
+    return transport.send(data, length);
+}
+
+static const LinkModel_t LINKS[] = {
+    {"single buffer",          6,  1, 6, true,  0},
+    {"7 buffers",              6,  7, 6, true,  0},
+    {"short connection event", 6,  7, 3, true,  0},
+    {"30 ms interval",         24, 7, 6, true,  0},
+    {"100 ms interval",        80, 7, 6, true,  0},
+    {"not acknowledged",       6,  7, 6, false, 0},
+    {"disconnection",          6,  7, 6, true,  1000},
+};
+static const unsigned NUM_LINKS = sizeof(LINKS) / sizeof(LINKS[0]);
+
+static const uint8_t  PAYLOADS[]       = {THROUGHPUT_MIN_PAYLOAD, THROUGHPUT_MAX_PAYLOAD};
+static const unsigned NUM_PAYLOADS     = sizeof(PAYLOADS) / sizeof(PAYLOADS[0]);
+
+static const uint16_t DURATION_SECONDS = 2;
+static const uint32_t POLL_PERIOD_USEC = 100000;
+static const uint32_t TIME_LIMIT_USEC  = (DURATION_SECONDS + 5) * 1000000;
+
+static unsigned failures = 0;
+
+static void check(bool condition, const char *description)
+{
+    if (!condition) {
+        printf("  FAILED: %s\r\n", description);
+        failures++;
+    }
+}
+
+/**
+ * Run a test over a link, on a simulated clock, then check the statistics of
+ * both ends against what the link allows.
+ */
+static void runScenario(const LinkModel_t &link, uint8_t payloadSize)
+{
+    ThroughputConfig_t config = {THROUGHPUT_MODE_NOTIFICATIONS, payloadSize, DURATION_SECONDS, link.connectionInterval};
+    ThroughputSender   sender(mockSend);
+    ThroughputReceiver receiver;
+
+    printf("%s, %u.%02u ms interval, %u buffers, %u packets per event, %u byte payload\r\n",
+           link.name, link.connectionInterval * 5 / 4, (link.connectionInterval * 125) % 100,
+           link.txBuffers, link.packetsPerEvent, payloadSize);
+
+    transport.reset(link);
+    receiver.start(config, 0);
+    sender.start(config, 0);
+
+    uint32_t intervalUsec  = link.connectionInterval * 1250;
+    uint32_t nextEventUsec = intervalUsec;
+    uint32_t nextPollUsec  = POLL_PERIOD_USEC;
+    bool     senderDone    = false;
+    bool     receiverDone  = false;
+
+    for (uint32_t time = 0; (!senderDone || !receiverDone) && time < TIME_LIMIT_USEC; ) {
+        time = (nextEventUsec < nextPollUsec) ? nextEventUsec : nextPollUsec;
+        uint32_t now = time / 1000;
+
+        if (link.disconnectAtMsec && now >= link.disconnectAtMsec && transport.isConnected()) {
+            transport.disconnect();
+        }
+
+        if (time == nextEventUsec) {
+            unsigned count = transport.connectionEvent(receiver, now);
+            if (count > 0) {
+                sender.dataSent(count, now);
+            }
+            nextEventUsec += intervalUsec;
+        }
+        if (time == nextPollUsec) {
+            senderDone   |= sender.poll(now);
+            receiverDone |= receiver.poll(now);
+            nextPollUsec += POLL_PERIOD_USEC;
+        }
+    }
+
+    const ThroughputStats &sent     = sender.getStats();
+    const ThroughputStats &received = receiver.getStats();
+    sent.print("  sender");
+    received.print("  receiver");
+
+    check(senderDone && receiverDone, "test ended");
+    check(received.lost == 0 && received.corrupted == 0 && received.outOfOrder == 0, "packets received in sequence");
+    check(received.packets == sent.packets, "packets acknowledged are received");
+
+    if (!link.acknowledged) {
+        check(sent.packets == 0 && sent.unacknowledged == link.txBuffers, "packets left unacknowledged");
+        return;
+    }
+    if (link.disconnectAtMsec) {
+        check(sent.failed == 1, "disconnection ends the test");
+        check(sent.unacknowledged <= link.txBuffers, "packets lost in the stack counted unacknowledged");
+        return;
+    }
+
+    /* Steady state: the buffers are refilled after each event, which sends
+     * as many packets as the buffers and the event length allow. The last
+     * event only sends what is left at the end of the test */
+    unsigned perEvent = (link.txBuffers < link.packetsPerEvent) ? link.txBuffers : link.packetsPerEvent;
+    uint32_t expected = perEvent * 100;
+    check(sent.unacknowledged == 0, "all packets acknowledged");
+    check(sent.events > 0 && sent.getPacketsPerEvent() + expected / sent.events + 3 >= expected &&
+          sent.getPacketsPerEvent() <= expected + 3, "packets per connection event");
+    check(sent.eventHistogram[perEvent - 1] + 1 >= sent.events, "packets per TX complete event");
+
+    /* A packet waits for the packets queued before it */
+    uint32_t maxLatency = ((link.txBuffers + perEvent - 1) / perEvent) * intervalUsec / 1000 + 1;
+    check(sent.latencyMax <= maxLatency, "latency bounded by the buffers");
+}
+
+int main()
+{
+    for (unsigned i = 0; i < NUM_LINKS; i++) {
+        for (unsigned j = 0; j < NUM_PAYLOADS; j++) {
+            runScenario(LINKS[i], PAYLOADS[j]);
+        }
+    }
+
+    printf("%u failures\r\n", failures);
+    return failures;
+}
@@ -0,0 +1,104 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2006-2015 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __THROUGHPUTRECEIVER_H__
+#define __THROUGHPUTRECEIVER_H__
+
+#include "ThroughputTest.h"
+
+/**
+ * Receiving end of a throughput test. Counts the packets received and
+ * checks their sequence numbers and content.
+ */
+class ThroughputReceiver
+{
+public:
+    /**
+     * Time after the end of the test given to the packets still buffered by
+     * the sender.
+     */
+    static const uint32_t GRACE_MSEC = 1000;
+
+    ThroughputReceiver(void) :
+        running(false),
+        endTime(0),
+        expectedSequence(0)
+    {
+        /* empty */
+    }
+
+    void start(const ThroughputConfig_t &config, uint32_t now)
+    {
+        stats.reset(config, now);
+        running          = true;
+        endTime          = now + config.durationSeconds * 1000 + GRACE_MSEC;
+        expectedSequence = 0;
+    }
+
+    /**
+     * Report a notification or write command received.
+     */
+    void received(const uint8_t *data, uint16_t length, uint32_t now)
+    {
+        if (!running) {
+            return;
+        }
+
+        uint32_t sequence;
+        if (!throughputCheckPacket(data, length, sequence)) {
+            stats.corrupted++;
+        } else if (sequence >= expectedSequence) {
+            stats.lost       += sequence - expectedSequence;
+            expectedSequence  = sequence + 1;
+        } else {
+            stats.outOfOrder++;
+        }
+        stats.recordPackets(1, length, now);
+    }
+
+    /**
+     * @return true when the test has just ended, for its statistics to be
+     *         reported.
+     */
+    bool poll(uint32_t now)
+    {
+        if (!running || (int32_t)(now - endTime) < 0) {
+            return false;
+        }
+
+        running = false;
+        return true;
+    }
+
+    bool isRunning(void) const
+    {
+        return running;
+    }
+
+    const ThroughputStats &getStats(void) const
+    {
+        return stats;
+    }
+
+private:
+    bool            running;
+    uint32_t        endTime;
+    uint32_t        expectedSequence;
+
+    ThroughputStats stats;
+};
+
+#endif  /* __THROUGHPUTRECEIVER_H__ */
@@ -0,0 +1,192 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2006-2015 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __THROUGHPUTSENDER_H__
+#define __THROUGHPUTSENDER_H__
+
+#include "ThroughputTest.h"
+
+/**
+ * Sending end of a throughput test. Keeps the buffers of the stack full of
+ * notifications or write commands for the duration of the test, and
+ * measures how fast the stack gets them acknowledged.
+ *
+ * The packets are handed to the stack by a send function, the BLE API on a
+ * board or a mock transport on a host. The application reports the TX
+ * complete events of the stack with dataSent(), and calls poll()
+ * periodically to end the test.
+ */
+class ThroughputSender
+{
+public:
+    typedef ThroughputSendStatus_t (*Send_t)(const uint8_t *data, uint8_t length);
+
+    /**
+     * Packets handed to the stack and not acknowledged yet. More than the
+     * stack can buffer, so that the stack decides.
+     */
+    static const unsigned MAX_IN_FLIGHT      = 16;
+    /**
+     * Time given to the packets in flight at the end of the test before
+     * they are counted unacknowledged.
+     */
+    static const uint32_t DRAIN_TIMEOUT_MSEC = 1000;
+
+    ThroughputSender(Send_t send) :
+        send(send),
+        running(false),
+        endTime(0),
+        sequence(0),
+        head(0),
+        inFlight(0)
+    {
+        /* empty */
+    }
+
+    /**
+     * Start sending, until config.durationSeconds have elapsed.
+     */
+    void start(const ThroughputConfig_t &config, uint32_t now)
+    {
+        stats.reset(config, now);
+        running  = true;
+        endTime  = now + config.durationSeconds * 1000;
+        sequence = 0;
+        head     = 0;
+        inFlight = 0;
+        pump(now);
+    }
+
+    /**
+     * Stop sending before the end of the test; poll() ends it once the
+     * packets in flight are acknowledged.
+     */
+    void stop(uint32_t now)
+    {
+        if (running && (int32_t)(endTime - now) > 0) {
+            endTime = now;
+        }
+    }
+
+    /**
+     * Report a TX complete event of the stack, then refill its buffers.
+     *
+     * @param[in] count
+     *              The number of packets acknowledged by the peer.
+     */
+    void dataSent(unsigned count, uint32_t now)
+    {
+        if (!running) {
+            return;
+        }
+
+        /* Packets sent by others on the same connection */
+        if (count > inFlight) {
+            count = inFlight;
+        }
+
+        stats.recordEvent(count);
+        for (unsigned i = 0; i < count; i++) {
+            stats.recordLatency(now - sendTimes[head]);
+            head = (head + 1) % MAX_IN_FLIGHT;
+        }
+        inFlight -= count;
+        stats.recordPackets(count, count * stats.config.payloadSize, now);
+
+        pump(now);
+    }
+
+    /**
+     * End the test once its duration has elapsed and the packets in flight
+     * are acknowledged, or the drain timeout has expired.
+     *
+     * @return true when the test has just ended, for its statistics to be
+     *         reported.
+     */
+    bool poll(uint32_t now)
+    {
+        if (!running) {
+            return false;
+        }
+
+        if ((int32_t)(now - endTime) < 0) {
+            pump(now);
+            return false;
+        }
+
+        if (inFlight > 0 && (now - endTime) < DRAIN_TIMEOUT_MSEC) {
+            return false;
+        }
+
+        stats.unacknowledged = inFlight;
+        running              = false;
+        return true;
+    }
+
+    bool isRunning(void) const
+    {
+        return running;
+    }
+
+    const ThroughputStats &getStats(void) const
+    {
+        return stats;
+    }
+
+private:
+    /**
+     * Hand packets to the stack until it is full.
+     */
+    void pump(uint32_t now)
+    {
+        uint8_t packet[THROUGHPUT_MAX_PAYLOAD];
+        uint8_t length = stats.config.payloadSize;
+
+        while ((int32_t)(now - endTime) < 0 && inFlight < MAX_IN_FLIGHT) {
+            throughputFillPacket(packet, length, sequence);
+
+            ThroughputSendStatus_t status = send(packet, length);
+            if (status == THROUGHPUT_SEND_BUSY) {
+                stats.busy++;
+                return;
+            }
+            if (status != THROUGHPUT_SEND_ACCEPTED) {
+                /* The connection is unusable, end the test */
+                stats.failed++;
+                endTime = now;
+                return;
+            }
+
+            sendTimes[(head + inFlight) % MAX_IN_FLIGHT] = now;
+            inFlight++;
+            sequence++;
+        }
+    }
+
+    Send_t          send;
+    bool            running;
+    uint32_t        endTime;
+    uint32_t        sequence;
+
+    /* Time each packet in flight was handed to the stack, oldest at head */
+    uint32_t        sendTimes[MAX_IN_FLIGHT];
+    unsigned        head;
+    unsigned        inFlight;
+
+    ThroughputStats stats;
+};
+
+#endif  /* __THROUGHPUTSENDER_H__ */
@@ -0,0 +1,78 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2006-2015 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __BLE_THROUGHPUT_SERVICE_H__
+#define __BLE_THROUGHPUT_SERVICE_H__
+
+#include "ThroughputTest.h"
+
+/**
+ * The data characteristic carries the packets of the tests, notified by the
+ * peripheral or written without response by the central. The central starts
+ * the tests by writing a ThroughputConfig_t to the control characteristic.
+ */
+class ThroughputService {
+public:
+    ThroughputService(BLE &_ble) :
+        ble(_ble),
+        data(THROUGHPUT_DATA_UUID, dataValue, THROUGHPUT_MAX_PAYLOAD, THROUGHPUT_MAX_PAYLOAD,
+             GattCharacteristic::BLE_GATT_CHAR_PROPERTIES_NOTIFY |
+             GattCharacteristic::BLE_GATT_CHAR_PROPERTIES_WRITE_WITHOUT_RESPONSE),
+        control(THROUGHPUT_CONTROL_UUID, controlValue)
+    {
+        memset(dataValue, 0, sizeof(dataValue));
+        memset(controlValue, 0, sizeof(controlValue));
+
+        GattCharacteristic *charTable[] = {&data, &control};
+        GattService         throughputService(THROUGHPUT_SERVICE_UUID, charTable, sizeof(charTable) / sizeof(GattCharacteristic *));
+        ble.gattServer().addService(throughputService);
+    }
+
+    GattAttribute::Handle_t getDataHandle() const
+    {
+        return data.getValueHandle();
+    }
+
+    GattAttribute::Handle_t getControlHandle() const
+    {
+        return control.getValueHandle();
+    }
+
+    /**
+     * Notify a packet to the central.
+     */
+    ThroughputSendStatus_t notify(const uint8_t *packet, uint8_t length)
+    {
+        switch (ble.gattServer().write(data.getValueHandle(), packet, length)) {
+            case BLE_ERROR_NONE:
+                return THROUGHPUT_SEND_ACCEPTED;
+            case BLE_ERROR_NO_MEM:
+            case BLE_STACK_BUSY:
+                return THROUGHPUT_SEND_BUSY;
+            default:
+                return THROUGHPUT_SEND_FAILED;
+        }
+    }
+
+private:
+    BLE                                                                &ble;
+    uint8_t                                                             dataValue[THROUGHPUT_MAX_PAYLOAD];
+    uint8_t                                                             controlValue[THROUGHPUT_CONFIG_SIZE];
+    GattCharacteristic                                                  data;
+    WriteOnlyArrayGattCharacteristic<uint8_t, THROUGHPUT_CONFIG_SIZE>   control;
+};
+
+#endif /* #ifndef __BLE_THROUGHPUT_SERVICE_H__ */
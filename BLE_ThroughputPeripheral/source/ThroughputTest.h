@@ -0,0 +1,320 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2006-2015 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __THROUGHPUTTEST_H__
+#define __THROUGHPUTTEST_H__
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+/*
+ * Definitions common to both ends of the throughput test. Nothing here
+ * depends on the BLE API, so that the sender and receiver can be run against
+ * a mock transport on a host. BLE_ThroughputCentral links to this file and
+ * to the sender and receiver.
+ */
+
+/* GATT layout of the throughput service of the peripheral */
+static const uint16_t THROUGHPUT_SERVICE_UUID      = 0xA100;
+static const uint16_t THROUGHPUT_DATA_UUID         = 0xA101;   /* notify, write without response */
+static const uint16_t THROUGHPUT_CONTROL_UUID      = 0xA102;   /* write, ThroughputConfig_t */
+
+/* What this version of the BLE API and the SoftDevices it runs on can use:
+ * there is no ATT MTU exchange, no data length extension and no 2M PHY */
+static const uint16_t THROUGHPUT_SUPPORTED_ATT_MTU = 23;
+static const uint16_t THROUGHPUT_SUPPORTED_OCTETS  = 27;
+static const uint8_t  THROUGHPUT_SUPPORTED_PHY     = 1;
+
+/* Packets carry a sequence number, and fit in a notification or write
+ * command with the supported ATT MTU, less its 3 byte header */
+static const uint8_t  THROUGHPUT_MIN_PAYLOAD       = 4;
+static const uint8_t  THROUGHPUT_MAX_PAYLOAD       = THROUGHPUT_SUPPORTED_ATT_MTU - 3;
+
+enum ThroughputMode_t {
+    THROUGHPUT_MODE_STOP           = 0,
+    THROUGHPUT_MODE_NOTIFICATIONS  = 1,     /* peripheral to central */
+    THROUGHPUT_MODE_WRITE_COMMANDS = 2      /* central to peripheral */
+};
+
+/**
+ * A test, written by the central to the control characteristic.
+ */
+struct ThroughputConfig_t {
+    uint8_t  mode;
+    uint8_t  payloadSize;
+    uint16_t durationSeconds;
+    uint16_t connectionInterval;            /* 1.25 ms units, to count the connection events */
+};
+
+static const uint16_t THROUGHPUT_CONFIG_SIZE = 6;
+
+/**
+ * Result of handing a packet to the stack.
+ */
+enum ThroughputSendStatus_t {
+    THROUGHPUT_SEND_ACCEPTED,
+    THROUGHPUT_SEND_BUSY,                   /* stack buffers full, retried once packets are sent */
+    THROUGHPUT_SEND_FAILED
+};
+
+inline const char *throughputModeName(uint8_t mode)
+{
+    switch (mode) {
+        case THROUGHPUT_MODE_NOTIFICATIONS:
+            return "notifications";
+        case THROUGHPUT_MODE_WRITE_COMMANDS:
+            return "write commands";
+        default:
+            return "stop";
+    }
+}
+
+/**
+ * Serialize a test, little endian.
+ */
+inline void throughputEncodeConfig(const ThroughputConfig_t &config, uint8_t data[THROUGHPUT_CONFIG_SIZE])
+{
+    data[0] = config.mode;
+    data[1] = config.payloadSize;
+    data[2] = config.durationSeconds & 0xFF;
+    data[3] = config.durationSeconds >> 8;
+    data[4] = config.connectionInterval & 0xFF;
+    data[5] = config.connectionInterval >> 8;
+}
+
+/**
+ * Parse a test written to the control characteristic.
+ *
+ * @return false if the test is malformed or its payload size is not
+ *         supported.
+ */
+inline bool throughputDecodeConfig(const uint8_t *data, uint16_t length, ThroughputConfig_t &config)
+{
+    if (length != THROUGHPUT_CONFIG_SIZE) {
+        return false;
+    }
+
+    config.mode               = data[0];
+    config.payloadSize        = data[1];
+    config.durationSeconds    = data[2] | (data[3] << 8);
+    config.connectionInterval = data[4] | (data[5] << 8);
+
+    if (config.mode == THROUGHPUT_MODE_STOP) {
+        return true;
+    }
+    return (config.mode == THROUGHPUT_MODE_NOTIFICATIONS || config.mode == THROUGHPUT_MODE_WRITE_COMMANDS) &&
+           config.payloadSize >= THROUGHPUT_MIN_PAYLOAD && config.payloadSize <= THROUGHPUT_MAX_PAYLOAD &&
+           config.durationSeconds > 0 && config.connectionInterval > 0;
+}
+
+/**
+ * Fill a packet: the sequence number, little endian, then bytes derived from
+ * it so that the receiver can detect corruption.
+ */
+inline void throughputFillPacket(uint8_t *data, uint8_t length, uint32_t sequence)
+{
+    for (uint8_t i = 0; i < length; i++) {
+        data[i] = (i < 4) ? (uint8_t)(sequence >> (8 * i)) : (uint8_t)(sequence + i);
+    }
+}
+
+/**
+ * Check a packet filled by throughputFillPacket().
+ *
+ * @param[out] sequence
+ *                 The sequence number of the packet.
+ *
+ * @return false if the packet is too short or corrupted.
+ */
+inline bool throughputCheckPacket(const uint8_t *data, uint16_t length, uint32_t &sequence)
+{
+    if (length < THROUGHPUT_MIN_PAYLOAD) {
+        return false;
+    }
+
+    sequence = data[0] | (data[1] << 8) | (data[2] << 16) | ((uint32_t)data[3] << 24);
+    for (uint16_t i = 4; i < length; i++) {
+        if (data[i] != (uint8_t)(sequence + i)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Measurements of one end of a test.
+ */
+class ThroughputStats
+{
+public:
+    /* Latency buckets: under 1, 2, 4, ... 256 ms, then 256 ms and more */
+    static const unsigned LATENCY_BUCKETS = 10;
+    /* Packets per TX complete event: 1 to 7, then 8 and more */
+    static const unsigned EVENT_BUCKETS   = 8;
+
+    ThroughputStats(void)
+    {
+        ThroughputConfig_t config = {THROUGHPUT_MODE_STOP, 0, 0, 0};
+        reset(config, 0);
+    }
+
+    void reset(const ThroughputConfig_t &testConfig, uint32_t now)
+    {
+        memset(this, 0, sizeof(*this));
+        config    = testConfig;
+        startTime = now;
+        lastTime  = now;
+    }
+
+    /**
+     * Count packets acknowledged by the stack, or received.
+     */
+    void recordPackets(unsigned count, uint32_t bytesCount, uint32_t now)
+    {
+        packets  += count;
+        bytes    += bytesCount;
+        lastTime  = now;
+    }
+
+    /**
+     * Count the packets reported by one TX complete event, which the stack
+     * raises at most once per connection event.
+     */
+    void recordEvent(unsigned count)
+    {
+        if (count == 0) {
+            return;
+        }
+        events++;
+        eventHistogram[(count < EVENT_BUCKETS) ? count - 1 : EVENT_BUCKETS - 1]++;
+    }
+
+    /**
+     * Record the time between a packet being handed to the stack and its
+     * acknowledgement by the peer.
+     */
+    void recordLatency(uint32_t latencyMsec)
+    {
+        unsigned bucket = 0;
+        while (bucket < LATENCY_BUCKETS - 1 && latencyMsec >= (1UL << bucket)) {
+            bucket++;
+        }
+        latencyHistogram[bucket]++;
+        latencySum += latencyMsec;
+        if (latencyMsec > latencyMax) {
+            latencyMax = latencyMsec;
+        }
+    }
+
+    uint32_t getElapsedMsec(void) const
+    {
+        return lastTime - startTime;
+    }
+
+    uint32_t getBytesPerSecond(void) const
+    {
+        uint32_t elapsed = getElapsedMsec();
+        return elapsed ? (uint32_t)((uint64_t)bytes * 1000 / elapsed) : 0;
+    }
+
+    /**
+     * Get the average number of packets per connection event, in hundredths.
+     */
+    uint32_t getPacketsPerEvent(void) const
+    {
+        uint32_t elapsed = getElapsedMsec();
+        /* elapsed / (connectionInterval * 1.25 ms) connection events */
+        return elapsed ? (uint32_t)((uint64_t)packets * config.connectionInterval * 125 / elapsed) : 0;
+    }
+
+    /**
+     * Get the upper bound of the latency bucket holding a percentile, in ms.
+     */
+    uint32_t getLatencyPercentile(unsigned percent) const
+    {
+        uint32_t total = 0;
+        for (unsigned i = 0; i < LATENCY_BUCKETS; i++) {
+            total += latencyHistogram[i];
+        }
+
+        uint32_t count = 0;
+        for (unsigned i = 0; i < LATENCY_BUCKETS - 1; i++) {
+            count += latencyHistogram[i];
+            if (total && (uint64_t)count * 100 >= (uint64_t)total * percent) {
+                return 1UL << i;
+            }
+        }
+        return latencyMax;
+    }
+
+    void print(const char *role) const
+    {
+        printf("%s: %lu ms, %lu packets, %lu bytes, %lu bytes/s, %lu.%02lu packets per connection event\r\n",
+               role, (unsigned long)getElapsedMsec(), (unsigned long)packets, (unsigned long)bytes,
+               (unsigned long)getBytesPerSecond(),
+               (unsigned long)getPacketsPerEvent() / 100, (unsigned long)getPacketsPerEvent() % 100);
+
+        if (lost || corrupted || outOfOrder) {
+            printf("  %lu lost, %lu corrupted, %lu out of order\r\n",
+                   (unsigned long)lost, (unsigned long)corrupted, (unsigned long)outOfOrder);
+        }
+        if (busy || failed || unacknowledged) {
+            printf("  stack full %lu times, %lu failed, %lu unacknowledged\r\n",
+                   (unsigned long)busy, (unsigned long)failed, (unsigned long)unacknowledged);
+        }
+
+        if (events) {
+            printf("  packets per TX complete event:");
+            for (unsigned i = 0; i < EVENT_BUCKETS; i++) {
+                printf(" %u%s:%lu", i + 1, (i == EVENT_BUCKETS - 1) ? "+" : "", (unsigned long)eventHistogram[i]);
+            }
+            printf("\r\n");
+
+            printf("  latency ms:");
+            for (unsigned i = 0; i < LATENCY_BUCKETS; i++) {
+                printf(" %s%lu:%lu", (i == LATENCY_BUCKETS - 1) ? ">=" : "<",
+                       (unsigned long)(1UL << ((i == LATENCY_BUCKETS - 1) ? i - 1 : i)), (unsigned long)latencyHistogram[i]);
+            }
+            printf("\r\n  latency p50 <%lu ms, p99 <%lu ms, max %lu ms, average %lu ms\r\n",
+                   (unsigned long)getLatencyPercentile(50), (unsigned long)getLatencyPercentile(99),
+                   (unsigned long)latencyMax, (unsigned long)(packets ? latencySum / packets : 0));
+        }
+    }
+
+    ThroughputConfig_t config;
+    uint32_t           startTime;
+    uint32_t           lastTime;        /* last packet acknowledged or received */
+    uint32_t           packets;
+    uint32_t           bytes;
+
+    /* Sender */
+    uint32_t           busy;
+    uint32_t           failed;
+    uint32_t           unacknowledged;
+    uint32_t           events;
+    uint32_t           eventHistogram[EVENT_BUCKETS];
+    uint32_t           latencyHistogram[LATENCY_BUCKETS];
+    uint32_t           latencySum;
+    uint32_t           latencyMax;
+
+    /* Receiver */
+    uint32_t           lost;
+    uint32_t           corrupted;
+    uint32_t           outOfOrder;
+};
+
+#endif  /* __THROUGHPUTTEST_H__ */
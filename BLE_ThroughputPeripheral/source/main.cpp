@@ -0,0 +1,208 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2006-2015 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <events/mbed_events.h>
+#include <mbed.h>
+#include "ble/BLE.h"
+#include "ThroughputService.h"
+#include "ThroughputSender.h"
+#include "ThroughputReceiver.h"
+
+DigitalOut alivenessLED(LED1, 0);
+
+const static char     DEVICE_NAME[] = "THROUGHPUT";
+static const uint16_t uuid16_list[] = {THROUGHPUT_SERVICE_UUID};
+
+static const int TEST_POLL_PERIOD_MSEC = 100;
+
+static EventQueue eventQueue(/* event count */ 10 * EVENTS_EVENT_SIZE);
+
+static ThroughputSendStatus_t notifyPacket(const uint8_t *packet, uint8_t length);
+
+static Timer              uptime;
+static ThroughputService *throughputServicePtr;
+static ThroughputSender   sender(notifyPacket);
+static ThroughputReceiver receiver;
+static bool               notificationsEnabled = false;
+
+static ThroughputSendStatus_t notifyPacket(const uint8_t *packet, uint8_t length)
+{
+    return throughputServicePtr->notify(packet, length);
+}
+
+void disconnectionCallback(const Gap::DisconnectionCallbackParams_t *params)
+{
+    (void) params;
+    notificationsEnabled = false;
+    /* Tests in progress end and are reported by pollTest() */
+    sender.stop(uptime.read_ms());
+    BLE::Instance().gap().startAdvertising();
+}
+
+void blinkCallback(void)
+{
+    alivenessLED = !alivenessLED; /* Do blinky on LED1 to indicate system aliveness. */
+}
+
+void updatesEnabledCallback(GattAttribute::Handle_t handle)
+{
+    (void) handle;
+    notificationsEnabled = true;
+}
+
+void updatesDisabledCallback(GattAttribute::Handle_t handle)
+{
+    (void) handle;
+    notificationsEnabled = false;
+}
+
+/**
+ * Start the test written by the central to the control characteristic.
+ */
+void startTest(const uint8_t *data, uint16_t length)
+{
+    uint32_t           now = uptime.read_ms();
+    ThroughputConfig_t config;
+
+    if (!throughputDecodeConfig(data, length, config)) {
+        printf("invalid test\r\n");
+        return;
+    }
+
+    if (config.mode == THROUGHPUT_MODE_STOP) {
+        sender.stop(now);
+        return;
+    }
+    if (sender.isRunning() || receiver.isRunning()) {
+        printf("test already running\r\n");
+        return;
+    }
+
+    printf("%s, %u byte payload, %u.%02u ms interval, %u s\r\n",
+           throughputModeName(config.mode), config.payloadSize,
+           config.connectionInterval * 5 / 4, (config.connectionInterval * 125) % 100, config.durationSeconds);
+
+    if (config.mode == THROUGHPUT_MODE_NOTIFICATIONS) {
+        if (!notificationsEnabled) {
+            printf("notifications not enabled by the central\r\n");
+            return;
+        }
+        sender.start(config, now);
+    } else {
+        receiver.start(config, now);
+    }
+}
+
+/**
+ * Write commands of the central carry test packets, write requests to the
+ * control characteristic start the tests.
+ */
+void onDataWrittenCallback(const GattWriteCallbackParams *params)
+{
+    if (params->handle == throughputServicePtr->getDataHandle()) {
+        receiver.received(params->data, params->len, uptime.read_ms());
+    } else if (params->handle == throughputServicePtr->getControlHandle()) {
+        startTest(params->data, params->len);
+    }
+}
+
+/**
+ * The stack raises a TX complete event for the notifications acknowledged
+ * in each connection event.
+ */
+void dataSentCallback(unsigned count)
+{
+    sender.dataSent(count, uptime.read_ms());
+}
+
+/**
+ * End the tests whose duration has elapsed and report them.
+ */
+void pollTest(void)
+{
+    uint32_t now = uptime.read_ms();
+
+    if (sender.poll(now)) {
+        sender.getStats().print("sender");
+    }
+    if (receiver.poll(now)) {
+        receiver.getStats().print("receiver");
+    }
+}
+
+/**
+ * This function is called when the ble initialization process has failled
+ */
+void onBleInitError(BLE &ble, ble_error_t error)
+{
+    /* Initialization error handling should go here */
+}
+
+/**
+ * Callback triggered when the ble initialization process has finished
+ */
+void bleInitComplete(BLE::InitializationCompleteCallbackContext *params)
+{
+    BLE&        ble   = params->ble;
+    ble_error_t error = params->error;
+
+    if (error != BLE_ERROR_NONE) {
+        /* In case of error, forward the error handling to onBleInitError */
+        onBleInitError(ble, error);
+        return;
+    }
+
+    /* Ensure that it is the default instance of BLE */
+    if(ble.getInstanceID() != BLE::DEFAULT_INSTANCE) {
+        return;
+    }
+
+    ble.gap().onDisconnection(disconnectionCallback);
+    ble.gattServer().onDataWritten(onDataWrittenCallback);
+    ble.gattServer().onDataSent(dataSentCallback);
+    ble.gattServer().onUpdatesEnabled(updatesEnabledCallback);
+    ble.gattServer().onUpdatesDisabled(updatesDisabledCallback);
+
+    throughputServicePtr = new ThroughputService(ble);
+
+    /* setup advertising */
+    ble.gap().accumulateAdvertisingPayload(GapAdvertisingData::BREDR_NOT_SUPPORTED | GapAdvertisingData::LE_GENERAL_DISCOVERABLE);
+    ble.gap().accumulateAdvertisingPayload(GapAdvertisingData::COMPLETE_LIST_16BIT_SERVICE_IDS, (uint8_t *)uuid16_list, sizeof(uuid16_list));
+    ble.gap().accumulateAdvertisingPayload(GapAdvertisingData::COMPLETE_LOCAL_NAME, (uint8_t *)DEVICE_NAME, sizeof(DEVICE_NAME));
+    ble.gap().setAdvertisingType(GapAdvertisingParams::ADV_CONNECTABLE_UNDIRECTED);
+    ble.gap().setAdvertisingInterval(100); /* 100ms. */
+    ble.gap().startAdvertising();
+}
+
+void scheduleBleEventsProcessing(BLE::OnEventsToProcessCallbackContext* context) {
+    BLE &ble = BLE::Instance();
+    eventQueue.call(Callback<void()>(&ble, &BLE::processEvents));
+}
+
+int main()
+{
+    uptime.start();
+    eventQueue.call_every(500, blinkCallback);
+    eventQueue.call_every(TEST_POLL_PERIOD_MSEC, pollTest);
+
+    BLE &ble = BLE::Instance();
+    ble.onEventsToProcess(scheduleBleEventsProcessing);
+    ble.init(bleInitComplete);
+
+    eventQueue.dispatch_forever();
+
+    return 0;
+}